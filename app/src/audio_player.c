@@ -1,5 +1,7 @@
 #include "audio_player.h"
 
+#include <inttypes.h>
+
 #include "util/log.h"
 
 /** Downcast frame_sink to sc_audio_player */
@@ -7,6 +9,99 @@
 
 #define SC_SDL_SAMPLE_FMT AUDIO_F32
 
+// Audio output buffer requested in "auto" mode (the audio driver may choose a
+// bigger value)
+#define SC_AUDIO_OUTPUT_BUFFER_MIN SC_TICK_FROM_MS(2)
+
+// Never add more than this measured latency to the target buffering
+#define SC_AUDIO_OUTPUT_LATENCY_MAX SC_TICK_FROM_MS(100)
+
+#define SC_AUDIO_OUTPUT_STATS_INTERVAL SC_TICK_FROM_SEC(1)
+
+static void
+sc_audio_output_stats_init(struct sc_audio_output_stats *stats,
+                           sc_tick expected_period) {
+    stats->last = 0;
+    stats->expected_period = expected_period;
+    stats->next_report = 0;
+    stats->period_sum = 0;
+    stats->max_lateness = 0;
+    stats->count = 0;
+    stats->underflow_count = 0;
+    stats->latency = 0;
+    stats->recommended = false;
+}
+
+static void
+sc_audio_player_report_output_stats(struct sc_audio_player *ap) {
+    struct sc_audio_output_stats *stats = &ap->output_stats;
+    struct sc_audio_regulator *ar = &ap->audioreg;
+
+    uint32_t underflow_count = sc_audio_regulator_get_underflow_count(ar);
+    uint32_t underflows = underflow_count - stats->underflow_count;
+    stats->underflow_count = underflow_count;
+
+    sc_tick avg_period = stats->period_sum / (sc_tick) stats->count;
+    LOGV("[Audio] Output callback: period=%" PRItick "us (expected %" PRItick
+         "us) max_lateness=%" PRItick "us underflows=%" PRIu32, avg_period,
+         stats->expected_period, stats->max_lateness, underflows);
+
+    if (ap->auto_output_buffer) {
+        // A late callback is followed by callbacks in quick succession, which
+        // consume the buffered samples faster: the target buffering must
+        // absorb the worst lateness. Decrease slowly if the lateness drops.
+        sc_tick max_lateness = MIN(stats->max_lateness,
+                                   SC_AUDIO_OUTPUT_LATENCY_MAX);
+        uint32_t latency =
+            max_lateness * ar->sample_rate / SC_TICK_FREQ;
+        uint32_t decayed = stats->latency * 3 / 4;
+        latency = MAX(latency, decayed);
+        if (latency != stats->latency) {
+            stats->latency = latency;
+            sc_audio_regulator_set_output_latency(ar, latency);
+        }
+    } else if (underflows && stats->max_lateness > stats->expected_period
+            && !stats->recommended) {
+        sc_tick recommended = stats->expected_period + stats->max_lateness;
+        LOGW("Audio output callback late by up to %" PRItick "ms, consider "
+             "--audio-output-buffer=%" PRItick " or --audio-output-buffer=auto",
+             SC_TICK_TO_MS(stats->max_lateness),
+             SC_TICK_TO_MS(recommended) + 1);
+        stats->recommended = true;
+    }
+
+    stats->period_sum = 0;
+    stats->max_lateness = 0;
+    stats->count = 0;
+}
+
+static void
+sc_audio_player_update_output_stats(struct sc_audio_player *ap) {
+    struct sc_audio_output_stats *stats = &ap->output_stats;
+
+    sc_tick now = sc_tick_now();
+    if (!stats->last) {
+        stats->last = now;
+        stats->next_report = now + SC_AUDIO_OUTPUT_STATS_INTERVAL;
+        return;
+    }
+
+    sc_tick period = now - stats->last;
+    stats->last = now;
+
+    sc_tick lateness = period - stats->expected_period;
+    if (lateness > stats->max_lateness) {
+        stats->max_lateness = lateness;
+    }
+    stats->period_sum += period;
+    ++stats->count;
+
+    if (now >= stats->next_report) {
+        sc_audio_player_report_output_stats(ap);
+        stats->next_report = now + SC_AUDIO_OUTPUT_STATS_INTERVAL;
+    }
+}
+
 static void SDLCALL
 sc_audio_player_sdl_callback(void *userdata, uint8_t *stream, int len_int) {
     struct sc_audio_player *ap = userdata;
@@ -17,6 +112,8 @@ sc_audio_player_sdl_callback(void *userdata, uint8_t *stream, int len_int) {
     assert(len % ap->audioreg.sample_size == 0);
     uint32_t out_samples = len / ap->audioreg.sample_size;
 
+    sc_audio_player_update_output_stats(ap);
+
     sc_audio_regulator_pull(&ap->audioreg, stream, out_samples);
 }
 
@@ -25,7 +122,32 @@ sc_audio_player_frame_sink_push(struct sc_frame_sink *sink,
                                 const AVFrame *frame) {
     struct sc_audio_player *ap = DOWNCAST(sink);
 
-    return sc_audio_regulator_push(&ap->audioreg, frame);
+    bool ok = sc_audio_regulator_push(&ap->audioreg, frame);
+    if (!ok) {
+        return false;
+    }
+
+    if (ap->av_sync && frame->pts != AV_NOPTS_VALUE) {
+        struct sc_audio_regulator *ar = &ap->audioreg;
+        bool played = atomic_load_explicit(&ar->played, memory_order_relaxed);
+        if (played) {
+            // The first sample of this frame will be played once all the
+            // samples buffered before it and the SDL output buffer are
+            // consumed
+            int64_t buffered = sc_audiobuf_can_read(&ar->buf);
+            int64_t ahead = buffered - frame->nb_samples + ap->output_samples;
+            if (ahead < 0) {
+                ahead = 0;
+            }
+            sc_tick play_time = sc_tick_now()
+                              + ahead * SC_TICK_FREQ / ar->sample_rate;
+            // PTS (written by the server) are expressed in microseconds
+            sc_tick pts = SC_TICK_FROM_US(frame->pts);
+            sc_av_sync_update_audio(ap->av_sync, play_time, pts);
+        }
+    }
+
+    return true;
 }
 
 static bool
@@ -57,8 +179,11 @@ sc_audio_player_frame_sink_open(struct sc_frame_sink *sink,
         return false;
     }
 
-    uint64_t aout_samples = ap->output_buffer_duration * ctx->sample_rate
-                                                       / SC_TICK_FREQ;
+    sc_tick output_buffer_duration = ap->auto_output_buffer
+                                   ? SC_AUDIO_OUTPUT_BUFFER_MIN
+                                   : ap->output_buffer_duration;
+    uint64_t aout_samples = output_buffer_duration * ctx->sample_rate
+                                                   / SC_TICK_FREQ;
     assert(aout_samples <= 0xFFFF);
 
     SDL_AudioSpec desired = {
@@ -71,13 +196,27 @@ sc_audio_player_frame_sink_open(struct sc_frame_sink *sink,
     };
     SDL_AudioSpec obtained;
 
-    ap->device = SDL_OpenAudioDevice(NULL, 0, &desired, &obtained, 0);
+    // In auto mode, let the audio driver increase the buffer size if the
+    // requested value is too small
+    int allowed_changes = ap->auto_output_buffer ? SDL_AUDIO_ALLOW_SAMPLES_CHANGE
+                                                 : 0;
+    ap->device = SDL_OpenAudioDevice(NULL, 0, &desired, &obtained,
+                                     allowed_changes);
     if (!ap->device) {
         LOGE("Could not open audio device: %s", SDL_GetError());
         sc_audio_regulator_destroy(&ap->audioreg);
         return false;
     }
 
+    ap->output_samples = obtained.samples;
+    sc_tick expected_period = (sc_tick) obtained.samples * SC_TICK_FREQ
+                                                          / ctx->sample_rate;
+    sc_audio_output_stats_init(&ap->output_stats, expected_period);
+    if (ap->auto_output_buffer) {
+        LOGI("Audio output buffer: %" PRItick "ms (%" PRIu16 " samples)",
+             SC_TICK_TO_MS(expected_period), obtained.samples);
+    }
+
     // The thread calling open() is the thread calling push(), which fills the
     // audio buffer consumed by the SDL audio thread.
     ok = sc_thread_set_priority(SC_THREAD_PRIORITY_TIME_CRITICAL);
@@ -104,9 +243,13 @@ sc_audio_player_frame_sink_close(struct sc_frame_sink *sink) {
 
 void
 sc_audio_player_init(struct sc_audio_player *ap, sc_tick target_buffering,
-                     sc_tick output_buffer_duration) {
+                     sc_tick output_buffer_duration,
+                     struct sc_av_sync *av_sync) {
     ap->target_buffering_delay = target_buffering;
+    ap->auto_output_buffer =
+        output_buffer_duration == SC_AUDIO_OUTPUT_BUFFER_AUTO;
     ap->output_buffer_duration = output_buffer_duration;
+    ap->av_sync = av_sync;
 
     static const struct sc_frame_sink_ops ops = {
         .open = sc_audio_player_frame_sink_open,
@@ -6,9 +6,31 @@
 #include <SDL2/SDL_audio.h>
 
 #include "audio_regulator.h"
+#include "av_sync.h"
+#include "options.h"
 #include "trait/frame_sink.h"
 #include "util/tick.h"
 
+// Timings of the SDL audio callback, measured on the SDL audio thread
+struct sc_audio_output_stats {
+    // Date of the previous callback (0 before the first callback)
+    sc_tick last;
+    // Expected period between callbacks (obtained output buffer duration)
+    sc_tick expected_period;
+
+    sc_tick next_report;
+    sc_tick period_sum;
+    sc_tick max_lateness;
+    unsigned count;
+    // Regulator underflow count at the start of the current window
+    uint32_t underflow_count;
+
+    // Latency folded into the regulator target buffering (in samples)
+    uint32_t latency;
+    // Set once a recommendation has been logged
+    bool recommended;
+};
+
 struct sc_audio_player {
     struct sc_frame_sink frame_sink;
 
@@ -22,12 +44,31 @@ struct sc_audio_player {
     // SDL audio output buffer size
     sc_tick output_buffer_duration;
 
+    // If set, request a very small audio output buffer, and add the measured
+    // output latency to the target buffering
+    bool auto_output_buffer;
+
+    // If set, report the audio playback time to synchronize video (optional)
+    struct sc_av_sync *av_sync;
+
     SDL_AudioDeviceID device;
+    // SDL audio output buffer size actually obtained (in samples)
+    uint16_t output_samples;
+    struct sc_audio_output_stats output_stats;
+
     struct sc_audio_regulator audioreg;
 };
 
+/**
+ * Initialize an audio player
+ *
+ * If audio_output_buffer is SC_AUDIO_OUTPUT_BUFFER_AUTO, the smallest possible
+ * audio output buffer is requested, and the audio output latency measured
+ * during playback is added to the target buffering.
+ */
 void
 sc_audio_player_init(struct sc_audio_player *ap, sc_tick target_buffering,
-                     sc_tick audio_output_buffer);
+                     sc_tick audio_output_buffer,
+                     struct sc_av_sync *av_sync);
 
 #endif
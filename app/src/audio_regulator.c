@@ -59,6 +59,111 @@
 #define TO_BYTES(SAMPLES) sc_audiobuf_to_bytes(&ar->buf, (SAMPLES))
 #define TO_SAMPLES(BYTES) sc_audiobuf_to_samples(&ar->buf, (BYTES))
 
+/**
+ * Concealment of buffer underflows
+ *
+ * Inserting silence on underflow causes a hard audible gap. Instead, the last
+ * samples played are repeated (alternately forward and backward, to avoid
+ * discontinuities) with a decreasing gain, so that the signal fades out
+ * smoothly. When real samples are available again, they are crossfaded with
+ * the concealment signal.
+ */
+
+// History of real samples used for concealment
+#define SC_PLC_HISTORY_MS 10
+// Duration of the concealment fade-out (silence afterwards)
+#define SC_PLC_FADE_MS 20
+// Duration of the crossfade on resumption
+#define SC_PLC_CROSSFADE_MS 5
+
+static void
+sc_audio_regulator_plc_append(struct sc_audio_regulator *ar,
+                              const uint8_t *samples, uint32_t count) {
+    uint32_t cap = ar->plc_history_capacity;
+    if (count >= cap) {
+        memcpy(ar->plc_history, samples + TO_BYTES(count - cap),
+               TO_BYTES(cap));
+        ar->plc_history_len = cap;
+        return;
+    }
+
+    uint32_t keep = MIN(ar->plc_history_len, cap - count);
+    uint8_t *history = (uint8_t *) ar->plc_history;
+    memmove(history, history + TO_BYTES(ar->plc_history_len - keep),
+            TO_BYTES(keep));
+    memcpy(history + TO_BYTES(keep), samples, TO_BYTES(count));
+    ar->plc_history_len = keep + count;
+}
+
+// Mix the next concealment sample into `sample`, which is kept with the weight
+// `real_weight` (0 to replace it entirely)
+static void
+sc_audio_regulator_plc_mix(struct sc_audio_regulator *ar, float *sample,
+                           float real_weight) {
+    unsigned channels = ar->sample_size / sizeof(float);
+    uint32_t fade = ar->sample_rate * SC_PLC_FADE_MS / 1000;
+    uint32_t len = ar->plc_history_len;
+
+    float gain = 0;
+    if (len && ar->plc_concealed < fade) {
+        gain = 1 - (float) ar->plc_concealed / fade;
+        ++ar->plc_concealed;
+    }
+
+    if (gain == 0) {
+        for (unsigned c = 0; c < channels; ++c) {
+            sample[c] = real_weight ? sample[c] * real_weight : 0;
+        }
+        return;
+    }
+
+    // Ping-pong in the history: forward, then backward
+    uint32_t pos = ar->plc_pos % (2 * len);
+    uint32_t index = pos < len ? pos : 2 * len - 1 - pos;
+    ar->plc_pos = pos + 1;
+
+    const float *src = ar->plc_history + index * channels;
+    gain *= 1 - real_weight;
+    for (unsigned c = 0; c < channels; ++c) {
+        float real = real_weight ? sample[c] * real_weight : 0;
+        sample[c] = real + src[c] * gain;
+    }
+}
+
+static void
+sc_audio_regulator_conceal(struct sc_audio_regulator *ar, uint8_t *out,
+                           uint32_t samples) {
+    if (!ar->plc_concealed) {
+        // Start the concealment from the last sample played, backward
+        ar->plc_pos = ar->plc_history_len;
+    }
+
+    for (uint32_t i = 0; i < samples; ++i) {
+        float *sample = (float *) (out + TO_BYTES(i));
+        sc_audio_regulator_plc_mix(ar, sample, 0);
+    }
+
+    if (!ar->plc_concealed) {
+        // Nothing to conceal (no history), but the next samples must still be
+        // faded in
+        ar->plc_concealed = 1;
+    }
+}
+
+static void
+sc_audio_regulator_crossfade(struct sc_audio_regulator *ar, uint8_t *out,
+                             uint32_t samples) {
+    uint32_t xfade = ar->sample_rate * SC_PLC_CROSSFADE_MS / 1000;
+    xfade = MIN(xfade, samples);
+    for (uint32_t i = 0; i < xfade; ++i) {
+        float *sample = (float *) (out + TO_BYTES(i));
+        float real_weight = (float) (i + 1) / (xfade + 1);
+        sc_audio_regulator_plc_mix(ar, sample, real_weight);
+    }
+
+    ar->plc_concealed = 0;
+}
+
 void
 sc_audio_regulator_pull(struct sc_audio_regulator *ar, uint8_t *out,
                         uint32_t out_samples) {
@@ -91,16 +196,26 @@ sc_audio_regulator_pull(struct sc_audio_regulator *ar, uint8_t *out,
 
     sc_mutex_unlock(&ar->mutex);
 
+    if (read) {
+        if (ar->plc_concealed) {
+            // Resume smoothly after an underflow
+            sc_audio_regulator_crossfade(ar, out, read);
+        }
+        sc_audio_regulator_plc_append(ar, out, read);
+    }
+
     if (read < out_samples) {
         uint32_t silence = out_samples - read;
-        // Insert silence. In theory, the inserted silent samples replace the
-        // missing real samples, which will arrive later, so they should be
-        // dropped to keep the latency minimal. However, this would cause very
-        // audible glitches, so let the clock compensation restore the target
-        // latency.
+        // Insert concealment samples (fading out to silence). In theory, the
+        // inserted samples replace the missing real samples, which will
+        // arrive later, so they should be dropped to keep the latency minimal.
+        // However, this would cause very audible glitches, so let the clock
+        // compensation restore the target latency.
         LOGD("[Audio] Buffer underflow, inserting silence: %" PRIu32 " samples",
              silence);
-        memset(out + TO_BYTES(read), 0, TO_BYTES(silence));
+        sc_audio_regulator_conceal(ar, out + TO_BYTES(read), silence);
+        atomic_fetch_add_explicit(&ar->underflow_count, 1,
+                                  memory_order_relaxed);
 
         bool received = atomic_load_explicit(&ar->received,
                                              memory_order_relaxed);
@@ -133,6 +248,17 @@ sc_audio_regulator_get_swr_buf(struct sc_audio_regulator *ar,
     return ar->swr_buf;
 }
 
+void
+sc_audio_regulator_set_output_latency(struct sc_audio_regulator *ar,
+                                      uint32_t samples) {
+    atomic_store_explicit(&ar->output_latency, samples, memory_order_relaxed);
+}
+
+uint32_t
+sc_audio_regulator_get_underflow_count(struct sc_audio_regulator *ar) {
+    return atomic_load_explicit(&ar->underflow_count, memory_order_relaxed);
+}
+
 bool
 sc_audio_regulator_push(struct sc_audio_regulator *ar, const AVFrame *frame) {
     SwrContext *swr_ctx = ar->swr_ctx;
@@ -203,6 +329,10 @@ sc_audio_regulator_push(struct sc_audio_regulator *ar, const AVFrame *frame) {
         }
     }
 
+    // The measured output latency (if any) increases the target buffering
+    uint32_t target_buffering = ar->target_buffering
+            + atomic_load_explicit(&ar->output_latency, memory_order_relaxed);
+
     uint32_t underflow = 0;
     uint32_t max_buffered_samples;
     bool played = atomic_load_explicit(&ar->played, memory_order_relaxed);
@@ -210,13 +340,13 @@ sc_audio_regulator_push(struct sc_audio_regulator *ar, const AVFrame *frame) {
         underflow = atomic_exchange_explicit(&ar->underflow, 0,
                                              memory_order_relaxed);
 
-        max_buffered_samples = ar->target_buffering * 11 / 10
+        max_buffered_samples = target_buffering * 11 / 10
                              + 60 * ar->sample_rate / 1000 /* 60 ms */;
     } else {
         // Playback not started yet, do not accumulate more than
         // max_initial_buffering samples, this would cause unnecessary delay
         // (and glitches to compensate) on start.
-        max_buffered_samples = ar->target_buffering
+        max_buffered_samples = target_buffering
                              + 10 * ar->sample_rate / 1000 /* 10 ms */;
     }
 
@@ -288,7 +418,7 @@ sc_audio_regulator_push(struct sc_audio_regulator *ar, const AVFrame *frame) {
         ar->samples_since_resync = 0;
 
         float avg = sc_average_get(&ar->avg_buffering);
-        int diff = ar->target_buffering - avg;
+        int diff = target_buffering - avg;
 
         // Enable compensation when the difference exceeds +/- 4ms.
         // Disable compensation when the difference is lower than +/- 1ms.
@@ -299,7 +429,7 @@ sc_audio_regulator_push(struct sc_audio_regulator *ar, const AVFrame *frame) {
         if (abs(diff) < threshold) {
             // Do not compensate for small values, the error is just noise
             diff = 0;
-        } else if (diff < 0 && can_read < ar->target_buffering) {
+        } else if (diff < 0 && can_read < target_buffering) {
             // Do not accelerate if the instant buffering level is below the
             // target, this would increase underflow
             diff = 0;
@@ -311,7 +441,7 @@ sc_audio_regulator_push(struct sc_audio_regulator *ar, const AVFrame *frame) {
         int abs_max_diff = distance / 50;
         diff = CLAMP(diff, -abs_max_diff, abs_max_diff);
         LOGV("[Audio] Buffering: target=%" PRIu32 " avg=%f cur=%" PRIu32
-             " compensation=%d", ar->target_buffering, avg, can_read, diff);
+             " compensation=%d", target_buffering, avg, can_read, diff);
 
         int ret = swr_set_compensation(swr_ctx, diff, distance);
         if (ret < 0) {
@@ -377,11 +507,22 @@ sc_audio_regulator_init(struct sc_audio_regulator *ar, size_t sample_size,
         goto error_destroy_mutex;
     }
 
+    uint32_t plc_history_samples = ar->sample_rate * SC_PLC_HISTORY_MS / 1000;
+    ar->plc_history = malloc(TO_BYTES(plc_history_samples));
+    if (!ar->plc_history) {
+        LOG_OOM();
+        goto error_destroy_audiobuf;
+    }
+    ar->plc_history_capacity = plc_history_samples;
+    ar->plc_history_len = 0;
+    ar->plc_pos = 0;
+    ar->plc_concealed = 0;
+
     size_t initial_swr_buf_size = TO_BYTES(4096);
     ar->swr_buf = malloc(initial_swr_buf_size);
     if (!ar->swr_buf) {
         LOG_OOM();
-        goto error_destroy_audiobuf;
+        goto error_free_plc_history;
     }
     ar->swr_buf_alloc_size = initial_swr_buf_size;
 
@@ -394,10 +535,14 @@ sc_audio_regulator_init(struct sc_audio_regulator *ar, size_t sample_size,
     atomic_init(&ar->played, false);
     atomic_init(&ar->received, false);
     atomic_init(&ar->underflow, 0);
+    atomic_init(&ar->underflow_count, 0);
+    atomic_init(&ar->output_latency, 0);
     ar->compensation_active = false;
 
     return true;
 
+error_free_plc_history:
+    free(ar->plc_history);
 error_destroy_audiobuf:
     sc_audiobuf_destroy(&ar->buf);
 error_destroy_mutex:
@@ -411,6 +556,7 @@ error_free_swr_ctx:
 void
 sc_audio_regulator_destroy(struct sc_audio_regulator *ar) {
     free(ar->swr_buf);
+    free(ar->plc_history);
     sc_audiobuf_destroy(&ar->buf);
     sc_mutex_destroy(&ar->mutex);
     swr_free(&ar->swr_ctx);
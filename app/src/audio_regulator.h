@@ -46,6 +46,13 @@ struct sc_audio_regulator {
     // Number of silence samples inserted since the last received packet
     atomic_uint_least32_t underflow;
 
+    // Number of buffer underflow events since the start (for stats)
+    atomic_uint_least32_t underflow_count;
+
+    // Additional target buffering to absorb the audio output jitter (in
+    // samples), measured by the player
+    atomic_uint_least32_t output_latency;
+
     // Non-zero compensation applied (only used by the receiver thread)
     bool compensation_active;
 
@@ -54,6 +61,16 @@ struct sc_audio_regulator {
 
     // Set to true the first time samples are pulled by the player
     atomic_bool played;
+
+    // Concealment of buffer underflows (only used by the player thread)
+    // Last real samples played
+    float *plc_history;
+    uint32_t plc_history_capacity; // in samples
+    uint32_t plc_history_len; // in samples
+    // Position in the history (ping-pong) of the next concealment sample
+    uint32_t plc_pos;
+    // Number of samples concealed since the last real sample
+    uint32_t plc_concealed;
 };
 
 bool
@@ -70,4 +87,20 @@ void
 sc_audio_regulator_pull(struct sc_audio_regulator *ar, uint8_t *out,
                         uint32_t samples);
 
+/**
+ * Set the measured audio output latency (in samples)
+ *
+ * It is added to the target buffering, to absorb the irregularities of the
+ * audio output callback.
+ */
+void
+sc_audio_regulator_set_output_latency(struct sc_audio_regulator *ar,
+                                      uint32_t samples);
+
+/**
+ * Get the number of buffer underflow events since the start
+ */
+uint32_t
+sc_audio_regulator_get_underflow_count(struct sc_audio_regulator *ar);
+
 #endif
@@ -0,0 +1,91 @@
+#include "av_sync.h"
+
+#include <inttypes.h>
+
+#include "util/log.h"
+
+#define SC_AV_SYNC_REPORT_INTERVAL SC_TICK_FROM_SEC(1)
+
+static void
+sc_av_sync_reset_stats(struct sc_av_sync *sync) {
+    sync->offset_sum = 0;
+    sync->offset_min = 0;
+    sync->offset_max = 0;
+    sync->offset_count = 0;
+}
+
+bool
+sc_av_sync_init(struct sc_av_sync *sync, sc_tick max_delay) {
+    bool ok = sc_mutex_init(&sync->mutex);
+    if (!ok) {
+        return false;
+    }
+
+    sync->max_delay = max_delay;
+    sc_clock_init(&sync->audio_clock);
+    sc_av_sync_reset_stats(sync);
+    sync->next_report = 0;
+
+    return true;
+}
+
+void
+sc_av_sync_destroy(struct sc_av_sync *sync) {
+    sc_mutex_destroy(&sync->mutex);
+}
+
+void
+sc_av_sync_update_audio(struct sc_av_sync *sync, sc_tick play_time,
+                        sc_tick pts) {
+    sc_mutex_lock(&sync->mutex);
+    sc_clock_update(&sync->audio_clock, play_time, pts);
+    sc_mutex_unlock(&sync->mutex);
+}
+
+bool
+sc_av_sync_to_system_time(struct sc_av_sync *sync, sc_tick pts,
+                          sc_tick *system_time) {
+    sc_mutex_lock(&sync->mutex);
+    bool known = sync->audio_clock.range;
+    if (known) {
+        *system_time = sc_clock_to_system_time(&sync->audio_clock, pts);
+    }
+    sc_mutex_unlock(&sync->mutex);
+
+    return known;
+}
+
+void
+sc_av_sync_report_video(struct sc_av_sync *sync, sc_tick now, sc_tick pts) {
+    sc_mutex_lock(&sync->mutex);
+
+    if (!sync->audio_clock.range) {
+        // Audio playback not started yet, nothing to compare with
+        sc_mutex_unlock(&sync->mutex);
+        return;
+    }
+
+    sc_tick offset =
+        now - sc_clock_to_system_time(&sync->audio_clock, pts);
+
+    if (!sync->offset_count || offset < sync->offset_min) {
+        sync->offset_min = offset;
+    }
+    if (!sync->offset_count || offset > sync->offset_max) {
+        sync->offset_max = offset;
+    }
+    sync->offset_sum += offset;
+    ++sync->offset_count;
+
+    if (now >= sync->next_report) {
+        sc_tick avg = sync->offset_sum / (sc_tick) sync->offset_count;
+        LOGD("[A/V sync] video offset: avg=%" PRItick "ms min=%" PRItick
+             "ms max=%" PRItick "ms (%u frames)",
+             SC_TICK_TO_MS(avg), SC_TICK_TO_MS(sync->offset_min),
+             SC_TICK_TO_MS(sync->offset_max), sync->offset_count);
+        sc_av_sync_reset_stats(sync);
+        sync->next_report = now + SC_AV_SYNC_REPORT_INTERVAL;
+    }
+
+    sc_mutex_unlock(&sync->mutex);
+}
@@ -0,0 +1,81 @@
+#ifndef SC_AV_SYNC_H
+#define SC_AV_SYNC_H
+
+#include "common.h"
+
+#include <stdbool.h>
+
+#include "clock.h"
+#include "util/thread.h"
+#include "util/tick.h"
+
+/**
+ * Audio/video synchronization
+ *
+ * Audio samples are not played as soon as they are decoded: they are delayed
+ * by the audio regulator buffering (--audio-buffer) and by the audio output
+ * buffer (--audio-output-buffer, plus any additional latency in SDL).
+ *
+ * The audio player regularly reports the system time at which the samples it
+ * receives will actually be heard. This provides a clock mapping the stream
+ * PTS to the audio playback time, which the video delay buffer uses to present
+ * each frame at the same time as the matching audio.
+ *
+ * Audio and video PTS are both expressed in the device monotonic time base, so
+ * the same clock applies to both streams.
+ */
+struct sc_av_sync {
+    sc_mutex mutex;
+
+    // Maximum delay applied to video frames
+    sc_tick max_delay;
+
+    // The following fields are protected by the mutex
+
+    // Mapping from audio PTS to the time it is played
+    struct sc_clock audio_clock;
+
+    // Stats about the offset between video frames presentation and the audio
+    // playback of the same PTS (positive if video is late)
+    sc_tick offset_sum;
+    sc_tick offset_min;
+    sc_tick offset_max;
+    unsigned offset_count;
+    sc_tick next_report;
+};
+
+bool
+sc_av_sync_init(struct sc_av_sync *sync, sc_tick max_delay);
+
+void
+sc_av_sync_destroy(struct sc_av_sync *sync);
+
+/**
+ * Notify that the audio samples starting at stream time `pts` will be played
+ * at system time `play_time`
+ *
+ * Called from the audio player.
+ */
+void
+sc_av_sync_update_audio(struct sc_av_sync *sync, sc_tick play_time,
+                        sc_tick pts);
+
+/**
+ * Get the system time at which the audio for stream time `pts` is played
+ *
+ * Return false if this time is not known yet (audio playback not started).
+ */
+bool
+sc_av_sync_to_system_time(struct sc_av_sync *sync, sc_tick pts,
+                          sc_tick *system_time);
+
+/**
+ * Notify that the video frame for stream time `pts` has been presented at
+ * system time `now`
+ *
+ * This is only used to report the A/V offset.
+ */
+void
+sc_av_sync_report_video(struct sc_av_sync *sync, sc_tick now, sc_tick pts);
+
+#endif
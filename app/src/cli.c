@@ -1,7 +1,9 @@
 #include "cli.h"
 
 #include <assert.h>
+#include <errno.h>
 #include <getopt.h>
+#include <math.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -113,6 +115,31 @@ enum {
     OPT_ANGLE,
     OPT_NO_VD_SYSTEM_DECORATIONS,
     OPT_NO_VD_DESTROY_CONTENT,
+    OPT_AV_SYNC,
+    OPT_AUDIO_SAMPLE_RATE,
+    OPT_AUDIO_CHANNELS,
+    OPT_RECORD_QUEUE_LIMIT,
+    OPT_RECORD_QUEUE_OVERFLOW,
+    OPT_RECORD_IO_BUFFER,
+    OPT_RECORD_FLUSH_INTERVAL,
+    OPT_RECORD_SYNC_INTERVAL,
+    OPT_RECORD_FRAGMENTED,
+    OPT_RECORD_SEGMENT_DURATION,
+    OPT_RECORD_SEGMENT_SIZE,
+    OPT_REPLAY,
+    OPT_REPLAY_DURATION,
+    OPT_REPLAY_SIZE,
+    OPT_VIDEO_STREAM_OUTPUT,
+    OPT_VIDEO_STREAM_FORMAT,
+    OPT_VIDEO_STREAM_SERVER,
+    OPT_V4L2_PASSTHROUGH,
+    OPT_PRINT_INPUT_LATENCY,
+    OPT_CONTROL_RECORD,
+    OPT_CONTROL_REPLAY,
+    OPT_CONTROL_REPLAY_SPEED,
+    OPT_NO_INPUT_TIMESTAMPS,
+    OPT_RECORD_NO_AUDIO,
+    OPT_RECORD_NO_VIDEO,
 };
 
 struct sc_option {
@@ -178,6 +205,14 @@ static const struct sc_option options[] = {
                 "likelihood of buffer underrun (causing audio glitches).\n"
                 "Default is 50.",
     },
+    {
+        .longopt_id = OPT_AUDIO_CHANNELS,
+        .longopt = "audio-channels",
+        .argdesc = "value",
+        .text = "Select the number of audio channels to capture (1 for mono, "
+                "2 for stereo).\n"
+                "Default is 2.",
+    },
     {
         .longopt_id = OPT_AUDIO_CODEC,
         .longopt = "audio-codec",
@@ -212,6 +247,17 @@ static const struct sc_option options[] = {
                 "codec provided by --audio-codec).\n"
                 "The available encoders can be listed by --list-encoders.",
     },
+    {
+        .longopt_id = OPT_AUDIO_SAMPLE_RATE,
+        .longopt = "audio-sample-rate",
+        .argdesc = "value",
+        .text = "Select the audio sample rate, in Hz (8000, 12000, 16000, "
+                "24000 or 48000).\n"
+                "A lower sample rate (typically with --audio-channels=1) "
+                "reduces the bandwidth and the decoding cost, for example for "
+                "voice-only monitoring.\n"
+                "Default is 48000.",
+    },
     {
         .longopt_id = OPT_AUDIO_SOURCE,
         .longopt = "audio-source",
@@ -233,8 +279,21 @@ static const struct sc_option options[] = {
                 "milliseconds).\n"
                 "If you get \"robotic\" audio playback, you should test with "
                 "a higher value (10). Do not change this setting otherwise.\n"
+                "If \"auto\" is given, the smallest possible buffer is used, "
+                "and the audio output latency measured during playback is "
+                "added to the audio buffer (see --audio-buffer).\n"
                 "Default is 5.",
     },
+    {
+        .longopt_id = OPT_AV_SYNC,
+        .longopt = "av-sync",
+        .text = "Delay video frames to present them along with the matching "
+                "audio samples.\n"
+                "By default, video frames are displayed as soon as they are "
+                "decoded, while audio playback is delayed by the audio "
+                "buffering (see --audio-buffer and --audio-output-buffer).\n"
+                "This option requires both video and audio playback.",
+    },
     {
         .shortopt = 'b',
         .longopt = "video-bit-rate",
@@ -326,6 +385,32 @@ static const struct sc_option options[] = {
         .longopt = "codec-options",
         .argdesc = "key[:type]=value[,...]",
     },
+    {
+        .longopt_id = OPT_CONTROL_RECORD,
+        .longopt = "control-record",
+        .argdesc = "file",
+        .text = "Record the control messages sent to the device (along with "
+                "the time of their input events) to a file, to be replayed "
+                "later with --control-replay.",
+    },
+    {
+        .longopt_id = OPT_CONTROL_REPLAY,
+        .longopt = "control-replay",
+        .argdesc = "file",
+        .text = "Replay the control messages recorded by --control-record, "
+                "with their original timing.\n"
+                "The keyboard and mouse input modes should be the same as "
+                "during the recording.",
+    },
+    {
+        .longopt_id = OPT_CONTROL_REPLAY_SPEED,
+        .longopt = "control-replay-speed",
+        .argdesc = "factor",
+        .text = "Set the speed factor of --control-replay.\n"
+                "If set to 0, the messages are replayed as fast as possible "
+                "(to measure the control throughput).\n"
+                "Default is 1.",
+    },
     {
         .longopt_id = OPT_CROP,
         .longopt = "crop",
@@ -639,6 +724,16 @@ static const struct sc_option options[] = {
         .longopt_id = OPT_NO_DISPLAY,
         .longopt = "no-display",
     },
+    {
+        .longopt_id = OPT_NO_INPUT_TIMESTAMPS,
+        .longopt = "no-input-timestamps",
+        .text = "By default, the capture time of the touch and scroll events "
+                "is sent to the device, so that the injected events preserve "
+                "their original spacing even if they are delayed in transit "
+                "(for example over Wi-Fi).\n"
+                "This option disables this behavior: the events are "
+                "timestamped on reception by the device.",
+    },
     {
         .longopt_id = OPT_NO_KEY_REPEAT,
         .longopt = "no-key-repeat",
@@ -756,6 +851,16 @@ static const struct sc_option options[] = {
         .text = "Start FPS counter, to print framerate logs to the console. "
                 "It can be started or stopped at any time with MOD+i.",
     },
+    {
+        .longopt_id = OPT_PRINT_INPUT_LATENCY,
+        .longopt = "print-input-latency",
+        .text = "Print input latency statistics to the console every 10 "
+                "seconds: for each control message type, the median (p50) "
+                "and the 99th percentile (p99) of the delay between the input "
+                "event and the message being sent to the device, along with "
+                "the maximum control queue depth and the number of messages "
+                "dropped or merged.",
+    },
     {
         .longopt_id = OPT_PUSH_TARGET,
         .longopt = "push-target",
@@ -770,13 +875,26 @@ static const struct sc_option options[] = {
         .argdesc = "file.mp4",
         .text = "Record screen to file.\n"
                 "The format is determined by the --record-format option if "
-                "set, or by the file extension.",
+                "set, or by the file extension.\n"
+                "This option may be repeated to record to several files at "
+                "once (up to 4), sharing the same stream. With several "
+                "outputs, an audio-only format (e.g. opus or m4a) records "
+                "only the audio stream.",
     },
     {
         .longopt_id = OPT_RAW_KEY_EVENTS,
         .longopt = "raw-key-events",
         .text = "Inject key events for all input keys, and ignore text events."
     },
+    {
+        .longopt_id = OPT_RECORD_FLUSH_INTERVAL,
+        .longopt = "record-flush-interval",
+        .argdesc = "ms",
+        .text = "Write the buffered recording data to the file at least every "
+                "<ms> milliseconds (only if --record-io-buffer is not 0).\n"
+                "0 means that data is written only when the buffer is full.\n"
+                "Default is 1000.",
+    },
     {
         .longopt_id = OPT_RECORD_FORMAT,
         .longopt = "record-format",
@@ -784,6 +902,39 @@ static const struct sc_option options[] = {
         .text = "Force recording format (mp4, mkv, m4a, mka, opus, aac, flac "
                 "or wav).",
     },
+    {
+        .longopt_id = OPT_RECORD_FRAGMENTED,
+        .longopt = "record-fragmented",
+        .text = "Record to a fragmented MP4 file (one fragment per GOP). The "
+                "file remains playable even if scrcpy is killed, and the "
+                "memory usage does not grow with the recording duration.\n"
+                "Only supported for MP4 formats (mp4, m4a and aac).",
+    },
+    {
+        .longopt_id = OPT_RECORD_IO_BUFFER,
+        .longopt = "record-io-buffer",
+        .argdesc = "bytes",
+        .text = "Set the size of the recording write buffers. The file is "
+                "written from a separate thread, with 2 buffers of this "
+                "size.\n"
+                "Supports 'K' and 'M' suffixes.\n"
+                "If 0, the file is written directly by FFmpeg.\n"
+                "Default is 4M.",
+    },
+    {
+        .longopt_id = OPT_RECORD_NO_AUDIO,
+        .longopt = "record-no-audio",
+        .text = "Do not record the audio stream to the file of the previous "
+                "--record option (the audio is still captured for the other "
+                "consumers).",
+    },
+    {
+        .longopt_id = OPT_RECORD_NO_VIDEO,
+        .longopt = "record-no-video",
+        .text = "Do not record the video stream to the file of the previous "
+                "--record option (the video is still captured for the other "
+                "consumers).",
+    },
     {
         .longopt_id = OPT_RECORD_ORIENTATION,
         .longopt = "record-orientation",
@@ -793,6 +944,55 @@ static const struct sc_option options[] = {
                 "the clockwise rotation in degrees.\n"
                 "Default is 0.",
     },
+    {
+        .longopt_id = OPT_RECORD_QUEUE_LIMIT,
+        .longopt = "record-queue-limit",
+        .argdesc = "bytes",
+        .text = "Limit the total size of the packets waiting to be written to "
+                "the recording file (if the storage is too slow).\n"
+                "Supports 'K' and 'M' suffixes.\n"
+                "Default is 0 (unlimited).",
+    },
+    {
+        .longopt_id = OPT_RECORD_QUEUE_OVERFLOW,
+        .longopt = "record-queue-overflow",
+        .argdesc = "value",
+        .text = "Select the behavior when the --record-queue-limit is "
+                "reached.\n"
+                "Possible values are \"block\" (wait for the storage, which "
+                "also delays mirroring), \"drop\" (drop video packets until "
+                "the next keyframe, and audio packets) and \"abort\" (stop "
+                "the recording).\n"
+                "Default is block.",
+    },
+    {
+        .longopt_id = OPT_RECORD_SEGMENT_DURATION,
+        .longopt = "record-segment-duration",
+        .argdesc = "seconds",
+        .text = "Split the recording into several files of about <seconds> "
+                "seconds each. Each file starts on a video keyframe.\n"
+                "The record filename must contain the segment index pattern "
+                "(e.g. file-%03d.mkv).",
+    },
+    {
+        .longopt_id = OPT_RECORD_SEGMENT_SIZE,
+        .longopt = "record-segment-size",
+        .argdesc = "bytes",
+        .text = "Split the recording into several files of about <bytes> "
+                "bytes each. Each file starts on a video keyframe.\n"
+                "Supports 'K' and 'M' suffixes.\n"
+                "The record filename must contain the segment index pattern "
+                "(e.g. file-%03d.mkv).",
+    },
+    {
+        .longopt_id = OPT_RECORD_SYNC_INTERVAL,
+        .longopt = "record-sync-interval",
+        .argdesc = "ms",
+        .text = "Flush the recording file to the storage device (fdatasync) "
+                "at most every <ms> milliseconds, and on close (only if "
+                "--record-io-buffer is not 0).\n"
+                "Default is 0 (never sync explicitly).",
+    },
     {
         .longopt_id = OPT_RENDER_DRIVER,
         .longopt = "render-driver",
@@ -803,6 +1003,34 @@ static const struct sc_option options[] = {
                 "\"opengles2\", \"opengles\", \"metal\" and \"software\".\n"
                 "<https://wiki.libsdl.org/SDL_HINT_RENDER_DRIVER>",
     },
+    {
+        .longopt_id = OPT_REPLAY,
+        .longopt = "replay",
+        .argdesc = "file",
+        .text = "Keep the last seconds of the stream in memory, and save "
+                "them to a file on MOD+e (instant replay).\n"
+                "The filename must contain the replay index pattern (e.g. "
+                "replay-%03d.mp4), existing files are not overwritten.\n"
+                "The format is determined by the filename extension.",
+    },
+    {
+        .longopt_id = OPT_REPLAY_DURATION,
+        .longopt = "replay-duration",
+        .argdesc = "seconds",
+        .text = "Set the duration of the instant replay buffer (see "
+                "--replay). The buffer is trimmed by whole GOPs, so the saved "
+                "duration may be slightly longer.\n"
+                "Default is 30.",
+    },
+    {
+        .longopt_id = OPT_REPLAY_SIZE,
+        .longopt = "replay-size",
+        .argdesc = "bytes",
+        .text = "Limit the size of the instant replay buffer (see "
+                "--replay).\n"
+                "Supports 'K' and 'M' suffixes.\n"
+                "Default is 64M.",
+    },
     {
         .longopt_id = OPT_REQUIRE_AUDIO,
         .longopt = "require-audio",
@@ -943,6 +1171,14 @@ static const struct sc_option options[] = {
                 "Default is 0 (no buffering).\n"
                 "This option is only available on Linux.",
     },
+    {
+        .longopt_id = OPT_V4L2_PASSTHROUGH,
+        .longopt = "v4l2-passthrough",
+        .text = "Write the compressed H.264 stream to the V4L2 device, "
+                "without decoding it (the V4L2 consumers must decode H.264 "
+                "themselves).\n"
+                "This option is only available on Linux.",
+    },
     {
         .longopt_id = OPT_VIDEO_BUFFER,
         .longopt = "video-buffer",
@@ -987,6 +1223,43 @@ static const struct sc_option options[] = {
                 "Camera mirroring requires Android 12+.\n"
                 "Default is display.",
     },
+    {
+        .longopt_id = OPT_VIDEO_STREAM_FORMAT,
+        .longopt = "video-stream-format",
+        .argdesc = "format",
+        .text = "Select the format of the --video-stream-output and "
+                "--video-stream-server streams:\n"
+                "\"annexb\": the raw packets (Annex-B for H.264 and "
+                "H.265, OBUs for AV1);\n"
+                "\"scrcpy\": the scrcpy framing, a 12-byte codec header "
+                "(codec id, width and height) then each packet prefixed by "
+                "a 12-byte header (PTS with config/keyframe flags, and "
+                "size).\n"
+                "Default is annexb.",
+    },
+    {
+        .longopt_id = OPT_VIDEO_STREAM_OUTPUT,
+        .longopt = "video-stream-output",
+        .argdesc = "target",
+        .text = "Write the video stream, without remuxing, to another "
+                "program: \"-\" for stdout, \"unix:<path>\" to connect to "
+                "a listening Unix socket, or the path of a FIFO or a file.\n"
+                "For stdout, the logs are printed to stderr instead.\n"
+                "The writes never block: if the consumer is too slow, the "
+                "packets are dropped until the next keyframe.\n"
+                "This option is not available on Windows.",
+    },
+    {
+        .longopt_id = OPT_VIDEO_STREAM_SERVER,
+        .longopt = "video-stream-server",
+        .argdesc = "port",
+        .text = "Serve the video stream on localhost:<port> (TCP) to several "
+                "local clients, without opening additional device "
+                "sessions.\n"
+                "A client joining late starts from the latest keyframe. A "
+                "client too slow drops packets until the next keyframe, "
+                "without affecting the others.",
+    },
     {
         .shortopt = 'w',
         .longopt = "stay-awake",
@@ -1152,6 +1425,10 @@ static const struct sc_shortcut shortcuts[] = {
         .shortcuts = { "MOD+k" },
         .text = "Open keyboard settings on the device (for HID keyboard only)",
     },
+    {
+        .shortcuts = { "MOD+e" },
+        .text = "Save the instant replay (see --replay)",
+    },
     {
         .shortcuts = { "MOD+i" },
         .text = "Enable/disable FPS counter (print frames/second in logs)",
@@ -1604,6 +1881,11 @@ parse_buffering_time(const char *s, sc_tick *tick) {
 
 static bool
 parse_audio_output_buffer(const char *s, sc_tick *tick) {
+    if (!strcmp(s, "auto")) {
+        *tick = SC_AUDIO_OUTPUT_BUFFER_AUTO;
+        return true;
+    }
+
     long value;
     bool ok = parse_integer_arg(s, &value, false, 0, 1000,
                                 "audio output buffer");
@@ -1615,6 +1897,39 @@ parse_audio_output_buffer(const char *s, sc_tick *tick) {
     return true;
 }
 
+static bool
+parse_audio_sample_rate(const char *s, uint32_t *sample_rate) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 8000, 48000,
+                                "audio sample rate");
+    if (!ok) {
+        return false;
+    }
+
+    // Only sample rates supported by all the audio codecs (including Opus)
+    if (value != 8000 && value != 12000 && value != 16000 && value != 24000
+            && value != 48000) {
+        LOGE("Unsupported audio sample rate: %ld (expected 8000, 12000, 16000, "
+             "24000 or 48000)", value);
+        return false;
+    }
+
+    *sample_rate = (uint32_t) value;
+    return true;
+}
+
+static bool
+parse_audio_channels(const char *s, uint8_t *channels) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 1, 2, "audio channels");
+    if (!ok) {
+        return false;
+    }
+
+    *channels = (uint8_t) value;
+    return true;
+}
+
 static bool
 parse_orientation(const char *s, enum sc_orientation *orientation) {
     if (!strcmp(s, "0")) {
@@ -1904,6 +2219,153 @@ parse_record_format(const char *optarg, enum sc_record_format *format) {
     return true;
 }
 
+static bool
+parse_record_queue_limit(const char *s, uint32_t *limit) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, true, 0, 0x7FFFFFFF,
+                                "record queue limit");
+    if (!ok) {
+        return false;
+    }
+
+    *limit = (uint32_t) value;
+    return true;
+}
+
+static bool
+parse_record_io_buffer(const char *s, uint32_t *size) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, true, 0, 0x7FFFFFFF,
+                                "record I/O buffer size");
+    if (!ok) {
+        return false;
+    }
+
+    *size = (uint32_t) value;
+    return true;
+}
+
+static bool
+parse_record_interval(const char *s, sc_tick *tick, const char *name) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 0, 0x7FFFFFFF, name);
+    if (!ok) {
+        return false;
+    }
+
+    *tick = SC_TICK_FROM_MS(value);
+    return true;
+}
+
+static bool
+parse_record_segment_duration(const char *s, sc_tick *duration) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 0, 0x7FFFFFFF,
+                                "record segment duration");
+    if (!ok) {
+        return false;
+    }
+
+    *duration = SC_TICK_FROM_SEC(value);
+    return true;
+}
+
+static bool
+parse_record_segment_size(const char *s, uint32_t *size) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, true, 0, 0x7FFFFFFF,
+                                "record segment size");
+    if (!ok) {
+        return false;
+    }
+
+    *size = (uint32_t) value;
+    return true;
+}
+
+static bool
+parse_replay_duration(const char *s, sc_tick *duration) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 1, 0x7FFFFFFF,
+                                "replay duration");
+    if (!ok) {
+        return false;
+    }
+
+    *duration = SC_TICK_FROM_SEC(value);
+    return true;
+}
+
+static bool
+parse_replay_size(const char *s, uint32_t *size) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, true, 0, 0x7FFFFFFF,
+                                "replay size");
+    if (!ok) {
+        return false;
+    }
+
+    *size = (uint32_t) value;
+    return true;
+}
+
+static bool
+parse_control_replay_speed(const char *s, float *speed) {
+    char *endptr;
+    if (*s == '\0') {
+        LOGE("Control replay speed parameter is empty");
+        return false;
+    }
+
+    errno = 0;
+    float value = strtof(s, &endptr);
+    if (errno == ERANGE || *endptr != '\0' || !isfinite(value)
+            || value < 0) {
+        LOGE("Invalid control replay speed: %s (expected a non-negative "
+             "number)", s);
+        return false;
+    }
+
+    *speed = value;
+    return true;
+}
+
+static bool
+parse_stream_format(const char *optarg, enum sc_stream_format *format) {
+    if (!strcmp(optarg, "annexb")) {
+        *format = SC_STREAM_FORMAT_ANNEXB;
+        return true;
+    }
+    if (!strcmp(optarg, "scrcpy")) {
+        *format = SC_STREAM_FORMAT_SCRCPY;
+        return true;
+    }
+
+    LOGE("Unsupported video stream format: %s (expected annexb or scrcpy)",
+         optarg);
+    return false;
+}
+
+static bool
+parse_record_queue_overflow(const char *optarg,
+                            enum sc_record_overflow *overflow) {
+    if (!strcmp(optarg, "block")) {
+        *overflow = SC_RECORD_OVERFLOW_BLOCK;
+        return true;
+    }
+    if (!strcmp(optarg, "drop")) {
+        *overflow = SC_RECORD_OVERFLOW_DROP;
+        return true;
+    }
+    if (!strcmp(optarg, "abort")) {
+        *overflow = SC_RECORD_OVERFLOW_ABORT;
+        return true;
+    }
+    LOGE("Unsupported record queue overflow: %s (expected block, drop or "
+         "abort)", optarg);
+    return false;
+}
+
 static bool
 parse_ip(const char *optarg, uint32_t *ipv4) {
     return net_parse_ipv4(optarg, ipv4);
@@ -1930,6 +2392,56 @@ guess_record_format(const char *filename) {
     return get_record_format(ext);
 }
 
+static bool
+check_record_format(const struct scrcpy_options *opts,
+                    enum sc_record_format format, bool video, bool audio) {
+    if (video && sc_record_format_is_audio_only(format)) {
+        LOGE("Audio container does not support video stream");
+        return false;
+    }
+
+    if (!audio) {
+        // The audio codec does not matter
+        return true;
+    }
+
+    if (format == SC_RECORD_FORMAT_OPUS
+            && opts->audio_codec != SC_CODEC_OPUS) {
+        LOGE("Recording to OPUS file requires an OPUS audio stream "
+             "(try with --audio-codec=opus)");
+        return false;
+    }
+
+    if (format == SC_RECORD_FORMAT_AAC
+            && opts->audio_codec != SC_CODEC_AAC) {
+        LOGE("Recording to AAC file requires an AAC audio stream "
+             "(try with --audio-codec=aac)");
+        return false;
+    }
+    if (format == SC_RECORD_FORMAT_FLAC
+            && opts->audio_codec != SC_CODEC_FLAC) {
+        LOGE("Recording to FLAC file requires a FLAC audio stream "
+             "(try with --audio-codec=flac)");
+        return false;
+    }
+
+    if (format == SC_RECORD_FORMAT_WAV
+            && opts->audio_codec != SC_CODEC_RAW) {
+        LOGE("Recording to WAV file requires a RAW audio stream "
+             "(try with --audio-codec=raw)");
+        return false;
+    }
+
+    if ((format == SC_RECORD_FORMAT_MP4 ||
+         format == SC_RECORD_FORMAT_M4A)
+            && opts->audio_codec == SC_CODEC_RAW) {
+        LOGE("Recording to MP4 container does not support RAW audio");
+        return false;
+    }
+
+    return true;
+}
+
 static bool
 parse_video_codec(const char *optarg, enum sc_codec *codec) {
     if (!strcmp(optarg, "h264")) {
@@ -2285,6 +2797,17 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
                     return false;
                 }
                 break;
+            case OPT_AUDIO_SAMPLE_RATE:
+                if (!parse_audio_sample_rate(optarg,
+                                             &opts->audio_sample_rate)) {
+                    return false;
+                }
+                break;
+            case OPT_AUDIO_CHANNELS:
+                if (!parse_audio_channels(optarg, &opts->audio_channels)) {
+                    return false;
+                }
+                break;
             case OPT_CROP:
                 opts->crop = optarg;
                 break;
@@ -2310,6 +2833,50 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
                     return false;
                 }
                 break;
+            case OPT_RECORD_QUEUE_LIMIT:
+                if (!parse_record_queue_limit(optarg,
+                                              &opts->record_queue_limit)) {
+                    return false;
+                }
+                break;
+            case OPT_RECORD_FRAGMENTED:
+                opts->record_fragmented = true;
+                break;
+            case OPT_RECORD_IO_BUFFER:
+                if (!parse_record_io_buffer(optarg, &opts->record_io_buffer)) {
+                    return false;
+                }
+                break;
+            case OPT_RECORD_FLUSH_INTERVAL:
+                if (!parse_record_interval(optarg, &opts->record_flush_interval,
+                                           "record flush interval")) {
+                    return false;
+                }
+                break;
+            case OPT_RECORD_SYNC_INTERVAL:
+                if (!parse_record_interval(optarg, &opts->record_sync_interval,
+                                           "record sync interval")) {
+                    return false;
+                }
+                break;
+            case OPT_RECORD_SEGMENT_DURATION:
+                if (!parse_record_segment_duration(optarg,
+                                            &opts->record_segment_duration)) {
+                    return false;
+                }
+                break;
+            case OPT_RECORD_SEGMENT_SIZE:
+                if (!parse_record_segment_size(optarg,
+                                               &opts->record_segment_size)) {
+                    return false;
+                }
+                break;
+            case OPT_RECORD_QUEUE_OVERFLOW:
+                if (!parse_record_queue_overflow(optarg,
+                                            &opts->record_queue_overflow)) {
+                    return false;
+                }
+                break;
             case 'h':
                 args->help = true;
                 break;
@@ -2349,6 +2916,9 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
             case OPT_NO_MOUSE_HOVER:
                 opts->mouse_hover = false;
                 break;
+            case OPT_NO_INPUT_TIMESTAMPS:
+                opts->input_timestamps = false;
+                break;
             case OPT_HID_MOUSE_DEPRECATED:
                 LOGE("--hid-mouse has been removed, use --mouse=aoa or "
                      "--mouse=uhid instead.");
@@ -2397,7 +2967,29 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
                 }
                 break;
             case 'r':
-                opts->record_filename = optarg;
+                if (opts->record_count == SC_MAX_RECORDS) {
+                    LOGE("Too many recording outputs (max %d)",
+                         SC_MAX_RECORDS);
+                    return false;
+                }
+                opts->records[opts->record_count].filename = optarg;
+                opts->records[opts->record_count].video = true;
+                opts->records[opts->record_count].audio = true;
+                ++opts->record_count;
+                break;
+            case OPT_RECORD_NO_AUDIO:
+                if (!opts->record_count) {
+                    LOGE("--record-no-audio must follow a --record option");
+                    return false;
+                }
+                opts->records[opts->record_count - 1].audio = false;
+                break;
+            case OPT_RECORD_NO_VIDEO:
+                if (!opts->record_count) {
+                    LOGE("--record-no-video must follow a --record option");
+                    return false;
+                }
+                opts->records[opts->record_count - 1].video = false;
                 break;
             case 's':
                 opts->serial = optarg;
@@ -2488,6 +3080,19 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
                 opts->record_orientation = orientation;
                 break;
             }
+            case OPT_REPLAY:
+                opts->replay_filename = optarg;
+                break;
+            case OPT_REPLAY_DURATION:
+                if (!parse_replay_duration(optarg, &opts->replay_duration)) {
+                    return false;
+                }
+                break;
+            case OPT_REPLAY_SIZE:
+                if (!parse_replay_size(optarg, &opts->replay_size)) {
+                    return false;
+                }
+                break;
             case OPT_RENDER_DRIVER:
                 opts->render_driver = optarg;
                 break;
@@ -2572,6 +3177,21 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
             case OPT_PRINT_FPS:
                 opts->start_fps_counter = true;
                 break;
+            case OPT_PRINT_INPUT_LATENCY:
+                opts->print_input_latency = true;
+                break;
+            case OPT_CONTROL_RECORD:
+                opts->control_record_filename = optarg;
+                break;
+            case OPT_CONTROL_REPLAY:
+                opts->control_replay_filename = optarg;
+                break;
+            case OPT_CONTROL_REPLAY_SPEED:
+                if (!parse_control_replay_speed(optarg,
+                                                &opts->control_replay_speed)) {
+                    return false;
+                }
+                break;
             case OPT_CODEC:
                 LOGE("--codec has been removed, "
                      "use --video-codec or --audio-codec.");
@@ -2614,6 +3234,39 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
                      "platform).");
                 return false;
 #endif
+            case OPT_V4L2_PASSTHROUGH:
+#ifdef HAVE_V4L2
+                opts->v4l2_passthrough = true;
+                break;
+#else
+                LOGE("V4L2 (--v4l2-passthrough) is disabled (or unsupported "
+                     "on this platform).");
+                return false;
+#endif
+            case OPT_VIDEO_STREAM_OUTPUT:
+#ifdef HAVE_STREAM_OUTPUT
+                opts->video_stream_output = optarg;
+                break;
+#else
+                LOGE("Video stream output (--video-stream-output) is not "
+                     "supported on this platform.");
+                return false;
+#endif
+            case OPT_VIDEO_STREAM_FORMAT:
+                if (!parse_stream_format(optarg,
+                                         &opts->video_stream_format)) {
+                    return false;
+                }
+                break;
+            case OPT_VIDEO_STREAM_SERVER:
+                if (!parse_port(optarg, &opts->video_stream_server_port)) {
+                    return false;
+                }
+                if (!opts->video_stream_server_port) {
+                    LOGE("Invalid video stream server port: 0");
+                    return false;
+                }
+                break;
             case OPT_LIST_ENCODERS:
                 opts->list |= SC_OPTION_LIST_ENCODERS;
                 break;
@@ -2694,6 +3347,9 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
             case OPT_AUDIO_DUP:
                 opts->audio_dup = true;
                 break;
+            case OPT_AV_SYNC:
+                opts->av_sync = true;
+                break;
             case 'G':
                 opts->gamepad_input_mode = SC_GAMEPAD_INPUT_MODE_UHID_OR_AOA;
                 break;
@@ -2753,12 +3409,17 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
 
     bool otg = false;
     bool v4l2 = false;
+    bool stream_output = false;
 #ifdef HAVE_USB
     otg = opts->otg;
 #endif
 #ifdef HAVE_V4L2
     v4l2 = !!opts->v4l2_device;
 #endif
+#ifdef HAVE_STREAM_OUTPUT
+    stream_output = !!opts->video_stream_output;
+#endif
+    stream_output |= !!opts->video_stream_server_port;
 
     if (!opts->window) {
         // Without window, there cannot be any video playback or control
@@ -2776,13 +3437,14 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
         opts->audio_playback = false;
     }
 
-    if (opts->video && !opts->video_playback && !opts->record_filename
-            && !v4l2) {
-        LOGI("No video playback, no recording, no V4L2 sink: video disabled");
+    if (opts->video && !opts->video_playback && !opts->record_count
+            && !v4l2 && !stream_output) {
+        LOGI("No video playback, no recording, no V4L2 sink, no stream "
+             "output: video disabled");
         opts->video = false;
     }
 
-    if (opts->audio && !opts->audio_playback && !opts->record_filename) {
+    if (opts->audio && !opts->audio_playback && !opts->record_count) {
         LOGI("No audio playback, no recording: audio disabled");
         opts->audio = false;
     }
@@ -2810,6 +3472,11 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
         }
     }
 
+    if (opts->av_sync && (!opts->video_playback || !opts->audio_playback)) {
+        LOGE("A/V sync requires both video and audio playback");
+        return false;
+    }
+
 #ifdef HAVE_V4L2
     if (v4l2) {
         if (!opts->video) {
@@ -2827,8 +3494,31 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
         LOGE("V4L2 buffer value without V4L2 sink");
         return false;
     }
+
+    if (opts->v4l2_passthrough) {
+        if (!opts->v4l2_device) {
+            LOGE("V4L2 passthrough without V4L2 sink");
+            return false;
+        }
+
+        if (opts->video_codec != SC_CODEC_H264) {
+            LOGE("V4L2 passthrough requires --video-codec=h264");
+            return false;
+        }
+
+        if (opts->v4l2_buffer) {
+            LOGE("V4L2 buffer is not supported in passthrough mode");
+            return false;
+        }
+    }
 #endif
 
+    if (stream_output && !opts->video) {
+        LOGE("Video stream output or server requires video capture, but "
+             "--no-video was set.");
+        return false;
+    }
+
     if (opts->control) {
         if (opts->keyboard_input_mode == SC_KEYBOARD_INPUT_MODE_AUTO) {
             opts->keyboard_input_mode = otg ? SC_KEYBOARD_INPUT_MODE_AOA
@@ -3047,27 +3737,40 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
         }
     }
 
-    if (opts->record_format && !opts->record_filename) {
+    if (opts->record_format && !opts->record_count) {
         LOGE("Record format specified without recording");
         return false;
     }
 
-    if (opts->record_filename) {
+    if (opts->record_format && opts->record_count > 1) {
+        LOGE("Record format specified for several recording outputs (the "
+             "format of each output is determined by its extension)");
+        return false;
+    }
+
+    if (opts->record_queue_limit && !opts->record_count) {
+        LOGE("Record queue limit specified without recording");
+        return false;
+    }
+
+    if (opts->record_fragmented && !opts->record_count) {
+        LOGE("Fragmented recording specified without recording");
+        return false;
+    }
+
+    bool record_segmented = opts->record_segment_duration
+                         || opts->record_segment_size;
+    if (record_segmented && !opts->record_count) {
+        LOGE("Segmented recording specified without recording");
+        return false;
+    }
+
+    if (opts->record_count) {
         if (!opts->video && !opts->audio) {
             LOGE("Video and audio disabled, nothing to record");
             return false;
         }
 
-        if (!opts->record_format) {
-            opts->record_format = guess_record_format(opts->record_filename);
-            if (!opts->record_format) {
-                LOGE("No format specified for \"%s\" "
-                     "(try with --record-format=mkv)",
-                     opts->record_filename);
-                return false;
-            }
-        }
-
         if (opts->record_orientation != SC_ORIENTATION_0) {
             if (sc_orientation_is_mirror(opts->record_orientation)) {
                 LOGE("Record orientation only supports rotation, not "
@@ -3076,44 +3779,92 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
                 return false;
             }
         }
+    }
+
+    for (unsigned i = 0; i < opts->record_count; ++i) {
+        struct sc_record_output *record = &opts->records[i];
+
+        if (opts->record_format) {
+            record->format = opts->record_format;
+        } else {
+            record->format = guess_record_format(record->filename);
+            if (!record->format) {
+                LOGE("No format specified for \"%s\" "
+                     "(try with --record-format=mkv)",
+                     record->filename);
+                return false;
+            }
+        }
+
+        // With several outputs, an audio-only output records only the audio
+        // stream (with a single output, recording no video is an error)
+        if (opts->record_count > 1
+                && sc_record_format_is_audio_only(record->format)) {
+            record->video = false;
+        }
+        record->video &= opts->video;
+        record->audio &= opts->audio;
+
+        if (!record->video && !record->audio) {
+            LOGE("Nothing to record to \"%s\"", record->filename);
+            return false;
+        }
+
+        if (!check_record_format(opts, record->format, record->video,
+                                 record->audio)) {
+            return false;
+        }
 
-        if (opts->video
-                && sc_record_format_is_audio_only(opts->record_format)) {
-            LOGE("Audio container does not support video stream");
+        if (opts->record_fragmented
+                && record->format != SC_RECORD_FORMAT_MP4
+                && record->format != SC_RECORD_FORMAT_M4A
+                && record->format != SC_RECORD_FORMAT_AAC) {
+            LOGE("Fragmented recording requires an MP4 container "
+                 "(mp4, m4a or aac)");
             return false;
         }
 
-        if (opts->record_format == SC_RECORD_FORMAT_OPUS
-                && opts->audio_codec != SC_CODEC_OPUS) {
-            LOGE("Recording to OPUS file requires an OPUS audio stream "
-                 "(try with --audio-codec=opus)");
+        if (record_segmented && !sc_str_is_index_pattern(record->filename)) {
+            LOGE("Segmented recording requires a pattern in the filename, "
+                 "e.g. file-%%03d.mkv");
+            return false;
+        }
+    }
+
+    if (opts->replay_filename) {
+        if (!opts->video && !opts->audio) {
+            LOGE("Video and audio disabled, nothing to replay");
             return false;
         }
 
-        if (opts->record_format == SC_RECORD_FORMAT_AAC
-                && opts->audio_codec != SC_CODEC_AAC) {
-            LOGE("Recording to AAC file requires an AAC audio stream "
-                 "(try with --audio-codec=aac)");
+        if (!opts->window) {
+            LOGE("Instant replay requires a window (it is saved by a "
+                 "shortcut)");
             return false;
         }
-        if (opts->record_format == SC_RECORD_FORMAT_FLAC
-                && opts->audio_codec != SC_CODEC_FLAC) {
-            LOGE("Recording to FLAC file requires a FLAC audio stream "
-                 "(try with --audio-codec=flac)");
+
+        if (!sc_str_is_index_pattern(opts->replay_filename)) {
+            LOGE("Instant replay requires a pattern in the filename, "
+                 "e.g. replay-%%03d.mp4");
             return false;
         }
 
-        if (opts->record_format == SC_RECORD_FORMAT_WAV
-                && opts->audio_codec != SC_CODEC_RAW) {
-            LOGE("Recording to WAV file requires a RAW audio stream "
-                 "(try with --audio-codec=raw)");
+        opts->replay_format = guess_record_format(opts->replay_filename);
+        if (!opts->replay_format) {
+            LOGE("No format found for \"%s\" (try with a .mkv or .mp4 "
+                 "extension)", opts->replay_filename);
             return false;
         }
 
-        if ((opts->record_format == SC_RECORD_FORMAT_MP4 ||
-             opts->record_format == SC_RECORD_FORMAT_M4A)
-                && opts->audio_codec == SC_CODEC_RAW) {
-            LOGE("Recording to MP4 container does not support RAW audio");
+        if (!check_record_format(opts, opts->replay_format, opts->video,
+                                 opts->audio)) {
+            return false;
+        }
+
+        if (opts->record_orientation != SC_ORIENTATION_0
+                && sc_orientation_is_mirror(opts->record_orientation)) {
+            LOGE("Record orientation only supports rotation, not flipping: %s",
+                 sc_orientation_get_name(opts->record_orientation));
             return false;
         }
     }
@@ -3155,6 +3906,24 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
             LOGE("Cannot start an Android app if control is disabled");
             return false;
         }
+        if (opts->print_input_latency) {
+            LOGW("--print-input-latency has no effect if control is "
+                 "disabled");
+            opts->print_input_latency = false;
+        }
+        if (opts->control_record_filename) {
+            LOGE("Cannot record control messages if control is disabled");
+            return false;
+        }
+        if (opts->control_replay_filename) {
+            LOGE("Cannot replay control messages if control is disabled");
+            return false;
+        }
+    }
+
+    if (opts->control_replay_speed != 1.0f && !opts->control_replay_filename) {
+        LOGE("Control replay speed specified without control replay");
+        return false;
     }
 
 # ifdef _WIN32
@@ -3176,7 +3945,7 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
     if (otg) {
         // OTG mode is compatible with only very few options.
         // Only report obvious errors.
-        if (opts->record_filename) {
+        if (opts->record_count) {
             LOGE("OTG mode: cannot record");
             return false;
         }
@@ -3204,6 +3973,14 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
             LOGE("OTG mode: could not sink to V4L2 device");
             return false;
         }
+        if (stream_output) {
+            LOGE("OTG mode: could not output the video stream");
+            return false;
+        }
+        if (opts->control_record_filename || opts->control_replay_filename) {
+            LOGE("OTG mode: could not record or replay control messages");
+            return false;
+        }
     }
 
     return true;
@@ -61,6 +61,14 @@
 # define SCRCPY_LAVC_HAS_CODECPAR_CODEC_SIDEDATA
 #endif
 
+// In ffmpeg/doc/APIchanges:
+// 2023-09-07 - 0a9d4ce0 - lavf 60.12.100 - avio.h
+//   Constify the buffer pointees in the write_packet and write_data_type
+//   callbacks of AVIOContext on the next major bump.
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(61, 0, 100)
+# define SCRCPY_LAVF_HAS_AVIO_WRITE_CONST_BUF
+#endif
+
 #if SDL_VERSION_ATLEAST(2, 0, 6)
 // <https://github.com/libsdl-org/SDL/commit/d7a318de563125e5bb465b1000d6bc9576fbc6fc>
 # define SCRCPY_SDL_HAS_HINT_TOUCH_MOUSE_EVENTS
@@ -5,6 +5,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "hid/hid_mouse.h"
 #include "util/binary.h"
 #include "util/log.h"
 #include "util/str.h"
@@ -44,6 +45,29 @@ static const char *const android_motionevent_action_labels[] = {
     "btn-release",
 };
 
+static const char *const control_msg_type_labels[] = {
+    "inject-keycode",
+    "inject-text",
+    "inject-touch",
+    "inject-scroll",
+    "back-or-screen-on",
+    "expand-notification-panel",
+    "expand-settings-panel",
+    "collapse-panels",
+    "get-clipboard",
+    "set-clipboard",
+    "set-display-power",
+    "rotate-device",
+    "uhid-create",
+    "uhid-input",
+    "uhid-destroy",
+    "open-hard-keyboard-settings",
+    "start-app",
+    "reset-video",
+    "chunk",
+    "inject-touch-compact",
+};
+
 static const char *const copy_key_labels[] = {
     "none",
     "copy",
@@ -72,6 +96,33 @@ write_position(uint8_t *buf, const struct sc_position *position) {
     sc_write16be(&buf[10], position->screen_size.height);
 }
 
+// The scroll amount, between -SC_CONTROL_MSG_SCROLL_MAX and
+// SC_CONTROL_MSG_SCROLL_MAX, is encoded as a 16-bit fixed-point value scaled
+// down to [-1, 1]
+static int16_t
+write_scroll(float scroll) {
+    float max = SC_CONTROL_MSG_SCROLL_MAX;
+    return sc_float_to_i16fp(CLAMP(scroll, -max, max) / max);
+}
+
+static float
+read_scroll(const uint8_t *buf) {
+    return sc_i16fp_to_float((int16_t) sc_read16be(buf))
+         * SC_CONTROL_MSG_SCROLL_MAX;
+}
+
+// Write the event time in milliseconds (4 bytes)
+static void
+write_event_time(uint8_t *buf, sc_tick event_time) {
+    // Only the differences between event times matter, so the value may wrap
+    // around, but 0 is reserved for an unknown time
+    uint32_t value = (uint32_t) SC_TICK_TO_MS(event_time);
+    if (event_time && !value) {
+        value = 1;
+    }
+    sc_write32be(buf, value);
+}
+
 // Write truncated string, and return the size
 static size_t
 write_string_payload(uint8_t *payload, const char *utf8, size_t max_len) {
@@ -124,17 +175,19 @@ sc_control_msg_serialize(const struct sc_control_msg *msg, uint8_t *buf) {
             sc_write16be(&buf[22], pressure);
             sc_write32be(&buf[24], msg->inject_touch_event.action_button);
             sc_write32be(&buf[28], msg->inject_touch_event.buttons);
-            return 32;
+            write_event_time(&buf[32], msg->inject_touch_event.event_time);
+            return 36;
         case SC_CONTROL_MSG_TYPE_INJECT_SCROLL_EVENT:
             write_position(&buf[1], &msg->inject_scroll_event.position);
             int16_t hscroll =
-                sc_float_to_i16fp(msg->inject_scroll_event.hscroll);
+                write_scroll(msg->inject_scroll_event.hscroll);
             int16_t vscroll =
-                sc_float_to_i16fp(msg->inject_scroll_event.vscroll);
+                write_scroll(msg->inject_scroll_event.vscroll);
             sc_write16be(&buf[13], (uint16_t) hscroll);
             sc_write16be(&buf[15], (uint16_t) vscroll);
             sc_write32be(&buf[17], msg->inject_scroll_event.buttons);
-            return 21;
+            write_event_time(&buf[21], msg->inject_scroll_event.event_time);
+            return 25;
         case SC_CONTROL_MSG_TYPE_BACK_OR_SCREEN_ON:
             buf[1] = msg->inject_keycode.action;
             return 2;
@@ -175,7 +228,9 @@ sc_control_msg_serialize(const struct sc_control_msg *msg, uint8_t *buf) {
             sc_write16be(&buf[1], msg->uhid_destroy.id);
             return 3;
         case SC_CONTROL_MSG_TYPE_START_APP: {
-            size_t len = write_string_tiny(&buf[1], msg->start_app.name, 255);
+            size_t len =
+                write_string_tiny(&buf[1], msg->start_app.name,
+                                  SC_CONTROL_MSG_START_APP_NAME_MAX_LENGTH);
             return 1 + len;
         }
         case SC_CONTROL_MSG_TYPE_EXPAND_NOTIFICATION_PANEL:
@@ -192,6 +247,300 @@ sc_control_msg_serialize(const struct sc_control_msg *msg, uint8_t *buf) {
     }
 }
 
+static void
+read_position(const uint8_t *buf, struct sc_position *position) {
+    position->point.x = (int32_t) sc_read32be(&buf[0]);
+    position->point.y = (int32_t) sc_read32be(&buf[4]);
+    position->screen_size.width = sc_read16be(&buf[8]);
+    position->screen_size.height = sc_read16be(&buf[10]);
+}
+
+// Read a string of the given length as a new null-terminated string
+static char *
+read_string(const uint8_t *buf, size_t len) {
+    char *s = malloc(len + 1);
+    if (!s) {
+        LOG_OOM();
+        return NULL;
+    }
+    memcpy(s, buf, len);
+    s[len] = '\0';
+    return s;
+}
+
+ssize_t
+sc_control_msg_deserialize(const uint8_t *buf, size_t len,
+                           struct sc_control_msg *msg) {
+    if (!len) {
+        return 0; // no message
+    }
+
+    msg->type = buf[0];
+    switch (msg->type) {
+        case SC_CONTROL_MSG_TYPE_INJECT_KEYCODE:
+            if (len < 14) {
+                return 0; // no complete message
+            }
+            msg->inject_keycode.action = buf[1];
+            msg->inject_keycode.keycode = sc_read32be(&buf[2]);
+            msg->inject_keycode.repeat = sc_read32be(&buf[6]);
+            msg->inject_keycode.metastate = sc_read32be(&buf[10]);
+            return 14;
+        case SC_CONTROL_MSG_TYPE_INJECT_TEXT: {
+            if (len < 5) {
+                return 0; // no complete message
+            }
+            size_t text_len = sc_read32be(&buf[1]);
+            if (text_len > len - 5) {
+                return 0; // no complete message
+            }
+            msg->inject_text.text = read_string(&buf[5], text_len);
+            if (!msg->inject_text.text) {
+                return -1;
+            }
+            return 5 + text_len;
+        }
+        case SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT:
+            if (len < 36) {
+                return 0; // no complete message
+            }
+            msg->inject_touch_event.action = buf[1];
+            msg->inject_touch_event.pointer_id = sc_read64be(&buf[2]);
+            read_position(&buf[10], &msg->inject_touch_event.position);
+            msg->inject_touch_event.pressure =
+                sc_u16fp_to_float(sc_read16be(&buf[22]));
+            msg->inject_touch_event.action_button = sc_read32be(&buf[24]);
+            msg->inject_touch_event.buttons = sc_read32be(&buf[28]);
+            msg->inject_touch_event.event_time =
+                SC_TICK_FROM_MS(sc_read32be(&buf[32]));
+            return 36;
+        case SC_CONTROL_MSG_TYPE_INJECT_SCROLL_EVENT:
+            if (len < 25) {
+                return 0; // no complete message
+            }
+            read_position(&buf[1], &msg->inject_scroll_event.position);
+            msg->inject_scroll_event.hscroll = read_scroll(&buf[13]);
+            msg->inject_scroll_event.vscroll = read_scroll(&buf[15]);
+            msg->inject_scroll_event.buttons = sc_read32be(&buf[17]);
+            msg->inject_scroll_event.event_time =
+                SC_TICK_FROM_MS(sc_read32be(&buf[21]));
+            return 25;
+        case SC_CONTROL_MSG_TYPE_BACK_OR_SCREEN_ON:
+            if (len < 2) {
+                return 0; // no complete message
+            }
+            msg->back_or_screen_on.action = buf[1];
+            return 2;
+        case SC_CONTROL_MSG_TYPE_GET_CLIPBOARD:
+            if (len < 2) {
+                return 0; // no complete message
+            }
+            msg->get_clipboard.copy_key = buf[1];
+            return 2;
+        case SC_CONTROL_MSG_TYPE_SET_CLIPBOARD: {
+            if (len < 14) {
+                return 0; // no complete message
+            }
+            size_t text_len = sc_read32be(&buf[10]);
+            if (text_len > len - 14) {
+                return 0; // no complete message
+            }
+            msg->set_clipboard.sequence = sc_read64be(&buf[1]);
+            msg->set_clipboard.paste = buf[9];
+            msg->set_clipboard.text = read_string(&buf[14], text_len);
+            if (!msg->set_clipboard.text) {
+                return -1;
+            }
+            return 14 + text_len;
+        }
+        case SC_CONTROL_MSG_TYPE_SET_DISPLAY_POWER:
+            if (len < 2) {
+                return 0; // no complete message
+            }
+            msg->set_display_power.on = buf[1];
+            return 2;
+        case SC_CONTROL_MSG_TYPE_UHID_INPUT: {
+            if (len < 5) {
+                return 0; // no complete message
+            }
+            size_t size = sc_read16be(&buf[3]);
+            if (size > SC_HID_MAX_SIZE) {
+                LOGW("UHID input too large: %" SC_PRIsizet, size);
+                return -1;
+            }
+            if (size > len - 5) {
+                return 0; // no complete message
+            }
+            msg->uhid_input.id = sc_read16be(&buf[1]);
+            msg->uhid_input.size = size;
+            memcpy(msg->uhid_input.data, &buf[5], size);
+            return 5 + size;
+        }
+        case SC_CONTROL_MSG_TYPE_UHID_DESTROY:
+            if (len < 3) {
+                return 0; // no complete message
+            }
+            msg->uhid_destroy.id = sc_read16be(&buf[1]);
+            return 3;
+        case SC_CONTROL_MSG_TYPE_START_APP: {
+            if (len < 2) {
+                return 0; // no complete message
+            }
+            size_t name_len = buf[1];
+            if (name_len > len - 2) {
+                return 0; // no complete message
+            }
+            msg->start_app.name = read_string(&buf[2], name_len);
+            if (!msg->start_app.name) {
+                return -1;
+            }
+            return 2 + name_len;
+        }
+        case SC_CONTROL_MSG_TYPE_EXPAND_NOTIFICATION_PANEL:
+        case SC_CONTROL_MSG_TYPE_EXPAND_SETTINGS_PANEL:
+        case SC_CONTROL_MSG_TYPE_COLLAPSE_PANELS:
+        case SC_CONTROL_MSG_TYPE_ROTATE_DEVICE:
+        case SC_CONTROL_MSG_TYPE_OPEN_HARD_KEYBOARD_SETTINGS:
+        case SC_CONTROL_MSG_TYPE_RESET_VIDEO:
+            // no additional data
+            return 1;
+        default:
+            // UHID_CREATE references static data, it cannot be deserialized
+            LOGW("Cannot deserialize message type: %u", (unsigned) msg->type);
+            return -1;
+    }
+}
+
+void
+sc_control_msg_encoder_init(struct sc_control_msg_encoder *encoder) {
+    encoder->touch_valid = false;
+    encoder->other_pointer_valid = false;
+}
+
+static size_t
+serialize_touch_compact(struct sc_control_msg_encoder *encoder,
+                        const struct sc_control_msg *msg, uint8_t *buf) {
+    uint64_t pointer_id = msg->inject_touch_event.pointer_id;
+    const struct sc_point *point = &msg->inject_touch_event.position.point;
+    const struct sc_size *size = &msg->inject_touch_event.position.screen_size;
+    uint16_t pressure = sc_float_to_u16fp(msg->inject_touch_event.pressure);
+    enum android_motionevent_buttons action_button =
+        msg->inject_touch_event.action_button;
+    enum android_motionevent_buttons buttons = msg->inject_touch_event.buttons;
+
+    bool valid = encoder->touch_valid;
+    uint8_t flags = 0;
+    size_t len = SC_CONTROL_MSG_TOUCH_COMPACT_HEADER_SIZE;
+
+    if (valid && pointer_id == encoder->pointers[0].id) {
+        // Same pointer as the last one, nothing to write
+    } else if (encoder->other_pointer_valid
+            && pointer_id == encoder->pointers[1].id) {
+        flags |= SC_CONTROL_MSG_TOUCH_COMPACT_FLAG_OTHER_POINTER;
+        // Swap the two pointers
+        struct sc_point other_point = encoder->pointers[1].point;
+        encoder->pointers[1] = encoder->pointers[0];
+        encoder->pointers[0].id = pointer_id;
+        encoder->pointers[0].point = other_point;
+    } else {
+        flags |= SC_CONTROL_MSG_TOUCH_COMPACT_FLAG_POINTER_ID;
+        sc_write64be(&buf[len], pointer_id);
+        len += 8;
+        // The new pointer position is relative to the last position
+        if (valid) {
+            encoder->pointers[1] = encoder->pointers[0];
+            encoder->other_pointer_valid = true;
+        }
+        encoder->pointers[0].id = pointer_id;
+    }
+
+    if (!valid || size->width != encoder->screen_size.width
+               || size->height != encoder->screen_size.height) {
+        flags |= SC_CONTROL_MSG_TOUCH_COMPACT_FLAG_SCREEN_SIZE;
+        sc_write16be(&buf[len], size->width);
+        sc_write16be(&buf[len + 2], size->height);
+        len += 4;
+    }
+
+    const struct sc_point *prev = &encoder->pointers[0].point;
+    int64_t dx = (int64_t) point->x - prev->x;
+    int64_t dy = (int64_t) point->y - prev->y;
+    if (valid && dx >= INT8_MIN && dx <= INT8_MAX
+              && dy >= INT8_MIN && dy <= INT8_MAX) {
+        flags |= SC_CONTROL_MSG_TOUCH_COMPACT_FLAG_DELTA8;
+        buf[len] = (uint8_t) (int8_t) dx;
+        buf[len + 1] = (uint8_t) (int8_t) dy;
+        len += 2;
+    } else if (valid && dx >= INT16_MIN && dx <= INT16_MAX
+                     && dy >= INT16_MIN && dy <= INT16_MAX) {
+        sc_write16be(&buf[len], (uint16_t) (int16_t) dx);
+        sc_write16be(&buf[len + 2], (uint16_t) (int16_t) dy);
+        len += 4;
+    } else {
+        flags |= SC_CONTROL_MSG_TOUCH_COMPACT_FLAG_ABSOLUTE;
+        sc_write32be(&buf[len], point->x);
+        sc_write32be(&buf[len + 4], point->y);
+        len += 8;
+    }
+
+    if (!valid || pressure != encoder->pressure) {
+        flags |= SC_CONTROL_MSG_TOUCH_COMPACT_FLAG_PRESSURE;
+        sc_write16be(&buf[len], pressure);
+        len += 2;
+    }
+
+    if (!valid || action_button != encoder->action_button
+               || buttons != encoder->buttons) {
+        flags |= SC_CONTROL_MSG_TOUCH_COMPACT_FLAG_BUTTONS;
+        sc_write32be(&buf[len], action_button);
+        sc_write32be(&buf[len + 4], buttons);
+        len += 8;
+    }
+
+    sc_tick event_time = msg->inject_touch_event.event_time;
+    if (event_time) {
+        flags |= SC_CONTROL_MSG_TOUCH_COMPACT_FLAG_EVENT_TIME;
+        write_event_time(&buf[len], event_time);
+        len += 4;
+    }
+
+    buf[0] = SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT_COMPACT;
+    buf[1] = flags;
+    buf[2] = msg->inject_touch_event.action;
+
+    encoder->touch_valid = true;
+    encoder->pointers[0].point = *point;
+    encoder->screen_size = *size;
+    encoder->pressure = pressure;
+    encoder->action_button = action_button;
+    encoder->buttons = buttons;
+
+    return len;
+}
+
+size_t
+sc_control_msg_serialize_compact(struct sc_control_msg_encoder *encoder,
+                                 const struct sc_control_msg *msg,
+                                 uint8_t *buf) {
+    if (msg->type == SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT) {
+        return serialize_touch_compact(encoder, msg, buf);
+    }
+
+    // No compact encoding for the other messages
+    return sc_control_msg_serialize(msg, buf);
+}
+
+size_t
+sc_control_msg_serialize_chunk(const uint8_t *data, size_t len, bool last,
+                               uint8_t *buf) {
+    assert(len <= SC_CONTROL_MSG_CHUNK_MAX_DATA);
+    buf[0] = SC_CONTROL_MSG_TYPE_CHUNK;
+    buf[1] = last ? SC_CONTROL_MSG_CHUNK_FLAG_LAST : 0;
+    sc_write16be(&buf[2], len);
+    memcpy(&buf[SC_CONTROL_MSG_CHUNK_HEADER_SIZE], data, len);
+    return SC_CONTROL_MSG_CHUNK_HEADER_SIZE + len;
+}
+
 void
 sc_control_msg_log(const struct sc_control_msg *msg) {
 #define LOG_CMSG(fmt, ...) LOGV("input: " fmt, ## __VA_ARGS__)
@@ -320,6 +669,11 @@ sc_control_msg_log(const struct sc_control_msg *msg) {
     }
 }
 
+const char *
+sc_control_msg_type_label(enum sc_control_msg_type type) {
+    return ENUM_TO_LABEL(control_msg_type_labels, type);
+}
+
 bool
 sc_control_msg_is_droppable(const struct sc_control_msg *msg) {
     // Cannot drop UHID_CREATE messages, because it would cause all further
@@ -330,17 +684,158 @@ sc_control_msg_is_droppable(const struct sc_control_msg *msg) {
         && msg->type != SC_CONTROL_MSG_TYPE_UHID_DESTROY;
 }
 
+bool
+sc_control_msg_is_touch_move(const struct sc_control_msg *msg) {
+    if (msg->type != SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT) {
+        return false;
+    }
+
+    enum android_motionevent_action action = msg->inject_touch_event.action;
+    return action == AMOTION_EVENT_ACTION_MOVE
+        || action == AMOTION_EVENT_ACTION_HOVER_MOVE;
+}
+
+static bool
+sc_control_msg_merge_touch_move(struct sc_control_msg *prev,
+                                const struct sc_control_msg *msg) {
+    if (!sc_control_msg_is_touch_move(prev)
+            || !sc_control_msg_is_touch_move(msg)) {
+        return false;
+    }
+
+    if (prev->inject_touch_event.pointer_id
+                != msg->inject_touch_event.pointer_id
+            || prev->inject_touch_event.action
+                != msg->inject_touch_event.action
+            || prev->inject_touch_event.action_button
+                != msg->inject_touch_event.action_button
+            || prev->inject_touch_event.buttons
+                != msg->inject_touch_event.buttons) {
+        return false;
+    }
+
+    // Only the latest position matters
+    prev->inject_touch_event.position = msg->inject_touch_event.position;
+    prev->inject_touch_event.pressure = msg->inject_touch_event.pressure;
+    prev->inject_touch_event.event_time = msg->inject_touch_event.event_time;
+    return true;
+}
+
+static bool
+sc_control_msg_merge_scroll(struct sc_control_msg *prev,
+                            const struct sc_control_msg *msg) {
+    if (prev->type != SC_CONTROL_MSG_TYPE_INJECT_SCROLL_EVENT
+            || msg->type != SC_CONTROL_MSG_TYPE_INJECT_SCROLL_EVENT) {
+        return false;
+    }
+
+    const struct sc_position *pos = &prev->inject_scroll_event.position;
+    const struct sc_position *msg_pos = &msg->inject_scroll_event.position;
+    if (pos->point.x != msg_pos->point.x
+            || pos->point.y != msg_pos->point.y
+            || pos->screen_size.width != msg_pos->screen_size.width
+            || pos->screen_size.height != msg_pos->screen_size.height
+            || prev->inject_scroll_event.buttons
+                != msg->inject_scroll_event.buttons) {
+        return false;
+    }
+
+    float hscroll = prev->inject_scroll_event.hscroll;
+    float vscroll = prev->inject_scroll_event.vscroll;
+    float msg_hscroll = msg->inject_scroll_event.hscroll;
+    float msg_vscroll = msg->inject_scroll_event.vscroll;
+
+    // A change of direction must not be cancelled out
+    if (hscroll * msg_hscroll < 0 || vscroll * msg_vscroll < 0) {
+        return false;
+    }
+
+    hscroll += msg_hscroll;
+    vscroll += msg_vscroll;
+    if (hscroll < -SC_CONTROL_MSG_SCROLL_MAX
+            || hscroll > SC_CONTROL_MSG_SCROLL_MAX
+            || vscroll < -SC_CONTROL_MSG_SCROLL_MAX
+            || vscroll > SC_CONTROL_MSG_SCROLL_MAX) {
+        return false;
+    }
+
+    prev->inject_scroll_event.hscroll = hscroll;
+    prev->inject_scroll_event.vscroll = vscroll;
+    prev->inject_scroll_event.event_time = msg->inject_scroll_event.event_time;
+    return true;
+}
+
+static bool
+sc_control_msg_is_hid_mouse_input(const struct sc_control_msg *msg) {
+    return msg->type == SC_CONTROL_MSG_TYPE_UHID_INPUT
+        && msg->uhid_input.id == SC_HID_ID_MOUSE
+        && msg->uhid_input.size == SC_HID_MOUSE_INPUT_SIZE;
+}
+
+bool
+sc_control_msg_is_bulk(const struct sc_control_msg *msg) {
+    return msg->type == SC_CONTROL_MSG_TYPE_INJECT_TEXT
+        || msg->type == SC_CONTROL_MSG_TYPE_SET_CLIPBOARD
+        || msg->type == SC_CONTROL_MSG_TYPE_START_APP;
+}
+
+bool
+sc_control_msg_is_pointer_event(const struct sc_control_msg *msg) {
+    return msg->type == SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT
+        || msg->type == SC_CONTROL_MSG_TYPE_INJECT_SCROLL_EVENT
+        || sc_control_msg_is_hid_mouse_input(msg);
+}
+
+static bool
+sc_control_msg_merge_hid_mouse_input(struct sc_control_msg *prev,
+                                     const struct sc_control_msg *msg) {
+    if (!sc_control_msg_is_hid_mouse_input(prev)
+            || !sc_control_msg_is_hid_mouse_input(msg)) {
+        return false;
+    }
+
+    uint8_t *dst = prev->uhid_input.data;
+    const uint8_t *src = msg->uhid_input.data;
+
+    // data[0] contains the buttons state
+    if (dst[0] != src[0]) {
+        return false;
+    }
+
+    // data[1], data[2] and data[3] contain the relative x, y and wheel motion
+    int sums[3];
+    for (int i = 0; i < 3; ++i) {
+        sums[i] = (int8_t) dst[i + 1] + (int8_t) src[i + 1];
+        if (sums[i] < -127 || sums[i] > 127) {
+            return false;
+        }
+    }
+
+    for (int i = 0; i < 3; ++i) {
+        dst[i + 1] = (uint8_t) (int8_t) sums[i];
+    }
+    return true;
+}
+
+bool
+sc_control_msg_merge(struct sc_control_msg *prev,
+                     const struct sc_control_msg *msg) {
+    return sc_control_msg_merge_touch_move(prev, msg)
+        || sc_control_msg_merge_scroll(prev, msg)
+        || sc_control_msg_merge_hid_mouse_input(prev, msg);
+}
+
 void
 sc_control_msg_destroy(struct sc_control_msg *msg) {
     switch (msg->type) {
         case SC_CONTROL_MSG_TYPE_INJECT_TEXT:
-            free(msg->inject_text.text);
+            free((char *) msg->inject_text.text);
             break;
         case SC_CONTROL_MSG_TYPE_SET_CLIPBOARD:
-            free(msg->set_clipboard.text);
+            free((char *) msg->set_clipboard.text);
             break;
         case SC_CONTROL_MSG_TYPE_START_APP:
-            free(msg->start_app.name);
+            free((char *) msg->start_app.name);
             break;
         default:
             // do nothing
@@ -6,17 +6,53 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <sys/types.h>
 
 #include "android/input.h"
 #include "android/keycodes.h"
 #include "coords.h"
 #include "hid/hid_event.h"
+#include "util/tick.h"
 
 #define SC_CONTROL_MSG_MAX_SIZE (1 << 18) // 256k
 
 #define SC_CONTROL_MSG_INJECT_TEXT_MAX_LENGTH 300
 // type: 1 byte; sequence: 8 bytes; paste flag: 1 byte; length: 4 bytes
 #define SC_CONTROL_MSG_CLIPBOARD_TEXT_MAX_LENGTH (SC_CONTROL_MSG_MAX_SIZE - 14)
+#define SC_CONTROL_MSG_START_APP_NAME_MAX_LENGTH 255
+
+// Maximum scroll amount (in each direction) of a single scroll event, which
+// may result from the accumulation of several input events
+#define SC_CONTROL_MSG_SCROLL_MAX 16
+
+// A serialized message larger than SC_CONTROL_MSG_CHUNK_MAX_DATA is sent in
+// several chunks, reassembled by the server
+// type: 1 byte; flags: 1 byte; length: 2 bytes
+#define SC_CONTROL_MSG_CHUNK_HEADER_SIZE 4
+#define SC_CONTROL_MSG_CHUNK_MAX_DATA 4096
+#define SC_CONTROL_MSG_CHUNK_FLAG_LAST 1
+
+// Compact touch event: the fields equal to those of the previous compact
+// touch event are omitted, and the position is delta-encoded (relative to the
+// last position of the same pointer, the last two pointers being tracked)
+// type: 1 byte; flags: 1 byte; action: 1 byte
+#define SC_CONTROL_MSG_TOUCH_COMPACT_HEADER_SIZE 3
+// The pointer id follows (8 bytes), for a pointer not tracked
+#define SC_CONTROL_MSG_TOUCH_COMPACT_FLAG_POINTER_ID 0x01
+// The screen size follows (2 + 2 bytes)
+#define SC_CONTROL_MSG_TOUCH_COMPACT_FLAG_SCREEN_SIZE 0x02
+// The position is absolute (4 + 4 bytes), rather than a delta (2 + 2 bytes)
+#define SC_CONTROL_MSG_TOUCH_COMPACT_FLAG_ABSOLUTE 0x04
+// The position is a small delta (1 + 1 bytes)
+#define SC_CONTROL_MSG_TOUCH_COMPACT_FLAG_DELTA8 0x08
+// The pressure follows (2 bytes)
+#define SC_CONTROL_MSG_TOUCH_COMPACT_FLAG_PRESSURE 0x10
+// The action button and the buttons follow (4 + 4 bytes)
+#define SC_CONTROL_MSG_TOUCH_COMPACT_FLAG_BUTTONS 0x20
+// The pointer is the one before the last one (for multi-touch)
+#define SC_CONTROL_MSG_TOUCH_COMPACT_FLAG_OTHER_POINTER 0x40
+// The event time follows (4 bytes)
+#define SC_CONTROL_MSG_TOUCH_COMPACT_FLAG_EVENT_TIME 0x80
 
 #define SC_POINTER_ID_MOUSE UINT64_C(-1)
 #define SC_POINTER_ID_GENERIC_FINGER UINT64_C(-2)
@@ -43,6 +79,10 @@ enum sc_control_msg_type {
     SC_CONTROL_MSG_TYPE_OPEN_HARD_KEYBOARD_SETTINGS,
     SC_CONTROL_MSG_TYPE_START_APP,
     SC_CONTROL_MSG_TYPE_RESET_VIDEO,
+    // Never queued, see sc_control_msg_serialize_chunk()
+    SC_CONTROL_MSG_TYPE_CHUNK,
+    // Never queued, see sc_control_msg_serialize_compact()
+    SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT_COMPACT,
 };
 
 enum sc_copy_key {
@@ -53,6 +93,9 @@ enum sc_copy_key {
 
 struct sc_control_msg {
     enum sc_control_msg_type type;
+    // Not serialized: the time of the input event which generated the message
+    // (or the time it was pushed), set by the controller
+    sc_tick timestamp;
     union {
         struct {
             enum android_keyevent_action action;
@@ -60,8 +103,10 @@ struct sc_control_msg {
             uint32_t repeat;
             enum android_metastate metastate;
         } inject_keycode;
+        // The text payloads are borrowed: the controller copies them on push
+        // (only a deserialized message owns them, see sc_control_msg_destroy())
         struct {
-            char *text; // owned, to be freed by free()
+            const char *text;
         } inject_text;
         struct {
             enum android_motionevent_action action;
@@ -70,12 +115,16 @@ struct sc_control_msg {
             uint64_t pointer_id;
             struct sc_position position;
             float pressure;
+            // The capture time of the input event (0 if unknown), set by the
+            // controller and sent to the device (in milliseconds)
+            sc_tick event_time;
         } inject_touch_event;
         struct {
             struct sc_position position;
             float hscroll;
             float vscroll;
             enum android_motionevent_buttons buttons;
+            sc_tick event_time; // same as inject_touch_event.event_time
         } inject_scroll_event;
         struct {
             enum android_keyevent_action action; // action for the BACK key
@@ -86,7 +135,7 @@ struct sc_control_msg {
         } get_clipboard;
         struct {
             uint64_t sequence;
-            char *text; // owned, to be freed by free()
+            const char *text;
             bool paste;
         } set_clipboard;
         struct {
@@ -109,24 +158,104 @@ struct sc_control_msg {
             uint16_t id;
         } uhid_destroy;
         struct {
-            char *name;
+            const char *name;
         } start_app;
     };
 };
 
+// State of the compact encoding, shared by the successive messages (the
+// server maintains the same state to decode them)
+struct sc_control_msg_encoder {
+    // The last compact touch event (if touch_valid)
+    bool touch_valid;
+    // The last two pointers (the last one first) and their last positions
+    struct {
+        uint64_t id;
+        struct sc_point point;
+    } pointers[2];
+    bool other_pointer_valid; // pointers[1] is set
+    struct sc_size screen_size;
+    uint16_t pressure; // fixed-point
+    enum android_motionevent_buttons action_button;
+    enum android_motionevent_buttons buttons;
+};
+
 // buf size must be at least CONTROL_MSG_MAX_SIZE
 // return the number of bytes written
 size_t
 sc_control_msg_serialize(const struct sc_control_msg *msg, uint8_t *buf);
 
+void
+sc_control_msg_encoder_init(struct sc_control_msg_encoder *encoder);
+
+// Serialize a message using the compact encoding if any (for touch events),
+// which depends on the messages previously serialized by the same encoder:
+// all the messages must be sent in order
+// buf size must be at least CONTROL_MSG_MAX_SIZE
+// return the number of bytes written
+size_t
+sc_control_msg_serialize_compact(struct sc_control_msg_encoder *encoder,
+                                 const struct sc_control_msg *msg,
+                                 uint8_t *buf);
+
+// Deserialize a message serialized by sc_control_msg_serialize() (UHID_CREATE
+// is not supported)
+// The message must be destroyed by sc_control_msg_destroy()
+// return the number of bytes read, 0 if the message is not complete, or -1 on
+// error
+ssize_t
+sc_control_msg_deserialize(const uint8_t *buf, size_t len,
+                           struct sc_control_msg *msg);
+
+// Serialize a chunk of a serialized message (at most
+// SC_CONTROL_MSG_CHUNK_MAX_DATA bytes)
+// buf size must be at least SC_CONTROL_MSG_CHUNK_HEADER_SIZE + len
+// return the number of bytes written
+size_t
+sc_control_msg_serialize_chunk(const uint8_t *data, size_t len, bool last,
+                               uint8_t *buf);
+
 void
 sc_control_msg_log(const struct sc_control_msg *msg);
 
+const char *
+sc_control_msg_type_label(enum sc_control_msg_type type);
+
 // Even when the buffer is "full", some messages must absolutely not be dropped
 // to avoid inconsistencies.
 bool
 sc_control_msg_is_droppable(const struct sc_control_msg *msg);
 
+// Bulk messages (text, clipboard, app name) may be large, and must not delay
+// the input events
+bool
+sc_control_msg_is_bulk(const struct sc_control_msg *msg);
+
+// Pointer events (touch, scroll and HID mouse input) are the only messages
+// which may be sent before the bulk messages pushed before them
+bool
+sc_control_msg_is_pointer_event(const struct sc_control_msg *msg);
+
+// Return true if msg is a touch move (or hover move) event, which may be
+// merged into a previous move event of the same pointer
+bool
+sc_control_msg_is_touch_move(const struct sc_control_msg *msg);
+
+// Merge msg into prev, a previous message not sent yet, if the result is
+// equivalent to sending prev then msg:
+//  - a touch move event replaces a move event of the same pointer (with the
+//    same action and buttons);
+//  - a scroll event is summed into a previous scroll event at the same
+//    position (with the same buttons) scrolling in the same direction, as
+//    long as the result does not exceed SC_CONTROL_MSG_SCROLL_MAX;
+//  - a relative UHID mouse report is summed into the previous one (with the
+//    same buttons), as long as the result fits in a report.
+// Return true if msg has been merged (it must then not be sent).
+bool
+sc_control_msg_merge(struct sc_control_msg *prev,
+                     const struct sc_control_msg *msg);
+
+// Free the payload of a message returned by sc_control_msg_deserialize()
 void
 sc_control_msg_destroy(struct sc_control_msg *msg);
 
@@ -0,0 +1,198 @@
+#include "control_msg_queue.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/log.h"
+#include "util/str.h"
+
+bool
+sc_control_msg_queue_init(struct sc_control_msg_queue *queue, size_t capacity,
+                          size_t arena_capacity) {
+    assert(capacity);
+
+    queue->slots = calloc(capacity, sizeof(*queue->slots));
+    if (!queue->slots) {
+        LOG_OOM();
+        return false;
+    }
+
+    if (arena_capacity) {
+        queue->arena = malloc(arena_capacity);
+        if (!queue->arena) {
+            LOG_OOM();
+            free(queue->slots);
+            return false;
+        }
+    } else {
+        queue->arena = NULL;
+    }
+
+    queue->capacity = capacity;
+    queue->head = 0;
+    queue->taken = 0;
+    queue->size = 0;
+    queue->arena_capacity = arena_capacity;
+    queue->arena_head = 0;
+    queue->arena_used = 0;
+    return true;
+}
+
+void
+sc_control_msg_queue_destroy(struct sc_control_msg_queue *queue) {
+    for (size_t i = 0; i < queue->size; ++i) {
+        size_t index = (queue->head + i) % queue->capacity;
+        free(queue->slots[index].allocated);
+    }
+    free(queue->arena);
+    free(queue->slots);
+}
+
+// Return a reference to the text payload of msg (or NULL if it has none)
+static const char **
+get_text_ref(struct sc_control_msg *msg, size_t *max_len) {
+    switch (msg->type) {
+        case SC_CONTROL_MSG_TYPE_INJECT_TEXT:
+            *max_len = SC_CONTROL_MSG_INJECT_TEXT_MAX_LENGTH;
+            return &msg->inject_text.text;
+        case SC_CONTROL_MSG_TYPE_SET_CLIPBOARD:
+            *max_len = SC_CONTROL_MSG_CLIPBOARD_TEXT_MAX_LENGTH;
+            return &msg->set_clipboard.text;
+        case SC_CONTROL_MSG_TYPE_START_APP:
+            *max_len = SC_CONTROL_MSG_START_APP_NAME_MAX_LENGTH;
+            return &msg->start_app.name;
+        default:
+            return NULL;
+    }
+}
+
+// Reserve size contiguous bytes in the arena, and return their offset, or -1
+// if there is not enough free space
+static ssize_t
+arena_reserve(struct sc_control_msg_queue *queue, size_t size,
+              size_t *reserved) {
+    size_t cap = queue->arena_capacity;
+    if (!queue->arena_used) {
+        // Restart from the beginning, to maximize the contiguous space
+        queue->arena_head = 0;
+    }
+
+    size_t tail = (queue->arena_head + queue->arena_used) % cap;
+    if (queue->arena_used && tail <= queue->arena_head) {
+        // The free space is between the tail and the head
+        if (size > queue->arena_head - tail) {
+            return -1;
+        }
+        *reserved = size;
+        return tail;
+    }
+
+    // The free space is after the tail, then before the head
+    if (size <= cap - tail) {
+        *reserved = size;
+        return tail;
+    }
+    if (size <= queue->arena_head) {
+        // Skip the end of the arena
+        *reserved = cap - tail + size;
+        return 0;
+    }
+    return -1;
+}
+
+static bool
+sc_control_msg_queue_copy_text(struct sc_control_msg_queue *queue,
+                               struct sc_control_msg_queue_slot *slot) {
+    slot->arena_size = 0;
+    slot->allocated = NULL;
+
+    size_t max_len;
+    const char **ref = get_text_ref(&slot->msg, &max_len);
+    if (!ref || !*ref) {
+        // No payload
+        return true;
+    }
+
+    const char *text = *ref;
+    size_t len = sc_str_utf8_truncation_index(text, max_len);
+
+    char *copy;
+    if (len < sizeof(slot->inline_text)) {
+        copy = slot->inline_text;
+    } else {
+        size_t reserved;
+        ssize_t offset = queue->arena_capacity
+                       ? arena_reserve(queue, len + 1, &reserved)
+                       : -1;
+        if (offset >= 0) {
+            copy = &queue->arena[offset];
+            slot->arena_size = reserved;
+            queue->arena_used += reserved;
+        } else {
+            copy = malloc(len + 1);
+            if (!copy) {
+                LOG_OOM();
+                return false;
+            }
+            slot->allocated = copy;
+        }
+    }
+
+    memcpy(copy, text, len);
+    copy[len] = '\0';
+    *ref = copy;
+    return true;
+}
+
+bool
+sc_control_msg_queue_push(struct sc_control_msg_queue *queue,
+                          const struct sc_control_msg *msg) {
+    if (sc_control_msg_queue_is_full(queue)) {
+        return false;
+    }
+
+    size_t index = (queue->head + queue->size) % queue->capacity;
+    struct sc_control_msg_queue_slot *slot = &queue->slots[index];
+    slot->msg = *msg;
+    if (!sc_control_msg_queue_copy_text(queue, slot)) {
+        return false;
+    }
+
+    ++queue->size;
+    return true;
+}
+
+struct sc_control_msg *
+sc_control_msg_queue_get(struct sc_control_msg_queue *queue, size_t index) {
+    assert(index < sc_control_msg_queue_pending(queue));
+    index = (queue->head + queue->taken + index) % queue->capacity;
+    return &queue->slots[index].msg;
+}
+
+const struct sc_control_msg *
+sc_control_msg_queue_take(struct sc_control_msg_queue *queue) {
+    assert(sc_control_msg_queue_pending(queue));
+    size_t index = (queue->head + queue->taken) % queue->capacity;
+    ++queue->taken;
+    return &queue->slots[index].msg;
+}
+
+void
+sc_control_msg_queue_release(struct sc_control_msg_queue *queue) {
+    assert(queue->taken);
+    struct sc_control_msg_queue_slot *slot = &queue->slots[queue->head];
+
+    free(slot->allocated);
+    if (slot->arena_size) {
+        // The arena is released in the same order as it is reserved
+        assert(slot->arena_size <= queue->arena_used);
+        queue->arena_head =
+            (queue->arena_head + slot->arena_size) % queue->arena_capacity;
+        queue->arena_used -= slot->arena_size;
+    }
+
+    queue->head = (queue->head + 1) % queue->capacity;
+    --queue->taken;
+    --queue->size;
+}
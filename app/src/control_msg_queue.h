@@ -0,0 +1,100 @@
+#ifndef SC_CONTROL_MSG_QUEUE_H
+#define SC_CONTROL_MSG_QUEUE_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "control_msg.h"
+
+/**
+ * Fixed-capacity queue of control messages
+ *
+ * All the memory is allocated on init, so that pushing and releasing messages
+ * never allocates: the messages are stored in a ring of slots, and their text
+ * payload (if any) is copied either inline in the slot (short texts, like
+ * typed characters), or in an arena (a ring buffer, allocated and released in
+ * the same order as the messages). Only a payload larger than the free space
+ * in the arena (a large clipboard) is allocated separately.
+ *
+ * The oldest messages may be taken to be processed outside of the lock
+ * protecting the queue: they remain valid (and are not pending anymore) until
+ * they are released.
+ *
+ * The queue itself is not thread-safe.
+ */
+
+// Fits any SDL text input event
+#define SC_CONTROL_MSG_QUEUE_INLINE_SIZE 32
+
+struct sc_control_msg_queue_slot {
+    struct sc_control_msg msg;
+    char inline_text[SC_CONTROL_MSG_QUEUE_INLINE_SIZE];
+    size_t arena_size; // bytes reserved in the arena (including padding)
+    char *allocated; // payload allocated out of the arena, or NULL
+};
+
+struct sc_control_msg_queue {
+    struct sc_control_msg_queue_slot *slots;
+    size_t capacity;
+    size_t head; // the oldest message (taken or not)
+    size_t taken; // messages taken and not released yet
+    size_t size; // all the messages (taken or not)
+
+    char *arena;
+    size_t arena_capacity;
+    size_t arena_head; // start of the oldest reservation
+    size_t arena_used;
+};
+
+bool
+sc_control_msg_queue_init(struct sc_control_msg_queue *queue, size_t capacity,
+                          size_t arena_capacity);
+
+// Free the payloads of the remaining messages
+void
+sc_control_msg_queue_destroy(struct sc_control_msg_queue *queue);
+
+// Return true if the queue contains no message, neither pending nor taken
+static inline bool
+sc_control_msg_queue_is_empty(const struct sc_control_msg_queue *queue) {
+    return !queue->size;
+}
+
+static inline bool
+sc_control_msg_queue_is_full(const struct sc_control_msg_queue *queue) {
+    return queue->size == queue->capacity;
+}
+
+// Return the number of pending messages (pushed and not taken)
+static inline size_t
+sc_control_msg_queue_pending(const struct sc_control_msg_queue *queue) {
+    return queue->size - queue->taken;
+}
+
+/**
+ * Push a copy of a message, including its text payload (truncated to its
+ * maximum serialized length)
+ *
+ * The caller keeps the ownership of the text payload of msg.
+ *
+ * Return false if the queue is full (or on allocation failure).
+ */
+bool
+sc_control_msg_queue_push(struct sc_control_msg_queue *queue,
+                          const struct sc_control_msg *msg);
+
+// Return the pending message at index (0 is the oldest)
+struct sc_control_msg *
+sc_control_msg_queue_get(struct sc_control_msg_queue *queue, size_t index);
+
+// Take the oldest pending message, which remains valid until it is released
+const struct sc_control_msg *
+sc_control_msg_queue_take(struct sc_control_msg_queue *queue);
+
+// Release the oldest taken message
+void
+sc_control_msg_queue_release(struct sc_control_msg_queue *queue);
+
+#endif
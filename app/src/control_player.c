@@ -0,0 +1,232 @@
+#include "control_player.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "control_recorder.h"
+#include "util/acksync.h"
+#include "util/binary.h"
+#include "util/log.h"
+
+// Delay before retrying to push a message if the controller queue is full
+#define SC_CONTROL_PLAYER_RETRY_DELAY SC_TICK_FROM_MS(1)
+
+// Wait until the deadline, return false if the player is stopped
+static bool
+sc_control_player_wait(struct sc_control_player *player, sc_tick deadline) {
+    sc_mutex_lock(&player->mutex);
+    bool timed_out = false;
+    while (!player->stopped && !timed_out) {
+        timed_out = !sc_cond_timedwait(&player->cond, &player->mutex, deadline);
+    }
+    bool stopped = player->stopped;
+    sc_mutex_unlock(&player->mutex);
+
+    return !stopped;
+}
+
+static bool
+sc_control_player_is_stopped(struct sc_control_player *player) {
+    sc_mutex_lock(&player->mutex);
+    bool stopped = player->stopped;
+    sc_mutex_unlock(&player->mutex);
+    return stopped;
+}
+
+// Read the next message, return 1 on success, 0 on end of file, -1 on error
+static int
+sc_control_player_read(struct sc_control_player *player, uint8_t *buf,
+                       sc_tick *pts, size_t *len) {
+    uint8_t header[SC_CONTROL_RECORD_MSG_HEADER_SIZE];
+    size_t r = fread(header, 1, sizeof(header), player->file);
+    if (!r && feof(player->file)) {
+        return 0;
+    }
+    if (r != sizeof(header)) {
+        LOGE("Control replay: truncated file");
+        return -1;
+    }
+
+    *pts = sc_read64be(&header[0]);
+    *len = sc_read32be(&header[8]);
+    if (!*len || *len > SC_CONTROL_MSG_MAX_SIZE) {
+        LOGE("Control replay: invalid message length: %" SC_PRIsizet, *len);
+        return -1;
+    }
+
+    if (fread(buf, *len, 1, player->file) != 1) {
+        LOGE("Control replay: truncated file");
+        return -1;
+    }
+
+    return 1;
+}
+
+static int
+run_control_player(void *data) {
+    struct sc_control_player *player = data;
+
+    uint8_t *buf = malloc(SC_CONTROL_MSG_MAX_SIZE);
+    if (!buf) {
+        LOG_OOM();
+        return 0;
+    }
+
+    uint64_t count = 0;
+    uint64_t skipped = 0;
+    sc_tick start = sc_tick_now();
+
+    for (;;) {
+        sc_tick pts;
+        size_t len;
+        int r = sc_control_player_read(player, buf, &pts, &len);
+        if (r <= 0) {
+            break;
+        }
+
+        if (buf[0] == SC_CONTROL_MSG_TYPE_UHID_CREATE
+                || buf[0] == SC_CONTROL_MSG_TYPE_UHID_DESTROY) {
+            // The UHID devices of the current session are used
+            ++skipped;
+            continue;
+        }
+
+        struct sc_control_msg msg;
+        ssize_t consumed = sc_control_msg_deserialize(buf, len, &msg);
+        if (consumed != (ssize_t) len) {
+            if (consumed > 0) {
+                sc_control_msg_destroy(&msg);
+            }
+            LOGE("Control replay: invalid message");
+            break;
+        }
+
+        if (msg.type == SC_CONTROL_MSG_TYPE_SET_CLIPBOARD) {
+            // Do not expect any acknowledgement
+            msg.set_clipboard.sequence = SC_SEQUENCE_INVALID;
+        }
+
+        if (player->speed) {
+            sc_tick deadline = start + (sc_tick) (pts / player->speed);
+            if (!sc_control_player_wait(player, deadline)) {
+                sc_control_msg_destroy(&msg);
+                break;
+            }
+        }
+
+        // Do not lose any message if the controller queue is full
+        bool pushed;
+        while (!(pushed = sc_controller_push_msg(player->controller, &msg))) {
+            sc_tick deadline = sc_tick_now() + SC_CONTROL_PLAYER_RETRY_DELAY;
+            if (!sc_control_player_wait(player, deadline)) {
+                break;
+            }
+        }
+
+        // The payload has been copied by the controller
+        sc_control_msg_destroy(&msg);
+        if (!pushed) {
+            break;
+        }
+
+        ++count;
+    }
+
+    free(buf);
+
+    if (!sc_control_player_is_stopped(player)) {
+        sc_tick duration = sc_tick_now() - start;
+        LOGI("Control replay: %" PRIu64 " messages pushed in %" PRItick
+             " ms (%" PRIu64 " UHID device messages skipped)", count,
+             SC_TICK_TO_MS(duration), skipped);
+    }
+
+    return 0;
+}
+
+bool
+sc_control_player_init(struct sc_control_player *player,
+                       const struct sc_control_player_params *params) {
+    assert(params->controller);
+    assert(params->speed >= 0);
+
+    player->file = fopen(params->filename, "rb");
+    if (!player->file) {
+        LOGE("Could not open control record file %s: %s", params->filename,
+             strerror(errno));
+        return false;
+    }
+
+    uint8_t header[SC_CONTROL_RECORD_HEADER_SIZE];
+    if (fread(header, sizeof(header), 1, player->file) != 1
+            || memcmp(header, SC_CONTROL_RECORD_MAGIC, 4)) {
+        LOGE("Invalid control record file: %s", params->filename);
+        goto error_close_file;
+    }
+
+    uint32_t version = sc_read32be(&header[4]);
+    if (version != SC_CONTROL_RECORD_VERSION) {
+        LOGE("Unsupported control record version: %" PRIu32, version);
+        goto error_close_file;
+    }
+
+    bool ok = sc_mutex_init(&player->mutex);
+    if (!ok) {
+        goto error_close_file;
+    }
+
+    ok = sc_cond_init(&player->cond);
+    if (!ok) {
+        goto error_mutex_destroy;
+    }
+
+    player->controller = params->controller;
+    player->speed = params->speed;
+    player->stopped = false;
+
+    return true;
+
+error_mutex_destroy:
+    sc_mutex_destroy(&player->mutex);
+error_close_file:
+    fclose(player->file);
+
+    return false;
+}
+
+bool
+sc_control_player_start(struct sc_control_player *player) {
+    LOGD("Starting control player thread");
+
+    bool ok = sc_thread_create(&player->thread, run_control_player,
+                               "scrcpy-ctlplay", player);
+    if (!ok) {
+        LOGE("Could not start control player thread");
+        return false;
+    }
+
+    return true;
+}
+
+void
+sc_control_player_stop(struct sc_control_player *player) {
+    sc_mutex_lock(&player->mutex);
+    player->stopped = true;
+    sc_cond_signal(&player->cond);
+    sc_mutex_unlock(&player->mutex);
+}
+
+void
+sc_control_player_join(struct sc_control_player *player) {
+    sc_thread_join(&player->thread, NULL);
+}
+
+void
+sc_control_player_destroy(struct sc_control_player *player) {
+    sc_cond_destroy(&player->cond);
+    sc_mutex_destroy(&player->mutex);
+    fclose(player->file);
+}
@@ -0,0 +1,57 @@
+#ifndef SC_CONTROL_PLAYER_H
+#define SC_CONTROL_PLAYER_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "controller.h"
+#include "util/thread.h"
+
+/**
+ * Control player
+ *
+ * Push the control messages recorded by a control recorder back to the
+ * controller, with their original timing (possibly time-scaled), or as fast as
+ * possible.
+ *
+ * The UHID devices are not recreated: the recorded UHID input messages only
+ * work if scrcpy is started with the same keyboard and mouse modes.
+ */
+
+struct sc_control_player {
+    struct sc_controller *controller;
+    FILE *file;
+    // Playback speed factor (0 to push the messages as fast as possible)
+    double speed;
+
+    sc_thread thread;
+    sc_mutex mutex;
+    sc_cond cond;
+    bool stopped;
+};
+
+struct sc_control_player_params {
+    struct sc_controller *controller;
+    const char *filename;
+    double speed;
+};
+
+bool
+sc_control_player_init(struct sc_control_player *player,
+                       const struct sc_control_player_params *params);
+
+bool
+sc_control_player_start(struct sc_control_player *player);
+
+void
+sc_control_player_stop(struct sc_control_player *player);
+
+void
+sc_control_player_join(struct sc_control_player *player);
+
+void
+sc_control_player_destroy(struct sc_control_player *player);
+
+#endif
@@ -0,0 +1,94 @@
+#include "control_recorder.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/binary.h"
+#include "util/log.h"
+
+bool
+sc_control_recorder_init(struct sc_control_recorder *recorder,
+                         const char *filename) {
+    recorder->buffer = malloc(SC_CONTROL_MSG_MAX_SIZE);
+    if (!recorder->buffer) {
+        LOG_OOM();
+        return false;
+    }
+
+    recorder->file = fopen(filename, "wb");
+    if (!recorder->file) {
+        LOGE("Could not open control record file %s: %s", filename,
+             strerror(errno));
+        goto error_free_buffer;
+    }
+
+    uint8_t header[SC_CONTROL_RECORD_HEADER_SIZE];
+    memcpy(header, SC_CONTROL_RECORD_MAGIC, 4);
+    sc_write32be(&header[4], SC_CONTROL_RECORD_VERSION);
+    if (fwrite(header, sizeof(header), 1, recorder->file) != 1) {
+        LOGE("Could not write control record file %s", filename);
+        goto error_close_file;
+    }
+
+    recorder->start = 0;
+    recorder->count = 0;
+    recorder->failed = false;
+
+    LOGI("Recording control messages to %s", filename);
+    return true;
+
+error_close_file:
+    fclose(recorder->file);
+error_free_buffer:
+    free(recorder->buffer);
+
+    return false;
+}
+
+void
+sc_control_recorder_destroy(struct sc_control_recorder *recorder) {
+    if (fclose(recorder->file) && !recorder->failed) {
+        LOGE("Could not close the control record file: %s", strerror(errno));
+    }
+
+    free(recorder->buffer);
+
+    LOGI("Control messages recorded: %" PRIu64, recorder->count);
+}
+
+void
+sc_control_recorder_write(struct sc_control_recorder *recorder,
+                          const struct sc_control_msg *msg) {
+    if (recorder->failed) {
+        return;
+    }
+
+    sc_tick timestamp = msg->timestamp;
+    size_t len = sc_control_msg_serialize(msg, recorder->buffer);
+    if (!len) {
+        return;
+    }
+
+    if (!recorder->start) {
+        recorder->start = timestamp;
+    }
+
+    // The messages are recorded in the order they are sent, which may differ
+    // slightly from the order of their input events
+    sc_tick pts = MAX(timestamp - recorder->start, 0);
+
+    uint8_t header[SC_CONTROL_RECORD_MSG_HEADER_SIZE];
+    sc_write64be(&header[0], pts);
+    sc_write32be(&header[8], len);
+    if (fwrite(header, sizeof(header), 1, recorder->file) != 1
+            || fwrite(recorder->buffer, len, 1, recorder->file) != 1) {
+        LOGE("Could not write control record, recording stopped");
+        recorder->failed = true;
+        return;
+    }
+
+    ++recorder->count;
+}
@@ -0,0 +1,59 @@
+#ifndef SC_CONTROL_RECORDER_H
+#define SC_CONTROL_RECORDER_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "control_msg.h"
+#include "util/tick.h"
+
+/**
+ * Control recorder
+ *
+ * Record the control messages sent to the device, with their timestamps, so
+ * that they can be replayed later (see control_player.h).
+ *
+ * File format (all values are big-endian):
+ *  - header: magic "SCCR" (4 bytes), version (4 bytes);
+ *  - then for each message:
+ *     - timestamp in microseconds, relative to the first message (8 bytes);
+ *     - length (4 bytes);
+ *     - the message, serialized by sc_control_msg_serialize() (the full
+ *       encoding, which does not depend on the previous messages, even if the
+ *       compact encoding was sent to the device).
+ */
+
+#define SC_CONTROL_RECORD_MAGIC "SCCR"
+#define SC_CONTROL_RECORD_VERSION 1
+#define SC_CONTROL_RECORD_HEADER_SIZE 8
+#define SC_CONTROL_RECORD_MSG_HEADER_SIZE 12
+
+struct sc_control_recorder {
+    // All the fields are accessed only from the controller thread (except on
+    // init and destroy)
+    FILE *file;
+    uint8_t *buffer; // SC_CONTROL_MSG_MAX_SIZE bytes
+    sc_tick start; // timestamp of the first message (0 if none)
+    uint64_t count;
+    bool failed;
+};
+
+bool
+sc_control_recorder_init(struct sc_control_recorder *recorder,
+                         const char *filename);
+
+void
+sc_control_recorder_destroy(struct sc_control_recorder *recorder);
+
+/**
+ * Record a message (with the time of its input event)
+ */
+void
+sc_control_recorder_write(struct sc_control_recorder *recorder,
+                          const struct sc_control_msg *msg);
+
+#endif
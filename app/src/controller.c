@@ -1,11 +1,28 @@
 #include "controller.h"
 
 #include <assert.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "util/log.h"
 
 // Drop droppable events above this limit
 #define SC_CONTROL_MSG_QUEUE_LIMIT 60
+// Additional room for the non-droppable events (which are dropped anyway if
+// the queue is full)
+#define SC_CONTROL_MSG_QUEUE_RESERVED 16
+
+// The text payloads of the bulk messages are copied in an arena (only the
+// bulk messages have text payloads)
+#define SC_CONTROLLER_BULK_ARENA_SIZE (64 * 1024)
+
+// Send the serialized messages once they exceed this size
+#define SC_CONTROLLER_BATCH_MAX_BYTES 16384
+
+// Any message must fit after a batch not sent yet
+#define SC_CONTROLLER_BUFFER_SIZE \
+    (SC_CONTROLLER_BATCH_MAX_BYTES + SC_CONTROL_MSG_MAX_SIZE)
 
 static void
 sc_controller_receiver_on_ended(struct sc_receiver *receiver, bool error,
@@ -18,52 +35,100 @@ sc_controller_receiver_on_ended(struct sc_receiver *receiver, bool error,
 }
 
 bool
-sc_controller_init(struct sc_controller *controller, sc_socket control_socket,
+sc_controller_init(struct sc_controller *controller,
+                   const struct sc_controller_params *params,
                    const struct sc_controller_callbacks *cbs,
                    void *cbs_userdata) {
-    sc_vecdeque_init(&controller->queue);
-
-    // Add 4 to support 4 non-droppable events without re-allocation
-    bool ok = sc_vecdeque_reserve(&controller->queue,
-                                  SC_CONTROL_MSG_QUEUE_LIMIT + 4);
+    // The input messages being sent (at most one batch) remain in the queue
+    // until they are released
+    bool ok = sc_control_msg_queue_init(&controller->queue,
+                                        SC_CONTROL_MSG_QUEUE_LIMIT
+                                            + SC_CONTROL_MSG_QUEUE_RESERVED
+                                            + SC_CONTROLLER_BATCH_MAX_MSGS,
+                                        0);
     if (!ok) {
         return false;
     }
 
+    // The bulk message being sent (at most one) remains in the queue until it
+    // is fully sent
+    ok = sc_control_msg_queue_init(&controller->bulk_queue,
+                                   SC_CONTROL_MSG_QUEUE_LIMIT
+                                       + SC_CONTROL_MSG_QUEUE_RESERVED + 1,
+                                   SC_CONTROLLER_BULK_ARENA_SIZE);
+    if (!ok) {
+        goto error_destroy_queue;
+    }
+
     static const struct sc_receiver_callbacks receiver_cbs = {
         .on_ended = sc_controller_receiver_on_ended,
     };
 
-    ok = sc_receiver_init(&controller->receiver, control_socket, &receiver_cbs,
-                          controller);
+    ok = sc_receiver_init(&controller->receiver, params->control_socket,
+                          &receiver_cbs, controller);
     if (!ok) {
-        sc_vecdeque_destroy(&controller->queue);
-        return false;
+        goto error_destroy_bulk_queue;
     }
 
     ok = sc_mutex_init(&controller->mutex);
     if (!ok) {
-        sc_receiver_destroy(&controller->receiver);
-        sc_vecdeque_destroy(&controller->queue);
-        return false;
+        goto error_destroy_receiver;
     }
 
     ok = sc_cond_init(&controller->msg_cond);
     if (!ok) {
-        sc_receiver_destroy(&controller->receiver);
-        sc_mutex_destroy(&controller->mutex);
-        sc_vecdeque_destroy(&controller->queue);
-        return false;
+        goto error_destroy_mutex;
+    }
+
+    controller->buffer = malloc(SC_CONTROLLER_BUFFER_SIZE);
+    if (!controller->buffer) {
+        LOG_OOM();
+        goto error_destroy_cond;
+    }
+
+    controller->bulk.data = malloc(SC_CONTROL_MSG_MAX_SIZE);
+    if (!controller->bulk.data) {
+        LOG_OOM();
+        goto error_free_buffer;
     }
 
-    controller->control_socket = control_socket;
+    controller->bulk.size = 0;
+    controller->bulk.offset = 0;
+    sc_control_msg_encoder_init(&controller->encoder);
+
+    controller->control_socket = params->control_socket;
     controller->stopped = false;
+    memset(&controller->stats, 0, sizeof(controller->stats));
+
+    controller->print_latency = params->print_latency;
+    memset(&controller->latency, 0, sizeof(controller->latency));
+    controller->recorder = params->recorder;
+    controller->input_timestamps = params->input_timestamps;
+    controller->timestamps = params->print_latency || params->recorder;
+    controller->input_time = 0;
+    controller->scroll_interval = params->scroll_interval;
+    controller->scroll_deadline = 0;
 
     assert(cbs && cbs->on_ended);
     controller->cbs = cbs;
     controller->cbs_userdata = cbs_userdata;
 
     return true;
+
+error_free_buffer:
+    free(controller->buffer);
+error_destroy_cond:
+    sc_cond_destroy(&controller->msg_cond);
+error_destroy_mutex:
+    sc_mutex_destroy(&controller->mutex);
+error_destroy_receiver:
+    sc_receiver_destroy(&controller->receiver);
+error_destroy_bulk_queue:
+    sc_control_msg_queue_destroy(&controller->bulk_queue);
+error_destroy_queue:
+    sc_control_msg_queue_destroy(&controller->queue);
+
+    return false;
 }
 
 void
@@ -79,16 +144,67 @@ sc_controller_destroy(struct sc_controller *controller) {
     sc_cond_destroy(&controller->msg_cond);
     sc_mutex_destroy(&controller->mutex);
 
-    while (!sc_vecdeque_is_empty(&controller->queue)) {
-        struct sc_control_msg *msg = sc_vecdeque_popref(&controller->queue);
-        assert(msg);
-        sc_control_msg_destroy(msg);
-    }
-    sc_vecdeque_destroy(&controller->queue);
+    sc_control_msg_queue_destroy(&controller->queue);
+    sc_control_msg_queue_destroy(&controller->bulk_queue);
 
+    free(controller->bulk.data);
+    free(controller->buffer);
     sc_receiver_destroy(&controller->receiver);
 }
 
+// Merge msg into a queued message not sent yet, so that stale motion events do
+// not accumulate if the control socket stalls
+static bool
+sc_controller_coalesce(struct sc_controller *controller,
+                       const struct sc_control_msg *msg) {
+    struct sc_control_msg_queue *queue = &controller->queue;
+
+    // Only move events are merged, and never across any other event, to
+    // preserve the ordering with respect to down/up events
+    size_t i = sc_control_msg_queue_pending(queue);
+    while (i) {
+        struct sc_control_msg *prev = sc_control_msg_queue_get(queue, --i);
+        if (sc_control_msg_merge(prev, msg)) {
+            return true;
+        }
+
+        // A touch move event may be merged across the move events of other
+        // pointers, which are independent
+        if (!sc_control_msg_is_touch_move(msg)
+                || !sc_control_msg_is_touch_move(prev)
+                || prev->inject_touch_event.pointer_id
+                    == msg->inject_touch_event.pointer_id) {
+            break;
+        }
+    }
+
+    return false;
+}
+
+// Return true if the last pending input message is a scroll event, which is
+// held until controller->scroll_deadline
+static bool
+sc_controller_has_held_scroll(struct sc_controller *controller) {
+    if (!controller->scroll_interval) {
+        return false;
+    }
+
+    size_t pending = sc_control_msg_queue_pending(&controller->queue);
+    if (!pending) {
+        return false;
+    }
+
+    const struct sc_control_msg *last =
+        sc_control_msg_queue_get(&controller->queue, pending - 1);
+    return last->type == SC_CONTROL_MSG_TYPE_INJECT_SCROLL_EVENT;
+}
+
+void
+sc_controller_set_input_time(struct sc_controller *controller, sc_tick time) {
+    assert(sc_thread_get_id() == SC_MAIN_THREAD_ID);
+    controller->input_time = time;
+}
+
 bool
 sc_controller_push_msg(struct sc_controller *controller,
                        const struct sc_control_msg *msg) {
@@ -96,64 +212,296 @@ sc_controller_push_msg(struct sc_controller *controller,
         sc_control_msg_log(msg);
     }
 
+    // The input time only concerns the messages pushed from the main thread
+    sc_tick input_time = sc_thread_get_id() == SC_MAIN_THREAD_ID
+                       ? controller->input_time : 0;
+
+    struct sc_control_msg queued = *msg;
+    queued.timestamp = 0;
+    if (controller->timestamps) {
+        queued.timestamp = input_time ? input_time : sc_tick_now();
+    }
+
+    // The capture time of the input events is sent to the device, so that the
+    // injected events preserve the original spacing (0 if unknown)
+    sc_tick event_time = controller->input_timestamps ? input_time : 0;
+    if (queued.type == SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT) {
+        queued.inject_touch_event.event_time = event_time;
+    } else if (queued.type == SC_CONTROL_MSG_TYPE_INJECT_SCROLL_EVENT) {
+        queued.inject_scroll_event.event_time = event_time;
+    }
+
     bool pushed = false;
 
     sc_mutex_lock(&controller->mutex);
-    size_t size = sc_vecdeque_size(&controller->queue);
+    if (sc_controller_coalesce(controller, &queued)) {
+        // The merged message keeps the timestamp of the oldest event
+        ++controller->latency.merged;
+        sc_mutex_unlock(&controller->mutex);
+        // The event has been taken into account
+        return true;
+    }
+
+    // The controller thread must also be woken up if it waits for the
+    // deadline of a held scroll event, which must not delay the next message
+    bool was_empty = sc_control_msg_queue_is_empty(&controller->queue)
+                  && sc_control_msg_queue_is_empty(&controller->bulk_queue);
+    bool wake = was_empty || sc_controller_has_held_scroll(controller);
+
+    // Only the pointer events may be sent before the pending bulk messages
+    // (including the one being sent)
+    struct sc_control_msg_queue *queue = &controller->queue;
+    if (sc_control_msg_is_bulk(msg)
+            || (!sc_control_msg_is_pointer_event(msg)
+                && !sc_control_msg_queue_is_empty(&controller->bulk_queue))) {
+        queue = &controller->bulk_queue;
+    }
+
+    // The text payload (if any) is copied, the queue never allocates for
+    // input events
+    size_t size = sc_control_msg_queue_pending(queue);
     if (size < SC_CONTROL_MSG_QUEUE_LIMIT) {
-        bool was_empty = sc_vecdeque_is_empty(&controller->queue);
-        sc_vecdeque_push_noresize(&controller->queue, *msg);
-        pushed = true;
-        if (was_empty) {
+        pushed = sc_control_msg_queue_push(queue, &queued);
+        if (pushed && wake) {
             sc_cond_signal(&controller->msg_cond);
         }
     } else if (!sc_control_msg_is_droppable(msg)) {
-        bool ok = sc_vecdeque_push(&controller->queue, *msg);
-        if (ok) {
-            pushed = true;
-        } else {
+        pushed = sc_control_msg_queue_push(queue, &queued);
+        if (!pushed) {
             // A non-droppable event must be dropped anyway
-            LOG_OOM();
+            LOGW("Control queue full, dropping a %s message",
+                 sc_control_msg_type_label(msg->type));
         }
     }
     // Otherwise, the msg is discarded
 
+    if (pushed) {
+        if (queued.type == SC_CONTROL_MSG_TYPE_INJECT_SCROLL_EVENT) {
+            // Accumulate the next scroll events (until the direction or the
+            // position changes) during one interval
+            controller->scroll_deadline =
+                sc_tick_now() + controller->scroll_interval;
+        }
+
+        size_t depth = sc_control_msg_queue_pending(&controller->queue)
+                     + sc_control_msg_queue_pending(&controller->bulk_queue);
+        controller->latency.max_depth =
+            MAX(controller->latency.max_depth, depth);
+    } else {
+        ++controller->latency.dropped;
+    }
+
     sc_mutex_unlock(&controller->mutex);
 
     return pushed;
 }
 
 static bool
-process_msg(struct sc_controller *controller,
-            const struct sc_control_msg *msg, bool *eos) {
-    static uint8_t serialized_msg[SC_CONTROL_MSG_MAX_SIZE];
-    size_t length = sc_control_msg_serialize(msg, serialized_msg);
-    if (!length) {
-        *eos = false;
+sc_controller_send(struct sc_controller *controller, const uint8_t *data,
+                   size_t len, bool *eos) {
+    ssize_t w = net_send_all(controller->control_socket, data, len);
+    if ((size_t) w != len) {
+        *eos = true;
         return false;
     }
 
-    ssize_t w =
-        net_send_all(controller->control_socket, serialized_msg, length);
-    if ((size_t) w != length) {
-        *eos = true;
+    ++controller->stats.writes;
+    controller->stats.bytes += len;
+    return true;
+}
+
+static bool
+process_batch(struct sc_controller *controller, size_t count, bool *eos) {
+    size_t len = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const struct sc_control_msg *msg = controller->batch[i];
+        // The buffer always has room for SC_CONTROL_MSG_MAX_SIZE bytes
+        size_t length =
+            sc_control_msg_serialize_compact(&controller->encoder, msg,
+                                             controller->buffer + len);
+        if (!length) {
+            *eos = false;
+            return false;
+        }
+
+        if (controller->recorder) {
+            sc_control_recorder_write(controller->recorder, msg);
+        }
+
+        len += length;
+        if (len > SC_CONTROLLER_BATCH_MAX_BYTES) {
+            if (!sc_controller_send(controller, controller->buffer, len,
+                                    eos)) {
+                return false;
+            }
+            len = 0;
+        }
+    }
+
+    if (len && !sc_controller_send(controller, controller->buffer, len, eos)) {
         return false;
     }
 
     return true;
 }
 
+static bool
+sc_controller_start_bulk(struct sc_controller *controller,
+                         const struct sc_control_msg *msg) {
+    struct sc_controller_bulk *bulk = &controller->bulk;
+    assert(!bulk->size);
+
+    size_t size = sc_control_msg_serialize(msg, bulk->data);
+    if (!size) {
+        return false;
+    }
+
+    if (controller->recorder) {
+        sc_control_recorder_write(controller->recorder, msg);
+    }
+
+    bulk->size = size;
+    bulk->offset = 0;
+    bulk->type = msg->type;
+    bulk->timestamp = msg->timestamp;
+    ++controller->stats.bulk_msgs;
+    return true;
+}
+
+// Send the next part of the current bulk message: either the whole message if
+// it is small, or its next chunk. Return false on error.
+static bool
+sc_controller_send_bulk(struct sc_controller *controller, bool *eos) {
+    struct sc_controller_bulk *bulk = &controller->bulk;
+    assert(bulk->offset < bulk->size);
+
+    if (bulk->size <= SC_CONTROL_MSG_CHUNK_MAX_DATA) {
+        // No need to split
+        if (!sc_controller_send(controller, bulk->data, bulk->size, eos)) {
+            return false;
+        }
+        bulk->offset = bulk->size;
+        return true;
+    }
+
+    size_t remaining = bulk->size - bulk->offset;
+    size_t chunk_len = MIN(remaining, SC_CONTROL_MSG_CHUNK_MAX_DATA);
+    bool last = chunk_len == remaining;
+    size_t len = sc_control_msg_serialize_chunk(bulk->data + bulk->offset,
+                                                chunk_len, last,
+                                                controller->buffer);
+    if (!sc_controller_send(controller, controller->buffer, len, eos)) {
+        return false;
+    }
+
+    bulk->offset += chunk_len;
+    ++controller->stats.chunks;
+    return true;
+}
+
+static void
+sc_controller_stats_add_batch(struct sc_controller_stats *stats,
+                              size_t count) {
+    assert(count);
+    stats->msgs += count;
+
+    unsigned bucket = 0;
+    while (count > 1 && bucket < SC_CONTROLLER_BATCH_BUCKETS - 1) {
+        count >>= 1;
+        ++bucket;
+    }
+    ++stats->batch_sizes[bucket];
+}
+
+static void
+sc_controller_stats_log(const struct sc_controller_stats *stats) {
+    if (!stats->writes) {
+        return;
+    }
+
+    const uint64_t *b = stats->batch_sizes;
+    LOGD("Controller: %" PRIu64 " messages in %" PRIu64 " writes (%" PRIu64
+         " bytes per write); batch sizes: 1: %" PRIu64 ", 2-3: %" PRIu64
+         ", 4-7: %" PRIu64 ", 8-15: %" PRIu64 ", 16+: %" PRIu64 "; %" PRIu64
+         " bulk messages (%" PRIu64 " chunks)",
+         stats->msgs, stats->writes, stats->bytes / stats->writes, b[0], b[1],
+         b[2], b[3], b[4], stats->bulk_msgs, stats->chunks);
+}
+
+static void
+sc_controller_latency_add(struct sc_controller_latency *latency,
+                          enum sc_control_msg_type type, sc_tick timestamp,
+                          sc_tick now) {
+    if ((size_t) type < ARRAY_LEN(latency->histograms)) {
+        sc_histogram_add(&latency->histograms[type], now - timestamp);
+    }
+}
+
+static void
+sc_controller_latency_report(struct sc_controller *controller, sc_tick now) {
+    struct sc_controller_latency *latency = &controller->latency;
+
+    sc_mutex_lock(&controller->mutex);
+    size_t max_depth = latency->max_depth;
+    uint64_t dropped = latency->dropped;
+    uint64_t merged = latency->merged;
+    latency->max_depth = 0;
+    latency->dropped = 0;
+    latency->merged = 0;
+    sc_mutex_unlock(&controller->mutex);
+
+    unsigned sec = SC_TICK_TO_SEC(now - latency->last_report);
+    LOGI("Input latency over %u s: max queue depth %" SC_PRIsizet ", %" PRIu64
+         " dropped, %" PRIu64 " merged", sec, max_depth, dropped, merged);
+
+    for (size_t i = 0; i < ARRAY_LEN(latency->histograms); ++i) {
+        struct sc_histogram *h = &latency->histograms[i];
+        if (h->count) {
+            sc_tick p50 = sc_histogram_percentile(h, 50);
+            sc_tick p99 = sc_histogram_percentile(h, 99);
+            LOGI("    %s: %" PRIu64 " messages, p50 %.1f ms, p99 %.1f ms",
+                 sc_control_msg_type_label(i), h->count,
+                 (double) p50 / 1000, (double) p99 / 1000);
+            sc_histogram_reset(h);
+        }
+    }
+
+    latency->last_report = now;
+}
+
 static int
 run_controller(void *data) {
     struct sc_controller *controller = data;
 
     bool error = false;
 
+    if (controller->print_latency) {
+        controller->latency.last_report = sc_tick_now();
+    }
+
     for (;;) {
         sc_mutex_lock(&controller->mutex);
-        while (!controller->stopped
-                && sc_vecdeque_is_empty(&controller->queue)) {
-            sc_cond_wait(&controller->msg_cond, &controller->mutex);
+        size_t ready;
+        for (;;) {
+            ready = sc_control_msg_queue_pending(&controller->queue);
+            bool held = sc_controller_has_held_scroll(controller)
+                     && sc_tick_now() < controller->scroll_deadline;
+            if (held) {
+                --ready;
+            }
+
+            // A bulk message being sent is still in bulk_queue
+            bool bulk = !sc_control_msg_queue_is_empty(&controller->bulk_queue);
+            if (controller->stopped || ready || bulk) {
+                break;
+            }
+
+            if (held) {
+                sc_cond_timedwait(&controller->msg_cond, &controller->mutex,
+                                  controller->scroll_deadline);
+            } else {
+                sc_cond_wait(&controller->msg_cond, &controller->mutex);
+            }
         }
         if (controller->stopped) {
             // stop immediately, do not process further msgs
@@ -162,13 +510,70 @@ run_controller(void *data) {
             break;
         }
 
-        assert(!sc_vecdeque_is_empty(&controller->queue));
-        struct sc_control_msg msg = sc_vecdeque_pop(&controller->queue);
+        // Take all the pending input messages at once (they remain valid
+        // until they are released), except a held scroll event
+        size_t count = 0;
+        while (count < SC_CONTROLLER_BATCH_MAX_MSGS && count < ready) {
+            controller->batch[count++] =
+                sc_control_msg_queue_take(&controller->queue);
+        }
+
+        // The next bulk message is kept in the queue until it is fully sent,
+        // so that the messages pushed meanwhile are ordered after it
+        const struct sc_control_msg *bulk_msg = NULL;
+        if (!controller->bulk.size
+                && sc_control_msg_queue_pending(&controller->bulk_queue)) {
+            bulk_msg = sc_control_msg_queue_take(&controller->bulk_queue);
+        }
         sc_mutex_unlock(&controller->mutex);
 
-        bool eos;
-        bool ok = process_msg(controller, &msg, &eos);
-        sc_control_msg_destroy(&msg);
+        bool eos = false;
+        bool ok = true;
+
+        // The input messages are sent first
+        if (count) {
+            sc_controller_stats_add_batch(&controller->stats, count);
+
+            ok = process_batch(controller, count, &eos);
+
+            if (ok && controller->print_latency) {
+                sc_tick now = sc_tick_now();
+                for (size_t i = 0; i < count; ++i) {
+                    const struct sc_control_msg *msg = controller->batch[i];
+                    sc_controller_latency_add(&controller->latency, msg->type,
+                                              msg->timestamp, now);
+                }
+            }
+
+            sc_mutex_lock(&controller->mutex);
+            for (size_t i = 0; i < count; ++i) {
+                sc_control_msg_queue_release(&controller->queue);
+            }
+            sc_mutex_unlock(&controller->mutex);
+        }
+
+        // Then at most one chunk of the current bulk message, so that any
+        // input message pushed meanwhile is not delayed by a large message
+        if (ok && bulk_msg) {
+            ok = sc_controller_start_bulk(controller, bulk_msg);
+        }
+        if (ok && controller->bulk.size) {
+            ok = sc_controller_send_bulk(controller, &eos);
+            if (ok && controller->bulk.offset == controller->bulk.size) {
+                controller->bulk.size = 0;
+                if (controller->print_latency) {
+                    sc_controller_latency_add(&controller->latency,
+                                              controller->bulk.type,
+                                              controller->bulk.timestamp,
+                                              sc_tick_now());
+                }
+
+                sc_mutex_lock(&controller->mutex);
+                sc_control_msg_queue_release(&controller->bulk_queue);
+                sc_mutex_unlock(&controller->mutex);
+            }
+        }
+
         if (!ok) {
             if (eos) {
                 LOGD("Controller stopped (socket closed)");
@@ -176,8 +581,18 @@ run_controller(void *data) {
             error = !eos;
             break;
         }
+
+        if (controller->print_latency) {
+            sc_tick now = sc_tick_now();
+            if (now - controller->latency.last_report
+                    >= SC_CONTROLLER_LATENCY_REPORT_INTERVAL) {
+                sc_controller_latency_report(controller, now);
+            }
+        }
     }
 
+    sc_controller_stats_log(&controller->stats);
+
     controller->cbs->on_ended(controller, error, controller->cbs_userdata);
 
     return 0;
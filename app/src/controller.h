@@ -4,15 +4,55 @@
 #include "common.h"
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "control_msg.h"
+#include "control_msg_queue.h"
+#include "control_recorder.h"
 #include "receiver.h"
 #include "util/acksync.h"
+#include "util/histogram.h"
 #include "util/net.h"
 #include "util/thread.h"
-#include "util/vecdeque.h"
+#include "util/tick.h"
 
-struct sc_control_msg_queue SC_VECDEQUE(struct sc_control_msg);
+// Maximum number of messages dequeued at once
+#define SC_CONTROLLER_BATCH_MAX_MSGS 64
+
+// The batch_sizes histogram buckets: 1, 2-3, 4-7, 8-15 and 16+ messages
+#define SC_CONTROLLER_BATCH_BUCKETS 5
+
+struct sc_controller_stats {
+    uint64_t msgs;
+    uint64_t writes;
+    uint64_t bytes;
+    uint64_t batch_sizes[SC_CONTROLLER_BATCH_BUCKETS];
+    uint64_t bulk_msgs;
+    uint64_t chunks;
+};
+
+// The bulk message being sent (possibly by chunks)
+struct sc_controller_bulk {
+    uint8_t *data; // serialized message, SC_CONTROL_MSG_MAX_SIZE bytes
+    size_t size; // 0 if no bulk message is being sent
+    size_t offset;
+    enum sc_control_msg_type type;
+    sc_tick timestamp;
+};
+
+#define SC_CONTROLLER_LATENCY_REPORT_INTERVAL SC_TICK_FROM_SEC(10)
+
+// Delay between the input events and the control messages being sent
+struct sc_controller_latency {
+    // Accessed only from the controller thread
+    struct sc_histogram histograms[SC_CONTROL_MSG_TYPE_CHUNK];
+    sc_tick last_report;
+
+    // Protected by the controller mutex
+    size_t max_depth;
+    uint64_t dropped;
+    uint64_t merged;
+};
 
 struct sc_controller {
     sc_socket control_socket;
@@ -20,9 +60,44 @@ struct sc_controller {
     sc_mutex mutex;
     sc_cond msg_cond;
     bool stopped;
+    // Latency-critical messages (input events), always sent first
     struct sc_control_msg_queue queue;
+    // Bulk messages (sent by chunks, interleaved with the input messages), and
+    // the messages which must not be sent before them
+    struct sc_control_msg_queue bulk_queue;
     struct sc_receiver receiver;
 
+    // Accessed only from the controller thread: all the queued input messages
+    // are taken at once, serialized back to back and sent together
+    const struct sc_control_msg *batch[SC_CONTROLLER_BATCH_MAX_MSGS];
+    uint8_t *buffer;
+    // The input messages are serialized in the compact encoding (the bulk
+    // messages, sent in a different order, have no compact encoding)
+    struct sc_control_msg_encoder encoder;
+    // The head of bulk_queue, removed once fully sent
+    struct sc_controller_bulk bulk;
+    struct sc_controller_stats stats;
+
+    bool print_latency;
+    struct sc_controller_latency latency;
+    struct sc_control_recorder *recorder; // may be NULL
+
+    // Set if the messages must be timestamped (for latency statistics or
+    // recording)
+    bool timestamps;
+    // Send the capture time of the input events to the device
+    bool input_timestamps;
+    // Accessed only from the main thread: the time of the input event being
+    // processed (0 if none)
+    sc_tick input_time;
+
+    // The last pending scroll event is held during this interval (0 to
+    // disable), to accumulate the next scroll events into it
+    sc_tick scroll_interval;
+    // Protected by the mutex: the time at which the last pending message, if
+    // it is a scroll event, must be sent
+    sc_tick scroll_deadline;
+
     const struct sc_controller_callbacks *cbs;
     void *cbs_userdata;
 };
@@ -32,8 +107,20 @@ struct sc_controller_callbacks {
                      void *userdata);
 };
 
+struct sc_controller_params {
+    sc_socket control_socket;
+    bool print_latency;
+    bool input_timestamps;
+    // Accumulate the scroll events during this interval, typically a display
+    // refresh interval (0 to send them immediately)
+    sc_tick scroll_interval;
+    // Record the control messages sent (may be NULL)
+    struct sc_control_recorder *recorder;
+};
+
 bool
-sc_controller_init(struct sc_controller *controller, sc_socket control_socket,
+sc_controller_init(struct sc_controller *controller,
+                   const struct sc_controller_params *params,
                    const struct sc_controller_callbacks *cbs,
                    void *cbs_userdata);
 
@@ -54,6 +141,20 @@ sc_controller_stop(struct sc_controller *controller);
 void
 sc_controller_join(struct sc_controller *controller);
 
+/**
+ * Set the time of the input event being processed, to timestamp the messages
+ * pushed meanwhile from the main thread
+ *
+ * Reset it to 0 once the event is processed.
+ */
+void
+sc_controller_set_input_time(struct sc_controller *controller, sc_tick time);
+
+/**
+ * Push a control message to be sent to the device
+ *
+ * Its text payload (if any) is copied: the caller keeps its ownership.
+ */
 bool
 sc_controller_push_msg(struct sc_controller *controller,
                        const struct sc_control_msg *msg);
@@ -36,7 +36,13 @@ static int
 run_buffering(void *data) {
     struct sc_delay_buffer *db = data;
 
-    assert(db->delay > 0);
+    assert(db->delay > 0 || db->av_sync);
+
+    // With A/V sync, frames may be delayed up to the audio playback latency
+    sc_tick max_delay = db->delay;
+    if (db->av_sync) {
+        max_delay += db->av_sync->max_delay;
+    }
 
     for (;;) {
         sc_mutex_lock(&db->mutex);
@@ -52,14 +58,19 @@ run_buffering(void *data) {
 
         struct sc_delayed_frame dframe = sc_vecdeque_pop(&db->queue);
 
-        sc_tick max_deadline = sc_tick_now() + db->delay;
+        sc_tick max_deadline = sc_tick_now() + max_delay;
         // PTS (written by the server) are expressed in microseconds
         sc_tick pts = SC_TICK_FROM_US(dframe.frame->pts);
 
         bool timed_out = false;
         while (!db->stopped && !timed_out) {
-            sc_tick deadline = sc_clock_to_system_time(&db->clock, pts)
-                             + db->delay;
+            sc_tick deadline;
+            if (!db->av_sync
+                    || !sc_av_sync_to_system_time(db->av_sync, pts,
+                                                  &deadline)) {
+                deadline = sc_clock_to_system_time(&db->clock, pts);
+            }
+            deadline += db->delay;
             if (deadline > max_deadline) {
                 deadline = max_deadline;
             }
@@ -81,6 +92,10 @@ run_buffering(void *data) {
              pts, dframe.push_date, sc_tick_now());
 #endif
 
+        if (db->av_sync) {
+            sc_av_sync_report_video(db->av_sync, sc_tick_now(), pts);
+        }
+
         bool ok = sc_frame_source_sinks_push(&db->frame_source, dframe.frame);
         sc_delayed_frame_destroy(&dframe);
         if (!ok) {
@@ -223,11 +238,12 @@ sc_delay_buffer_frame_sink_push(struct sc_frame_sink *sink,
 
 void
 sc_delay_buffer_init(struct sc_delay_buffer *db, sc_tick delay,
-                     bool first_frame_asap) {
-    assert(delay > 0);
+                     bool first_frame_asap, struct sc_av_sync *av_sync) {
+    assert(delay > 0 || av_sync);
 
     db->delay = delay;
     db->first_frame_asap = first_frame_asap;
+    db->av_sync = av_sync;
 
     sc_frame_source_init(&db->frame_source);
 
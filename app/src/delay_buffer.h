@@ -6,6 +6,7 @@
 #include <stdbool.h>
 #include <libavutil/frame.h>
 
+#include "av_sync.h"
 #include "clock.h"
 #include "trait/frame_source.h"
 #include "trait/frame_sink.h"
@@ -33,6 +34,7 @@ struct sc_delay_buffer {
 
     sc_tick delay;
     bool first_frame_asap;
+    struct sc_av_sync *av_sync; // optional
 
     sc_thread thread;
     sc_mutex mutex;
@@ -52,12 +54,14 @@ struct sc_delay_buffer_callbacks {
 /**
  * Initialize a delay buffer.
  *
- * \param delay a (strictly) positive delay
+ * \param delay a (strictly) positive delay (may be 0 if av_sync is set)
  * \param first_frame_asap if true, do not delay the first frame (useful for
                            a video stream).
+ * \param av_sync if not NULL, present frames along with the matching audio
+ *                (the delay is added on top of the audio playback time)
  */
 void
 sc_delay_buffer_init(struct sc_delay_buffer *db, sc_tick delay,
-                     bool first_frame_asap);
+                     bool first_frame_asap, struct sc_av_sync *av_sync);
 
 #endif
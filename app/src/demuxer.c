@@ -9,22 +9,8 @@
 #include "util/binary.h"
 #include "util/log.h"
 
-#define SC_PACKET_HEADER_SIZE 12
-
-#define SC_PACKET_FLAG_CONFIG    (UINT64_C(1) << 63)
-#define SC_PACKET_FLAG_KEY_FRAME (UINT64_C(1) << 62)
-
-#define SC_PACKET_PTS_MASK (SC_PACKET_FLAG_KEY_FRAME - 1)
-
 static enum AVCodecID
 sc_demuxer_to_avcodec_id(uint32_t codec_id) {
-#define SC_CODEC_ID_H264 UINT32_C(0x68323634) // "h264" in ASCII
-#define SC_CODEC_ID_H265 UINT32_C(0x68323635) // "h265" in ASCII
-#define SC_CODEC_ID_AV1 UINT32_C(0x00617631) // "av1" in ASCII
-#define SC_CODEC_ID_OPUS UINT32_C(0x6f707573) // "opus" in ASCII
-#define SC_CODEC_ID_AAC UINT32_C(0x00616163) // "aac" in ASCII
-#define SC_CODEC_ID_FLAC UINT32_C(0x666c6163) // "flac" in ASCII
-#define SC_CODEC_ID_RAW UINT32_C(0x00726177) // "raw" in ASCII
     switch (codec_id) {
         case SC_CODEC_ID_H264:
             return AV_CODEC_ID_H264;
@@ -77,6 +63,20 @@ sc_demuxer_recv_video_size(struct sc_demuxer *demuxer, uint32_t *width,
     return true;
 }
 
+static bool
+sc_demuxer_recv_audio_format(struct sc_demuxer *demuxer, uint32_t *sample_rate,
+                             uint8_t *channels) {
+    uint8_t data[5];
+    ssize_t r = net_recv_all(demuxer->socket, data, 5);
+    if (r < 5) {
+        return false;
+    }
+
+    *sample_rate = sc_read32be(data);
+    *channels = data[4];
+    return true;
+}
+
 static bool
 sc_demuxer_recv_packet(struct sc_demuxer *demuxer, AVPacket *packet) {
     // The video and audio streams contain a sequence of raw packets (as
@@ -199,14 +199,30 @@ run_demuxer(void *data) {
         codec_ctx->height = height;
         codec_ctx->pix_fmt = AV_PIX_FMT_YUV420P;
     } else {
-        // Hardcoded audio properties
+        // Audio format negotiated with the server
+        uint32_t sample_rate;
+        uint8_t channels;
+        ok = sc_demuxer_recv_audio_format(demuxer, &sample_rate, &channels);
+        if (!ok) {
+            goto finally_free_context;
+        }
+
+        if (!sample_rate || sample_rate > 192000 || !channels) {
+            LOGE("Demuxer '%s': invalid audio format: %" PRIu32 " Hz, %u "
+                 "channel(s)", demuxer->name, sample_rate, channels);
+            goto finally_free_context;
+        }
+
+        LOGD("Demuxer '%s': audio format: %" PRIu32 " Hz, %u channel(s)",
+             demuxer->name, sample_rate, channels);
+
 #ifdef SCRCPY_LAVU_HAS_CHLAYOUT
-        codec_ctx->ch_layout = (AVChannelLayout) AV_CHANNEL_LAYOUT_STEREO;
+        av_channel_layout_default(&codec_ctx->ch_layout, channels);
 #else
-        codec_ctx->channel_layout = AV_CH_LAYOUT_STEREO;
-        codec_ctx->channels = 2;
+        codec_ctx->channel_layout = av_get_default_channel_layout(channels);
+        codec_ctx->channels = channels;
 #endif
-        codec_ctx->sample_rate = 48000;
+        codec_ctx->sample_rate = sample_rate;
 
         if (raw_codec_id == SC_CODEC_ID_FLAC) {
             // The sample_fmt is not set by the FLAC decoder
@@ -314,3 +330,44 @@ void
 sc_demuxer_join(struct sc_demuxer *demuxer) {
     sc_thread_join(&demuxer->thread, NULL);
 }
+
+bool
+sc_demuxer_write_video_codec_header(uint8_t *buf, const AVCodecContext *ctx) {
+    uint32_t raw_codec_id;
+    switch (ctx->codec_id) {
+        case AV_CODEC_ID_H264:
+            raw_codec_id = SC_CODEC_ID_H264;
+            break;
+        case AV_CODEC_ID_HEVC:
+            raw_codec_id = SC_CODEC_ID_H265;
+            break;
+#ifdef SCRCPY_LAVC_HAS_AV1
+        case AV_CODEC_ID_AV1:
+            raw_codec_id = SC_CODEC_ID_AV1;
+            break;
+#endif
+        default:
+            return false;
+    }
+
+    sc_write32be(buf, raw_codec_id);
+    sc_write32be(&buf[4], ctx->width);
+    sc_write32be(&buf[8], ctx->height);
+    return true;
+}
+
+void
+sc_demuxer_write_packet_header(uint8_t *buf, const AVPacket *packet) {
+    uint64_t pts_flags;
+    if (packet->pts == AV_NOPTS_VALUE) {
+        pts_flags = SC_PACKET_FLAG_CONFIG;
+    } else {
+        pts_flags = packet->pts & SC_PACKET_PTS_MASK;
+        if (packet->flags & AV_PKT_FLAG_KEY) {
+            pts_flags |= SC_PACKET_FLAG_KEY_FRAME;
+        }
+    }
+
+    sc_write64be(buf, pts_flags);
+    sc_write32be(&buf[8], packet->size);
+}
@@ -4,11 +4,29 @@
 #include "common.h"
 
 #include <stdbool.h>
+#include <stdint.h>
+#include <libavcodec/avcodec.h>
 
 #include "trait/packet_source.h"
 #include "util/net.h"
 #include "util/thread.h"
 
+// Stream protocol, also used to forward the raw stream to other programs
+#define SC_PACKET_HEADER_SIZE 12
+
+#define SC_PACKET_FLAG_CONFIG    (UINT64_C(1) << 63)
+#define SC_PACKET_FLAG_KEY_FRAME (UINT64_C(1) << 62)
+
+#define SC_PACKET_PTS_MASK (SC_PACKET_FLAG_KEY_FRAME - 1)
+
+#define SC_CODEC_ID_H264 UINT32_C(0x68323634) // "h264" in ASCII
+#define SC_CODEC_ID_H265 UINT32_C(0x68323635) // "h265" in ASCII
+#define SC_CODEC_ID_AV1 UINT32_C(0x00617631) // "av1" in ASCII
+#define SC_CODEC_ID_OPUS UINT32_C(0x6f707573) // "opus" in ASCII
+#define SC_CODEC_ID_AAC UINT32_C(0x00616163) // "aac" in ASCII
+#define SC_CODEC_ID_FLAC UINT32_C(0x666c6163) // "flac" in ASCII
+#define SC_CODEC_ID_RAW UINT32_C(0x00726177) // "raw" in ASCII
+
 struct sc_demuxer {
     struct sc_packet_source packet_source; // packet source trait
 
@@ -43,4 +61,21 @@ sc_demuxer_start(struct sc_demuxer *demuxer);
 void
 sc_demuxer_join(struct sc_demuxer *demuxer);
 
+/**
+ * Write the video codec header (codec id, width and height) of the stream
+ * protocol (SC_VIDEO_CODEC_HEADER_SIZE bytes)
+ *
+ * Return false if the codec is not supported by the protocol.
+ */
+#define SC_VIDEO_CODEC_HEADER_SIZE 12
+bool
+sc_demuxer_write_video_codec_header(uint8_t *buf, const AVCodecContext *ctx);
+
+/**
+ * Write the header of a packet in the stream protocol format
+ * (SC_PACKET_HEADER_SIZE bytes)
+ */
+void
+sc_demuxer_write_packet_header(uint8_t *buf, const AVPacket *packet);
+
 #endif
@@ -1,93 +1,70 @@
 #include "device_msg.h"
 
 #include <stdint.h>
-#include <stdlib.h>
-#include <string.h>
 
 #include "util/binary.h"
 #include "util/log.h"
 
 ssize_t
-sc_device_msg_deserialize(const uint8_t *buf, size_t len,
-                          struct sc_device_msg *msg) {
+sc_device_msg_get_size(const uint8_t *buf, size_t len) {
     if (!len) {
         return 0; // no message
     }
 
-    msg->type = buf[0];
-    switch (msg->type) {
+    switch (buf[0]) {
         case DEVICE_MSG_TYPE_CLIPBOARD: {
             if (len < 5) {
                 // at least type + empty string length
-                return 0; // no complete message
+                return 0; // no complete header
             }
             size_t clipboard_len = sc_read32be(&buf[1]);
-            if (clipboard_len > len - 5) {
-                return 0; // no complete message
-            }
-            char *text = malloc(clipboard_len + 1);
-            if (!text) {
-                LOG_OOM();
+            if (clipboard_len > DEVICE_MSG_TEXT_MAX_LENGTH) {
+                LOGW("Device clipboard text too long: %" SC_PRIsizet,
+                     clipboard_len);
                 return -1;
             }
-            if (clipboard_len) {
-                memcpy(text, &buf[5], clipboard_len);
-            }
-            text[clipboard_len] = '\0';
-
-            msg->clipboard.text = text;
             return 5 + clipboard_len;
         }
-        case DEVICE_MSG_TYPE_ACK_CLIPBOARD: {
-            if (len < 9) {
-                return 0; // no complete message
-            }
-            uint64_t sequence = sc_read64be(&buf[1]);
-            msg->ack_clipboard.sequence = sequence;
+        case DEVICE_MSG_TYPE_ACK_CLIPBOARD:
             return 9;
-        }
         case DEVICE_MSG_TYPE_UHID_OUTPUT: {
             if (len < 5) {
                 // at least id + size
-                return 0; // not available
+                return 0; // no complete header
             }
-            uint16_t id = sc_read16be(&buf[1]);
             size_t size = sc_read16be(&buf[3]);
-            if (size < len - 5) {
-                return 0; // not available
-            }
-            uint8_t *data = malloc(size);
-            if (!data) {
-                LOG_OOM();
-                return -1;
-            }
-            if (size) {
-                memcpy(data, &buf[5], size);
-            }
-
-            msg->uhid_output.id = id;
-            msg->uhid_output.size = size;
-            msg->uhid_output.data = data;
-
             return 5 + size;
         }
         default:
-            LOGW("Unknown device message type: %d", (int) msg->type);
+            LOGW("Unknown device message type: %d", (int) buf[0]);
             return -1; // error, we cannot recover
     }
 }
 
-void
-sc_device_msg_destroy(struct sc_device_msg *msg) {
+ssize_t
+sc_device_msg_deserialize(const uint8_t *buf, size_t len,
+                          struct sc_device_msg *msg) {
+    ssize_t size = sc_device_msg_get_size(buf, len);
+    if (size <= 0 || (size_t) size > len) {
+        // error, or no complete message
+        return size == -1 ? -1 : 0;
+    }
+
+    msg->type = buf[0];
     switch (msg->type) {
         case DEVICE_MSG_TYPE_CLIPBOARD:
-            free(msg->clipboard.text);
+            msg->clipboard.text = (const char *) &buf[5];
+            msg->clipboard.len = size - 5;
             break;
-        case DEVICE_MSG_TYPE_UHID_OUTPUT:
-            free(msg->uhid_output.data);
+        case DEVICE_MSG_TYPE_ACK_CLIPBOARD:
+            msg->ack_clipboard.sequence = sc_read64be(&buf[1]);
             break;
-        default:
-            // nothing to do
+        case DEVICE_MSG_TYPE_UHID_OUTPUT:
+            msg->uhid_output.id = sc_read16be(&buf[1]);
+            msg->uhid_output.size = size - 5;
+            msg->uhid_output.data = &buf[5];
             break;
     }
+
+    return size;
 }
@@ -10,6 +10,9 @@
 #define DEVICE_MSG_MAX_SIZE (1 << 18) // 256k
 // type: 1 byte; length: 4 bytes
 #define DEVICE_MSG_TEXT_MAX_LENGTH (DEVICE_MSG_MAX_SIZE - 5)
+// The size of the largest message header (ACK_CLIPBOARD: type + sequence),
+// enough to know the total size of any message
+#define DEVICE_MSG_HEADER_MAX_SIZE 9
 
 enum sc_device_msg_type {
     DEVICE_MSG_TYPE_CLIPBOARD,
@@ -17,11 +20,14 @@ enum sc_device_msg_type {
     DEVICE_MSG_TYPE_UHID_OUTPUT,
 };
 
+// The payloads are not copied: they point into the deserialized buffer, and
+// are valid only as long as the buffer content
 struct sc_device_msg {
     enum sc_device_msg_type type;
     union {
         struct {
-            char *text; // owned, to be freed by free()
+            const char *text; // not nul-terminated
+            size_t len;
         } clipboard;
         struct {
             uint64_t sequence;
@@ -29,17 +35,19 @@ struct sc_device_msg {
         struct {
             uint16_t id;
             uint16_t size;
-            uint8_t *data; // owned, to be freed by free()
+            const uint8_t *data;
         } uhid_output;
     };
 };
 
+// return the total size of the message starting at buf (0 if the header is
+// not complete, -1 on error)
+ssize_t
+sc_device_msg_get_size(const uint8_t *buf, size_t len);
+
 // return the number of bytes consumed (0 for no msg available, -1 on error)
 ssize_t
 sc_device_msg_deserialize(const uint8_t *buf, size_t len,
                           struct sc_device_msg *msg);
 
-void
-sc_device_msg_destroy(struct sc_device_msg *msg);
-
 #endif
@@ -0,0 +1,360 @@
+#include "file_writer.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <string.h>
+#include <libavutil/mem.h>
+
+#include "util/file.h"
+#include "util/log.h"
+
+// Every packet is flushed to the front buffer (AVFormatContext.flush_packets),
+// so the AVIOContext buffer does not need to be large
+#define SC_FILE_WRITER_AVIO_BUFFER_SIZE (64 * 1024)
+
+#define SC_FILE_WRITER_REPORT_INTERVAL SC_TICK_FROM_SEC(10)
+
+#ifdef SCRCPY_LAVF_HAS_AVIO_WRITE_CONST_BUF
+typedef const uint8_t sc_avio_write_buf;
+#else
+typedef uint8_t sc_avio_write_buf;
+#endif
+
+static void
+sc_file_writer_swap(struct sc_file_writer *writer) {
+    // The mutex must be locked
+    assert(!writer->back_size);
+    assert(writer->front_size);
+
+    uint8_t *tmp = writer->back;
+    writer->back = writer->front;
+    writer->back_size = writer->front_size;
+    writer->front = tmp;
+    writer->front_size = 0;
+
+    sc_cond_broadcast(&writer->cond);
+}
+
+static bool
+sc_file_writer_wait_back(struct sc_file_writer *writer) {
+    // The mutex must be locked
+    if (writer->back_size && !writer->error) {
+        sc_tick start = sc_tick_now();
+        do {
+            sc_cond_wait(&writer->cond, &writer->mutex);
+        } while (writer->back_size && !writer->error);
+        writer->stats.stall_time += sc_tick_now() - start;
+    }
+
+    return !writer->error;
+}
+
+static bool
+sc_file_writer_drain(struct sc_file_writer *writer) {
+    // The mutex must be locked
+    if (!sc_file_writer_wait_back(writer)) {
+        return false;
+    }
+
+    if (writer->front_size) {
+        sc_file_writer_swap(writer);
+        if (!sc_file_writer_wait_back(writer)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static int
+sc_file_writer_write_packet(void *opaque, sc_avio_write_buf *buf,
+                            int buf_size) {
+    struct sc_file_writer *writer = opaque;
+
+    const uint8_t *data = buf;
+    size_t len = buf_size;
+
+    sc_mutex_lock(&writer->mutex);
+
+    while (len && !writer->error) {
+        if (writer->front_size == writer->capacity) {
+            // The front buffer is full, it must become the back buffer
+            if (!sc_file_writer_wait_back(writer)) {
+                break;
+            }
+            sc_file_writer_swap(writer);
+        }
+
+        size_t n = MIN(len, writer->capacity - writer->front_size);
+        memcpy(writer->front + writer->front_size, data, n);
+        writer->front_size += n;
+        data += n;
+        len -= n;
+    }
+
+    bool error = writer->error;
+
+    sc_mutex_unlock(&writer->mutex);
+
+    return error ? AVERROR(EIO) : buf_size;
+}
+
+static int64_t
+sc_file_writer_seek(void *opaque, int64_t offset, int whence) {
+    struct sc_file_writer *writer = opaque;
+
+    if (whence == AVSEEK_SIZE) {
+        // Unknown size
+        return AVERROR(ENOSYS);
+    }
+
+    // The muxer seeks to update previously written data (e.g. the MP4 mdat
+    // size), so all the data written so far must reach the file first
+    sc_mutex_lock(&writer->mutex);
+    bool ok = sc_file_writer_drain(writer);
+    sc_mutex_unlock(&writer->mutex);
+
+    if (!ok) {
+        return AVERROR(EIO);
+    }
+
+    // Both buffers are empty, so the I/O thread does not access the file
+    int64_t r = sc_file_seek(writer->fd, offset, whence & ~AVSEEK_FORCE);
+    return r < 0 ? AVERROR(EIO) : r;
+}
+
+static void
+sc_file_writer_report(struct sc_file_writer *writer, sc_tick now) {
+    // The mutex must be locked
+    if (now < writer->next_report) {
+        return;
+    }
+
+    writer->next_report = now + SC_FILE_WRITER_REPORT_INTERVAL;
+
+    struct sc_file_writer_stats *stats = &writer->stats;
+    uint64_t kib_per_write = stats->writes ? stats->bytes / stats->writes / 1024
+                                           : 0;
+    // Throughput while writing, in KiB/s
+    uint64_t throughput = stats->write_time
+                        ? stats->bytes * SC_TICK_FREQ / stats->write_time / 1024
+                        : 0;
+    LOGD("Recording I/O: %" PRIu64 " KiB in %" PRIu64 " writes (%" PRIu64
+         " KiB/write, %" PRIu64 " KiB/s), sync %" PRItick " ms, "
+         "stalled %" PRItick " ms", stats->bytes / 1024, stats->writes,
+         kib_per_write, throughput, SC_TICK_TO_MS(stats->sync_time),
+         SC_TICK_TO_MS(stats->stall_time));
+}
+
+static int
+run_file_writer(void *data) {
+    struct sc_file_writer *writer = data;
+
+    sc_mutex_lock(&writer->mutex);
+
+    for (;;) {
+        while (!writer->stopped && !writer->back_size) {
+            if (!writer->flush_interval) {
+                sc_cond_wait(&writer->cond, &writer->mutex);
+                continue;
+            }
+
+            sc_tick deadline = writer->last_flush + writer->flush_interval;
+            bool signaled =
+                sc_cond_timedwait(&writer->cond, &writer->mutex, deadline);
+            if (!signaled) {
+                if (writer->front_size) {
+                    // Write the pending data even if the buffer is not full
+                    sc_file_writer_swap(writer);
+                } else {
+                    writer->last_flush = sc_tick_now();
+                }
+            }
+        }
+
+        if (!writer->back_size) {
+            assert(writer->stopped);
+            if (!writer->front_size || writer->error) {
+                break;
+            }
+            // Write the remaining data before stopping
+            sc_file_writer_swap(writer);
+        }
+
+        const uint8_t *buf = writer->back;
+        size_t size = writer->back_size;
+        bool error = writer->error;
+
+        sc_mutex_unlock(&writer->mutex);
+
+        sc_tick start = sc_tick_now();
+        bool ok = !error && sc_file_write_all(writer->fd, buf, size);
+        sc_tick now = sc_tick_now();
+        sc_tick write_time = now - start;
+
+        sc_tick sync_time = 0;
+        if (ok && writer->sync_interval
+                && now - writer->last_sync >= writer->sync_interval) {
+            ok = sc_file_sync(writer->fd);
+            writer->last_sync = sc_tick_now();
+            sync_time = writer->last_sync - now;
+            now = writer->last_sync;
+        }
+
+        sc_mutex_lock(&writer->mutex);
+
+        if (ok) {
+            writer->stats.bytes += size;
+            ++writer->stats.writes;
+            writer->stats.write_time += write_time;
+            writer->stats.sync_time += sync_time;
+        } else if (!writer->error) {
+            LOGE("Could not write to the recording file");
+            writer->error = true;
+        }
+
+        writer->back_size = 0;
+        writer->last_flush = now;
+        sc_cond_broadcast(&writer->cond);
+
+        sc_file_writer_report(writer, now);
+    }
+
+    sc_mutex_unlock(&writer->mutex);
+
+    return 0;
+}
+
+bool
+sc_file_writer_open(struct sc_file_writer *writer, const char *filename,
+                    const struct sc_file_writer_params *params) {
+    assert(params->buffer_size);
+
+    writer->capacity = params->buffer_size;
+
+    // av_malloc() returns aligned memory
+    writer->buffers[0] = av_malloc(writer->capacity);
+    if (!writer->buffers[0]) {
+        LOG_OOM();
+        return false;
+    }
+
+    writer->buffers[1] = av_malloc(writer->capacity);
+    if (!writer->buffers[1]) {
+        LOG_OOM();
+        goto error_free_buffer0;
+    }
+
+    uint8_t *avio_buffer = av_malloc(SC_FILE_WRITER_AVIO_BUFFER_SIZE);
+    if (!avio_buffer) {
+        LOG_OOM();
+        goto error_free_buffer1;
+    }
+
+    writer->avio = avio_alloc_context(avio_buffer,
+                                      SC_FILE_WRITER_AVIO_BUFFER_SIZE, 1,
+                                      writer, NULL, sc_file_writer_write_packet,
+                                      sc_file_writer_seek);
+    if (!writer->avio) {
+        LOG_OOM();
+        av_free(avio_buffer);
+        goto error_free_buffer1;
+    }
+
+    bool ok = sc_mutex_init(&writer->mutex);
+    if (!ok) {
+        goto error_free_avio;
+    }
+
+    ok = sc_cond_init(&writer->cond);
+    if (!ok) {
+        goto error_destroy_mutex;
+    }
+
+    writer->fd = sc_file_open_write(filename);
+    if (writer->fd == -1) {
+        goto error_destroy_cond;
+    }
+
+    writer->front = writer->buffers[0];
+    writer->front_size = 0;
+    writer->back = writer->buffers[1];
+    writer->back_size = 0;
+
+    writer->flush_interval = params->flush_interval;
+    writer->sync_interval = params->sync_interval;
+    writer->last_flush = sc_tick_now();
+    writer->last_sync = writer->last_flush;
+    writer->next_report = writer->last_flush + SC_FILE_WRITER_REPORT_INTERVAL;
+
+    writer->stopped = false;
+    writer->error = false;
+
+    writer->stats.bytes = 0;
+    writer->stats.writes = 0;
+    writer->stats.write_time = 0;
+    writer->stats.sync_time = 0;
+    writer->stats.stall_time = 0;
+
+    ok = sc_thread_create(&writer->thread, run_file_writer, "scrcpy-rec-io",
+                          writer);
+    if (!ok) {
+        LOGE("Could not start recording I/O thread");
+        goto error_close_file;
+    }
+
+    return true;
+
+error_close_file:
+    sc_file_close(writer->fd);
+error_destroy_cond:
+    sc_cond_destroy(&writer->cond);
+error_destroy_mutex:
+    sc_mutex_destroy(&writer->mutex);
+error_free_avio:
+    av_freep(&writer->avio->buffer);
+    avio_context_free(&writer->avio);
+error_free_buffer1:
+    av_free(writer->buffers[1]);
+error_free_buffer0:
+    av_free(writer->buffers[0]);
+
+    return false;
+}
+
+bool
+sc_file_writer_close(struct sc_file_writer *writer) {
+    // Move the data from the AVIOContext buffer to the front buffer
+    avio_flush(writer->avio);
+
+    sc_mutex_lock(&writer->mutex);
+    writer->stopped = true;
+    sc_cond_signal(&writer->cond);
+    sc_mutex_unlock(&writer->mutex);
+
+    sc_thread_join(&writer->thread, NULL);
+
+    // The I/O thread is stopped, no need to lock
+    bool ok = !writer->error;
+    if (ok && writer->sync_interval) {
+        // Make sure the whole recording reaches the storage
+        ok = sc_file_sync(writer->fd);
+    }
+
+    sc_file_close(writer->fd);
+
+    writer->next_report = 0; // force the report
+    sc_file_writer_report(writer, sc_tick_now());
+
+    av_freep(&writer->avio->buffer);
+    avio_context_free(&writer->avio);
+
+    sc_cond_destroy(&writer->cond);
+    sc_mutex_destroy(&writer->mutex);
+
+    av_free(writer->buffers[1]);
+    av_free(writer->buffers[0]);
+
+    return ok;
+}
@@ -0,0 +1,78 @@
+#ifndef SC_FILE_WRITER_H
+#define SC_FILE_WRITER_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <libavformat/avio.h>
+
+#include "util/thread.h"
+#include "util/tick.h"
+
+/**
+ * Write-behind file writer, exposed as an AVIOContext
+ *
+ * The muxer writes into a large front buffer, while the back buffer is written
+ * to the file from a dedicated I/O thread. The muxer only blocks when both
+ * buffers are full (the storage is too slow), or on seek.
+ */
+
+struct sc_file_writer_params {
+    size_t buffer_size; // size of each of the 2 buffers
+    sc_tick flush_interval; // 0 to flush only when a buffer is full
+    sc_tick sync_interval; // 0 to never sync explicitly
+};
+
+struct sc_file_writer_stats {
+    uint64_t bytes;
+    uint64_t writes;
+    sc_tick write_time; // total time spent in write()
+    sc_tick sync_time; // total time spent in sync()
+    sc_tick stall_time; // total time the muxer has been blocked
+};
+
+struct sc_file_writer {
+    AVIOContext *avio;
+    int fd;
+
+    sc_thread thread;
+    sc_mutex mutex;
+    sc_cond cond;
+
+    uint8_t *buffers[2];
+    size_t capacity;
+
+    // The front buffer is filled by the muxer
+    uint8_t *front;
+    size_t front_size;
+    // The back buffer is written by the I/O thread (if back_size != 0)
+    uint8_t *back;
+    size_t back_size;
+
+    sc_tick flush_interval;
+    sc_tick sync_interval;
+    sc_tick last_flush; // accessed only from the I/O thread
+    sc_tick last_sync; // accessed only from the I/O thread
+
+    bool stopped;
+    bool error;
+
+    struct sc_file_writer_stats stats;
+    sc_tick next_report; // accessed only from the I/O thread
+};
+
+bool
+sc_file_writer_open(struct sc_file_writer *writer, const char *filename,
+                    const struct sc_file_writer_params *params);
+
+/**
+ * Write all the pending data, then close the file
+ *
+ * Return false if any write failed.
+ */
+bool
+sc_file_writer_close(struct sc_file_writer *writer);
+
+#endif
@@ -2,10 +2,6 @@
 
 #include <stdint.h>
 
-// 1 byte for buttons + padding, 1 byte for X position, 1 byte for Y position,
-// 1 byte for wheel motion
-#define SC_HID_MOUSE_INPUT_SIZE 4
-
 /**
  * Mouse descriptor from the specification:
  * <https://www.usb.org/document-library/device-class-definition-hid-111>
@@ -8,6 +8,10 @@
 
 #define SC_HID_ID_MOUSE 2
 
+// 1 byte for buttons + padding, 1 byte for X position, 1 byte for Y position,
+// 1 byte for wheel motion
+#define SC_HID_MOUSE_INPUT_SIZE 4
+
 void
 sc_hid_mouse_generate_open(struct sc_hid_open *hid_open);
 
@@ -24,6 +24,7 @@ sc_input_manager_init(struct sc_input_manager *im,
 
     im->controller = params->controller;
     im->fp = params->fp;
+    im->replay = params->replay;
     im->screen = params->screen;
     im->kp = params->kp;
     im->mp = params->mp;
@@ -184,21 +185,15 @@ set_device_clipboard(struct sc_input_manager *im, bool paste,
         return false;
     }
 
-    char *text_dup = strdup(text);
-    SDL_free(text);
-    if (!text_dup) {
-        LOGW("Could not strdup input text");
-        return false;
-    }
-
     struct sc_control_msg msg;
     msg.type = SC_CONTROL_MSG_TYPE_SET_CLIPBOARD;
     msg.set_clipboard.sequence = sequence;
-    msg.set_clipboard.text = text_dup;
+    msg.set_clipboard.text = text; // copied by the controller
     msg.set_clipboard.paste = paste;
 
-    if (!sc_controller_push_msg(im->controller, &msg)) {
-        free(text_dup);
+    bool ok = sc_controller_push_msg(im->controller, &msg);
+    SDL_free(text);
+    if (!ok) {
         LOGW("Could not request 'set device clipboard'");
         return false;
     }
@@ -248,18 +243,12 @@ clipboard_paste(struct sc_input_manager *im) {
         return;
     }
 
-    char *text_dup = strdup(text);
-    SDL_free(text);
-    if (!text_dup) {
-        LOGW("Could not strdup input text");
-        return;
-    }
-
     struct sc_control_msg msg;
     msg.type = SC_CONTROL_MSG_TYPE_INJECT_TEXT;
-    msg.inject_text.text = text_dup;
-    if (!sc_controller_push_msg(im->controller, &msg)) {
-        free(text_dup);
+    msg.inject_text.text = text; // copied by the controller
+    bool ok = sc_controller_push_msg(im->controller, &msg);
+    SDL_free(text);
+    if (!ok) {
         LOGW("Could not request 'paste clipboard'");
     }
 }
@@ -520,6 +509,11 @@ sc_input_manager_process_key(struct sc_input_manager *im,
                     sc_screen_resize_to_pixel_perfect(im->screen);
                 }
                 return;
+            case SDLK_e:
+                if (im->replay && !shift && !repeat && down) {
+                    sc_replay_save(im->replay);
+                }
+                return;
             case SDLK_i:
                 if (video && !shift && !repeat && down) {
                     switch_fps_counter_state(im);
@@ -1010,11 +1004,34 @@ sc_input_manager_process_file(struct sc_input_manager *im,
     }
 }
 
+// Return the time of the event, in the sc_tick_now() time base
+static sc_tick
+sc_input_manager_get_event_time(const SDL_Event *event) {
+    sc_tick now = sc_tick_now();
+    if (!event->common.timestamp) {
+        return now;
+    }
+
+    // SDL event timestamps are in milliseconds, relative to SDL_GetTicks()
+    uint32_t age = SDL_GetTicks() - event->common.timestamp;
+    return now - SC_TICK_FROM_MS(age);
+}
+
 void
 sc_input_manager_handle_event(struct sc_input_manager *im,
                               const SDL_Event *event) {
     bool control = im->controller;
     bool paused = im->screen->paused;
+
+    bool timestamps = control && (im->controller->timestamps
+                                  || im->controller->input_timestamps);
+    if (timestamps) {
+        // Timestamp the resulting control messages (for latency statistics
+        // or recording), and send the capture time to the device
+        sc_controller_set_input_time(im->controller,
+                                     sc_input_manager_get_event_time(event));
+    }
+
     switch (event->type) {
         case SDL_TEXTINPUT:
             if (!im->kp || paused) {
@@ -1082,4 +1099,8 @@ sc_input_manager_handle_event(struct sc_input_manager *im,
             sc_input_manager_process_file(im, &event->drop);
         }
     }
+
+    if (timestamps) {
+        sc_controller_set_input_time(im->controller, 0);
+    }
 }
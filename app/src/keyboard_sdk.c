@@ -3,8 +3,6 @@
 #include <assert.h>
 #include <ctype.h>
 #include <stdint.h>
-#include <stdlib.h>
-#include <string.h>
 
 #include "android/input.h"
 #include "android/keycodes.h"
@@ -316,13 +314,8 @@ sc_key_processor_process_text(struct sc_key_processor *kp,
 
     struct sc_control_msg msg;
     msg.type = SC_CONTROL_MSG_TYPE_INJECT_TEXT;
-    msg.inject_text.text = strdup(event->text);
-    if (!msg.inject_text.text) {
-        LOGW("Could not strdup input text");
-        return;
-    }
+    msg.inject_text.text = event->text; // copied by the controller
     if (!sc_controller_push_msg(kb->controller, &msg)) {
-        free(msg.inject_text.text);
         LOGW("Could not request 'inject text'");
     }
 }
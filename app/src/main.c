@@ -1,6 +1,7 @@
 #include "common.h"
 
 #include <stdbool.h>
+#include <string.h>
 #ifdef HAVE_V4L2
 # include <libavdevice/avdevice.h>
 #endif
@@ -10,6 +11,9 @@
 #include "cli.h"
 #include "options.h"
 #include "scrcpy.h"
+#ifdef HAVE_STREAM_OUTPUT
+# include "stream_output.h"
+#endif
 #include "usb/scrcpy_otg.h"
 #include "util/log.h"
 #include "util/net.h"
@@ -30,9 +34,6 @@ main_scrcpy(int argc, char *argv[]) {
     setbuf(stderr, NULL);
 #endif
 
-    printf("scrcpy " SCRCPY_VERSION
-           " <https://github.com/Genymobile/scrcpy>\n");
-
     struct scrcpy_cli_args args = {
         .opts = scrcpy_options_default,
         .help = false,
@@ -46,7 +47,24 @@ main_scrcpy(int argc, char *argv[]) {
 
     enum scrcpy_exit_code ret;
 
-    if (!scrcpy_parse_args(&args, argc, argv)) {
+    bool parsed = scrcpy_parse_args(&args, argc, argv);
+
+#ifdef HAVE_STREAM_OUTPUT
+    const char *stream_output = args.opts.video_stream_output;
+    if (parsed && stream_output && !strcmp(stream_output, "-")) {
+        // The video stream is written to stdout: anything else printed to
+        // stdout from now on, including the banner, goes to stderr
+        if (!sc_stream_output_reserve_stdout()) {
+            ret = SCRCPY_EXIT_FAILURE;
+            goto end;
+        }
+    }
+#endif
+
+    printf("scrcpy " SCRCPY_VERSION
+           " <https://github.com/Genymobile/scrcpy>\n");
+
+    if (!parsed) {
         ret = SCRCPY_EXIT_FAILURE;
         goto end;
     }
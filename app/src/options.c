@@ -5,7 +5,8 @@
 const struct scrcpy_options scrcpy_options_default = {
     .serial = NULL,
     .crop = NULL,
-    .record_filename = NULL,
+    .record_count = 0,
+    .replay_filename = NULL,
     .window_title = NULL,
     .push_target = NULL,
     .render_driver = NULL,
@@ -23,6 +24,8 @@ const struct scrcpy_options scrcpy_options_default = {
     .video_source = SC_VIDEO_SOURCE_DISPLAY,
     .audio_source = SC_AUDIO_SOURCE_AUTO,
     .record_format = SC_RECORD_FORMAT_AUTO,
+    .replay_format = SC_RECORD_FORMAT_AUTO,
+    .record_queue_overflow = SC_RECORD_OVERFLOW_BLOCK,
     .keyboard_input_mode = SC_KEYBOARD_INPUT_MODE_AUTO,
     .mouse_input_mode = SC_MOUSE_INPUT_MODE_AUTO,
     .gamepad_input_mode = SC_GAMEPAD_INPUT_MODE_DISABLED,
@@ -51,11 +54,17 @@ const struct scrcpy_options scrcpy_options_default = {
     .max_size = 0,
     .video_bit_rate = 0,
     .audio_bit_rate = 0,
+    .audio_sample_rate = 0,
+    .audio_channels = 0,
     .max_fps = NULL,
     .capture_orientation = SC_ORIENTATION_0,
     .capture_orientation_lock = SC_ORIENTATION_UNLOCKED,
     .display_orientation = SC_ORIENTATION_0,
     .record_orientation = SC_ORIENTATION_0,
+    .record_queue_limit = 0,
+    .record_io_buffer = 4000000,
+    .record_segment_size = 0,
+    .replay_size = 64000000,
     .window_x = SC_WINDOW_POSITION_UNDEFINED,
     .window_y = SC_WINDOW_POSITION_UNDEFINED,
     .window_width = 0,
@@ -64,12 +73,22 @@ const struct scrcpy_options scrcpy_options_default = {
     .video_buffer = 0,
     .audio_buffer = -1, // depends on the audio format,
     .audio_output_buffer = SC_TICK_FROM_MS(5),
+    .record_flush_interval = SC_TICK_FROM_SEC(1),
+    .record_sync_interval = 0,
+    .record_segment_duration = 0,
+    .replay_duration = SC_TICK_FROM_SEC(30),
     .time_limit = 0,
     .screen_off_timeout = -1,
 #ifdef HAVE_V4L2
     .v4l2_device = NULL,
     .v4l2_buffer = 0,
+    .v4l2_passthrough = false,
 #endif
+#ifdef HAVE_STREAM_OUTPUT
+    .video_stream_output = NULL,
+#endif
+    .video_stream_format = SC_STREAM_FORMAT_ANNEXB,
+    .video_stream_server_port = 0,
 #ifdef HAVE_USB
     .otg = false,
 #endif
@@ -97,6 +116,11 @@ const struct scrcpy_options scrcpy_options_default = {
     .select_usb = false,
     .cleanup = true,
     .start_fps_counter = false,
+    .print_input_latency = false,
+    .input_timestamps = true,
+    .control_record_filename = NULL,
+    .control_replay_filename = NULL,
+    .control_replay_speed = 1.0f,
     .power_on = true,
     .video = true,
     .audio = true,
@@ -107,6 +131,8 @@ const struct scrcpy_options scrcpy_options_default = {
     .window = true,
     .mouse_hover = true,
     .audio_dup = false,
+    .av_sync = false,
+    .record_fragmented = false,
     .new_display = NULL,
     .start_app = NULL,
     .angle = NULL,
@@ -29,6 +29,28 @@ enum sc_record_format {
     SC_RECORD_FORMAT_WAV,
 };
 
+// Maximum number of --record outputs
+#define SC_MAX_RECORDS 4
+
+struct sc_record_output {
+    const char *filename;
+    enum sc_record_format format;
+    // Streams to record (if captured)
+    bool video;
+    bool audio;
+};
+
+enum sc_record_overflow {
+    SC_RECORD_OVERFLOW_BLOCK,
+    SC_RECORD_OVERFLOW_DROP,
+    SC_RECORD_OVERFLOW_ABORT,
+};
+
+enum sc_stream_format {
+    SC_STREAM_FORMAT_ANNEXB,
+    SC_STREAM_FORMAT_SCRCPY,
+};
+
 static inline bool
 sc_record_format_is_audio_only(enum sc_record_format fmt) {
     return fmt == SC_RECORD_FORMAT_M4A
@@ -212,10 +234,16 @@ struct sc_port_range {
 
 #define SC_WINDOW_POSITION_UNDEFINED (-0x8000)
 
+// Use the smallest possible audio output buffer
+#define SC_AUDIO_OUTPUT_BUFFER_AUTO ((sc_tick) -1)
+
 struct scrcpy_options {
     const char *serial;
     const char *crop;
-    const char *record_filename;
+    // all the outputs share the same packets
+    struct sc_record_output records[SC_MAX_RECORDS];
+    unsigned record_count;
+    const char *replay_filename;
     const char *window_title;
     const char *push_target;
     const char *render_driver;
@@ -232,7 +260,9 @@ struct scrcpy_options {
     enum sc_codec audio_codec;
     enum sc_video_source video_source;
     enum sc_audio_source audio_source;
-    enum sc_record_format record_format;
+    enum sc_record_format record_format; // forced by --record-format
+    enum sc_record_format replay_format;
+    enum sc_record_overflow record_queue_overflow;
     enum sc_keyboard_input_mode keyboard_input_mode;
     enum sc_mouse_input_mode mouse_input_mode;
     enum sc_gamepad_input_mode gamepad_input_mode;
@@ -245,12 +275,18 @@ struct scrcpy_options {
     uint16_t max_size;
     uint32_t video_bit_rate;
     uint32_t audio_bit_rate;
+    uint32_t audio_sample_rate; // 0 for the server default (48000)
+    uint8_t audio_channels; // 0 for the server default (2)
     const char *max_fps; // float to be parsed by the server
     const char *angle; // float to be parsed by the server
     enum sc_orientation capture_orientation;
     enum sc_orientation_lock capture_orientation_lock;
     enum sc_orientation display_orientation;
     enum sc_orientation record_orientation;
+    uint32_t record_queue_limit; // in bytes, 0 for unlimited
+    uint32_t record_io_buffer; // in bytes, 0 to let FFmpeg write the file
+    uint32_t record_segment_size; // in bytes, 0 for no size limit
+    uint32_t replay_size; // in bytes, 0 for unlimited
     int16_t window_x; // SC_WINDOW_POSITION_UNDEFINED for "auto"
     int16_t window_y; // SC_WINDOW_POSITION_UNDEFINED for "auto"
     uint16_t window_width;
@@ -258,13 +294,23 @@ struct scrcpy_options {
     uint32_t display_id;
     sc_tick video_buffer;
     sc_tick audio_buffer;
-    sc_tick audio_output_buffer;
+    sc_tick audio_output_buffer; // or SC_AUDIO_OUTPUT_BUFFER_AUTO
+    sc_tick record_flush_interval;
+    sc_tick record_sync_interval;
+    sc_tick record_segment_duration;
+    sc_tick replay_duration;
     sc_tick time_limit;
     sc_tick screen_off_timeout;
 #ifdef HAVE_V4L2
     const char *v4l2_device;
     sc_tick v4l2_buffer;
+    bool v4l2_passthrough;
+#endif
+#ifdef HAVE_STREAM_OUTPUT
+    const char *video_stream_output;
 #endif
+    enum sc_stream_format video_stream_format;
+    uint16_t video_stream_server_port; // 0 to disable the stream server
 #ifdef HAVE_USB
     bool otg;
 #endif
@@ -292,6 +338,11 @@ struct scrcpy_options {
     bool select_tcpip;
     bool cleanup;
     bool start_fps_counter;
+    bool print_input_latency;
+    bool input_timestamps;
+    const char *control_record_filename;
+    const char *control_replay_filename;
+    float control_replay_speed;
     bool power_on;
     bool video;
     bool audio;
@@ -307,6 +358,8 @@ struct scrcpy_options {
     bool window;
     bool mouse_hover;
     bool audio_dup;
+    bool av_sync;
+    bool record_fragmented;
     const char *new_display; // [<width>x<height>][/<dpi>] parsed by the server
     const char *start_app;
     bool vd_destroy_content;
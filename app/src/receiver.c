@@ -2,6 +2,8 @@
 
 #include <assert.h>
 #include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
 #include <SDL2/SDL_clipboard.h>
 
 #include "device_msg.h"
@@ -10,11 +12,12 @@
 #include "util/str.h"
 #include "util/thread.h"
 
-struct sc_uhid_output_task_data {
-    struct sc_uhid_devices *uhid_devices;
-    uint16_t id;
-    uint16_t size;
+// The pending data of the ring buffer are [tail, tail + used), modulo
+// DEVICE_MSG_MAX_SIZE
+struct sc_receiver_ring {
     uint8_t *data;
+    size_t tail;
+    size_t used;
 };
 
 bool
@@ -29,6 +32,13 @@ sc_receiver_init(struct sc_receiver *receiver, sc_socket control_socket,
     receiver->acksync = NULL;
     receiver->uhid_devices = NULL;
 
+    for (size_t i = 0; i < SC_RECEIVER_UHID_OUTPUT_SLOTS; ++i) {
+        struct sc_receiver_uhid_output *output = &receiver->uhid_outputs[i];
+        output->receiver = receiver;
+        output->pooled = true;
+        output->busy = false;
+    }
+
     assert(cbs && cbs->on_ended);
     receiver->cbs = cbs;
     receiver->cbs_userdata = cbs_userdata;
@@ -60,25 +70,91 @@ task_set_clipboard(void *userdata) {
     free(text);
 }
 
+static struct sc_receiver_uhid_output *
+sc_receiver_acquire_uhid_output(struct sc_receiver *receiver, size_t size) {
+    struct sc_receiver_uhid_output *output = NULL;
+
+    if (size <= SC_RECEIVER_UHID_OUTPUT_INLINE_SIZE) {
+        sc_mutex_lock(&receiver->mutex);
+        for (size_t i = 0; i < SC_RECEIVER_UHID_OUTPUT_SLOTS; ++i) {
+            if (!receiver->uhid_outputs[i].busy) {
+                output = &receiver->uhid_outputs[i];
+                output->busy = true;
+                break;
+            }
+        }
+        sc_mutex_unlock(&receiver->mutex);
+
+        if (output) {
+            output->data = output->inline_data;
+            return output;
+        }
+    }
+
+    // Too large, or the main thread is late: allocate
+    output = malloc(sizeof(*output));
+    if (!output) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    if (size <= SC_RECEIVER_UHID_OUTPUT_INLINE_SIZE) {
+        output->data = output->inline_data;
+    } else {
+        output->data = malloc(size);
+        if (!output->data) {
+            LOG_OOM();
+            free(output);
+            return NULL;
+        }
+    }
+
+    output->receiver = receiver;
+    output->pooled = false;
+    return output;
+}
+
+static void
+sc_receiver_release_uhid_output(struct sc_receiver_uhid_output *output) {
+    if (output->pooled) {
+        struct sc_receiver *receiver = output->receiver;
+        sc_mutex_lock(&receiver->mutex);
+        output->busy = false;
+        sc_mutex_unlock(&receiver->mutex);
+    } else {
+        if (output->data != output->inline_data) {
+            free(output->data);
+        }
+        free(output);
+    }
+}
+
 static void
 task_uhid_output(void *userdata) {
     assert(sc_thread_get_id() == SC_MAIN_THREAD_ID);
 
-    struct sc_uhid_output_task_data *data = userdata;
+    struct sc_receiver_uhid_output *output = userdata;
 
-    sc_uhid_devices_process_hid_output(data->uhid_devices, data->id, data->data,
-                                       data->size);
+    sc_uhid_devices_process_hid_output(output->receiver->uhid_devices,
+                                       output->id, output->data, output->size);
 
-    free(data->data);
-    free(data);
+    sc_receiver_release_uhid_output(output);
 }
 
+// The msg payloads point into the receiver buffer: they must be copied if
+// they are used after this function returns
 static void
-process_msg(struct sc_receiver *receiver, struct sc_device_msg *msg) {
+process_msg(struct sc_receiver *receiver, const struct sc_device_msg *msg) {
     switch (msg->type) {
         case DEVICE_MSG_TYPE_CLIPBOARD: {
-            // Take ownership of the text (do not destroy the msg)
-            char *text = msg->clipboard.text;
+            size_t len = msg->clipboard.len;
+            char *text = malloc(len + 1);
+            if (!text) {
+                LOG_OOM();
+                return;
+            }
+            memcpy(text, msg->clipboard.text, len);
+            text[len] = '\0';
 
             bool ok = sc_post_to_main_thread(task_set_clipboard, text);
             if (!ok) {
@@ -104,9 +180,8 @@ process_msg(struct sc_receiver *receiver, struct sc_device_msg *msg) {
             }
 
             sc_acksync_ack(receiver->acksync, msg->ack_clipboard.sequence);
-            // No allocation to free in the msg
             break;
-        case DEVICE_MSG_TYPE_UHID_OUTPUT:
+        case DEVICE_MSG_TYPE_UHID_OUTPUT: {
             if (sc_get_log_level() <= SC_LOG_LEVEL_VERBOSE) {
                 char *hex = sc_str_to_hex_string(msg->uhid_output.data,
                                                  msg->uhid_output.size);
@@ -122,59 +197,105 @@ process_msg(struct sc_receiver *receiver, struct sc_device_msg *msg) {
 
             if (!receiver->uhid_devices) {
                 LOGE("Received unexpected HID output message");
-                sc_device_msg_destroy(msg);
                 return;
             }
 
-            struct sc_uhid_output_task_data *data = malloc(sizeof(*data));
-            if (!data) {
-                LOG_OOM();
+            uint16_t size = msg->uhid_output.size;
+            struct sc_receiver_uhid_output *output =
+                sc_receiver_acquire_uhid_output(receiver, size);
+            if (!output) {
                 return;
             }
 
-            // It is guaranteed that these pointers will still be valid when
-            // the main thread will process them (the main thread will stop
-            // processing SC_EVENT_RUN_ON_MAIN_THREAD on exit, when everything
-            // gets deinitialized)
-            data->uhid_devices = receiver->uhid_devices;
-            data->id = msg->uhid_output.id;
-            data->data = msg->uhid_output.data; // take ownership
-            data->size = msg->uhid_output.size;
+            // It is guaranteed that the receiver and the UHID devices will
+            // still be valid when the main thread will process the output
+            // (the main thread will stop processing SC_EVENT_RUN_ON_MAIN_THREAD
+            // on exit, when everything gets deinitialized)
+            output->id = msg->uhid_output.id;
+            output->size = size;
+            memcpy(output->data, msg->uhid_output.data, size);
 
-            bool ok = sc_post_to_main_thread(task_uhid_output, data);
+            bool ok = sc_post_to_main_thread(task_uhid_output, output);
             if (!ok) {
                 LOGW("Could not post UHID output to main thread");
-                free(data->data);
-                free(data);
+                sc_receiver_release_uhid_output(output);
                 return;
             }
 
             break;
+        }
     }
 }
 
-static ssize_t
-process_msgs(struct sc_receiver *receiver, const uint8_t *buf, size_t len) {
-    size_t head = 0;
-    for (;;) {
-        struct sc_device_msg msg;
-        ssize_t r = sc_device_msg_deserialize(&buf[head], len - head, &msg);
-        if (r == -1) {
-            return -1;
+// Copy the len first pending bytes of the ring buffer
+static void
+sc_receiver_ring_copy(const struct sc_receiver_ring *ring, uint8_t *dst,
+                      size_t len) {
+    assert(len <= ring->used);
+    size_t first = MIN(len, DEVICE_MSG_MAX_SIZE - ring->tail);
+    memcpy(dst, &ring->data[ring->tail], first);
+    memcpy(dst + first, ring->data, len - first);
+}
+
+// Process all the complete messages of the ring buffer, in place (only the
+// messages wrapping around the end of the buffer are copied to linear)
+// return false on error
+static bool
+process_msgs(struct sc_receiver *receiver, struct sc_receiver_ring *ring,
+             uint8_t *linear) {
+    while (ring->used) {
+        size_t contiguous = MIN(ring->used, DEVICE_MSG_MAX_SIZE - ring->tail);
+        const uint8_t *buf = &ring->data[ring->tail];
+
+        ssize_t size = sc_device_msg_get_size(buf, contiguous);
+        if (size == -1) {
+            return false;
         }
-        if (r == 0) {
-            return head;
+
+        if (!size || (size_t) size > contiguous) {
+            if (contiguous == ring->used) {
+                // No complete message
+                return true;
+            }
+
+            // The message wraps around the end of the ring buffer
+            if (!size) {
+                // Even its header
+                size_t len = MIN(ring->used, DEVICE_MSG_HEADER_MAX_SIZE);
+                sc_receiver_ring_copy(ring, linear, len);
+                size = sc_device_msg_get_size(linear, len);
+                if (size == -1) {
+                    return false;
+                }
+                if (!size) {
+                    // No complete header
+                    return true;
+                }
+            }
+
+            if ((size_t) size > ring->used) {
+                // No complete message
+                return true;
+            }
+
+            sc_receiver_ring_copy(ring, linear, size);
+            buf = linear;
         }
 
+        struct sc_device_msg msg;
+        ssize_t r = sc_device_msg_deserialize(buf, size, &msg);
+        assert(r == size);
+        (void) r;
+
         process_msg(receiver, &msg);
-        // the device msg must be destroyed by process_msg()
 
-        head += r;
-        assert(head <= len);
-        if (head == len) {
-            return head;
-        }
+        ring->tail = (ring->tail + size) % DEVICE_MSG_MAX_SIZE;
+        ring->used -= size;
     }
+
+    // Restart from the beginning, to receive into the whole buffer
+    ring->tail = 0;
+    return true;
 }
 
 static int
@@ -182,33 +303,39 @@ run_receiver(void *data) {
     struct sc_receiver *receiver = data;
 
     static uint8_t buf[DEVICE_MSG_MAX_SIZE];
-    size_t head = 0;
+    // For the messages wrapping around the end of the ring buffer
+    static uint8_t linear[DEVICE_MSG_MAX_SIZE];
+
+    struct sc_receiver_ring ring = {
+        .data = buf,
+        .tail = 0,
+        .used = 0,
+    };
 
     bool error = false;
 
     for (;;) {
-        assert(head < DEVICE_MSG_MAX_SIZE);
-        ssize_t r = net_recv(receiver->control_socket, buf + head,
-                             DEVICE_MSG_MAX_SIZE - head);
+        // A complete message never exceeds DEVICE_MSG_MAX_SIZE, so the buffer
+        // is never full after processing
+        assert(ring.used < DEVICE_MSG_MAX_SIZE);
+        size_t head = (ring.tail + ring.used) % DEVICE_MSG_MAX_SIZE;
+        // Receive into the contiguous free space
+        size_t avail = head >= ring.tail ? DEVICE_MSG_MAX_SIZE - head
+                                         : ring.tail - head;
+        ssize_t r = net_recv(receiver->control_socket, &buf[head], avail);
         if (r <= 0) {
             LOGD("Receiver stopped");
             // device disconnected: keep error=false
             break;
         }
 
-        head += r;
-        ssize_t consumed = process_msgs(receiver, buf, head);
-        if (consumed == -1) {
+        ring.used += r;
+        bool ok = process_msgs(receiver, &ring, linear);
+        if (!ok) {
             // an error occurred
             error = true;
             break;
         }
-
-        if (consumed) {
-            head -= consumed;
-            // shift the remaining data in the buffer
-            memmove(buf, &buf[consumed], head);
-        }
     }
 
     receiver->cbs->on_ended(receiver, error, receiver->cbs_userdata);
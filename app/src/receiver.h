@@ -4,12 +4,30 @@
 #include "common.h"
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "uhid/uhid_output.h"
 #include "util/acksync.h"
 #include "util/net.h"
 #include "util/thread.h"
 
+// Number of UHID outputs which may be pending on the main thread without any
+// allocation
+#define SC_RECEIVER_UHID_OUTPUT_SLOTS 16
+// Larger UHID outputs are allocated
+#define SC_RECEIVER_UHID_OUTPUT_INLINE_SIZE 64
+
+// A UHID output to be processed on the main thread
+struct sc_receiver_uhid_output {
+    struct sc_receiver *receiver;
+    uint16_t id;
+    uint16_t size;
+    uint8_t *data; // points to inline_data, unless the output is too large
+    uint8_t inline_data[SC_RECEIVER_UHID_OUTPUT_INLINE_SIZE];
+    bool pooled; // false if this task has been allocated
+    bool busy; // protected by receiver->mutex
+};
+
 // receive events from the device
 // managed by the controller
 struct sc_receiver {
@@ -17,6 +35,9 @@ struct sc_receiver {
     sc_thread thread;
     sc_mutex mutex;
 
+    // Released by the main thread once processed
+    struct sc_receiver_uhid_output uhid_outputs[SC_RECEIVER_UHID_OUTPUT_SLOTS];
+
     struct sc_acksync *acksync;
     struct sc_uhid_devices *uhid_devices;
 
@@ -9,6 +9,7 @@
 #include <libavutil/time.h>
 #include <libavutil/display.h>
 
+#include "util/file.h"
 #include "util/log.h"
 #include "util/str.h"
 
@@ -20,6 +21,8 @@
 
 static const AVRational SCRCPY_TIME_BASE = {1, 1000000}; // timestamps in us
 
+#define SC_RECORDER_QUEUE_REPORT_INTERVAL SC_TICK_FROM_SEC(10)
+
 static const AVOutputFormat *
 find_muxer(const char *name) {
 #ifdef SCRCPY_LAVF_HAS_NEW_MUXER_ITERATOR_API
@@ -53,14 +56,50 @@ sc_recorder_packet_ref(const AVPacket *packet) {
     return p;
 }
 
+static AVPacket *
+sc_recorder_queue_pop(struct sc_recorder *recorder,
+                      struct sc_recorder_queue *queue) {
+    // The mutex must be locked
+    assert(!sc_vecdeque_is_empty(queue));
+    AVPacket *p = sc_vecdeque_pop(queue);
+
+    assert(recorder->queue_bytes >= (size_t) p->size);
+    recorder->queue_bytes -= p->size;
+
+    if (recorder->queue_limit) {
+        // Wake up the producers blocked on a full queue
+        sc_cond_broadcast(&recorder->queue_cond);
+    }
+
+    return p;
+}
+
 static void
-sc_recorder_queue_clear(struct sc_recorder_queue *queue) {
+sc_recorder_queue_clear(struct sc_recorder *recorder,
+                        struct sc_recorder_queue *queue) {
     while (!sc_vecdeque_is_empty(queue)) {
-        AVPacket *p = sc_vecdeque_pop(queue);
+        AVPacket *p = sc_recorder_queue_pop(recorder, queue);
         av_packet_free(&p);
     }
 }
 
+static void
+sc_recorder_report_queue(struct sc_recorder *recorder) {
+    // The mutex must be locked
+    sc_tick now = sc_tick_now();
+    if (now < recorder->stats.next_report) {
+        return;
+    }
+
+    recorder->stats.next_report = now + SC_RECORDER_QUEUE_REPORT_INTERVAL;
+
+    LOGD("Recorder queue: %" SC_PRIsizet " video + %" SC_PRIsizet " audio "
+         "packets, %" SC_PRIsizet " KiB (max %" SC_PRIsizet " KiB)",
+         sc_vecdeque_size(&recorder->video_queue),
+         sc_vecdeque_size(&recorder->audio_queue),
+         recorder->queue_bytes / 1024, recorder->stats.max_bytes / 1024);
+}
+
 static const char *
 sc_recorder_get_format_name(enum sc_record_format format) {
     switch (format) {
@@ -83,7 +122,7 @@ sc_recorder_get_format_name(enum sc_record_format format) {
 }
 
 static bool
-sc_recorder_set_extradata(AVStream *ostream, const AVPacket *packet) {
+sc_recorder_set_extradata(AVCodecParameters *par, const AVPacket *packet) {
     uint8_t *extradata = av_malloc(packet->size * sizeof(uint8_t));
     if (!extradata) {
         LOG_OOM();
@@ -93,8 +132,9 @@ sc_recorder_set_extradata(AVStream *ostream, const AVPacket *packet) {
     // copy the first packet to the extra data
     memcpy(extradata, packet->data, packet->size);
 
-    ostream->codecpar->extradata = extradata;
-    ostream->codecpar->extradata_size = packet->size;
+    av_freep(&par->extradata);
+    par->extradata = extradata;
+    par->extradata_size = packet->size;
     return true;
 }
 
@@ -103,10 +143,20 @@ sc_recorder_rescale_packet(AVStream *stream, AVPacket *packet) {
     av_packet_rescale_ts(packet, SCRCPY_TIME_BASE, stream->time_base);
 }
 
+static inline bool
+sc_recorder_is_segmented(struct sc_recorder *recorder) {
+    return recorder->segment_duration || recorder->segment_size;
+}
+
+// The packet pts must be relative to the start of the segment
 static bool
-sc_recorder_write_stream(struct sc_recorder *recorder,
+sc_recorder_write_stream(struct sc_recorder_output *output,
                          struct sc_recorder_stream *st, AVPacket *packet) {
-    AVStream *stream = recorder->ctx->streams[st->index];
+    AVFormatContext *ctx = output->ctx;
+    AVStream *stream = ctx->streams[st->index];
+
+    packet->dts = packet->pts;
+
     sc_recorder_rescale_packet(stream, packet);
     if (st->last_pts != AV_NOPTS_VALUE && packet->pts <= st->last_pts) {
         LOGD("Fixing PTS non monotonically increasing in stream %d "
@@ -117,66 +167,561 @@ sc_recorder_write_stream(struct sc_recorder *recorder,
     } else {
         st->last_pts = packet->pts;
     }
-    return av_interleaved_write_frame(recorder->ctx, packet) >= 0;
+    return av_interleaved_write_frame(ctx, packet) >= 0;
 }
 
 static inline bool
 sc_recorder_write_video(struct sc_recorder *recorder, AVPacket *packet) {
-    return sc_recorder_write_stream(recorder, &recorder->video_stream, packet);
+    // Each segment starts at 0
+    packet->pts = sc_recorder_segments_video_pts(&recorder->segments,
+                                                 packet->pts);
+    return sc_recorder_write_stream(recorder->output, &recorder->video_stream,
+                                    packet);
 }
 
-static inline bool
+static bool
+sc_recorder_close_previous_segment(struct sc_recorder *recorder);
+
+static bool
 sc_recorder_write_audio(struct sc_recorder *recorder, AVPacket *packet) {
-    return sc_recorder_write_stream(recorder, &recorder->audio_stream, packet);
+    bool close_previous;
+    enum sc_recorder_segment segment =
+        sc_recorder_segments_route_audio(&recorder->segments, packet->pts,
+                                         &packet->pts, &close_previous);
+    if (close_previous && !sc_recorder_close_previous_segment(recorder)) {
+        return false;
+    }
+
+    if (segment == SC_RECORDER_SEGMENT_PREVIOUS) {
+        // A late audio packet, older than the first video keyframe of the
+        // current segment
+        return sc_recorder_write_stream(recorder->previous_output,
+                                        &recorder->previous_audio_stream,
+                                        packet);
+    }
+
+    return sc_recorder_write_stream(recorder->output, &recorder->audio_stream,
+                                    packet);
 }
 
 static bool
-sc_recorder_open_output_file(struct sc_recorder *recorder) {
+sc_recorder_set_fragmented(struct sc_recorder *recorder, AVDictionary **opts) {
+    // Write a moov atom without samples at the beginning of the file, then a
+    // fragment (moof + mdat) for each GOP. The file is playable even if it is
+    // not finalized, and the muxer does not need to keep the whole index in
+    // memory until the end.
+    const char *movflags;
+    const char *frag_duration;
+    if (recorder->video) {
+        movflags = "frag_keyframe+empty_moov+default_base_moof";
+        frag_duration = NULL;
+    } else {
+        // frag_keyframe only applies to video keyframes
+        movflags = "empty_moov+default_base_moof";
+        frag_duration = "1000000"; // 1 second
+    }
+
+    int r = av_dict_set(opts, "movflags", movflags, 0);
+    if (r < 0) {
+        LOG_OOM();
+        return false;
+    }
+
+    if (frag_duration) {
+        r = av_dict_set(opts, "frag_duration", frag_duration, 0);
+        if (r < 0) {
+            LOG_OOM();
+            av_dict_free(opts);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool
+sc_recorder_set_orientation(AVStream *stream, enum sc_orientation orientation) {
+    assert(!sc_orientation_is_mirror(orientation));
+
+    uint8_t *raw_data;
+#ifdef SCRCPY_LAVC_HAS_CODECPAR_CODEC_SIDEDATA
+    AVPacketSideData *sd =
+        av_packet_side_data_new(&stream->codecpar->coded_side_data,
+                                &stream->codecpar->nb_coded_side_data,
+                                AV_PKT_DATA_DISPLAYMATRIX,
+                                sizeof(int32_t) * 9, 0);
+    if (!sd) {
+        LOG_OOM();
+        return false;
+    }
+
+    raw_data = sd->data;
+#else
+    raw_data = av_stream_new_side_data(stream, AV_PKT_DATA_DISPLAYMATRIX,
+                                      sizeof(int32_t) * 9);
+    if (!raw_data) {
+        LOG_OOM();
+        return false;
+    }
+#endif
+
+    int32_t *matrix = (int32_t *) raw_data;
+
+    unsigned rotation = orientation;
+    unsigned angle = rotation * 90;
+
+    av_display_rotation_set(matrix, angle);
+
+    return true;
+}
+
+static struct sc_recorder_output *
+sc_recorder_output_open(struct sc_recorder *recorder, const char *filename) {
     const char *format_name = sc_recorder_get_format_name(recorder->format);
     assert(format_name);
     const AVOutputFormat *format = find_muxer(format_name);
     if (!format) {
         LOGE("Could not find muxer");
-        return false;
+        return NULL;
     }
 
-    recorder->ctx = avformat_alloc_context();
-    if (!recorder->ctx) {
+    // Allocated because the file writer I/O thread keeps a pointer to it
+    struct sc_recorder_output *output = malloc(sizeof(*output));
+    if (!output) {
         LOG_OOM();
-        return false;
+        return NULL;
     }
 
-    char *file_url = sc_str_concat("file:", recorder->filename);
-    if (!file_url) {
-        avformat_free_context(recorder->ctx);
-        return false;
+    output->filename = strdup(filename);
+    if (!output->filename) {
+        LOG_OOM();
+        goto error_free_output;
     }
 
-    int ret = avio_open(&recorder->ctx->pb, file_url, AVIO_FLAG_WRITE);
-    free(file_url);
-    if (ret < 0) {
-        LOGE("Failed to open output file: %s", recorder->filename);
-        avformat_free_context(recorder->ctx);
-        return false;
+    output->ctx = avformat_alloc_context();
+    if (!output->ctx) {
+        LOG_OOM();
+        goto error_free_filename;
+    }
+
+    if (recorder->io_params.buffer_size) {
+        bool ok = sc_file_writer_open(&output->writer, filename,
+                                      &recorder->io_params);
+        if (!ok) {
+            LOGE("Failed to open output file: %s", filename);
+            goto error_free_ctx;
+        }
+
+        output->ctx->pb = output->writer.avio;
+        // Pass every packet to the writer immediately, it buffers them anyway
+        output->ctx->flush_packets = 1;
+    } else {
+        char *file_url = sc_str_concat("file:", filename);
+        if (!file_url) {
+            goto error_free_ctx;
+        }
+
+        int ret = avio_open(&output->ctx->pb, file_url, AVIO_FLAG_WRITE);
+        free(file_url);
+        if (ret < 0) {
+            LOGE("Failed to open output file: %s", filename);
+            goto error_free_ctx;
+        }
     }
 
     // contrary to the deprecated API (av_oformat_next()), av_muxer_iterate()
     // returns (on purpose) a pointer-to-const, but AVFormatContext.oformat
     // still expects a pointer-to-non-const (it has not be updated accordingly)
     // <https://github.com/FFmpeg/FFmpeg/commit/0694d8702421e7aff1340038559c438b61bb30dd>
-    recorder->ctx->oformat = (AVOutputFormat *) format;
+    output->ctx->oformat = (AVOutputFormat *) format;
 
-    av_dict_set(&recorder->ctx->metadata, "comment",
+    av_dict_set(&output->ctx->metadata, "comment",
                 "Recorded by scrcpy " SCRCPY_VERSION, 0);
 
-    LOGI("Recording started to %s file: %s", format_name, recorder->filename);
-    return true;
+    return output;
+
+error_free_ctx:
+    avformat_free_context(output->ctx);
+error_free_filename:
+    free(output->filename);
+error_free_output:
+    free(output);
+
+    return NULL;
+}
+
+static bool
+sc_recorder_output_close_file(struct sc_recorder *recorder,
+                              struct sc_recorder_output *output) {
+    bool ok = true;
+    if (recorder->io_params.buffer_size) {
+        ok = sc_file_writer_close(&output->writer);
+        if (!ok) {
+            LOGE("Failed to write to %s", output->filename);
+        }
+    } else {
+        avio_close(output->ctx->pb);
+    }
+    avformat_free_context(output->ctx);
+    return ok;
+}
+
+static bool
+sc_recorder_output_close(struct sc_recorder *recorder,
+                         struct sc_recorder_output *output) {
+    bool ok = sc_recorder_output_close_file(recorder, output);
+    free(output->filename);
+    free(output);
+    return ok;
+}
+
+static bool
+sc_recorder_output_finalize(struct sc_recorder *recorder,
+                            struct sc_recorder_output *output) {
+    bool ok = av_write_trailer(output->ctx) >= 0;
+    if (!ok) {
+        LOGE("Failed to write trailer to %s", output->filename);
+    }
+
+    bool closed = sc_recorder_output_close(recorder, output);
+    return ok && closed;
 }
 
 static void
-sc_recorder_close_output_file(struct sc_recorder *recorder) {
-    avio_close(recorder->ctx->pb);
-    avformat_free_context(recorder->ctx);
+sc_recorder_output_discard(struct sc_recorder *recorder,
+                           struct sc_recorder_output *output) {
+    sc_recorder_output_close_file(recorder, output);
+
+    if (!sc_file_remove(output->filename)) {
+        LOGW("Could not remove unused recording file: %s", output->filename);
+    }
+
+    free(output->filename);
+    free(output);
+}
+
+static bool
+sc_recorder_output_add_stream(struct sc_recorder_output *output, int index,
+                              const AVCodecParameters *par) {
+    AVStream *stream = avformat_new_stream(output->ctx, NULL);
+    if (!stream) {
+        LOG_OOM();
+        return false;
+    }
+
+    assert(stream->index == index);
+    (void) index;
+
+    if (avcodec_parameters_copy(stream->codecpar, par) < 0) {
+        LOG_OOM();
+        return false;
+    }
+
+    return true;
+}
+
+static bool
+sc_recorder_output_write_header(struct sc_recorder *recorder,
+                                struct sc_recorder_output *output) {
+    // The codec parameters (including the extradata) are immutable once the
+    // first header is written, so this may be called from any thread
+    if (recorder->video) {
+        int index = recorder->video_stream.index;
+        bool ok = sc_recorder_output_add_stream(output, index,
+                                                recorder->video_codecpar);
+        if (!ok) {
+            return false;
+        }
+
+        if (recorder->orientation != SC_ORIENTATION_0) {
+            AVStream *stream = output->ctx->streams[index];
+            if (!sc_recorder_set_orientation(stream, recorder->orientation)) {
+                return false;
+            }
+        }
+    }
+
+    if (recorder->audio) {
+        bool ok = sc_recorder_output_add_stream(output,
+                                                recorder->audio_stream.index,
+                                                recorder->audio_codecpar);
+        if (!ok) {
+            return false;
+        }
+    }
+
+    AVDictionary *opts = NULL;
+    if (recorder->fragmented) {
+        assert(!strcmp(sc_recorder_get_format_name(recorder->format), "mp4"));
+        if (!sc_recorder_set_fragmented(recorder, &opts)) {
+            return false;
+        }
+    }
+
+    int r = avformat_write_header(output->ctx, &opts);
+    av_dict_free(&opts);
+    if (r < 0) {
+        LOGE("Failed to write header to %s", output->filename);
+        return false;
+    }
+
+    return true;
+}
+
+static struct sc_recorder_output *
+sc_recorder_output_prepare(struct sc_recorder *recorder, unsigned index) {
+    char *filename = sc_str_format_index(recorder->filename, index);
+    if (!filename) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    struct sc_recorder_output *output =
+        sc_recorder_output_open(recorder, filename);
+    free(filename);
+    if (!output) {
+        return NULL;
+    }
+
+    if (!sc_recorder_output_write_header(recorder, output)) {
+        sc_recorder_output_discard(recorder, output);
+        return NULL;
+    }
+
+    return output;
+}
+
+static int
+run_recorder_segmenter(void *data) {
+    struct sc_recorder *recorder = data;
+    struct sc_recorder_segmenter *seg = &recorder->segmenter;
+
+    sc_mutex_lock(&seg->mutex);
+
+    for (;;) {
+        while (!seg->stopped && !seg->error && !seg->to_close && seg->next) {
+            sc_cond_wait(&seg->cond, &seg->mutex);
+        }
+
+        // Always finalize the previous segment, even if stopped
+        if (seg->to_close) {
+            struct sc_recorder_output *output = seg->to_close;
+            sc_mutex_unlock(&seg->mutex);
+            bool ok = sc_recorder_output_finalize(recorder, output);
+            sc_mutex_lock(&seg->mutex);
+
+            seg->to_close = NULL;
+            if (!ok) {
+                seg->error = true;
+            }
+            sc_cond_broadcast(&seg->cond);
+            continue;
+        }
+
+        if (seg->stopped || seg->error) {
+            break;
+        }
+
+        // Open the next segment in advance
+        assert(!seg->next);
+        unsigned index = seg->next_index++;
+        sc_mutex_unlock(&seg->mutex);
+        struct sc_recorder_output *next =
+            sc_recorder_output_prepare(recorder, index);
+        sc_mutex_lock(&seg->mutex);
+
+        if (next) {
+            seg->next = next;
+        } else {
+            seg->error = true;
+        }
+        sc_cond_broadcast(&seg->cond);
+    }
+
+    struct sc_recorder_output *unused = seg->next;
+    seg->next = NULL;
+
+    sc_mutex_unlock(&seg->mutex);
+
+    if (unused) {
+        // The recording ended before the next segment was needed
+        sc_recorder_output_discard(recorder, unused);
+    }
+
+    LOGD("Recorder segmenter thread ended");
+
+    return 0;
+}
+
+static bool
+sc_recorder_segmenter_start(struct sc_recorder *recorder) {
+    struct sc_recorder_segmenter *seg = &recorder->segmenter;
+
+    bool ok = sc_mutex_init(&seg->mutex);
+    if (!ok) {
+        return false;
+    }
+
+    ok = sc_cond_init(&seg->cond);
+    if (!ok) {
+        goto error_mutex_destroy;
+    }
+
+    seg->stopped = false;
+    seg->error = false;
+    seg->next_index = 1; // the first segment is opened by the recorder thread
+    seg->next = NULL;
+    seg->to_close = NULL;
+
+    ok = sc_thread_create(&seg->thread, run_recorder_segmenter,
+                          "scrcpy-rec-seg", recorder);
+    if (!ok) {
+        LOGE("Could not start recorder segmenter thread");
+        goto error_cond_destroy;
+    }
+
+    return true;
+
+error_cond_destroy:
+    sc_cond_destroy(&seg->cond);
+error_mutex_destroy:
+    sc_mutex_destroy(&seg->mutex);
+
+    return false;
+}
+
+static bool
+sc_recorder_segmenter_stop(struct sc_recorder *recorder) {
+    struct sc_recorder_segmenter *seg = &recorder->segmenter;
+
+    sc_mutex_lock(&seg->mutex);
+    seg->stopped = true;
+    sc_cond_broadcast(&seg->cond);
+    sc_mutex_unlock(&seg->mutex);
+
+    sc_thread_join(&seg->thread, NULL);
+
+    // The thread is stopped, no need to lock
+    bool ok = !seg->error;
+
+    sc_cond_destroy(&seg->cond);
+    sc_mutex_destroy(&seg->mutex);
+
+    return ok;
+}
+
+static bool
+sc_recorder_must_rotate(struct sc_recorder *recorder, const AVPacket *packet) {
+    assert(sc_recorder_is_segmented(recorder));
+
+    if (recorder->video && !(packet->flags & AV_PKT_FLAG_KEY)) {
+        // A video segment must start on a keyframe
+        return false;
+    }
+
+    if (recorder->segment_duration
+            && packet->pts - recorder->segments.origin
+                    >= recorder->segment_duration) {
+        return true;
+    }
+
+    if (recorder->segment_size) {
+        int64_t pos = avio_tell(recorder->output->ctx->pb);
+        if (pos >= 0 && (uint64_t) pos >= recorder->segment_size) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Hand a segment to the segmenter thread, to be finalized
+static bool
+sc_recorder_close_segment(struct sc_recorder *recorder,
+                          struct sc_recorder_output *output) {
+    struct sc_recorder_segmenter *seg = &recorder->segmenter;
+
+    sc_mutex_lock(&seg->mutex);
+
+    // The segments are finalized one at a time
+    while (seg->to_close && !seg->error) {
+        sc_cond_wait(&seg->cond, &seg->mutex);
+    }
+
+    if (seg->error) {
+        sc_mutex_unlock(&seg->mutex);
+        sc_recorder_output_close(recorder, output);
+        LOGE("Could not finalize the recording segment");
+        return false;
+    }
+
+    seg->to_close = output;
+    sc_cond_broadcast(&seg->cond);
+
+    sc_mutex_unlock(&seg->mutex);
+
+    return true;
+}
+
+static bool
+sc_recorder_close_previous_segment(struct sc_recorder *recorder) {
+    struct sc_recorder_output *output = recorder->previous_output;
+    assert(output);
+    recorder->previous_output = NULL;
+    return sc_recorder_close_segment(recorder, output);
+}
+
+static bool
+sc_recorder_rotate(struct sc_recorder *recorder, int64_t pts) {
+    struct sc_recorder_segmenter *seg = &recorder->segmenter;
+
+    if (recorder->previous_output) {
+        // No audio packet has been received for the whole segment, the late
+        // audio packets of the previous one will not be received anymore
+        if (!sc_recorder_close_previous_segment(recorder)) {
+            return false;
+        }
+    }
+
+    sc_mutex_lock(&seg->mutex);
+
+    if (!seg->next && !seg->error) {
+        LOGW("Next recording segment not ready, waiting");
+        do {
+            sc_cond_wait(&seg->cond, &seg->mutex);
+        } while (!seg->next && !seg->error);
+    }
+
+    if (seg->error) {
+        sc_mutex_unlock(&seg->mutex);
+        LOGE("Could not rotate the recording segment");
+        return false;
+    }
+
+    struct sc_recorder_output *previous = recorder->output;
+    recorder->output = seg->next;
+    seg->next = NULL;
+    sc_cond_broadcast(&seg->cond);
+
+    sc_mutex_unlock(&seg->mutex);
+
+    // On a video keyframe, the audio packets older than the keyframe may
+    // still be received: keep the previous segment open for them
+    bool keep_previous = recorder->video && recorder->audio;
+    sc_recorder_segments_rotate(&recorder->segments, pts, keep_previous);
+
+    recorder->previous_audio_stream = recorder->audio_stream;
+    recorder->video_stream.last_pts = AV_NOPTS_VALUE;
+    recorder->audio_stream.last_pts = AV_NOPTS_VALUE;
+
+    LOGI("Recording to next segment: %s", recorder->output->filename);
+
+    if (keep_previous) {
+        recorder->previous_output = previous;
+        return true;
+    }
+
+    return sc_recorder_close_segment(recorder, previous);
 }
 
 static inline bool
@@ -218,14 +763,14 @@ sc_recorder_process_header(struct sc_recorder *recorder) {
     AVPacket *video_pkt = NULL;
     if (!sc_vecdeque_is_empty(&recorder->video_queue)) {
         assert(recorder->video);
-        video_pkt = sc_vecdeque_pop(&recorder->video_queue);
+        video_pkt = sc_recorder_queue_pop(recorder, &recorder->video_queue);
     }
 
     AVPacket *audio_pkt = NULL;
     if (recorder->audio_expects_config_packet &&
             !sc_vecdeque_is_empty(&recorder->audio_queue)) {
         assert(recorder->audio);
-        audio_pkt = sc_vecdeque_pop(&recorder->audio_queue);
+        audio_pkt = sc_recorder_queue_pop(recorder, &recorder->audio_queue);
     }
 
     sc_mutex_unlock(&recorder->mutex);
@@ -238,10 +783,9 @@ sc_recorder_process_header(struct sc_recorder *recorder) {
             goto end;
         }
 
-        assert(recorder->video_stream.index >= 0);
-        AVStream *video_stream =
-            recorder->ctx->streams[recorder->video_stream.index];
-        bool ok = sc_recorder_set_extradata(video_stream, video_pkt);
+        assert(recorder->video_codecpar);
+        bool ok = sc_recorder_set_extradata(recorder->video_codecpar,
+                                            video_pkt);
         if (!ok) {
             goto end;
         }
@@ -253,22 +797,15 @@ sc_recorder_process_header(struct sc_recorder *recorder) {
             goto end;
         }
 
-        assert(recorder->audio_stream.index >= 0);
-        AVStream *audio_stream =
-            recorder->ctx->streams[recorder->audio_stream.index];
-        bool ok = sc_recorder_set_extradata(audio_stream, audio_pkt);
+        assert(recorder->audio_codecpar);
+        bool ok = sc_recorder_set_extradata(recorder->audio_codecpar,
+                                            audio_pkt);
         if (!ok) {
             goto end;
         }
     }
 
-    bool ok = avformat_write_header(recorder->ctx, NULL) >= 0;
-    if (!ok) {
-        LOGE("Failed to write header to %s", recorder->filename);
-        goto end;
-    }
-
-    ret = true;
+    ret = sc_recorder_output_write_header(recorder, recorder->output);
 
 end:
     if (video_pkt) {
@@ -285,10 +822,7 @@ static bool
 sc_recorder_process_packets(struct sc_recorder *recorder) {
     int64_t pts_origin = AV_NOPTS_VALUE;
 
-    bool header_written = sc_recorder_process_header(recorder);
-    if (!header_written) {
-        return false;
-    }
+    bool segmented = sc_recorder_is_segmented(recorder);
 
     AVPacket *video_pkt = NULL;
     AVPacket *audio_pkt = NULL;
@@ -330,13 +864,17 @@ sc_recorder_process_packets(struct sc_recorder *recorder) {
                 && sc_vecdeque_is_empty(&recorder->audio_queue)));
 
         if (!video_pkt && !sc_vecdeque_is_empty(&recorder->video_queue)) {
-            video_pkt = sc_vecdeque_pop(&recorder->video_queue);
+            video_pkt = sc_recorder_queue_pop(recorder,
+                                              &recorder->video_queue);
         }
 
         if (!audio_pkt && !sc_vecdeque_is_empty(&recorder->audio_queue)) {
-            audio_pkt = sc_vecdeque_pop(&recorder->audio_queue);
+            audio_pkt = sc_recorder_queue_pop(recorder,
+                                              &recorder->audio_queue);
         }
 
+        sc_recorder_report_queue(recorder);
+
         if (recorder->stopped && !video_pkt && !audio_pkt) {
             assert(sc_vecdeque_is_empty(&recorder->video_queue));
             assert(sc_vecdeque_is_empty(&recorder->audio_queue));
@@ -406,6 +944,16 @@ sc_recorder_process_packets(struct sc_recorder *recorder) {
                 }
             }
 
+            // Rotate as soon as the keyframe starting the next segment is
+            // received (all the previous video packets are written), even if
+            // it is written only once the next video packet is received
+            if (segmented && sc_recorder_must_rotate(recorder, video_pkt)) {
+                if (!sc_recorder_rotate(recorder, video_pkt->pts)) {
+                    error = true;
+                    goto end;
+                }
+            }
+
             video_pkt_previous = video_pkt;
             video_pkt = NULL;
         }
@@ -414,6 +962,15 @@ sc_recorder_process_packets(struct sc_recorder *recorder) {
             audio_pkt->pts -= pts_origin;
             audio_pkt->dts = audio_pkt->pts;
 
+            // Without video, segments are split on audio packets
+            if (segmented && !recorder->video
+                    && sc_recorder_must_rotate(recorder, audio_pkt)) {
+                if (!sc_recorder_rotate(recorder, audio_pkt->pts)) {
+                    error = true;
+                    goto end;
+                }
+            }
+
             bool ok = sc_recorder_write_audio(recorder, audio_pkt);
             if (!ok) {
                 LOGE("Could not record audio packet");
@@ -441,12 +998,6 @@ sc_recorder_process_packets(struct sc_recorder *recorder) {
         av_packet_free(&last);
     }
 
-    int ret = av_write_trailer(recorder->ctx);
-    if (ret < 0) {
-        LOGE("Failed to write trailer to %s", recorder->filename);
-        error = false;
-    }
-
 end:
     if (video_pkt) {
         av_packet_free(&video_pkt);
@@ -460,14 +1011,65 @@ end:
 
 static bool
 sc_recorder_record(struct sc_recorder *recorder) {
-    bool ok = sc_recorder_open_output_file(recorder);
+    bool segmented = sc_recorder_is_segmented(recorder);
+
+    char *filename = segmented ? sc_str_format_index(recorder->filename, 0)
+                               : strdup(recorder->filename);
+    if (!filename) {
+        LOG_OOM();
+        return false;
+    }
+
+    recorder->output = sc_recorder_output_open(recorder, filename);
+    free(filename);
+    if (!recorder->output) {
+        return false;
+    }
+
+    const char *format_name = sc_recorder_get_format_name(recorder->format);
+    const char *mode = recorder->fragmented ? " (fragmented)" : "";
+    LOGI("Recording started to %s file%s: %s", format_name, mode,
+         recorder->output->filename);
+
+    bool ok = sc_recorder_process_header(recorder);
     if (!ok) {
+        sc_recorder_output_close(recorder, recorder->output);
         return false;
     }
 
+    if (segmented) {
+        // The codec parameters are now known, the next segments may be
+        // prepared in advance
+        ok = sc_recorder_segmenter_start(recorder);
+        if (!ok) {
+            sc_recorder_output_close(recorder, recorder->output);
+            return false;
+        }
+    }
+
     ok = sc_recorder_process_packets(recorder);
-    sc_recorder_close_output_file(recorder);
-    return ok;
+
+    // On error, the files are closed without writing the trailer
+    bool closed = true;
+    if (recorder->previous_output) {
+        struct sc_recorder_output *previous = recorder->previous_output;
+        closed = ok ? sc_recorder_output_finalize(recorder, previous)
+                    : sc_recorder_output_close(recorder, previous);
+        recorder->previous_output = NULL;
+    }
+
+    bool current_closed =
+        ok ? sc_recorder_output_finalize(recorder, recorder->output)
+           : sc_recorder_output_close(recorder, recorder->output);
+    closed = closed && current_closed;
+    recorder->output = NULL;
+
+    if (segmented) {
+        bool segmenter_ok = sc_recorder_segmenter_stop(recorder);
+        ok = ok && segmenter_ok;
+    }
+
+    return ok && closed;
 }
 
 static int
@@ -484,10 +1086,23 @@ run_recorder(void *data) {
     // Prevent the producer to push any new packet
     recorder->stopped = true;
     // Discard pending packets
-    sc_recorder_queue_clear(&recorder->video_queue);
-    sc_recorder_queue_clear(&recorder->audio_queue);
+    sc_recorder_queue_clear(recorder, &recorder->video_queue);
+    sc_recorder_queue_clear(recorder, &recorder->audio_queue);
+    // Unblock the producers (if the queue_limit is 0, nobody can be blocked)
+    sc_cond_broadcast(&recorder->queue_cond);
+    if (recorder->overflowed) {
+        success = false;
+    }
+    struct sc_recorder_queue_stats stats = recorder->stats;
     sc_mutex_unlock(&recorder->mutex);
 
+    if (stats.dropped_video || stats.dropped_audio || stats.blocked) {
+        LOGW("Recorder queue: max %" SC_PRIsizet " KiB, dropped %" PRIu64
+             " video and %" PRIu64 " audio packets, blocked during %"
+             PRItick " ms", stats.max_bytes / 1024, stats.dropped_video,
+             stats.dropped_audio, SC_TICK_TO_MS(stats.blocked));
+    }
+
     if (success) {
         const char *format_name = sc_recorder_get_format_name(recorder->format);
         LOGI("Recording complete to %s file: %s", format_name,
@@ -503,39 +1118,127 @@ run_recorder(void *data) {
     return 0;
 }
 
+static inline bool
+sc_recorder_queue_is_full(struct sc_recorder *recorder,
+                          struct sc_recorder_queue *queue, size_t size) {
+    // A packet is always accepted in an empty queue, so that one stream never
+    // starves the other (the recorder may wait for a packet from each stream)
+    return recorder->queue_limit && !sc_vecdeque_is_empty(queue)
+        && recorder->queue_bytes + size > recorder->queue_limit;
+}
+
+static void
+sc_recorder_on_queue_full(struct sc_recorder *recorder) {
+    // The mutex must be locked
+    if (!recorder->stats.full) {
+        recorder->stats.full = true;
+        const char *action =
+            recorder->overflow == SC_RECORD_OVERFLOW_BLOCK ? "blocking"
+                                                           : "dropping";
+        LOGW("Recorder queue full (%" SC_PRIsizet " KiB), the storage is too "
+             "slow: %s", recorder->queue_bytes / 1024, action);
+    }
+}
+
 static bool
-sc_recorder_set_orientation(AVStream *stream, enum sc_orientation orientation) {
-    assert(!sc_orientation_is_mirror(orientation));
+sc_recorder_push(struct sc_recorder *recorder, struct sc_recorder_queue *queue,
+                 int stream_index, const AVPacket *packet, bool video) {
+    sc_mutex_lock(&recorder->mutex);
 
-    uint8_t *raw_data;
-#ifdef SCRCPY_LAVC_HAS_CODECPAR_CODEC_SIDEDATA
-    AVPacketSideData *sd =
-        av_packet_side_data_new(&stream->codecpar->coded_side_data,
-                                &stream->codecpar->nb_coded_side_data,
-                                AV_PKT_DATA_DISPLAYMATRIX,
-                                sizeof(int32_t) * 9, 0);
-    if (!sd) {
-        LOG_OOM();
+    if (recorder->stopped) {
+        // reject any new packet
+        sc_mutex_unlock(&recorder->mutex);
         return false;
     }
 
-    raw_data = sd->data;
-#else
-    raw_data = av_stream_new_side_data(stream, AV_PKT_DATA_DISPLAYMATRIX,
-                                      sizeof(int32_t) * 9);
-    if (!raw_data) {
+    // Config packets are never dropped (the first one is required to write
+    // the header)
+    bool config = packet->pts == AV_NOPTS_VALUE;
+    bool key = packet->flags & AV_PKT_FLAG_KEY;
+    size_t size = packet->size;
+
+    if (video && recorder->video_dropping && !config && !key) {
+        // Once a video packet is dropped, all packets until the next keyframe
+        // must be dropped
+        ++recorder->stats.dropped_video;
+        sc_mutex_unlock(&recorder->mutex);
+        return true;
+    }
+
+    if (!config && sc_recorder_queue_is_full(recorder, queue, size)) {
+        switch (recorder->overflow) {
+            case SC_RECORD_OVERFLOW_BLOCK: {
+                sc_recorder_on_queue_full(recorder);
+                sc_tick start = sc_tick_now();
+                do {
+                    sc_cond_wait(&recorder->queue_cond, &recorder->mutex);
+                } while (!recorder->stopped
+                        && sc_recorder_queue_is_full(recorder, queue, size));
+                recorder->stats.blocked += sc_tick_now() - start;
+
+                if (recorder->stopped) {
+                    sc_mutex_unlock(&recorder->mutex);
+                    return false;
+                }
+                break;
+            }
+            case SC_RECORD_OVERFLOW_DROP:
+                sc_recorder_on_queue_full(recorder);
+                if (video) {
+                    recorder->video_dropping = true;
+                    ++recorder->stats.dropped_video;
+                } else {
+                    ++recorder->stats.dropped_audio;
+                }
+                sc_mutex_unlock(&recorder->mutex);
+                return true;
+            default:
+                assert(recorder->overflow == SC_RECORD_OVERFLOW_ABORT);
+                LOGE("Recorder queue full, aborting recording");
+                // Finish the recording with the packets already queued
+                recorder->overflowed = true;
+                recorder->stopped = true;
+                sc_cond_signal(&recorder->cond);
+                sc_cond_broadcast(&recorder->queue_cond);
+                sc_mutex_unlock(&recorder->mutex);
+                return false;
+        }
+    }
+
+    if (video && key) {
+        recorder->video_dropping = false;
+    }
+
+    AVPacket *rec = sc_recorder_packet_ref(packet);
+    if (!rec) {
         LOG_OOM();
+        sc_mutex_unlock(&recorder->mutex);
         return false;
     }
-#endif
 
-    int32_t *matrix = (int32_t *) raw_data;
+    rec->stream_index = stream_index;
 
-    unsigned rotation = orientation;
-    unsigned angle = rotation * 90;
+    bool ok = sc_vecdeque_push(queue, rec);
+    if (!ok) {
+        LOG_OOM();
+        av_packet_free(&rec);
+        sc_mutex_unlock(&recorder->mutex);
+        return false;
+    }
 
-    av_display_rotation_set(matrix, angle);
+    recorder->queue_bytes += size;
+    if (recorder->queue_bytes > recorder->stats.max_bytes) {
+        recorder->stats.max_bytes = recorder->queue_bytes;
+    }
+    if (recorder->stats.full
+            && recorder->queue_bytes <= recorder->queue_limit / 2) {
+        // Warn again on the next overflow
+        recorder->stats.full = false;
+    }
+
+    sc_cond_signal(&recorder->cond);
 
+    sc_mutex_unlock(&recorder->mutex);
     return true;
 }
 
@@ -552,26 +1255,26 @@ sc_recorder_video_packet_sink_open(struct sc_packet_sink *sink,
         return false;
     }
 
-    AVStream *stream = avformat_new_stream(recorder->ctx, ctx->codec);
-    if (!stream) {
+    // The streams are created on each output (segment) from these parameters
+    AVCodecParameters *par = avcodec_parameters_alloc();
+    if (!par) {
+        LOG_OOM();
         sc_mutex_unlock(&recorder->mutex);
         return false;
     }
 
-    int r = avcodec_parameters_from_context(stream->codecpar, ctx);
+    int r = avcodec_parameters_from_context(par, ctx);
     if (r < 0) {
+        avcodec_parameters_free(&par);
         sc_mutex_unlock(&recorder->mutex);
         return false;
     }
 
-    recorder->video_stream.index = stream->index;
+    recorder->video_codecpar = par;
+    // The video stream, if any, is always the first one
+    recorder->video_stream.index = 0;
 
     if (recorder->orientation != SC_ORIENTATION_0) {
-        if (!sc_recorder_set_orientation(stream, recorder->orientation)) {
-            sc_mutex_unlock(&recorder->mutex);
-            return false;
-        }
-
         LOGI("Record orientation set to %s",
              sc_orientation_get_name(recorder->orientation));
     }
@@ -593,6 +1296,7 @@ sc_recorder_video_packet_sink_close(struct sc_packet_sink *sink) {
     // EOS also stops the recorder
     recorder->stopped = true;
     sc_cond_signal(&recorder->cond);
+    sc_cond_broadcast(&recorder->queue_cond);
     sc_mutex_unlock(&recorder->mutex);
 }
 
@@ -603,34 +1307,8 @@ sc_recorder_video_packet_sink_push(struct sc_packet_sink *sink,
     // only written from this thread, no need to lock
     assert(recorder->video_init);
 
-    sc_mutex_lock(&recorder->mutex);
-
-    if (recorder->stopped) {
-        // reject any new packet
-        sc_mutex_unlock(&recorder->mutex);
-        return false;
-    }
-
-    AVPacket *rec = sc_recorder_packet_ref(packet);
-    if (!rec) {
-        LOG_OOM();
-        sc_mutex_unlock(&recorder->mutex);
-        return false;
-    }
-
-    rec->stream_index = recorder->video_stream.index;
-
-    bool ok = sc_vecdeque_push(&recorder->video_queue, rec);
-    if (!ok) {
-        LOG_OOM();
-        sc_mutex_unlock(&recorder->mutex);
-        return false;
-    }
-
-    sc_cond_signal(&recorder->cond);
-
-    sc_mutex_unlock(&recorder->mutex);
-    return true;
+    return sc_recorder_push(recorder, &recorder->video_queue,
+                            recorder->video_stream.index, packet, true);
 }
 
 static bool
@@ -643,19 +1321,22 @@ sc_recorder_audio_packet_sink_open(struct sc_packet_sink *sink,
 
     sc_mutex_lock(&recorder->mutex);
 
-    AVStream *stream = avformat_new_stream(recorder->ctx, ctx->codec);
-    if (!stream) {
+    AVCodecParameters *par = avcodec_parameters_alloc();
+    if (!par) {
+        LOG_OOM();
         sc_mutex_unlock(&recorder->mutex);
         return false;
     }
 
-    int r = avcodec_parameters_from_context(stream->codecpar, ctx);
+    int r = avcodec_parameters_from_context(par, ctx);
     if (r < 0) {
+        avcodec_parameters_free(&par);
         sc_mutex_unlock(&recorder->mutex);
         return false;
     }
 
-    recorder->audio_stream.index = stream->index;
+    recorder->audio_codecpar = par;
+    recorder->audio_stream.index = recorder->video ? 1 : 0;
 
     // A config packet is provided for all supported formats except raw audio
     recorder->audio_expects_config_packet =
@@ -679,6 +1360,7 @@ sc_recorder_audio_packet_sink_close(struct sc_packet_sink *sink) {
     // EOS also stops the recorder
     recorder->stopped = true;
     sc_cond_signal(&recorder->cond);
+    sc_cond_broadcast(&recorder->queue_cond);
     sc_mutex_unlock(&recorder->mutex);
 }
 
@@ -690,34 +1372,8 @@ sc_recorder_audio_packet_sink_push(struct sc_packet_sink *sink,
     // only written from this thread, no need to lock
     assert(recorder->audio_init);
 
-    sc_mutex_lock(&recorder->mutex);
-
-    if (recorder->stopped) {
-        // reject any new packet
-        sc_mutex_unlock(&recorder->mutex);
-        return false;
-    }
-
-    AVPacket *rec = sc_recorder_packet_ref(packet);
-    if (!rec) {
-        LOG_OOM();
-        sc_mutex_unlock(&recorder->mutex);
-        return false;
-    }
-
-    rec->stream_index = recorder->audio_stream.index;
-
-    bool ok = sc_vecdeque_push(&recorder->audio_queue, rec);
-    if (!ok) {
-        LOG_OOM();
-        sc_mutex_unlock(&recorder->mutex);
-        return false;
-    }
-
-    sc_cond_signal(&recorder->cond);
-
-    sc_mutex_unlock(&recorder->mutex);
-    return true;
+    return sc_recorder_push(recorder, &recorder->audio_queue,
+                            recorder->audio_stream.index, packet, false);
 }
 
 static void
@@ -743,13 +1399,12 @@ sc_recorder_stream_init(struct sc_recorder_stream *stream) {
 }
 
 bool
-sc_recorder_init(struct sc_recorder *recorder, const char *filename,
-                 enum sc_record_format format, bool video, bool audio,
-                 enum sc_orientation orientation,
+sc_recorder_init(struct sc_recorder *recorder,
+                 const struct sc_recorder_params *params,
                  const struct sc_recorder_callbacks *cbs, void *cbs_userdata) {
-    assert(!sc_orientation_is_mirror(orientation));
+    assert(!sc_orientation_is_mirror(params->orientation));
 
-    recorder->filename = strdup(filename);
+    recorder->filename = strdup(params->filename);
     if (!recorder->filename) {
         LOG_OOM();
         return false;
@@ -765,16 +1420,35 @@ sc_recorder_init(struct sc_recorder *recorder, const char *filename,
         goto error_mutex_destroy;
     }
 
+    ok = sc_cond_init(&recorder->queue_cond);
+    if (!ok) {
+        goto error_cond_destroy;
+    }
+
+    bool video = params->video;
+    bool audio = params->audio;
     assert(video || audio);
     recorder->video = video;
     recorder->audio = audio;
 
-    recorder->orientation = orientation;
+    recorder->orientation = params->orientation;
 
     sc_vecdeque_init(&recorder->video_queue);
     sc_vecdeque_init(&recorder->audio_queue);
     recorder->stopped = false;
 
+    recorder->queue_bytes = 0;
+    recorder->queue_limit = params->queue_limit;
+    recorder->overflow = params->overflow;
+    recorder->video_dropping = false;
+    recorder->overflowed = false;
+    recorder->stats.max_bytes = 0;
+    recorder->stats.dropped_video = 0;
+    recorder->stats.dropped_audio = 0;
+    recorder->stats.blocked = 0;
+    recorder->stats.next_report = 0;
+    recorder->stats.full = false;
+
     recorder->video_init = false;
     recorder->audio_init = false;
 
@@ -783,7 +1457,18 @@ sc_recorder_init(struct sc_recorder *recorder, const char *filename,
     sc_recorder_stream_init(&recorder->video_stream);
     sc_recorder_stream_init(&recorder->audio_stream);
 
-    recorder->format = format;
+    recorder->format = params->format;
+    recorder->fragmented = params->fragmented;
+    recorder->io_params = params->io;
+    recorder->output = NULL;
+
+    recorder->segment_duration = params->segment_duration;
+    recorder->segment_size = params->segment_size;
+    sc_recorder_segments_init(&recorder->segments);
+    recorder->previous_output = NULL;
+
+    recorder->video_codecpar = NULL;
+    recorder->audio_codecpar = NULL;
 
     assert(cbs && cbs->on_ended);
     recorder->cbs = cbs;
@@ -812,6 +1497,8 @@ sc_recorder_init(struct sc_recorder *recorder, const char *filename,
 
     return true;
 
+error_cond_destroy:
+    sc_cond_destroy(&recorder->cond);
 error_mutex_destroy:
     sc_mutex_destroy(&recorder->mutex);
 error_free_filename:
@@ -837,6 +1524,7 @@ sc_recorder_stop(struct sc_recorder *recorder) {
     sc_mutex_lock(&recorder->mutex);
     recorder->stopped = true;
     sc_cond_signal(&recorder->cond);
+    sc_cond_broadcast(&recorder->queue_cond);
     sc_mutex_unlock(&recorder->mutex);
 }
 
@@ -847,6 +1535,9 @@ sc_recorder_join(struct sc_recorder *recorder) {
 
 void
 sc_recorder_destroy(struct sc_recorder *recorder) {
+    avcodec_parameters_free(&recorder->audio_codecpar);
+    avcodec_parameters_free(&recorder->video_codecpar);
+    sc_cond_destroy(&recorder->queue_cond);
     sc_cond_destroy(&recorder->cond);
     sc_mutex_destroy(&recorder->mutex);
     free(recorder->filename);
@@ -8,18 +8,51 @@
 #include <libavcodec/packet.h>
 #include <libavformat/avformat.h>
 
+#include "file_writer.h"
 #include "options.h"
+#include "recorder_segments.h"
 #include "trait/packet_sink.h"
 #include "util/thread.h"
+#include "util/tick.h"
 #include "util/vecdeque.h"
 
 struct sc_recorder_queue SC_VECDEQUE(AVPacket *);
 
+struct sc_recorder_queue_stats {
+    size_t max_bytes; // high-water mark
+    uint64_t dropped_video;
+    uint64_t dropped_audio;
+    sc_tick blocked; // total time the producers have been blocked
+    sc_tick next_report;
+    bool full; // reset once the queue is half empty
+};
+
 struct sc_recorder_stream {
     int index;
     int64_t last_pts;
 };
 
+// A muxer writing to a file
+struct sc_recorder_output {
+    char *filename;
+    AVFormatContext *ctx;
+    // used if the recorder io_params.buffer_size is not 0
+    struct sc_file_writer writer;
+};
+
+// Open the next segment and finalize the previous one from a helper thread,
+// so that a rotation does not block the recorder thread
+struct sc_recorder_segmenter {
+    sc_thread thread;
+    sc_mutex mutex;
+    sc_cond cond;
+    bool stopped;
+    bool error;
+    unsigned next_index;
+    struct sc_recorder_output *next; // prepared by the helper thread
+    struct sc_recorder_output *to_close; // finalized by the helper thread
+};
+
 struct sc_recorder {
     struct sc_packet_sink video_packet_sink;
     struct sc_packet_sink audio_packet_sink;
@@ -37,9 +70,30 @@ struct sc_recorder {
 
     enum sc_orientation orientation;
 
+    // a pattern containing the segment index if the recording is segmented
     char *filename;
     enum sc_record_format format;
-    AVFormatContext *ctx;
+    bool fragmented;
+
+    // if io_params.buffer_size is 0, the file is written by FFmpeg directly
+    struct sc_file_writer_params io_params;
+
+    // accessed only from the recorder thread
+    struct sc_recorder_output *output;
+
+    // The recording is segmented if any of these is not 0
+    sc_tick segment_duration;
+    uint64_t segment_size;
+    struct sc_recorder_segments segments;
+    // the previous segment, kept open for the late audio packets
+    // (accessed only from the recorder thread)
+    struct sc_recorder_output *previous_output;
+    struct sc_recorder_stream previous_audio_stream;
+    struct sc_recorder_segmenter segmenter;
+
+    // set on packet sinks open, immutable once the header is written
+    AVCodecParameters *video_codecpar;
+    AVCodecParameters *audio_codecpar;
 
     sc_thread thread;
     sc_mutex mutex;
@@ -49,6 +103,19 @@ struct sc_recorder {
     struct sc_recorder_queue video_queue;
     struct sc_recorder_queue audio_queue;
 
+    // Total size of the packets in both queues, bounded by queue_limit
+    // (0 for unlimited)
+    size_t queue_bytes;
+    size_t queue_limit;
+    enum sc_record_overflow overflow;
+    // signaled when packets are removed from the queues
+    sc_cond queue_cond;
+    // drop all video packets until the next keyframe
+    bool video_dropping;
+    // set if the recording is aborted due to a queue overflow
+    bool overflowed;
+    struct sc_recorder_queue_stats stats;
+
     // wake up the recorder thread once the video or audio codec is known
     bool video_init;
     bool audio_init;
@@ -67,10 +134,23 @@ struct sc_recorder_callbacks {
                      void *userdata);
 };
 
+struct sc_recorder_params {
+    const char *filename;
+    enum sc_record_format format;
+    bool video;
+    bool audio;
+    enum sc_orientation orientation;
+    bool fragmented; // only for MP4 formats
+    size_t queue_limit; // in bytes, 0 for unlimited
+    enum sc_record_overflow overflow;
+    struct sc_file_writer_params io;
+    sc_tick segment_duration; // 0 for no duration limit
+    uint64_t segment_size; // 0 for no size limit
+};
+
 bool
-sc_recorder_init(struct sc_recorder *recorder, const char *filename,
-                 enum sc_record_format format, bool video, bool audio,
-                 enum sc_orientation orientation,
+sc_recorder_init(struct sc_recorder *recorder,
+                 const struct sc_recorder_params *params,
                  const struct sc_recorder_callbacks *cbs, void *cbs_userdata);
 
 bool
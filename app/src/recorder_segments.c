@@ -0,0 +1,46 @@
+#include "recorder_segments.h"
+
+#include <assert.h>
+
+void
+sc_recorder_segments_init(struct sc_recorder_segments *segs) {
+    segs->origin = 0;
+    segs->previous_origin = 0;
+    segs->previous_open = false;
+}
+
+void
+sc_recorder_segments_rotate(struct sc_recorder_segments *segs, int64_t origin,
+                            bool keep_previous) {
+    assert(origin >= segs->origin);
+    segs->previous_origin = segs->origin;
+    segs->origin = origin;
+    segs->previous_open = keep_previous;
+}
+
+enum sc_recorder_segment
+sc_recorder_segments_route_audio(struct sc_recorder_segments *segs,
+                                 int64_t pts, int64_t *segment_pts,
+                                 bool *close_previous) {
+    *close_previous = false;
+
+    if (segs->previous_open) {
+        if (pts < segs->origin) {
+            // A late audio packet, older than the current segment
+            int64_t previous_pts = pts - segs->previous_origin;
+            *segment_pts = previous_pts > 0 ? previous_pts : 0;
+            return SC_RECORDER_SEGMENT_PREVIOUS;
+        }
+
+        // The audio packets are received in order, the next ones will not
+        // belong to the previous segment
+        segs->previous_open = false;
+        *close_previous = true;
+    }
+
+    // The pts may be negative only if the audio is late by more than a whole
+    // segment (the previous segment is then already closed)
+    int64_t current_pts = pts - segs->origin;
+    *segment_pts = current_pts > 0 ? current_pts : 0;
+    return SC_RECORDER_SEGMENT_CURRENT;
+}
@@ -0,0 +1,67 @@
+#ifndef SC_RECORDER_SEGMENTS_H
+#define SC_RECORDER_SEGMENTS_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Timeline of the segments of a segmented recording
+ *
+ * A segment starts on a video keyframe, but the audio packets are not
+ * received in sync with the video packets: some audio packets older than the
+ * keyframe may be received after it. The previous segment therefore remains
+ * open until the first audio packet of the new segment is received, so that
+ * no audio packet is lost or shifted.
+ *
+ * The pts are relative to the start of the recording.
+ */
+
+enum sc_recorder_segment {
+    SC_RECORDER_SEGMENT_CURRENT,
+    SC_RECORDER_SEGMENT_PREVIOUS,
+};
+
+struct sc_recorder_segments {
+    int64_t origin; // pts of the start of the current segment
+    int64_t previous_origin;
+    // Set if the previous segment still accepts the audio packets older than
+    // the current segment
+    bool previous_open;
+};
+
+void
+sc_recorder_segments_init(struct sc_recorder_segments *segs);
+
+/**
+ * Start a new segment at origin
+ *
+ * If keep_previous is set, the previous segment remains open for the late
+ * audio packets. Otherwise (or if a previous segment was still open), the
+ * caller must close it.
+ */
+void
+sc_recorder_segments_rotate(struct sc_recorder_segments *segs, int64_t origin,
+                            bool keep_previous);
+
+/**
+ * Select the segment to which an audio packet must be written, and return its
+ * pts relative to the start of that segment
+ *
+ * If close_previous is set on return, the previous segment is not needed
+ * anymore, and must be closed by the caller (before writing the packet).
+ */
+enum sc_recorder_segment
+sc_recorder_segments_route_audio(struct sc_recorder_segments *segs,
+                                 int64_t pts, int64_t *segment_pts,
+                                 bool *close_previous);
+
+// Return the pts of a video packet relative to the start of its segment
+static inline int64_t
+sc_recorder_segments_video_pts(const struct sc_recorder_segments *segs,
+                               int64_t pts) {
+    return pts - segs->origin;
+}
+
+#endif
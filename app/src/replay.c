@@ -0,0 +1,526 @@
+#include "replay.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/file.h"
+#include "util/log.h"
+#include "util/str.h"
+
+/** Downcast packet sinks to replay */
+#define DOWNCAST_VIDEO(SINK) \
+    container_of(SINK, struct sc_replay, video_packet_sink)
+#define DOWNCAST_AUDIO(SINK) \
+    container_of(SINK, struct sc_replay, audio_packet_sink)
+
+// Value of AVPacket.stream_index for packets in the queue
+#define SC_REPLAY_STREAM_VIDEO 0
+#define SC_REPLAY_STREAM_AUDIO 1
+
+// Do not loop forever if all the filenames are already used
+#define SC_REPLAY_MAX_INDEX_ATTEMPTS 10000
+
+static AVPacket *
+sc_replay_packet_ref(const AVPacket *packet) {
+    AVPacket *p = av_packet_alloc();
+    if (!p) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    // The packet data is refcounted, it is not copied
+    if (av_packet_ref(p, packet)) {
+        av_packet_free(&p);
+        return NULL;
+    }
+
+    return p;
+}
+
+static inline bool
+sc_replay_is_video_keyframe(const AVPacket *packet) {
+    return packet->stream_index == SC_REPLAY_STREAM_VIDEO
+        && (packet->flags & AV_PKT_FLAG_KEY);
+}
+
+static void
+sc_replay_queue_pop(struct sc_replay *replay) {
+    // The mutex must be locked
+    AVPacket *p = sc_vecdeque_pop(&replay->queue);
+
+    assert(replay->bytes >= (size_t) p->size);
+    replay->bytes -= p->size;
+    if (sc_replay_is_video_keyframe(p)) {
+        assert(replay->video_keyframes);
+        --replay->video_keyframes;
+    }
+
+    av_packet_free(&p);
+}
+
+static bool
+sc_replay_is_over_limits(struct sc_replay *replay) {
+    // The mutex must be locked
+    if (sc_vecdeque_is_empty(&replay->queue)) {
+        return false;
+    }
+
+    if (replay->max_bytes && replay->bytes > replay->max_bytes) {
+        return true;
+    }
+
+    AVPacket *first = sc_vecdeque_peek(&replay->queue);
+    return replay->last_pts - first->pts > replay->max_duration;
+}
+
+static void
+sc_replay_trim(struct sc_replay *replay) {
+    // The mutex must be locked
+    while (sc_replay_is_over_limits(replay)) {
+        if (!replay->video) {
+            if (sc_vecdeque_size(&replay->queue) == 1) {
+                break;
+            }
+            sc_replay_queue_pop(replay);
+            continue;
+        }
+
+        if (replay->video_keyframes < 2) {
+            // Always keep the current GOP
+            break;
+        }
+
+        // Drop the oldest GOP (and the audio packets received meanwhile)
+        assert(sc_replay_is_video_keyframe(sc_vecdeque_peek(&replay->queue)));
+        do {
+            sc_replay_queue_pop(replay);
+        } while (!sc_replay_is_video_keyframe(
+                                        sc_vecdeque_peek(&replay->queue)));
+    }
+}
+
+static bool
+sc_replay_push(struct sc_replay *replay, const AVPacket *packet, bool video) {
+    AVPacket *p = sc_replay_packet_ref(packet);
+    if (!p) {
+        return false;
+    }
+
+    sc_mutex_lock(&replay->mutex);
+
+    if (packet->pts == AV_NOPTS_VALUE) {
+        // Keep the latest config packet, it will be written as extradata
+        AVPacket **config = video ? &replay->video_config
+                                  : &replay->audio_config;
+        if (*config) {
+            av_packet_free(config);
+        }
+        *config = p;
+        sc_mutex_unlock(&replay->mutex);
+        return true;
+    }
+
+    p->stream_index = video ? SC_REPLAY_STREAM_VIDEO : SC_REPLAY_STREAM_AUDIO;
+
+    if (replay->video && sc_vecdeque_is_empty(&replay->queue)
+            && !sc_replay_is_video_keyframe(p)) {
+        // The replay must start on a video keyframe
+        sc_mutex_unlock(&replay->mutex);
+        av_packet_free(&p);
+        return true;
+    }
+
+    bool ok = sc_vecdeque_push(&replay->queue, p);
+    if (!ok) {
+        LOG_OOM();
+        sc_mutex_unlock(&replay->mutex);
+        av_packet_free(&p);
+        return false;
+    }
+
+    replay->bytes += p->size;
+    if (sc_replay_is_video_keyframe(p)) {
+        ++replay->video_keyframes;
+    }
+    if (video || !replay->video) {
+        replay->last_pts = p->pts;
+    }
+
+    sc_replay_trim(replay);
+
+    sc_mutex_unlock(&replay->mutex);
+
+    return true;
+}
+
+static AVCodecParameters *
+sc_replay_codecpar_from_context(const AVCodecContext *ctx) {
+    AVCodecParameters *par = avcodec_parameters_alloc();
+    if (!par) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    if (avcodec_parameters_from_context(par, ctx) < 0) {
+        avcodec_parameters_free(&par);
+        return NULL;
+    }
+
+    return par;
+}
+
+static bool
+sc_replay_video_packet_sink_open(struct sc_packet_sink *sink,
+                                 AVCodecContext *ctx) {
+    struct sc_replay *replay = DOWNCAST_VIDEO(sink);
+
+    AVCodecParameters *par = sc_replay_codecpar_from_context(ctx);
+    if (!par) {
+        return false;
+    }
+
+    sc_mutex_lock(&replay->mutex);
+    assert(!replay->video_codecpar);
+    replay->video_codecpar = par;
+    sc_mutex_unlock(&replay->mutex);
+
+    return true;
+}
+
+static void
+sc_replay_video_packet_sink_close(struct sc_packet_sink *sink) {
+    // The buffered packets may still be saved
+    (void) sink;
+}
+
+static bool
+sc_replay_video_packet_sink_push(struct sc_packet_sink *sink,
+                                 const AVPacket *packet) {
+    struct sc_replay *replay = DOWNCAST_VIDEO(sink);
+    return sc_replay_push(replay, packet, true);
+}
+
+static bool
+sc_replay_audio_packet_sink_open(struct sc_packet_sink *sink,
+                                 AVCodecContext *ctx) {
+    struct sc_replay *replay = DOWNCAST_AUDIO(sink);
+
+    AVCodecParameters *par = sc_replay_codecpar_from_context(ctx);
+    if (!par) {
+        return false;
+    }
+
+    sc_mutex_lock(&replay->mutex);
+    assert(!replay->audio_codecpar);
+    replay->audio_codecpar = par;
+    // A config packet is provided for all supported formats except raw audio
+    replay->audio_expects_config_packet =
+        ctx->codec_id != AV_CODEC_ID_PCM_S16LE;
+    sc_mutex_unlock(&replay->mutex);
+
+    return true;
+}
+
+static void
+sc_replay_audio_packet_sink_close(struct sc_packet_sink *sink) {
+    // The buffered packets may still be saved
+    (void) sink;
+}
+
+static bool
+sc_replay_audio_packet_sink_push(struct sc_packet_sink *sink,
+                                 const AVPacket *packet) {
+    struct sc_replay *replay = DOWNCAST_AUDIO(sink);
+    return sc_replay_push(replay, packet, false);
+}
+
+static void
+sc_replay_audio_packet_sink_disable(struct sc_packet_sink *sink) {
+    struct sc_replay *replay = DOWNCAST_AUDIO(sink);
+
+    sc_mutex_lock(&replay->mutex);
+    replay->audio = false;
+    sc_mutex_unlock(&replay->mutex);
+}
+
+static void
+sc_replay_on_recorder_ended(struct sc_recorder *recorder, bool success,
+                            void *userdata) {
+    (void) recorder;
+    (void) success; // the recorder already logs the result
+
+    struct sc_replay *replay = userdata;
+
+    sc_mutex_lock(&replay->mutex);
+    replay->save_ended = true;
+    sc_mutex_unlock(&replay->mutex);
+}
+
+static char *
+sc_replay_next_filename(struct sc_replay *replay) {
+    // Do not overwrite the replays saved by a previous session
+    for (unsigned i = 0; i < SC_REPLAY_MAX_INDEX_ATTEMPTS; ++i) {
+        char *filename = sc_str_format_index(replay->filename,
+                                             replay->next_index++);
+        if (!filename) {
+            LOG_OOM();
+            return NULL;
+        }
+
+        if (!sc_file_is_regular(filename)) {
+            return filename;
+        }
+
+        free(filename);
+    }
+
+    LOGE("Could not find an unused replay filename for %s", replay->filename);
+    return NULL;
+}
+
+static bool
+sc_replay_open_sink(struct sc_packet_sink *sink,
+                    const AVCodecParameters *par) {
+    // The recorder only reads the codec parameters from the context
+    AVCodecContext *ctx = avcodec_alloc_context3(NULL);
+    if (!ctx) {
+        LOG_OOM();
+        return false;
+    }
+
+    bool ok = avcodec_parameters_to_context(ctx, par) >= 0
+           && sink->ops->open(sink, ctx);
+    avcodec_free_context(&ctx);
+    return ok;
+}
+
+static bool
+sc_replay_feed_recorder(struct sc_replay *replay, bool audio) {
+    // The mutex must be locked
+    struct sc_recorder *recorder = &replay->recorder;
+    struct sc_packet_sink *vsink = &recorder->video_packet_sink;
+    struct sc_packet_sink *asink = &recorder->audio_packet_sink;
+
+    if (replay->video && !sc_replay_open_sink(vsink, replay->video_codecpar)) {
+        return false;
+    }
+
+    if (audio && !sc_replay_open_sink(asink, replay->audio_codecpar)) {
+        if (replay->video) {
+            vsink->ops->close(vsink);
+        }
+        return false;
+    }
+
+    // The recorder takes new references, the packet data is shared. If the
+    // recorder fails, it rejects the packets and reports the error itself.
+    if (replay->video) {
+        vsink->ops->push(vsink, replay->video_config);
+    }
+    if (audio && replay->audio_expects_config_packet) {
+        asink->ops->push(asink, replay->audio_config);
+    }
+
+    size_t size = sc_vecdeque_size(&replay->queue);
+    for (size_t i = 0; i < size; ++i) {
+        AVPacket *packet = sc_vecdeque_get(&replay->queue, i);
+        if (packet->stream_index == SC_REPLAY_STREAM_VIDEO) {
+            vsink->ops->push(vsink, packet);
+        } else if (audio) {
+            asink->ops->push(asink, packet);
+        }
+    }
+
+    // Closing the sinks makes the recorder finish once all the packets are
+    // written
+    if (audio) {
+        asink->ops->close(asink);
+    }
+    if (replay->video) {
+        vsink->ops->close(vsink);
+    }
+
+    return true;
+}
+
+bool
+sc_replay_save(struct sc_replay *replay) {
+    sc_mutex_lock(&replay->mutex);
+
+    if (replay->saving) {
+        if (!replay->save_ended) {
+            sc_mutex_unlock(&replay->mutex);
+            LOGW("A replay is already being saved");
+            return false;
+        }
+
+        // The previous recorder thread has ended (or is about to)
+        sc_mutex_unlock(&replay->mutex);
+        sc_recorder_join(&replay->recorder);
+        sc_recorder_destroy(&replay->recorder);
+        sc_mutex_lock(&replay->mutex);
+        replay->saving = false;
+    }
+
+    if (sc_vecdeque_is_empty(&replay->queue)
+            || (replay->video && !replay->video_config)) {
+        sc_mutex_unlock(&replay->mutex);
+        LOGW("Replay buffer is empty, nothing to save");
+        return false;
+    }
+
+    // Without its config packet, the audio stream can not be recorded
+    bool audio = replay->audio && replay->audio_codecpar
+              && (replay->audio_config || !replay->audio_expects_config_packet);
+    if (!replay->video && !audio) {
+        sc_mutex_unlock(&replay->mutex);
+        LOGW("Replay buffer is empty, nothing to save");
+        return false;
+    }
+
+    char *filename = sc_replay_next_filename(replay);
+    if (!filename) {
+        sc_mutex_unlock(&replay->mutex);
+        return false;
+    }
+
+    static const struct sc_recorder_callbacks recorder_cbs = {
+        .on_ended = sc_replay_on_recorder_ended,
+    };
+    struct sc_recorder_params params = {
+        .filename = filename,
+        .format = replay->format,
+        .video = replay->video,
+        .audio = audio,
+        .orientation = replay->orientation,
+        .overflow = SC_RECORD_OVERFLOW_BLOCK,
+        // All the packets are already in memory
+        .queue_limit = 0,
+        .io = {
+            .buffer_size = 0,
+        },
+    };
+
+    bool ok = sc_recorder_init(&replay->recorder, &params, &recorder_cbs,
+                               replay);
+    free(filename);
+    if (!ok) {
+        sc_mutex_unlock(&replay->mutex);
+        return false;
+    }
+
+    ok = sc_recorder_start(&replay->recorder);
+    if (!ok) {
+        sc_mutex_unlock(&replay->mutex);
+        sc_recorder_destroy(&replay->recorder);
+        return false;
+    }
+
+    replay->saving = true;
+    replay->save_ended = false;
+
+    LOGI("Saving replay (%" SC_PRIsizet " packets, %" SC_PRIsizet " KiB)",
+         sc_vecdeque_size(&replay->queue), replay->bytes / 1024);
+
+    ok = sc_replay_feed_recorder(replay, audio);
+
+    sc_mutex_unlock(&replay->mutex);
+
+    if (!ok) {
+        sc_recorder_stop(&replay->recorder);
+    }
+
+    return ok;
+}
+
+bool
+sc_replay_init(struct sc_replay *replay,
+               const struct sc_replay_params *params) {
+    assert(params->video || params->audio);
+    assert(params->max_duration > 0);
+
+    replay->filename = strdup(params->filename);
+    if (!replay->filename) {
+        LOG_OOM();
+        return false;
+    }
+
+    bool ok = sc_mutex_init(&replay->mutex);
+    if (!ok) {
+        free(replay->filename);
+        return false;
+    }
+
+    replay->format = params->format;
+    replay->orientation = params->orientation;
+    replay->max_duration = params->max_duration;
+    replay->max_bytes = params->max_bytes;
+
+    replay->video = params->video;
+    replay->audio = params->audio;
+
+    replay->video_codecpar = NULL;
+    replay->audio_codecpar = NULL;
+    replay->video_config = NULL;
+    replay->audio_config = NULL;
+    replay->audio_expects_config_packet = false;
+
+    sc_vecdeque_init(&replay->queue);
+    replay->bytes = 0;
+    replay->video_keyframes = 0;
+    replay->last_pts = AV_NOPTS_VALUE;
+
+    replay->saving = false;
+    replay->save_ended = false;
+    replay->next_index = 0;
+
+    if (params->video) {
+        static const struct sc_packet_sink_ops video_ops = {
+            .open = sc_replay_video_packet_sink_open,
+            .close = sc_replay_video_packet_sink_close,
+            .push = sc_replay_video_packet_sink_push,
+        };
+
+        replay->video_packet_sink.ops = &video_ops;
+    }
+
+    if (params->audio) {
+        static const struct sc_packet_sink_ops audio_ops = {
+            .open = sc_replay_audio_packet_sink_open,
+            .close = sc_replay_audio_packet_sink_close,
+            .push = sc_replay_audio_packet_sink_push,
+            .disable = sc_replay_audio_packet_sink_disable,
+        };
+
+        replay->audio_packet_sink.ops = &audio_ops;
+    }
+
+    return true;
+}
+
+void
+sc_replay_destroy(struct sc_replay *replay) {
+    if (replay->saving) {
+        // Let the recorder finish writing the replay
+        sc_recorder_join(&replay->recorder);
+        sc_recorder_destroy(&replay->recorder);
+    }
+
+    while (!sc_vecdeque_is_empty(&replay->queue)) {
+        sc_replay_queue_pop(replay);
+    }
+    sc_vecdeque_destroy(&replay->queue);
+
+    if (replay->video_config) {
+        av_packet_free(&replay->video_config);
+    }
+    if (replay->audio_config) {
+        av_packet_free(&replay->audio_config);
+    }
+    avcodec_parameters_free(&replay->video_codecpar);
+    avcodec_parameters_free(&replay->audio_codecpar);
+
+    sc_mutex_destroy(&replay->mutex);
+    free(replay->filename);
+}
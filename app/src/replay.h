@@ -0,0 +1,94 @@
+#ifndef SC_REPLAY_H
+#define SC_REPLAY_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <libavcodec/avcodec.h>
+
+#include "options.h"
+#include "recorder.h"
+#include "trait/packet_sink.h"
+#include "util/thread.h"
+#include "util/tick.h"
+#include "util/vecdeque.h"
+
+/**
+ * Instant replay
+ *
+ * Keep the last packets of the stream in memory (sharing the demuxer packet
+ * buffers), so that they can be saved to a file on demand.
+ *
+ * The video packets are trimmed by whole GOPs, so that the buffer always
+ * starts on a keyframe.
+ */
+
+struct sc_replay_queue SC_VECDEQUE(AVPacket *);
+
+struct sc_replay {
+    struct sc_packet_sink video_packet_sink;
+    struct sc_packet_sink audio_packet_sink;
+
+    // a pattern containing the replay index
+    char *filename;
+    enum sc_record_format format;
+    enum sc_orientation orientation;
+
+    sc_tick max_duration;
+    size_t max_bytes;
+
+    sc_mutex mutex;
+
+    bool video;
+    bool audio;
+
+    // set on packet sinks open
+    AVCodecParameters *video_codecpar;
+    AVCodecParameters *audio_codecpar;
+    // the latest config packets, required to write the file header
+    AVPacket *video_config;
+    AVPacket *audio_config;
+    bool audio_expects_config_packet;
+
+    // The packets of both streams, in the order they have been received
+    // (AVPacket.stream_index is 0 for video and 1 for audio)
+    struct sc_replay_queue queue;
+    size_t bytes;
+    unsigned video_keyframes; // number of video keyframes in the queue
+    int64_t last_pts; // of the main stream (video if any, audio otherwise)
+
+    // A replay is saved by a temporary recorder
+    struct sc_recorder recorder;
+    bool saving;
+    bool save_ended;
+    unsigned next_index;
+};
+
+struct sc_replay_params {
+    const char *filename;
+    enum sc_record_format format;
+    bool video;
+    bool audio;
+    enum sc_orientation orientation;
+    sc_tick max_duration;
+    size_t max_bytes;
+};
+
+bool
+sc_replay_init(struct sc_replay *replay,
+               const struct sc_replay_params *params);
+
+/**
+ * Save the buffered packets to the next file (asynchronously)
+ *
+ * Only one replay may be saved at a time.
+ */
+bool
+sc_replay_save(struct sc_replay *replay);
+
+void
+sc_replay_destroy(struct sc_replay *replay);
+
+#endif
@@ -15,6 +15,9 @@
 #endif
 
 #include "audio_player.h"
+#include "av_sync.h"
+#include "control_player.h"
+#include "control_recorder.h"
 #include "controller.h"
 #include "decoder.h"
 #include "delay_buffer.h"
@@ -24,8 +27,10 @@
 #include "keyboard_sdk.h"
 #include "mouse_sdk.h"
 #include "recorder.h"
+#include "replay.h"
 #include "screen.h"
 #include "server.h"
+#include "stream_server.h"
 #include "uhid/gamepad_uhid.h"
 #include "uhid/keyboard_uhid.h"
 #include "uhid/mouse_uhid.h"
@@ -41,6 +46,9 @@
 #include "util/rand.h"
 #include "util/timeout.h"
 #include "util/tick.h"
+#ifdef HAVE_STREAM_OUTPUT
+# include "stream_output.h"
+#endif
 #ifdef HAVE_V4L2
 # include "v4l2_sink.h"
 #endif
@@ -53,13 +61,21 @@ struct scrcpy {
     struct sc_demuxer audio_demuxer;
     struct sc_decoder video_decoder;
     struct sc_decoder audio_decoder;
-    struct sc_recorder recorder;
+    struct sc_recorder recorders[SC_MAX_RECORDS];
+    struct sc_replay replay;
+#ifdef HAVE_STREAM_OUTPUT
+    struct sc_stream_output stream_output;
+#endif
+    struct sc_stream_server stream_server;
     struct sc_delay_buffer video_buffer;
+    struct sc_av_sync av_sync;
 #ifdef HAVE_V4L2
     struct sc_v4l2_sink v4l2_sink;
     struct sc_delay_buffer v4l2_buffer;
 #endif
     struct sc_controller controller;
+    struct sc_control_recorder control_recorder;
+    struct sc_control_player control_player;
     struct sc_file_pusher file_pusher;
 #ifdef HAVE_USB
     struct sc_usb usb;
@@ -164,6 +180,18 @@ sdl_configure(bool video_playback, bool disable_screensaver) {
     }
 }
 
+// The scroll events are accumulated during one display refresh interval
+static sc_tick
+get_scroll_interval(void) {
+    int refresh_rate = 60; // default
+    SDL_DisplayMode mode;
+    if (SDL_WasInit(SDL_INIT_VIDEO) && !SDL_GetDesktopDisplayMode(0, &mode)
+            && mode.refresh_rate > 0) {
+        refresh_rate = mode.refresh_rate;
+    }
+    return SC_TICK_FREQ / refresh_rate;
+}
+
 static enum scrcpy_exit_code
 event_loop(struct scrcpy *s) {
     SDL_Event event;
@@ -387,8 +415,14 @@ scrcpy(struct scrcpy_options *options) {
 
     bool server_started = false;
     bool file_pusher_initialized = false;
-    bool recorder_initialized = false;
-    bool recorder_started = false;
+    unsigned recorders_initialized = 0;
+    unsigned recorders_started = 0;
+    bool replay_initialized = false;
+#ifdef HAVE_STREAM_OUTPUT
+    bool stream_output_initialized = false;
+#endif
+    bool stream_server_initialized = false;
+    bool stream_server_started = false;
 #ifdef HAVE_V4L2
     bool v4l2_sink_initialized = false;
 #endif
@@ -402,7 +436,11 @@ scrcpy(struct scrcpy_options *options) {
 #endif
     bool controller_initialized = false;
     bool controller_started = false;
+    bool control_recorder_initialized = false;
+    bool control_player_initialized = false;
+    bool control_player_started = false;
     bool screen_initialized = false;
+    bool av_sync_initialized = false;
     bool timeout_initialized = false;
     bool timeout_started = false;
 
@@ -428,6 +466,8 @@ scrcpy(struct scrcpy_options *options) {
         .max_size = options->max_size,
         .video_bit_rate = options->video_bit_rate,
         .audio_bit_rate = options->audio_bit_rate,
+        .audio_sample_rate = options->audio_sample_rate,
+        .audio_channels = options->audio_channels,
         .max_fps = options->max_fps,
         .angle = options->angle,
         .screen_off_timeout = options->screen_off_timeout,
@@ -580,7 +620,7 @@ scrcpy(struct scrcpy_options *options) {
     bool needs_video_decoder = options->video_playback;
     bool needs_audio_decoder = options->audio_playback;
 #ifdef HAVE_V4L2
-    needs_video_decoder |= !!options->v4l2_device;
+    needs_video_decoder |= options->v4l2_device && !options->v4l2_passthrough;
 #endif
     if (needs_video_decoder) {
         sc_decoder_init(&s->video_decoder, "video");
@@ -593,31 +633,116 @@ scrcpy(struct scrcpy_options *options) {
                                   &s->audio_decoder.packet_sink);
     }
 
-    if (options->record_filename) {
+    for (unsigned i = 0; i < options->record_count; ++i) {
+        const struct sc_record_output *record = &options->records[i];
+        struct sc_recorder *recorder = &s->recorders[i];
+
+        // Every recorder is a separate packet sink with its own thread, but
+        // they all reference the same packet buffers
+        assert(!record->video || options->video);
+        assert(!record->audio || options->audio);
+
         static const struct sc_recorder_callbacks recorder_cbs = {
             .on_ended = sc_recorder_on_ended,
         };
-        if (!sc_recorder_init(&s->recorder, options->record_filename,
-                              options->record_format, options->video,
-                              options->audio, options->record_orientation,
-                              &recorder_cbs, NULL)) {
+        struct sc_recorder_params recorder_params = {
+            .filename = record->filename,
+            .format = record->format,
+            .video = record->video,
+            .audio = record->audio,
+            .orientation = options->record_orientation,
+            .fragmented = options->record_fragmented,
+            .queue_limit = options->record_queue_limit,
+            .overflow = options->record_queue_overflow,
+            .io = {
+                .buffer_size = options->record_io_buffer,
+                .flush_interval = options->record_flush_interval,
+                .sync_interval = options->record_sync_interval,
+            },
+            .segment_duration = options->record_segment_duration,
+            .segment_size = options->record_segment_size,
+        };
+        if (!sc_recorder_init(recorder, &recorder_params, &recorder_cbs,
+                              NULL)) {
             goto end;
         }
-        recorder_initialized = true;
+        ++recorders_initialized;
 
-        if (!sc_recorder_start(&s->recorder)) {
+        if (!sc_recorder_start(recorder)) {
             goto end;
         }
-        recorder_started = true;
+        ++recorders_started;
+
+        if (record->video) {
+            sc_packet_source_add_sink(&s->video_demuxer.packet_source,
+                                      &recorder->video_packet_sink);
+        }
+        if (record->audio) {
+            sc_packet_source_add_sink(&s->audio_demuxer.packet_source,
+                                      &recorder->audio_packet_sink);
+        }
+    }
+
+    struct sc_replay *replay = NULL;
+    if (options->replay_filename) {
+        struct sc_replay_params replay_params = {
+            .filename = options->replay_filename,
+            .format = options->replay_format,
+            .video = options->video,
+            .audio = options->audio,
+            .orientation = options->record_orientation,
+            .max_duration = options->replay_duration,
+            .max_bytes = options->replay_size,
+        };
+        if (!sc_replay_init(&s->replay, &replay_params)) {
+            goto end;
+        }
+        replay_initialized = true;
+        replay = &s->replay;
 
         if (options->video) {
             sc_packet_source_add_sink(&s->video_demuxer.packet_source,
-                                      &s->recorder.video_packet_sink);
+                                      &s->replay.video_packet_sink);
         }
         if (options->audio) {
             sc_packet_source_add_sink(&s->audio_demuxer.packet_source,
-                                      &s->recorder.audio_packet_sink);
+                                      &s->replay.audio_packet_sink);
+        }
+    }
+
+#ifdef HAVE_STREAM_OUTPUT
+    if (options->video_stream_output) {
+        struct sc_stream_output_params stream_output_params = {
+            .target = options->video_stream_output,
+            .format = options->video_stream_format,
+        };
+        if (!sc_stream_output_init(&s->stream_output, &stream_output_params)) {
+            goto end;
         }
+        stream_output_initialized = true;
+
+        sc_packet_source_add_sink(&s->video_demuxer.packet_source,
+                                  &s->stream_output.packet_sink);
+    }
+#endif
+
+    if (options->video_stream_server_port) {
+        struct sc_stream_server_params stream_server_params = {
+            .port = options->video_stream_server_port,
+            .format = options->video_stream_format,
+        };
+        if (!sc_stream_server_init(&s->stream_server, &stream_server_params)) {
+            goto end;
+        }
+        stream_server_initialized = true;
+
+        if (!sc_stream_server_start(&s->stream_server)) {
+            goto end;
+        }
+        stream_server_started = true;
+
+        sc_packet_source_add_sink(&s->video_demuxer.packet_source,
+                                  &s->stream_server.packet_sink);
     }
 
     struct sc_controller *controller = NULL;
@@ -630,8 +755,26 @@ scrcpy(struct scrcpy_options *options) {
             .on_ended = sc_controller_on_ended,
         };
 
-        if (!sc_controller_init(&s->controller, s->server.control_socket,
-            &controller_cbs, NULL)) {
+        struct sc_control_recorder *control_recorder = NULL;
+        if (options->control_record_filename) {
+            if (!sc_control_recorder_init(&s->control_recorder,
+                                          options->control_record_filename)) {
+                goto end;
+            }
+            control_recorder_initialized = true;
+            control_recorder = &s->control_recorder;
+        }
+
+        struct sc_controller_params controller_params = {
+            .control_socket = s->server.control_socket,
+            .print_latency = options->print_input_latency,
+            .input_timestamps = options->input_timestamps,
+            .scroll_interval = get_scroll_interval(),
+            .recorder = control_recorder,
+        };
+
+        if (!sc_controller_init(&s->controller, &controller_params,
+                                &controller_cbs, NULL)) {
             goto end;
         }
         controller_initialized = true;
@@ -786,6 +929,25 @@ aoa_complete:
     // There is a controller if and only if control is enabled
     assert(options->control == !!controller);
 
+    struct sc_av_sync *av_sync = NULL;
+    if (options->av_sync) {
+        assert(options->video_playback && options->audio_playback);
+        // Video frames may be delayed up to the audio playback latency (with
+        // some margin for the additional SDL and audio driver latency)
+        sc_tick max_delay = options->audio_buffer + SC_TICK_FROM_MS(100);
+        if (options->audio_output_buffer == SC_AUDIO_OUTPUT_BUFFER_AUTO) {
+            // The measured output latency is added to the audio buffering
+            max_delay += SC_TICK_FROM_MS(100);
+        } else {
+            max_delay += options->audio_output_buffer;
+        }
+        if (!sc_av_sync_init(&s->av_sync, max_delay)) {
+            goto end;
+        }
+        av_sync = &s->av_sync;
+        av_sync_initialized = true;
+    }
+
     if (options->window) {
         const char *window_title =
             options->window_title ? options->window_title : info->device_name;
@@ -794,6 +956,7 @@ aoa_complete:
             .video = options->video_playback,
             .controller = controller,
             .fp = fp,
+            .replay = replay,
             .kp = kp,
             .mp = mp,
             .gp = gp,
@@ -821,9 +984,9 @@ aoa_complete:
 
         if (options->video_playback) {
             struct sc_frame_source *src = &s->video_decoder.frame_source;
-            if (options->video_buffer) {
+            if (options->video_buffer || av_sync) {
                 sc_delay_buffer_init(&s->video_buffer,
-                                     options->video_buffer, true);
+                                     options->video_buffer, true, av_sync);
                 sc_frame_source_add_sink(src, &s->video_buffer.frame_sink);
                 src = &s->video_buffer.frame_source;
             }
@@ -834,25 +997,33 @@ aoa_complete:
 
     if (options->audio_playback) {
         sc_audio_player_init(&s->audio_player, options->audio_buffer,
-                             options->audio_output_buffer);
+                             options->audio_output_buffer, av_sync);
         sc_frame_source_add_sink(&s->audio_decoder.frame_source,
                                  &s->audio_player.frame_sink);
     }
 
 #ifdef HAVE_V4L2
     if (options->v4l2_device) {
-        if (!sc_v4l2_sink_init(&s->v4l2_sink, options->v4l2_device)) {
+        if (!sc_v4l2_sink_init(&s->v4l2_sink, options->v4l2_device,
+                               options->v4l2_passthrough)) {
             goto end;
         }
 
-        struct sc_frame_source *src = &s->video_decoder.frame_source;
-        if (options->v4l2_buffer) {
-            sc_delay_buffer_init(&s->v4l2_buffer, options->v4l2_buffer, true);
-            sc_frame_source_add_sink(src, &s->v4l2_buffer.frame_sink);
-            src = &s->v4l2_buffer.frame_source;
-        }
+        if (options->v4l2_passthrough) {
+            // The compressed packets are written without decoding
+            sc_packet_source_add_sink(&s->video_demuxer.packet_source,
+                                      &s->v4l2_sink.packet_sink);
+        } else {
+            struct sc_frame_source *src = &s->video_decoder.frame_source;
+            if (options->v4l2_buffer) {
+                sc_delay_buffer_init(&s->v4l2_buffer, options->v4l2_buffer,
+                                     true, NULL);
+                sc_frame_source_add_sink(src, &s->v4l2_buffer.frame_sink);
+                src = &s->v4l2_buffer.frame_source;
+            }
 
-        sc_frame_source_add_sink(src, &s->v4l2_sink.frame_sink);
+            sc_frame_source_add_sink(src, &s->v4l2_sink.frame_sink);
+        }
 
         v4l2_sink_initialized = true;
     }
@@ -916,20 +1087,34 @@ aoa_complete:
     if (options->control && options->start_app) {
         assert(controller);
 
-        char *name = strdup(options->start_app);
-        if (!name) {
-            LOG_OOM();
-            goto end;
-        }
-
         struct sc_control_msg msg;
         msg.type = SC_CONTROL_MSG_TYPE_START_APP;
-        msg.start_app.name = name;
+        msg.start_app.name = options->start_app; // copied by the controller
 
         if (!sc_controller_push_msg(controller, &msg)) {
-            LOGW("Could not request start app '%s'", name);
-            free(name);
+            LOGW("Could not request start app '%s'", options->start_app);
+        }
+    }
+
+    if (options->control_replay_filename) {
+        assert(controller);
+
+        struct sc_control_player_params control_player_params = {
+            .controller = controller,
+            .filename = options->control_replay_filename,
+            .speed = options->control_replay_speed,
+        };
+
+        if (!sc_control_player_init(&s->control_player,
+                                    &control_player_params)) {
+            goto end;
+        }
+        control_player_initialized = true;
+
+        if (!sc_control_player_start(&s->control_player)) {
+            goto end;
         }
+        control_player_started = true;
     }
 
     ret = event_loop(s);
@@ -968,14 +1153,20 @@ end:
         sc_acksync_destroy(acksync);
     }
 #endif
+    if (control_player_started) {
+        sc_control_player_stop(&s->control_player);
+    }
     if (controller_started) {
         sc_controller_stop(&s->controller);
     }
     if (file_pusher_initialized) {
         sc_file_pusher_stop(&s->file_pusher);
     }
-    if (recorder_initialized) {
-        sc_recorder_stop(&s->recorder);
+    for (unsigned i = 0; i < recorders_initialized; ++i) {
+        sc_recorder_stop(&s->recorders[i]);
+    }
+    if (stream_server_started) {
+        sc_stream_server_stop(&s->stream_server);
     }
     if (screen_initialized) {
         sc_screen_interrupt(&s->screen);
@@ -1027,18 +1218,54 @@ end:
         sc_screen_destroy(&s->screen);
     }
 
+    // The audio player and the video buffer are closed once the demuxers are
+    // joined
+    if (av_sync_initialized) {
+        sc_av_sync_destroy(&s->av_sync);
+    }
+
+    // The control player pushes messages to the controller
+    if (control_player_started) {
+        sc_control_player_join(&s->control_player);
+    }
+    if (control_player_initialized) {
+        sc_control_player_destroy(&s->control_player);
+    }
+
     if (controller_started) {
         sc_controller_join(&s->controller);
     }
     if (controller_initialized) {
         sc_controller_destroy(&s->controller);
     }
+    // The controller thread writes to the control recorder
+    if (control_recorder_initialized) {
+        sc_control_recorder_destroy(&s->control_recorder);
+    }
+
+    for (unsigned i = 0; i < recorders_started; ++i) {
+        sc_recorder_join(&s->recorders[i]);
+    }
+    for (unsigned i = 0; i < recorders_initialized; ++i) {
+        sc_recorder_destroy(&s->recorders[i]);
+    }
+
+    // The replay packet sinks are closed once the demuxers are joined
+    if (replay_initialized) {
+        sc_replay_destroy(&s->replay);
+    }
+
+#ifdef HAVE_STREAM_OUTPUT
+    if (stream_output_initialized) {
+        sc_stream_output_destroy(&s->stream_output);
+    }
+#endif
 
-    if (recorder_started) {
-        sc_recorder_join(&s->recorder);
+    if (stream_server_started) {
+        sc_stream_server_join(&s->stream_server);
     }
-    if (recorder_initialized) {
-        sc_recorder_destroy(&s->recorder);
+    if (stream_server_initialized) {
+        sc_stream_server_destroy(&s->stream_server);
     }
 
     if (file_pusher_initialized) {
@@ -76,6 +76,7 @@ struct sc_screen_params {
 
     struct sc_controller *controller;
     struct sc_file_pusher *fp;
+    struct sc_replay *replay; // may be NULL
     struct sc_key_processor *kp;
     struct sc_mouse_processor *mp;
     struct sc_gamepad_processor *gp;
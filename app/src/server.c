@@ -246,6 +246,12 @@ execute_server(struct sc_server *server,
     if (params->audio_bit_rate) {
         ADD_PARAM("audio_bit_rate=%" PRIu32, params->audio_bit_rate);
     }
+    if (params->audio_sample_rate) {
+        ADD_PARAM("audio_sample_rate=%" PRIu32, params->audio_sample_rate);
+    }
+    if (params->audio_channels) {
+        ADD_PARAM("audio_channels=%" PRIu8, params->audio_channels);
+    }
     if (params->video_codec != SC_CODEC_H264) {
         ADD_PARAM("video_codec=%s",
                   sc_server_get_codec_name(params->video_codec));
@@ -0,0 +1,416 @@
+#include "stream_output.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+#include "util/log.h"
+
+/** Downcast packet sink to stream output */
+#define DOWNCAST(SINK) container_of(SINK, struct sc_stream_output, packet_sink)
+
+#define SC_STREAM_OUTPUT_UNIX_PREFIX "unix:"
+
+// The original stdout, once reserved for the stream
+static int sc_stream_output_stdout_fd = -1;
+
+bool
+sc_stream_output_reserve_stdout(void) {
+    assert(sc_stream_output_stdout_fd == -1);
+
+    if (isatty(STDOUT_FILENO)) {
+        LOGE("Stream output: stdout is a terminal");
+        return false;
+    }
+
+    fflush(stdout);
+
+    // Not inherited by the child processes (adb and the server)
+    int fd = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+    if (fd == -1) {
+        LOGE("Could not duplicate stdout: %s", strerror(errno));
+        return false;
+    }
+
+    // Everything else printed to stdout (the logs, and the output of the
+    // child processes, which inherit it) goes to stderr
+    if (dup2(STDERR_FILENO, STDOUT_FILENO) == -1) {
+        LOGE("Could not redirect stdout: %s", strerror(errno));
+        close(fd);
+        return false;
+    }
+
+    sc_stream_output_stdout_fd = fd;
+    return true;
+}
+
+static int
+sc_stream_output_connect(const char *path) {
+    struct sockaddr_un addr;
+    size_t len = strlen(path);
+    if (len >= sizeof(addr.sun_path)) {
+        LOGE("Unix socket path too long: %s", path);
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path, len + 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) {
+        LOGE("Could not create Unix socket: %s", strerror(errno));
+        return -1;
+    }
+
+    if (fcntl(fd, F_SETFD, FD_CLOEXEC) == -1) {
+        LOGW("Could not set FD_CLOEXEC: %s", strerror(errno));
+    }
+
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+        LOGE("Could not connect to Unix socket %s: %s", path,
+             strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static int
+sc_stream_output_open_file(const char *path) {
+    struct stat st;
+    if (!stat(path, &st) && S_ISFIFO(st.st_mode)) {
+        LOGI("Stream output: waiting for a reader on %s...", path);
+    }
+
+    // For a FIFO, this blocks until the consumer opens it for reading
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        LOGE("Could not open %s: %s", path, strerror(errno));
+    }
+    return fd;
+}
+
+static bool
+sc_stream_output_open(struct sc_stream_output *so, const char *target) {
+    bool is_stdout = !strcmp(target, "-");
+    if (is_stdout) {
+        // Must have been reserved before anything was printed
+        assert(sc_stream_output_stdout_fd != -1);
+        so->fd = sc_stream_output_stdout_fd;
+        sc_stream_output_stdout_fd = -1;
+    } else {
+        size_t prefix_len = strlen(SC_STREAM_OUTPUT_UNIX_PREFIX);
+        if (!strncmp(target, SC_STREAM_OUTPUT_UNIX_PREFIX, prefix_len)) {
+            so->fd = sc_stream_output_connect(target + prefix_len);
+        } else {
+            so->fd = sc_stream_output_open_file(target);
+        }
+        if (so->fd == -1) {
+            return false;
+        }
+    }
+
+    // The writes must never block the demuxer
+    int flags = fcntl(so->fd, F_GETFL);
+    if (flags == -1 || fcntl(so->fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+        LOGE("Could not set O_NONBLOCK: %s", strerror(errno));
+        close(so->fd);
+        return false;
+    }
+
+    // The file description of stdout may be shared with the parent process
+    so->restore_flags = is_stdout ? flags : -1;
+
+    return true;
+}
+
+// Write (the remaining part of) the pending data, as much as possible without
+// blocking. Return false on error.
+static bool
+sc_stream_output_write_pending(struct sc_stream_output *so) {
+    assert(so->pending.active);
+
+    size_t header_size = so->pending.header_size;
+    AVPacket *packet = so->pending.packet; // empty if there is only a header
+    size_t total = header_size + packet->size;
+    size_t offset = so->pending.offset;
+
+    struct iovec iov[2];
+    int iovcnt = 0;
+    if (offset < header_size) {
+        iov[iovcnt].iov_base = so->pending.header + offset;
+        iov[iovcnt].iov_len = header_size - offset;
+        ++iovcnt;
+    }
+    if (packet->size) {
+        size_t data_offset = offset > header_size ? offset - header_size : 0;
+        iov[iovcnt].iov_base = packet->data + data_offset;
+        iov[iovcnt].iov_len = packet->size - data_offset;
+        ++iovcnt;
+    }
+
+    while (offset < total) {
+        ssize_t w = writev(so->fd, iov, iovcnt);
+        if (w == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                // The consumer is not ready, retry on the next packet
+                break;
+            }
+            if (errno == EPIPE) {
+                LOGW("Stream output: consumer disconnected");
+            } else {
+                LOGE("Stream output: could not write: %s", strerror(errno));
+            }
+            so->failed = true;
+            return false;
+        }
+
+        offset += w;
+
+        // Skip the iovecs fully written
+        size_t remaining = w;
+        int i = 0;
+        while (i < iovcnt && remaining >= iov[i].iov_len) {
+            remaining -= iov[i].iov_len;
+            ++i;
+        }
+        if (i < iovcnt) {
+            iov[i].iov_base = (uint8_t *) iov[i].iov_base + remaining;
+            iov[i].iov_len -= remaining;
+        }
+        memmove(iov, &iov[i], (iovcnt - i) * sizeof(*iov));
+        iovcnt -= i;
+    }
+
+    so->pending.offset = offset;
+    if (offset == total) {
+        so->pending.active = false;
+        av_packet_unref(packet);
+    }
+
+    return true;
+}
+
+// Start writing a packet. Return false if it could not be written at all
+// (either on error, or because the write would block).
+static bool
+sc_stream_output_send(struct sc_stream_output *so, const AVPacket *packet) {
+    assert(!so->pending.active);
+
+    if (so->format == SC_STREAM_FORMAT_SCRCPY) {
+        // Same packet header as the device stream
+        sc_demuxer_write_packet_header(so->pending.header, packet);
+        so->pending.header_size = SC_PACKET_HEADER_SIZE;
+    } else {
+        so->pending.header_size = 0;
+    }
+
+    // Reference the packet data, so that it can be completed later
+    if (av_packet_ref(so->pending.packet, packet)) {
+        LOG_OOM();
+        return false;
+    }
+
+    so->pending.offset = 0;
+    so->pending.active = true;
+
+    if (!sc_stream_output_write_pending(so)) {
+        return false;
+    }
+
+    if (so->pending.active && !so->pending.offset) {
+        // Nothing has been written, forget the packet
+        so->pending.active = false;
+        av_packet_unref(so->pending.packet);
+        return false;
+    }
+
+    return true;
+}
+
+static void
+sc_stream_output_drop(struct sc_stream_output *so) {
+    if (!so->dropping) {
+        LOGW("Stream output: consumer too slow, dropping packets until the "
+             "next keyframe");
+        so->dropping = true;
+    }
+    ++so->dropped;
+}
+
+static bool
+sc_stream_output_packet_sink_open(struct sc_packet_sink *sink,
+                                  AVCodecContext *ctx) {
+    struct sc_stream_output *so = DOWNCAST(sink);
+
+    so->config_merged = ctx->codec_id == AV_CODEC_ID_H264
+                     || ctx->codec_id == AV_CODEC_ID_HEVC;
+
+    // A consumer closing its end must not kill scrcpy: block SIGPIPE in the
+    // demuxer thread (the only thread writing to the output), so that the
+    // write fails with EPIPE instead
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGPIPE);
+    int r = pthread_sigmask(SIG_BLOCK, &set, NULL);
+    if (r) {
+        LOGE("Could not block SIGPIPE: %s", strerror(r));
+        return false;
+    }
+
+    if (so->format == SC_STREAM_FORMAT_SCRCPY) {
+        // Same codec header as the device video stream, written before the
+        // first packet
+        if (!sc_demuxer_write_video_codec_header(so->pending.header, ctx)) {
+            LOGE("Stream output: unsupported codec");
+            return false;
+        }
+        so->pending.header_size = SC_VIDEO_CODEC_HEADER_SIZE;
+        so->pending.offset = 0;
+        so->pending.active = true;
+    }
+
+    return true;
+}
+
+static void
+sc_stream_output_packet_sink_close(struct sc_packet_sink *sink) {
+    struct sc_stream_output *so = DOWNCAST(sink);
+
+    if (so->dropped) {
+        LOGI("Stream output: %" PRIu64 " packets dropped", so->dropped);
+    }
+}
+
+static bool
+sc_stream_output_packet_sink_push(struct sc_packet_sink *sink,
+                                  const AVPacket *packet) {
+    struct sc_stream_output *so = DOWNCAST(sink);
+
+    if (so->failed) {
+        // The stream output is disabled, but the mirroring continues
+        return true;
+    }
+
+    bool is_config = packet->pts == AV_NOPTS_VALUE;
+    if (is_config) {
+        // Keep it to resume on a keyframe after packets have been dropped
+        av_packet_unref(so->config);
+        if (av_packet_ref(so->config, packet)) {
+            LOG_OOM();
+            return false;
+        }
+    }
+
+    if (so->pending.active) {
+        if (!sc_stream_output_write_pending(so)) {
+            return true;
+        }
+        if (so->pending.active) {
+            // The previous packet is still not fully written
+            sc_stream_output_drop(so);
+            return true;
+        }
+    }
+
+    if (so->dropping) {
+        if (is_config || !(packet->flags & AV_PKT_FLAG_KEY)) {
+            ++so->dropped;
+            return true;
+        }
+
+        // Resume on this keyframe, preceded by the latest config packet
+        so->dropping = false;
+        if (so->config->size) {
+            if (!sc_stream_output_send(so, so->config) || so->pending.active) {
+                if (!so->failed) {
+                    sc_stream_output_drop(so);
+                }
+                return true;
+            }
+        }
+    }
+
+    if (is_config && so->config_merged
+            && so->format == SC_STREAM_FORMAT_ANNEXB) {
+        // It will be written along with the next packet
+        return true;
+    }
+
+    if (!sc_stream_output_send(so, packet) && !so->failed) {
+        sc_stream_output_drop(so);
+    }
+
+    return true;
+}
+
+bool
+sc_stream_output_init(struct sc_stream_output *so,
+                      const struct sc_stream_output_params *params) {
+    so->config = av_packet_alloc();
+    if (!so->config) {
+        LOG_OOM();
+        return false;
+    }
+
+    so->pending.packet = av_packet_alloc();
+    if (!so->pending.packet) {
+        LOG_OOM();
+        goto error_free_config;
+    }
+
+    if (!sc_stream_output_open(so, params->target)) {
+        goto error_free_pending;
+    }
+
+    so->format = params->format;
+    so->config_merged = false;
+    so->pending.header_size = 0;
+    so->pending.offset = 0;
+    so->pending.active = false;
+    so->dropping = false;
+    so->failed = false;
+    so->dropped = 0;
+
+    static const struct sc_packet_sink_ops ops = {
+        .open = sc_stream_output_packet_sink_open,
+        .close = sc_stream_output_packet_sink_close,
+        .push = sc_stream_output_packet_sink_push,
+    };
+
+    so->packet_sink.ops = &ops;
+
+    return true;
+
+error_free_pending:
+    av_packet_free(&so->pending.packet);
+error_free_config:
+    av_packet_free(&so->config);
+
+    return false;
+}
+
+void
+sc_stream_output_destroy(struct sc_stream_output *so) {
+    if (so->restore_flags != -1) {
+        // Leave stdout as it was
+        fcntl(so->fd, F_SETFL, so->restore_flags);
+    }
+    close(so->fd);
+    av_packet_free(&so->pending.packet);
+    av_packet_free(&so->config);
+}
@@ -0,0 +1,83 @@
+#ifndef SC_STREAM_OUTPUT_H
+#define SC_STREAM_OUTPUT_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <libavcodec/avcodec.h>
+
+#include "demuxer.h"
+#include "options.h"
+#include "trait/packet_sink.h"
+
+/**
+ * Raw stream output
+ *
+ * Write the video elementary stream, without remuxing, to stdout, a FIFO, a
+ * file or a Unix domain socket, for consumption by another program.
+ *
+ * The writes never block the demuxer: if the consumer does not read fast
+ * enough, the packets are dropped until the next keyframe.
+ */
+
+struct sc_stream_output {
+    struct sc_packet_sink packet_sink; // packet sink trait
+
+    // All the fields are accessed only from the demuxer thread (except on
+    // init and destroy)
+
+    int fd;
+    // The original flags of stdout, restored on destroy (-1 for other targets)
+    int restore_flags;
+    enum sc_stream_format format;
+
+    // For H.264 and H.265, the config packet is also prepended to the next
+    // media packet by the demuxer
+    bool config_merged;
+    AVPacket *config; // the latest config packet
+
+    // The packet partially written, to be completed before any other write
+    struct {
+        uint8_t header[SC_PACKET_HEADER_SIZE];
+        size_t header_size;
+        AVPacket *packet; // NULL if the pending write is only a header
+        size_t offset; // in the header and the packet data
+        bool active;
+    } pending;
+
+    // Drop all packets until the next keyframe
+    bool dropping;
+    // Set once the consumer is gone (the output is then disabled)
+    bool failed;
+    uint64_t dropped;
+};
+
+struct sc_stream_output_params {
+    // "-" for stdout (reserved by sc_stream_output_reserve_stdout()),
+    // "unix:<path>" for a Unix socket, a file path otherwise
+    const char *target;
+    enum sc_stream_format format;
+};
+
+/**
+ * Reserve stdout for the stream
+ *
+ * The stream is written to a duplicate of stdout, and stdout is redirected to
+ * stderr, so that nothing else (logs, child processes output) is written to
+ * the stream.
+ *
+ * This must be called before anything is printed, if the target is "-".
+ */
+bool
+sc_stream_output_reserve_stdout(void);
+
+bool
+sc_stream_output_init(struct sc_stream_output *so,
+                      const struct sc_stream_output_params *params);
+
+void
+sc_stream_output_destroy(struct sc_stream_output *so);
+
+#endif
@@ -0,0 +1,539 @@
+#include "stream_server.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <string.h>
+#ifndef _WIN32
+# include <signal.h>
+#endif
+
+#include "util/log.h"
+
+/** Downcast packet sink to stream server */
+#define DOWNCAST(SINK) container_of(SINK, struct sc_stream_server, packet_sink)
+
+static void
+sc_stream_server_queue_clear(struct sc_stream_server_queue *queue) {
+    while (!sc_vecdeque_is_empty(queue)) {
+        AVPacket *packet = sc_vecdeque_pop(queue);
+        av_packet_free(&packet);
+    }
+}
+
+static bool
+sc_stream_server_queue_push(struct sc_stream_server_queue *queue,
+                            const AVPacket *packet) {
+    // Only reference the packet data
+    AVPacket *p = av_packet_clone(packet);
+    if (!p) {
+        LOG_OOM();
+        return false;
+    }
+
+    if (!sc_vecdeque_push(queue, p)) {
+        LOG_OOM();
+        av_packet_free(&p);
+        return false;
+    }
+
+    return true;
+}
+
+static bool
+sc_stream_client_enqueue(struct sc_stream_client *client,
+                         const AVPacket *packet) {
+    if (!sc_stream_server_queue_push(&client->queue, packet)) {
+        return false;
+    }
+
+    client->queue_bytes += packet->size;
+    return true;
+}
+
+static void
+sc_stream_client_drop_queue(struct sc_stream_client *client) {
+    client->dropped += sc_vecdeque_size(&client->queue);
+    sc_stream_server_queue_clear(&client->queue);
+    client->queue_bytes = 0;
+}
+
+// Called with server->mutex locked
+static void
+sc_stream_client_push(struct sc_stream_client *client,
+                      const AVPacket *packet) {
+    struct sc_stream_server *server = client->server;
+
+    bool is_config = packet->pts == AV_NOPTS_VALUE;
+    bool is_key = !is_config && (packet->flags & AV_PKT_FLAG_KEY);
+
+    if (client->dropping && !is_key) {
+        // The config packet is kept by the server
+        if (!is_config) {
+            ++client->dropped;
+        }
+        return;
+    }
+
+    if (!client->dropping && client->queue_bytes + packet->size
+                                > SC_STREAM_SERVER_CLIENT_QUEUE_LIMIT) {
+        // The client is too slow, drop the current GOP
+        LOGW("Stream server: client too slow, dropping packets until the "
+             "next keyframe");
+        sc_stream_client_drop_queue(client);
+        client->dropping = true;
+        if (!is_key) {
+            ++client->dropped;
+            return;
+        }
+    }
+
+    if (client->dropping) {
+        // Resume on this keyframe, preceded by the latest config packet
+        client->dropping = false;
+        if (server->config->size
+                && !sc_stream_client_enqueue(client, server->config)) {
+            client->dropping = true;
+            return;
+        }
+    }
+
+    if (is_config && server->config_merged
+            && server->format == SC_STREAM_FORMAT_ANNEXB) {
+        // It will be sent along with the next packet
+        return;
+    }
+
+    if (!sc_stream_client_enqueue(client, packet)) {
+        sc_stream_client_drop_queue(client);
+        client->dropping = true;
+    }
+}
+
+static bool
+sc_stream_client_send(struct sc_stream_client *client, const AVPacket *packet) {
+    if (client->server->format == SC_STREAM_FORMAT_SCRCPY) {
+        uint8_t header[SC_PACKET_HEADER_SIZE];
+        sc_demuxer_write_packet_header(header, packet);
+        ssize_t w = net_send_all(client->socket, header, sizeof(header));
+        if (w != sizeof(header)) {
+            return false;
+        }
+    }
+
+    ssize_t w = net_send_all(client->socket, packet->data, packet->size);
+    return w == packet->size;
+}
+
+// Called with server->mutex locked
+static bool
+sc_stream_client_has_data(struct sc_stream_client *client, bool header_sent) {
+    if (!header_sent) {
+        return client->server->codec_known;
+    }
+    return !sc_vecdeque_is_empty(&client->queue);
+}
+
+static int
+run_stream_client(void *data) {
+    struct sc_stream_client *client = data;
+    struct sc_stream_server *server = client->server;
+
+#ifndef _WIN32
+    // A client closing its connection must not kill scrcpy: block SIGPIPE in
+    // this thread, so that send() fails with EPIPE instead
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+#endif
+
+    // The codec header is only sent for the scrcpy format
+    bool header_sent = server->format != SC_STREAM_FORMAT_SCRCPY;
+
+    for (;;) {
+        sc_mutex_lock(&server->mutex);
+        bool has_data;
+        while (!(has_data = sc_stream_client_has_data(client, header_sent))
+                && !server->stopped && !server->eos) {
+            sc_cond_wait(&server->cond, &server->mutex);
+        }
+
+        if (server->stopped || !has_data) {
+            // Stopped, or end of stream once all the packets are sent
+            sc_mutex_unlock(&server->mutex);
+            break;
+        }
+
+        if (!header_sent) {
+            uint8_t header[SC_VIDEO_CODEC_HEADER_SIZE];
+            memcpy(header, server->codec_header, sizeof(header));
+            sc_mutex_unlock(&server->mutex);
+
+            ssize_t w = net_send_all(client->socket, header, sizeof(header));
+            if (w != sizeof(header)) {
+                break;
+            }
+            header_sent = true;
+            continue;
+        }
+
+        AVPacket *packet = sc_vecdeque_pop(&client->queue);
+        assert(client->queue_bytes >= (size_t) packet->size);
+        client->queue_bytes -= packet->size;
+        sc_mutex_unlock(&server->mutex);
+
+        bool ok = sc_stream_client_send(client, packet);
+        av_packet_free(&packet);
+        if (!ok) {
+            break;
+        }
+    }
+
+    sc_mutex_lock(&server->mutex);
+    sc_stream_server_queue_clear(&client->queue);
+    client->queue_bytes = 0;
+    client->ended = true;
+    uint64_t dropped = client->dropped;
+    sc_mutex_unlock(&server->mutex);
+
+    LOGI("Stream server: client disconnected (%" PRIu64 " packets dropped)",
+         dropped);
+
+    return 0;
+}
+
+// Called with server->mutex locked
+static void
+sc_stream_client_release(struct sc_stream_client *client) {
+    assert(client->active);
+    assert(client->ended);
+
+    sc_thread_join(&client->thread, NULL);
+    net_close(client->socket);
+    sc_vecdeque_destroy(&client->queue);
+    client->active = false;
+}
+
+// Called with server->mutex locked
+static bool
+sc_stream_server_add_client(struct sc_stream_server *server,
+                            sc_socket socket) {
+    struct sc_stream_client *client = NULL;
+    for (unsigned i = 0; i < SC_STREAM_SERVER_MAX_CLIENTS; ++i) {
+        struct sc_stream_client *c = &server->clients[i];
+        if (c->active && c->ended) {
+            sc_stream_client_release(c);
+        }
+        if (!c->active && !client) {
+            client = c;
+        }
+    }
+
+    if (!client) {
+        LOGW("Stream server: too many clients (max %d)",
+             SC_STREAM_SERVER_MAX_CLIENTS);
+        return false;
+    }
+
+    client->server = server;
+    client->socket = socket;
+    client->ended = false;
+    client->queue_bytes = 0;
+    client->dropping = false;
+    client->dropped = 0;
+    sc_vecdeque_init(&client->queue);
+
+    if (!net_set_tcp_nodelay(socket, true)) {
+        LOGW("Stream server: could not disable Nagle's algorithm");
+    }
+
+    if (server->codec_known) {
+        // Late joiner: start from the latest keyframe if it is cached,
+        // otherwise wait for the next one
+        if (server->gop_valid && !sc_vecdeque_is_empty(&server->gop)) {
+            if (server->config->size
+                    && !sc_stream_client_enqueue(client, server->config)) {
+                // The GOP is not decodable without the codec config, wait for
+                // the next keyframe
+                client->dropping = true;
+            } else {
+                size_t size = sc_vecdeque_size(&server->gop);
+                for (size_t i = 0; i < size; ++i) {
+                    AVPacket *packet = sc_vecdeque_get(&server->gop, i);
+                    if (!sc_stream_client_enqueue(client, packet)) {
+                        sc_stream_client_drop_queue(client);
+                        client->dropping = true;
+                        break;
+                    }
+                }
+            }
+        } else {
+            client->dropping = true;
+        }
+    }
+
+    bool ok = sc_thread_create(&client->thread, run_stream_client,
+                               "scrcpy-stream-c", client);
+    if (!ok) {
+        LOGE("Stream server: could not start client thread");
+        sc_stream_server_queue_clear(&client->queue);
+        sc_vecdeque_destroy(&client->queue);
+        return false;
+    }
+
+    client->active = true;
+
+    LOGI("Stream server: client connected");
+    return true;
+}
+
+static int
+run_stream_server(void *data) {
+    struct sc_stream_server *server = data;
+
+    for (;;) {
+        sc_socket socket = net_accept(server->server_socket);
+
+        sc_mutex_lock(&server->mutex);
+        bool stopped = server->stopped;
+        if (socket != SC_SOCKET_NONE && !stopped) {
+            if (!sc_stream_server_add_client(server, socket)) {
+                net_close(socket);
+            }
+        }
+        sc_mutex_unlock(&server->mutex);
+
+        if (socket == SC_SOCKET_NONE) {
+            if (!stopped) {
+                LOGE("Stream server: could not accept client");
+            }
+            break;
+        }
+
+        if (stopped) {
+            net_close(socket);
+            break;
+        }
+    }
+
+    LOGD("Stream server thread ended");
+
+    return 0;
+}
+
+static bool
+sc_stream_server_packet_sink_open(struct sc_packet_sink *sink,
+                                  AVCodecContext *ctx) {
+    struct sc_stream_server *server = DOWNCAST(sink);
+
+    sc_mutex_lock(&server->mutex);
+    bool ok = sc_demuxer_write_video_codec_header(server->codec_header, ctx);
+    if (!ok && server->format == SC_STREAM_FORMAT_SCRCPY) {
+        sc_mutex_unlock(&server->mutex);
+        LOGE("Stream server: unsupported codec");
+        return false;
+    }
+
+    server->config_merged = ctx->codec_id == AV_CODEC_ID_H264
+                         || ctx->codec_id == AV_CODEC_ID_HEVC;
+    server->codec_known = true;
+    sc_cond_broadcast(&server->cond);
+    sc_mutex_unlock(&server->mutex);
+
+    return true;
+}
+
+static void
+sc_stream_server_packet_sink_close(struct sc_packet_sink *sink) {
+    struct sc_stream_server *server = DOWNCAST(sink);
+
+    sc_mutex_lock(&server->mutex);
+    server->eos = true;
+    sc_cond_broadcast(&server->cond);
+    sc_mutex_unlock(&server->mutex);
+}
+
+static bool
+sc_stream_server_packet_sink_push(struct sc_packet_sink *sink,
+                                  const AVPacket *packet) {
+    struct sc_stream_server *server = DOWNCAST(sink);
+
+    bool is_config = packet->pts == AV_NOPTS_VALUE;
+
+    sc_mutex_lock(&server->mutex);
+
+    if (is_config) {
+        // Kept for late joiners and for the clients resuming after drops
+        av_packet_unref(server->config);
+        if (av_packet_ref(server->config, packet)) {
+            sc_mutex_unlock(&server->mutex);
+            LOG_OOM();
+            return false;
+        }
+    } else {
+        if (packet->flags & AV_PKT_FLAG_KEY) {
+            // A new GOP starts
+            sc_stream_server_queue_clear(&server->gop);
+            server->gop_bytes = 0;
+            server->gop_valid = true;
+        }
+
+        if (server->gop_valid) {
+            if (server->gop_bytes + packet->size
+                        > SC_STREAM_SERVER_CLIENT_QUEUE_LIMIT
+                    || !sc_stream_server_queue_push(&server->gop, packet)) {
+                // Too large, late joiners will wait for the next keyframe
+                sc_stream_server_queue_clear(&server->gop);
+                server->gop_bytes = 0;
+                server->gop_valid = false;
+            } else {
+                server->gop_bytes += packet->size;
+            }
+        }
+    }
+
+    for (unsigned i = 0; i < SC_STREAM_SERVER_MAX_CLIENTS; ++i) {
+        struct sc_stream_client *client = &server->clients[i];
+        if (client->active && !client->ended) {
+            sc_stream_client_push(client, packet);
+        }
+    }
+
+    sc_cond_broadcast(&server->cond);
+    sc_mutex_unlock(&server->mutex);
+
+    return true;
+}
+
+bool
+sc_stream_server_init(struct sc_stream_server *server,
+                      const struct sc_stream_server_params *params) {
+    bool ok = sc_mutex_init(&server->mutex);
+    if (!ok) {
+        return false;
+    }
+
+    ok = sc_cond_init(&server->cond);
+    if (!ok) {
+        goto error_mutex_destroy;
+    }
+
+    server->config = av_packet_alloc();
+    if (!server->config) {
+        LOG_OOM();
+        goto error_cond_destroy;
+    }
+
+    server->server_socket = net_socket();
+    if (server->server_socket == SC_SOCKET_NONE) {
+        LOGE("Stream server: could not create socket");
+        goto error_free_config;
+    }
+
+    ok = net_listen(server->server_socket, IPV4_LOCALHOST, params->port,
+                    SC_STREAM_SERVER_MAX_CLIENTS);
+    if (!ok) {
+        LOGE("Stream server: could not listen on port %" PRIu16,
+             params->port);
+        goto error_close_socket;
+    }
+
+    server->port = params->port;
+    server->format = params->format;
+    server->stopped = false;
+    server->eos = false;
+    server->codec_known = false;
+    server->config_merged = false;
+    sc_vecdeque_init(&server->gop);
+    server->gop_bytes = 0;
+    server->gop_valid = false;
+
+    for (unsigned i = 0; i < SC_STREAM_SERVER_MAX_CLIENTS; ++i) {
+        server->clients[i].active = false;
+    }
+
+    static const struct sc_packet_sink_ops ops = {
+        .open = sc_stream_server_packet_sink_open,
+        .close = sc_stream_server_packet_sink_close,
+        .push = sc_stream_server_packet_sink_push,
+    };
+
+    server->packet_sink.ops = &ops;
+
+    LOGI("Stream server listening on localhost:%" PRIu16, params->port);
+
+    return true;
+
+error_close_socket:
+    net_close(server->server_socket);
+error_free_config:
+    av_packet_free(&server->config);
+error_cond_destroy:
+    sc_cond_destroy(&server->cond);
+error_mutex_destroy:
+    sc_mutex_destroy(&server->mutex);
+
+    return false;
+}
+
+bool
+sc_stream_server_start(struct sc_stream_server *server) {
+    LOGD("Starting stream server thread");
+    bool ok = sc_thread_create(&server->thread, run_stream_server,
+                               "scrcpy-stream", server);
+    if (!ok) {
+        LOGE("Could not start stream server thread");
+        return false;
+    }
+
+    return true;
+}
+
+void
+sc_stream_server_stop(struct sc_stream_server *server) {
+    sc_mutex_lock(&server->mutex);
+    server->stopped = true;
+    sc_cond_broadcast(&server->cond);
+
+    // Interrupt the blocking accept() and send() calls
+    net_interrupt(server->server_socket);
+    for (unsigned i = 0; i < SC_STREAM_SERVER_MAX_CLIENTS; ++i) {
+        struct sc_stream_client *client = &server->clients[i];
+        if (client->active && !client->ended) {
+            net_interrupt(client->socket);
+        }
+    }
+    sc_mutex_unlock(&server->mutex);
+}
+
+void
+sc_stream_server_join(struct sc_stream_server *server) {
+    sc_thread_join(&server->thread, NULL);
+
+    // The server thread is joined, the clients may not change anymore
+    for (unsigned i = 0; i < SC_STREAM_SERVER_MAX_CLIENTS; ++i) {
+        struct sc_stream_client *client = &server->clients[i];
+        if (client->active) {
+            sc_thread_join(&client->thread, NULL);
+        }
+    }
+}
+
+void
+sc_stream_server_destroy(struct sc_stream_server *server) {
+    for (unsigned i = 0; i < SC_STREAM_SERVER_MAX_CLIENTS; ++i) {
+        struct sc_stream_client *client = &server->clients[i];
+        if (client->active) {
+            net_close(client->socket);
+            sc_stream_server_queue_clear(&client->queue);
+            sc_vecdeque_destroy(&client->queue);
+        }
+    }
+
+    sc_stream_server_queue_clear(&server->gop);
+    sc_vecdeque_destroy(&server->gop);
+    net_close(server->server_socket);
+    av_packet_free(&server->config);
+    sc_cond_destroy(&server->cond);
+    sc_mutex_destroy(&server->mutex);
+}
@@ -0,0 +1,106 @@
+#ifndef SC_STREAM_SERVER_H
+#define SC_STREAM_SERVER_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <libavcodec/avcodec.h>
+
+#include "demuxer.h"
+#include "options.h"
+#include "trait/packet_sink.h"
+#include "util/net.h"
+#include "util/thread.h"
+#include "util/vecdeque.h"
+
+/**
+ * Stream server
+ *
+ * Serve the video stream to several local clients over TCP (on localhost),
+ * without opening additional device sessions.
+ *
+ * Each client has its own bounded queue (of references to the demuxer
+ * packets) and its own sending thread, so that a slow client drops whole GOPs
+ * without affecting the others. A late joiner receives the latest config
+ * packet and the packets of the current GOP, so that it can start decoding
+ * immediately.
+ */
+
+#define SC_STREAM_SERVER_MAX_CLIENTS 8
+// Per-client queue limit, in bytes
+#define SC_STREAM_SERVER_CLIENT_QUEUE_LIMIT (16 * 1024 * 1024)
+
+struct sc_stream_server_queue SC_VECDEQUE(AVPacket *);
+
+struct sc_stream_client {
+    struct sc_stream_server *server;
+    sc_socket socket;
+    sc_thread thread;
+
+    // All the fields below are protected by server->mutex
+
+    bool active; // the slot is in use (the thread must be joined)
+    bool ended; // the client thread has terminated
+    struct sc_stream_server_queue queue;
+    size_t queue_bytes;
+    // drop all packets until the next keyframe
+    bool dropping;
+    uint64_t dropped;
+};
+
+struct sc_stream_server {
+    struct sc_packet_sink packet_sink; // packet sink trait
+
+    uint16_t port;
+    enum sc_stream_format format;
+
+    sc_socket server_socket;
+    sc_thread thread; // accept the clients
+
+    sc_mutex mutex;
+    sc_cond cond; // signaled on new packets, on close and on stop
+
+    bool stopped;
+    bool eos; // the packet sink is closed
+
+    // set on packet sink open
+    bool codec_known;
+    uint8_t codec_header[SC_VIDEO_CODEC_HEADER_SIZE];
+    // For H.264 and H.265, the config packet is also prepended to the next
+    // media packet by the demuxer
+    bool config_merged;
+    AVPacket *config; // the latest config packet
+
+    // The packets since the latest keyframe, for late joiners (not cached if
+    // the GOP exceeds SC_STREAM_SERVER_CLIENT_QUEUE_LIMIT)
+    struct sc_stream_server_queue gop;
+    size_t gop_bytes;
+    bool gop_valid;
+
+    struct sc_stream_client clients[SC_STREAM_SERVER_MAX_CLIENTS];
+};
+
+struct sc_stream_server_params {
+    uint16_t port;
+    enum sc_stream_format format;
+};
+
+bool
+sc_stream_server_init(struct sc_stream_server *server,
+                      const struct sc_stream_server_params *params);
+
+bool
+sc_stream_server_start(struct sc_stream_server *server);
+
+void
+sc_stream_server_stop(struct sc_stream_server *server);
+
+void
+sc_stream_server_join(struct sc_stream_server *server);
+
+void
+sc_stream_server_destroy(struct sc_stream_server *server);
+
+#endif
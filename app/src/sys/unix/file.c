@@ -1,5 +1,7 @@
 #include "util/file.h"
 
+#include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -94,3 +96,69 @@ sc_file_is_regular(const char *path) {
     return S_ISREG(path_stat.st_mode);
 }
 
+int
+sc_file_open_write(const char *path) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        perror("open");
+    }
+    return fd;
+}
+
+bool
+sc_file_write_all(int fd, const void *buf, size_t len) {
+    const uint8_t *data = buf;
+    while (len) {
+        ssize_t w = write(fd, data, len);
+        if (w == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("write");
+            return false;
+        }
+        data += w;
+        len -= w;
+    }
+    return true;
+}
+
+int64_t
+sc_file_seek(int fd, int64_t offset, int whence) {
+    off_t r = lseek(fd, offset, whence);
+    if (r == -1) {
+        perror("lseek");
+    }
+    return r;
+}
+
+bool
+sc_file_sync(int fd) {
+#ifdef __APPLE__
+    // fdatasync() is not available on macOS
+    int r = fsync(fd);
+#else
+    int r = fdatasync(fd);
+#endif
+    if (r) {
+        perror("fdatasync");
+        return false;
+    }
+    return true;
+}
+
+void
+sc_file_close(int fd) {
+    if (close(fd)) {
+        perror("close");
+    }
+}
+
+bool
+sc_file_remove(const char *path) {
+    if (unlink(path)) {
+        perror("unlink");
+        return false;
+    }
+    return true;
+}
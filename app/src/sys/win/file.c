@@ -2,6 +2,9 @@
 
 #include <windows.h>
 
+#include <fcntl.h>
+#include <io.h>
+#include <stdio.h>
 #include <sys/stat.h>
 
 #include "util/log.h"
@@ -41,3 +44,81 @@ sc_file_is_regular(const char *path) {
     return S_ISREG(path_stat.st_mode);
 }
 
+int
+sc_file_open_write(const char *path) {
+    wchar_t *wide_path = sc_str_to_wchars(path);
+    if (!wide_path) {
+        LOG_OOM();
+        return -1;
+    }
+
+    int fd = _wopen(wide_path, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY
+                                         | _O_NOINHERIT,
+                    _S_IREAD | _S_IWRITE);
+    free(wide_path);
+
+    if (fd == -1) {
+        perror("open");
+    }
+    return fd;
+}
+
+bool
+sc_file_write_all(int fd, const void *buf, size_t len) {
+    const uint8_t *data = buf;
+    while (len) {
+        // _write() takes an unsigned int length
+        unsigned chunk = len > 0x40000000 ? 0x40000000 : (unsigned) len;
+        int w = _write(fd, data, chunk);
+        if (w == -1) {
+            perror("write");
+            return false;
+        }
+        data += w;
+        len -= w;
+    }
+    return true;
+}
+
+int64_t
+sc_file_seek(int fd, int64_t offset, int whence) {
+    int64_t r = _lseeki64(fd, offset, whence);
+    if (r == -1) {
+        perror("lseek");
+    }
+    return r;
+}
+
+bool
+sc_file_sync(int fd) {
+    if (_commit(fd)) {
+        perror("commit");
+        return false;
+    }
+    return true;
+}
+
+void
+sc_file_close(int fd) {
+    if (_close(fd)) {
+        perror("close");
+    }
+}
+
+bool
+sc_file_remove(const char *path) {
+    wchar_t *wide_path = sc_str_to_wchars(path);
+    if (!wide_path) {
+        LOG_OOM();
+        return false;
+    }
+
+    int r = _wunlink(wide_path);
+    free(wide_path);
+
+    if (r) {
+        perror("unlink");
+        return false;
+    }
+    return true;
+}
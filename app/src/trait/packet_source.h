@@ -7,7 +7,9 @@
 
 #include "trait/packet_sink.h"
 
-#define SC_PACKET_SOURCE_MAX_SINKS 2
+// decoder, up to 4 recorders (SC_MAX_RECORDS), replay, stream output, stream
+// server and V4L2 passthrough
+#define SC_PACKET_SOURCE_MAX_SINKS 9
 
 /**
  * Packet source trait
@@ -92,4 +92,20 @@ sc_float_to_i16fp(float f) {
     return (int16_t) i;
 }
 
+/**
+ * Convert an unsigned 16-bit fixed-point value to a float between 0 and 1
+ */
+static inline float
+sc_u16fp_to_float(uint16_t u) {
+    return u == 0xffff ? 1.0f : (u / 0x1p16f);
+}
+
+/**
+ * Convert a signed 16-bit fixed-point value to a float between -1 and 1
+ */
+static inline float
+sc_i16fp_to_float(int16_t i) {
+    return i == 0x7fff ? 1.0f : (i / 0x1p15f);
+}
+
 #endif
@@ -4,6 +4,8 @@
 #include "common.h"
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #ifdef _WIN32
 # define SC_PATH_SEPARATOR '\\'
@@ -46,4 +48,41 @@ sc_file_get_local_path(const char *name);
 bool
 sc_file_is_regular(const char *path);
 
+/**
+ * Open a file for writing (it is created or truncated)
+ *
+ * Return a file descriptor, or -1 on error.
+ */
+int
+sc_file_open_write(const char *path);
+
+/**
+ * Write all the bytes (retry on partial writes)
+ */
+bool
+sc_file_write_all(int fd, const void *buf, size_t len);
+
+/**
+ * Reposition the file offset (whence is SEEK_SET, SEEK_CUR or SEEK_END)
+ *
+ * Return the resulting offset, or -1 on error.
+ */
+int64_t
+sc_file_seek(int fd, int64_t offset, int whence);
+
+/**
+ * Flush the file data to the storage device
+ */
+bool
+sc_file_sync(int fd);
+
+void
+sc_file_close(int fd);
+
+/**
+ * Delete a file
+ */
+bool
+sc_file_remove(const char *path);
+
 #endif
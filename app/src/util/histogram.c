@@ -0,0 +1,81 @@
+#include "histogram.h"
+
+#include <assert.h>
+#include <string.h>
+
+// Number of sub-buckets per power of 2 (must be a power of 2)
+#define SC_HISTOGRAM_SUB_BITS 2
+#define SC_HISTOGRAM_SUB (1 << SC_HISTOGRAM_SUB_BITS)
+
+void
+sc_histogram_reset(struct sc_histogram *h) {
+    memset(h, 0, sizeof(*h));
+}
+
+static unsigned
+sc_histogram_get_bucket(uint64_t value) {
+    if (value < SC_HISTOGRAM_SUB) {
+        // One bucket per value
+        return value;
+    }
+
+    // Position of the most significant bit
+    unsigned msb = 63 - __builtin_clzll(value);
+    assert(msb >= SC_HISTOGRAM_SUB_BITS);
+
+    // The SC_HISTOGRAM_SUB_BITS bits following the most significant bit
+    unsigned sub = (value >> (msb - SC_HISTOGRAM_SUB_BITS))
+                 & (SC_HISTOGRAM_SUB - 1);
+    unsigned bucket = (msb - SC_HISTOGRAM_SUB_BITS + 1) * SC_HISTOGRAM_SUB
+                    + sub;
+    return bucket < SC_HISTOGRAM_BUCKETS ? bucket : SC_HISTOGRAM_BUCKETS - 1;
+}
+
+static uint64_t
+sc_histogram_get_bucket_max(unsigned bucket) {
+    if (bucket < SC_HISTOGRAM_SUB) {
+        return bucket;
+    }
+
+    unsigned shift = bucket / SC_HISTOGRAM_SUB - 1;
+    unsigned sub = bucket % SC_HISTOGRAM_SUB;
+    uint64_t min = (uint64_t) (SC_HISTOGRAM_SUB + sub) << shift;
+    return min + ((uint64_t) 1 << shift) - 1;
+}
+
+void
+sc_histogram_add(struct sc_histogram *h, sc_tick value) {
+    if (value < 0) {
+        // Should not happen with a monotonic clock, but be robust
+        value = 0;
+    }
+
+    ++h->buckets[sc_histogram_get_bucket(value)];
+    ++h->count;
+}
+
+sc_tick
+sc_histogram_percentile(const struct sc_histogram *h, unsigned percent) {
+    assert(percent <= 100);
+
+    if (!h->count) {
+        return 0;
+    }
+
+    // Rank of the requested value (in [1, count])
+    uint64_t rank = (h->count * percent + 99) / 100;
+    if (!rank) {
+        rank = 1;
+    }
+
+    uint64_t cumulated = 0;
+    for (unsigned i = 0; i < SC_HISTOGRAM_BUCKETS; ++i) {
+        cumulated += h->buckets[i];
+        if (cumulated >= rank) {
+            return sc_histogram_get_bucket_max(i);
+        }
+    }
+
+    assert(!"unreachable");
+    return 0;
+}
@@ -0,0 +1,39 @@
+#ifndef SC_HISTOGRAM_H
+#define SC_HISTOGRAM_H
+
+#include "common.h"
+
+#include <stdint.h>
+
+#include "util/tick.h"
+
+/**
+ * Histogram of durations, to estimate percentiles in constant memory
+ *
+ * The buckets grow exponentially (4 buckets per power of 2), so the relative
+ * error of a percentile is below 25%. Durations above 2^24 us (~16 seconds)
+ * are counted in the last bucket.
+ */
+
+#define SC_HISTOGRAM_BUCKETS 92
+
+struct sc_histogram {
+    uint64_t count;
+    uint32_t buckets[SC_HISTOGRAM_BUCKETS];
+};
+
+void
+sc_histogram_reset(struct sc_histogram *h);
+
+void
+sc_histogram_add(struct sc_histogram *h, sc_tick value);
+
+/**
+ * Return an upper bound of the given percentile (between 0 and 100)
+ *
+ * Return 0 if the histogram is empty.
+ */
+sc_tick
+sc_histogram_percentile(const struct sc_histogram *h, unsigned percent);
+
+#endif
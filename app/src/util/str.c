@@ -373,3 +373,106 @@ sc_str_to_hex_string(const uint8_t *data, size_t size) {
 
     return buffer;
 }
+
+#define SC_STR_INDEX_MAX_WIDTH 10
+
+// Parse an index conversion (after the '%'), for example "d" or "03d"
+//
+// Return the length of the conversion (excluding the '%'), or 0 if it is not
+// an index conversion.
+static size_t
+sc_str_parse_index_conversion(const char *s, unsigned *width, bool *zero) {
+    const char *p = s;
+
+    *zero = *p == '0';
+    if (*zero) {
+        ++p;
+    }
+
+    unsigned w = 0;
+    while (*p >= '0' && *p <= '9') {
+        w = w * 10 + (*p - '0');
+        if (w > SC_STR_INDEX_MAX_WIDTH) {
+            return 0;
+        }
+        ++p;
+    }
+
+    if (*p != 'd') {
+        return 0;
+    }
+
+    *width = w;
+    return p - s + 1;
+}
+
+bool
+sc_str_is_index_pattern(const char *pattern) {
+    unsigned count = 0;
+    for (const char *p = pattern; *p; ++p) {
+        if (*p != '%') {
+            continue;
+        }
+
+        ++p;
+        if (*p == '%') {
+            continue;
+        }
+
+        unsigned width;
+        bool zero;
+        size_t len = sc_str_parse_index_conversion(p, &width, &zero);
+        if (!len) {
+            return false;
+        }
+
+        ++count;
+        p += len - 1;
+    }
+
+    return count == 1;
+}
+
+char *
+sc_str_format_index(const char *pattern, unsigned index) {
+    assert(sc_str_is_index_pattern(pattern));
+
+    struct sc_strbuf buf;
+    if (!sc_strbuf_init(&buf, strlen(pattern) + 16)) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    for (const char *p = pattern; *p; ++p) {
+        bool ok;
+        if (*p != '%') {
+            ok = sc_strbuf_append_char(&buf, *p);
+        } else if (p[1] == '%') {
+            ok = sc_strbuf_append_char(&buf, '%');
+            ++p;
+        } else {
+            unsigned width;
+            bool zero;
+            size_t len = sc_str_parse_index_conversion(p + 1, &width, &zero);
+            assert(len);
+
+            // enough for SC_STR_INDEX_MAX_WIDTH or any unsigned value
+            char num[32];
+            int r = snprintf(num, sizeof(num), zero ? "%0*u" : "%*u",
+                             (int) width, index);
+            assert(r > 0 && (size_t) r < sizeof(num));
+            (void) r;
+
+            ok = sc_strbuf_append_str(&buf, num);
+            p += len;
+        }
+
+        if (!ok) {
+            LOG_OOM();
+            free(buf.s);
+            return NULL;
+        }
+    }
+
+    return buf.s;
+}
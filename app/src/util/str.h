@@ -155,4 +155,23 @@ sc_str_remove_trailing_cr(char *s, size_t len);
 char *
 sc_str_to_hex_string(const uint8_t *data, size_t len);
 
+/**
+ * Indicate if the pattern contains exactly one index conversion
+ *
+ * The conversion is "%d", optionally with a width, possibly zero-padded (for
+ * example "%3d" or "%03d"). Any other '%' must be escaped as "%%".
+ */
+bool
+sc_str_is_index_pattern(const char *pattern);
+
+/**
+ * Replace the index conversion of the pattern by the index
+ *
+ * The pattern must be valid (see sc_str_is_index_pattern()).
+ *
+ * The result must be freed by the caller.
+ */
+char *
+sc_str_format_index(const char *pattern, unsigned index);
+
 #endif
@@ -377,4 +377,35 @@ sc_vecdeque_growsize_(size_t value)
 #define sc_vecdeque_pop(pv) \
     (*sc_vecdeque_popref(pv))
 
+/**
+ * Return a pointer to the item at the given index (0 is the next item to be
+ * popped), without removing it
+ *
+ * The item may be modified in place.
+ *
+ * It is an error to call this function with an index out of bounds.
+ */
+#define sc_vecdeque_getref(pv, index) \
+({ \
+    assert((size_t) (index) < (pv)->size); \
+    &(pv)->data[((pv)->origin + (index)) % (pv)->cap]; \
+})
+
+/**
+ * Return the item at the given index (0 is the next item to be popped),
+ * without removing it
+ *
+ * It is an error to call this function with an index out of bounds.
+ */
+#define sc_vecdeque_get(pv, index) \
+    (*sc_vecdeque_getref(pv, index))
+
+/**
+ * Return the next item to be popped, without removing it
+ *
+ * It is an error to call this function if the VecDeque is empty.
+ */
+#define sc_vecdeque_peek(pv) \
+    sc_vecdeque_get(pv, 0)
+
 #endif
@@ -2,15 +2,24 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/videodev2.h>
+#include <libavutil/imgutils.h>
 
 #include "util/log.h"
 #include "util/str.h"
 
 /** Downcast frame_sink to sc_v4l2_sink */
 #define DOWNCAST(SINK) container_of(SINK, struct sc_v4l2_sink, frame_sink)
+/** Downcast packet_sink to sc_v4l2_sink */
+#define DOWNCAST_PACKET(SINK) \
+    container_of(SINK, struct sc_v4l2_sink, packet_sink)
 
 static const AVRational SCRCPY_TIME_BASE = {1, 1000000}; // timestamps in us
 
@@ -31,86 +40,186 @@ find_muxer(const char *name) {
     return oformat;
 }
 
-static bool
-write_header(struct sc_v4l2_sink *vs, const AVPacket *packet) {
+static void
+rescale_packet(struct sc_v4l2_sink *vs, AVPacket *packet) {
     AVStream *ostream = vs->format_ctx->streams[0];
+    av_packet_rescale_ts(packet, SCRCPY_TIME_BASE, ostream->time_base);
+}
 
-    uint8_t *extradata = av_malloc(packet->size * sizeof(uint8_t));
-    if (!extradata) {
-        LOG_OOM();
+// Negotiate the format of the images written to the device, and allocate the
+// staging buffer accordingly. On error, the previous format is kept.
+static bool
+sc_v4l2_sink_set_format(struct sc_v4l2_sink *vs, unsigned width,
+                        unsigned height) {
+    if (width % 2) {
+        // The chroma planes of V4L2 YUV420 images are exactly half as wide
+        LOGE("V4L2 sink requires an even width (%u)", width);
         return false;
     }
 
-    // copy the first packet to the extra data
-    memcpy(extradata, packet->data, packet->size);
-
-    ostream->codecpar->extradata = extradata;
-    ostream->codecpar->extradata_size = packet->size;
-
-    int ret = avformat_write_header(vs->format_ctx, NULL);
-    if (ret < 0) {
-        LOGE("Failed to write header to %s", vs->device_name);
+    struct v4l2_format fmt;
+    memset(&fmt, 0, sizeof(fmt));
+    fmt.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    if (ioctl(vs->fd, VIDIOC_G_FMT, &fmt) == -1) {
+        LOGE("Could not get the format of %s: %s", vs->device_name,
+             strerror(errno));
         return false;
     }
 
-    return true;
-}
+    fmt.fmt.pix.width = width;
+    fmt.fmt.pix.height = height;
+    fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_YUV420;
+    fmt.fmt.pix.field = V4L2_FIELD_NONE;
+    fmt.fmt.pix.bytesperline = width;
+    fmt.fmt.pix.sizeimage = width * height * 3 / 2;
+    fmt.fmt.pix.colorspace = V4L2_COLORSPACE_SRGB;
+    if (ioctl(vs->fd, VIDIOC_S_FMT, &fmt) == -1) {
+        LOGE("Could not set the format of %s: %s", vs->device_name,
+             strerror(errno));
+        return false;
+    }
 
-static void
-rescale_packet(struct sc_v4l2_sink *vs, AVPacket *packet) {
-    AVStream *ostream = vs->format_ctx->streams[0];
-    av_packet_rescale_ts(packet, SCRCPY_TIME_BASE, ostream->time_base);
-}
+    // The driver may adjust the requested format
+    if (fmt.fmt.pix.pixelformat != V4L2_PIX_FMT_YUV420
+            || fmt.fmt.pix.width != width || fmt.fmt.pix.height != height) {
+        LOGE("V4L2 device %s does not accept %ux%u YUV420 images",
+             vs->device_name, width, height);
+        return false;
+    }
 
-static bool
-write_packet(struct sc_v4l2_sink *vs, AVPacket *packet) {
-    if (!vs->header_written) {
-        bool ok = write_header(vs, packet);
-        if (!ok) {
-            return false;
-        }
-        vs->header_written = true;
-        return true;
+    unsigned bytesperline = fmt.fmt.pix.bytesperline;
+    if (bytesperline < width || bytesperline % 2) {
+        bytesperline = width;
     }
 
-    rescale_packet(vs, packet);
+    // The image written must have the size expected by the driver
+    size_t required_size = (size_t) bytesperline * height
+                         + 2 * (size_t) (bytesperline / 2) * ((height + 1) / 2);
+    if (fmt.fmt.pix.sizeimage < required_size) {
+        LOGE("Unexpected V4L2 image size for %ux%u: %" PRIu32, width, height,
+             fmt.fmt.pix.sizeimage);
+        return false;
+    }
 
-    bool ok = av_write_frame(vs->format_ctx, packet) >= 0;
+    // Zero-initialized, in case the driver expects some padding at the end
+    uint8_t *image = calloc(1, fmt.fmt.pix.sizeimage);
+    if (!image) {
+        LOG_OOM();
+        return false;
+    }
 
-    // Failing to write the last frame is not very serious, no future frame may
-    // depend on it, so the resulting file will still be valid
-    (void) ok;
+    free(vs->image);
+    vs->image = image;
+    vs->width = width;
+    vs->height = height;
+    vs->bytesperline = bytesperline;
+    vs->image_size = fmt.fmt.pix.sizeimage;
 
     return true;
 }
 
 static bool
-encode_and_write_frame(struct sc_v4l2_sink *vs, const AVFrame *frame) {
-    int ret = avcodec_send_frame(vs->encoder_ctx, frame);
-    if (ret < 0 && ret != AVERROR(EAGAIN)) {
-        LOGE("Could not send v4l2 video frame: %d", ret);
+sc_v4l2_sink_open_device(struct sc_v4l2_sink *vs, const AVCodecContext *ctx) {
+    vs->fd = open(vs->device_name, O_RDWR | O_CLOEXEC);
+    if (vs->fd == -1) {
+        LOGE("Failed to open output device: %s (%s)", vs->device_name,
+             strerror(errno));
         return false;
     }
 
-    AVPacket *packet = vs->packet;
-    ret = avcodec_receive_packet(vs->encoder_ctx, packet);
-    if (ret == 0) {
-        // A packet was received
+    vs->image = NULL;
+    vs->rejected_width = 0;
+    vs->rejected_height = 0;
 
-        bool ok = write_packet(vs, packet);
-        av_packet_unref(packet);
-        if (!ok) {
-            LOGW("Could not send packet to v4l2 sink");
-            return false;
-        }
-    } else if (ret != AVERROR(EAGAIN)) {
-        LOGE("Could not receive v4l2 video packet: %d", ret);
+    if (!sc_v4l2_sink_set_format(vs, ctx->width, ctx->height)) {
+        close(vs->fd);
         return false;
     }
 
     return true;
 }
 
+static void
+sc_v4l2_sink_close_device(struct sc_v4l2_sink *vs) {
+    free(vs->image);
+    close(vs->fd);
+}
+
+// Return true if the frame planes are laid out exactly like the V4L2 image,
+// so that it can be written without any copy
+static bool
+sc_v4l2_sink_is_image_layout(struct sc_v4l2_sink *vs, const AVFrame *frame) {
+    int luma_stride = vs->bytesperline;
+    int chroma_stride = vs->bytesperline / 2;
+    size_t luma_size = (size_t) luma_stride * vs->height;
+    size_t chroma_size = (size_t) chroma_stride * ((vs->height + 1) / 2);
+
+    return vs->image_size == luma_size + 2 * chroma_size
+        && frame->linesize[0] == luma_stride
+        && frame->linesize[1] == chroma_stride
+        && frame->linesize[2] == chroma_stride
+        && frame->data[1] == frame->data[0] + luma_size
+        && frame->data[2] == frame->data[1] + chroma_size;
+}
+
+static void
+write_frame(struct sc_v4l2_sink *vs, const AVFrame *frame) {
+    unsigned width = frame->width;
+    unsigned height = frame->height;
+    if (width != vs->width || height != vs->height) {
+        // The frame size changed (for example on device rotation)
+        if (width == vs->rejected_width && height == vs->rejected_height) {
+            // Already refused by the device
+            return;
+        }
+
+        if (!sc_v4l2_sink_set_format(vs, width, height)) {
+            LOGW("Dropping the %ux%u frames (not accepted by the v4l2 sink)",
+                 width, height);
+            vs->rejected_width = width;
+            vs->rejected_height = height;
+            return;
+        }
+
+        LOGI("v4l2 sink format changed to %ux%u", width, height);
+    }
+
+    const uint8_t *image;
+    if (sc_v4l2_sink_is_image_layout(vs, frame)) {
+        image = frame->data[0];
+    } else {
+        // Copy the planes once (row by row only if the strides differ)
+        int luma_stride = vs->bytesperline;
+        int chroma_stride = vs->bytesperline / 2;
+        int chroma_width = vs->width / 2;
+        int chroma_height = (vs->height + 1) / 2;
+
+        uint8_t *y = vs->image;
+        uint8_t *u = y + (size_t) luma_stride * vs->height;
+        uint8_t *v = u + (size_t) chroma_stride * chroma_height;
+
+        av_image_copy_plane(y, luma_stride, frame->data[0],
+                            frame->linesize[0], vs->width, vs->height);
+        av_image_copy_plane(u, chroma_stride, frame->data[1],
+                            frame->linesize[1], chroma_width, chroma_height);
+        av_image_copy_plane(v, chroma_stride, frame->data[2],
+                            frame->linesize[2], chroma_width, chroma_height);
+        image = vs->image;
+    }
+
+    // Each write() is a whole image for the device, it must not be split
+    ssize_t w;
+    do {
+        w = write(vs->fd, image, vs->image_size);
+    } while (w == -1 && errno == EINTR);
+
+    if (w != (ssize_t) vs->image_size) {
+        // Failing to write a frame is not very serious, the next one does not
+        // depend on it
+        LOGW("Could not write frame to v4l2 sink");
+    }
+}
+
 static int
 run_v4l2_sink(void *data) {
     struct sc_v4l2_sink *vs = data;
@@ -132,12 +241,8 @@ run_v4l2_sink(void *data) {
 
         sc_frame_buffer_consume(&vs->fb, vs->frame);
 
-        bool ok = encode_and_write_frame(vs, vs->frame);
+        write_frame(vs, vs->frame);
         av_frame_unref(vs->frame);
-        if (!ok) {
-            LOGE("Could not send frame to v4l2 sink");
-            break;
-        }
     }
 
     LOGD("V4l2 thread ended");
@@ -145,26 +250,10 @@ run_v4l2_sink(void *data) {
     return 0;
 }
 
+// Open the v4l2 muxer for a stream of the given codec
 static bool
-sc_v4l2_sink_open(struct sc_v4l2_sink *vs, const AVCodecContext *ctx) {
-    assert(ctx->pix_fmt == AV_PIX_FMT_YUV420P);
-    (void) ctx;
-
-    bool ok = sc_frame_buffer_init(&vs->fb);
-    if (!ok) {
-        return false;
-    }
-
-    ok = sc_mutex_init(&vs->mutex);
-    if (!ok) {
-        goto error_frame_buffer_destroy;
-    }
-
-    ok = sc_cond_init(&vs->cond);
-    if (!ok) {
-        goto error_mutex_destroy;
-    }
-
+sc_v4l2_sink_open_output(struct sc_v4l2_sink *vs, const AVCodecContext *ctx,
+                         enum AVCodecID codec_id) {
     const AVOutputFormat *format = find_muxer("v4l2");
     if (!format) {
         // Alternative name
@@ -172,12 +261,6 @@ sc_v4l2_sink_open(struct sc_v4l2_sink *vs, const AVCodecContext *ctx) {
     }
     if (!format) {
         LOGE("Could not find v4l2 muxer");
-        goto error_cond_destroy;
-    }
-
-    const AVCodec *encoder = avcodec_find_encoder(AV_CODEC_ID_RAWVIDEO);
-    if (!encoder) {
-        LOGE("Raw video encoder not found");
         return false;
     }
 
@@ -203,7 +286,7 @@ sc_v4l2_sink_open(struct sc_v4l2_sink *vs, const AVCodecContext *ctx) {
             sizeof(vs->format_ctx->filename));
 #endif
 
-    AVStream *ostream = avformat_new_stream(vs->format_ctx, encoder);
+    AVStream *ostream = avformat_new_stream(vs->format_ctx, NULL);
     if (!ostream) {
         LOG_OOM();
         goto error_avformat_free_context;
@@ -214,8 +297,8 @@ sc_v4l2_sink_open(struct sc_v4l2_sink *vs, const AVCodecContext *ctx) {
         goto error_avformat_free_context;
     }
 
-    // The codec is from the v4l2 encoder, not from the decoder
-    ostream->codecpar->codec_id = encoder->id;
+    // The codec is the one written to the device, not the decoder one
+    ostream->codecpar->codec_id = codec_id;
 
     int ret = avio_open(&vs->format_ctx->pb, vs->device_name, AVIO_FLAG_WRITE);
     if (ret < 0) {
@@ -224,60 +307,67 @@ sc_v4l2_sink_open(struct sc_v4l2_sink *vs, const AVCodecContext *ctx) {
         goto error_avformat_free_context;
     }
 
-    vs->encoder_ctx = avcodec_alloc_context3(encoder);
-    if (!vs->encoder_ctx) {
-        LOG_OOM();
-        goto error_avio_close;
+    return true;
+
+error_avformat_free_context:
+    avformat_free_context(vs->format_ctx);
+
+    return false;
+}
+
+static void
+sc_v4l2_sink_close_output(struct sc_v4l2_sink *vs) {
+    avio_close(vs->format_ctx->pb);
+    avformat_free_context(vs->format_ctx);
+}
+
+static bool
+sc_v4l2_sink_open(struct sc_v4l2_sink *vs, const AVCodecContext *ctx) {
+    assert(ctx->pix_fmt == AV_PIX_FMT_YUV420P);
+
+    bool ok = sc_frame_buffer_init(&vs->fb);
+    if (!ok) {
+        return false;
     }
 
-    vs->encoder_ctx->width = ctx->width;
-    vs->encoder_ctx->height = ctx->height;
-    vs->encoder_ctx->pix_fmt = AV_PIX_FMT_YUV420P;
-    vs->encoder_ctx->time_base.num = 1;
-    vs->encoder_ctx->time_base.den = 1;
+    ok = sc_mutex_init(&vs->mutex);
+    if (!ok) {
+        goto error_frame_buffer_destroy;
+    }
 
-    if (avcodec_open2(vs->encoder_ctx, encoder, NULL) < 0) {
-        LOGE("Could not open codec for v4l2");
-        goto error_avcodec_free_context;
+    ok = sc_cond_init(&vs->cond);
+    if (!ok) {
+        goto error_mutex_destroy;
     }
 
-    vs->frame = av_frame_alloc();
-    if (!vs->frame) {
-        LOG_OOM();
-        goto error_avcodec_free_context;
+    if (!sc_v4l2_sink_open_device(vs, ctx)) {
+        goto error_cond_destroy;
     }
 
-    vs->packet = av_packet_alloc();
-    if (!vs->packet) {
+    vs->frame = av_frame_alloc();
+    if (!vs->frame) {
         LOG_OOM();
-        goto error_av_frame_free;
+        goto error_close_device;
     }
 
     vs->has_frame = false;
-    vs->header_written = false;
     vs->stopped = false;
 
     LOGD("Starting v4l2 thread");
     ok = sc_thread_create(&vs->thread, run_v4l2_sink, "scrcpy-v4l2", vs);
     if (!ok) {
         LOGE("Could not start v4l2 thread");
-        goto error_av_packet_free;
+        goto error_av_frame_free;
     }
 
     LOGI("v4l2 sink started to device: %s", vs->device_name);
 
     return true;
 
-error_av_packet_free:
-    av_packet_free(&vs->packet);
 error_av_frame_free:
     av_frame_free(&vs->frame);
-error_avcodec_free_context:
-    avcodec_free_context(&vs->encoder_ctx);
-error_avio_close:
-    avio_close(vs->format_ctx->pb);
-error_avformat_free_context:
-    avformat_free_context(vs->format_ctx);
+error_close_device:
+    sc_v4l2_sink_close_device(vs);
 error_cond_destroy:
     sc_cond_destroy(&vs->cond);
 error_mutex_destroy:
@@ -297,11 +387,8 @@ sc_v4l2_sink_close(struct sc_v4l2_sink *vs) {
 
     sc_thread_join(&vs->thread, NULL);
 
-    av_packet_free(&vs->packet);
     av_frame_free(&vs->frame);
-    avcodec_free_context(&vs->encoder_ctx);
-    avio_close(vs->format_ctx->pb);
-    avformat_free_context(vs->format_ctx);
+    sc_v4l2_sink_close_device(vs);
     sc_cond_destroy(&vs->cond);
     sc_mutex_destroy(&vs->mutex);
     sc_frame_buffer_destroy(&vs->fb);
@@ -328,6 +415,8 @@ sc_v4l2_sink_push(struct sc_v4l2_sink *vs, const AVFrame *frame) {
 static bool
 sc_v4l2_frame_sink_open(struct sc_frame_sink *sink, const AVCodecContext *ctx) {
     struct sc_v4l2_sink *vs = DOWNCAST(sink);
+    // Only the packet sink trait is used in passthrough mode
+    assert(!vs->passthrough);
     return sc_v4l2_sink_open(vs, ctx);
 }
 
@@ -343,14 +432,92 @@ sc_v4l2_frame_sink_push(struct sc_frame_sink *sink, const AVFrame *frame) {
     return sc_v4l2_sink_push(vs, frame);
 }
 
+static bool
+sc_v4l2_packet_sink_open(struct sc_packet_sink *sink, AVCodecContext *ctx) {
+    struct sc_v4l2_sink *vs = DOWNCAST_PACKET(sink);
+    // Only the frame sink trait is used in raw mode
+    assert(vs->passthrough);
+
+    if (ctx->codec_id != AV_CODEC_ID_H264) {
+        LOGE("V4L2 passthrough requires H.264");
+        return false;
+    }
+
+    if (!sc_v4l2_sink_open_output(vs, ctx, AV_CODEC_ID_H264)) {
+        return false;
+    }
+
+    vs->packet = av_packet_alloc();
+    if (!vs->packet) {
+        LOG_OOM();
+        goto error_close_output;
+    }
+
+    int ret = avformat_write_header(vs->format_ctx, NULL);
+    if (ret < 0) {
+        LOGE("Failed to write header to %s", vs->device_name);
+        goto error_av_packet_free;
+    }
+
+    LOGI("v4l2 passthrough sink started to device: %s", vs->device_name);
+
+    return true;
+
+error_av_packet_free:
+    av_packet_free(&vs->packet);
+error_close_output:
+    sc_v4l2_sink_close_output(vs);
+
+    return false;
+}
+
+static void
+sc_v4l2_packet_sink_close(struct sc_packet_sink *sink) {
+    struct sc_v4l2_sink *vs = DOWNCAST_PACKET(sink);
+
+    av_packet_free(&vs->packet);
+    sc_v4l2_sink_close_output(vs);
+}
+
+static bool
+sc_v4l2_packet_sink_push(struct sc_packet_sink *sink, const AVPacket *packet) {
+    struct sc_v4l2_sink *vs = DOWNCAST_PACKET(sink);
+
+    if (packet->pts == AV_NOPTS_VALUE) {
+        // The config packet (SPS/PPS) is also prepended to the next packet by
+        // the demuxer, so that each buffer written is decodable as is
+        return true;
+    }
+
+    // Reference the packet, the timestamps are rescaled in place
+    if (av_packet_ref(vs->packet, packet)) {
+        LOG_OOM();
+        return false;
+    }
+
+    rescale_packet(vs, vs->packet);
+
+    bool ok = av_write_frame(vs->format_ctx, vs->packet) >= 0;
+    av_packet_unref(vs->packet);
+    if (!ok) {
+        LOGW("Could not write packet to v4l2 sink");
+    }
+
+    // Failing to write a packet must not stop the other sinks
+    return true;
+}
+
 bool
-sc_v4l2_sink_init(struct sc_v4l2_sink *vs, const char *device_name) {
+sc_v4l2_sink_init(struct sc_v4l2_sink *vs, const char *device_name,
+                  bool passthrough) {
     vs->device_name = strdup(device_name);
     if (!vs->device_name) {
         LOGE("Could not strdup v4l2 device name");
         return false;
     }
 
+    vs->passthrough = passthrough;
+
     static const struct sc_frame_sink_ops ops = {
         .open = sc_v4l2_frame_sink_open,
         .close = sc_v4l2_frame_sink_close,
@@ -359,6 +526,14 @@ sc_v4l2_sink_init(struct sc_v4l2_sink *vs, const char *device_name) {
 
     vs->frame_sink.ops = &ops;
 
+    static const struct sc_packet_sink_ops packet_ops = {
+        .open = sc_v4l2_packet_sink_open,
+        .close = sc_v4l2_packet_sink_close,
+        .push = sc_v4l2_packet_sink_push,
+    };
+
+    vs->packet_sink.ops = &packet_ops;
+
     return true;
 }
 
@@ -4,35 +4,60 @@
 #include "common.h"
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
 
 #include "frame_buffer.h"
 #include "trait/frame_sink.h"
+#include "trait/packet_sink.h"
 #include "util/thread.h"
 
+/**
+ * V4L2 sink
+ *
+ * By default, the decoded frames are written as raw YUV420 images directly to
+ * the device (the format is negotiated with VIDIOC_S_FMT). In passthrough
+ * mode, the H.264 packets are written as is (without decoding) through the
+ * libavformat v4l2 muxer, from the demuxer thread.
+ */
 struct sc_v4l2_sink {
     struct sc_frame_sink frame_sink; // frame sink trait
+    struct sc_packet_sink packet_sink; // packet sink trait (passthrough)
 
     struct sc_frame_buffer fb;
+
+    // raw mode
+    int fd;
+    unsigned width;
+    unsigned height;
+    unsigned bytesperline; // of the luma plane (halved for chroma planes)
+    size_t image_size;
+    uint8_t *image; // staging buffer, if the frame planes are not contiguous
+    // last frame size not accepted by the device (its frames are dropped)
+    unsigned rejected_width;
+    unsigned rejected_height;
+
+    // passthrough mode
     AVFormatContext *format_ctx;
-    AVCodecContext *encoder_ctx;
 
     char *device_name;
+    bool passthrough;
 
     sc_thread thread;
     sc_mutex mutex;
     sc_cond cond;
     bool has_frame;
     bool stopped;
-    bool header_written;
 
     AVFrame *frame;
     AVPacket *packet;
 };
 
 bool
-sc_v4l2_sink_init(struct sc_v4l2_sink *vs, const char *device_name);
+sc_v4l2_sink_init(struct sc_v4l2_sink *vs, const char *device_name,
+                  bool passthrough);
 
 void
 sc_v4l2_sink_destroy(struct sc_v4l2_sink *vs);
@@ -0,0 +1,295 @@
+#include "common.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/samplefmt.h>
+
+#include "audio_regulator.h"
+#include "util/tick.h"
+
+/**
+ * Headless benchmark of the audio regulator
+ *
+ * The producer (the device) and the consumer (the audio output) are simulated
+ * with synthetic clocks, in virtual time, so that the regulator can be tested
+ * and tuned without a device.
+ *
+ * The producer captures blocks of 960 samples (20ms) with a configurable clock
+ * drift. Each block is received after a random network jitter, and during
+ * regular stalls (the stream is TCP, so a "burst loss" is a stall followed by
+ * a burst of late packets). The consumer pulls 240 samples (5ms) at a fixed
+ * rate.
+ */
+
+#define SAMPLE_RATE 48000
+#define CHANNELS 2
+#define SAMPLE_SIZE (CHANNELS * sizeof(float))
+#define FRAME_SAMPLES 960
+#define OUT_SAMPLES 240
+#define TARGET_BUFFERING SC_TICK_FROM_MS(50)
+
+#define DURATION SC_TICK_FROM_SEC(60)
+#define WINDOW SC_TICK_FROM_SEC(1)
+#define NB_WINDOWS (DURATION / WINDOW)
+// The steady state is measured on the last 10 seconds
+#define STEADY_WINDOWS 10
+// Tolerance to consider that the buffering has converged to the steady state
+#define CONVERGENCE_TOLERANCE SC_TICK_FROM_MS(5)
+
+struct scenario {
+    const char *name;
+    int drift_ppm; // positive if the device clock is faster
+    sc_tick max_jitter;
+    sc_tick stall_interval; // 0 for no stall
+    sc_tick stall_duration;
+};
+
+struct result {
+    sc_tick latency; // steady-state buffering latency
+    uint32_t glitches;
+    sc_tick convergence; // time to reach the steady state
+    sc_tick max_latency;
+};
+
+// Deterministic pseudo-random generator (xorshift32)
+static uint32_t
+next_rand(uint32_t *state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static AVCodecContext *
+create_codec_context(void) {
+    AVCodecContext *ctx = avcodec_alloc_context3(NULL);
+    assert(ctx);
+
+    ctx->sample_rate = SAMPLE_RATE;
+    ctx->sample_fmt = AV_SAMPLE_FMT_FLT;
+#ifdef SCRCPY_LAVU_HAS_CHLAYOUT
+    av_channel_layout_default(&ctx->ch_layout, CHANNELS);
+#else
+    ctx->channel_layout = AV_CH_LAYOUT_STEREO;
+    ctx->channels = CHANNELS;
+#endif
+
+    return ctx;
+}
+
+static AVFrame *
+create_frame(void) {
+    AVFrame *frame = av_frame_alloc();
+    assert(frame);
+
+    frame->format = AV_SAMPLE_FMT_FLT;
+    frame->nb_samples = FRAME_SAMPLES;
+    frame->sample_rate = SAMPLE_RATE;
+#ifdef SCRCPY_LAVU_HAS_CHLAYOUT
+    av_channel_layout_default(&frame->ch_layout, CHANNELS);
+#else
+    frame->channel_layout = AV_CH_LAYOUT_STEREO;
+    frame->channels = CHANNELS;
+#endif
+
+    int ret = av_frame_get_buffer(frame, 0);
+    assert(!ret);
+    (void) ret;
+
+    av_samples_set_silence(frame->data, 0, FRAME_SAMPLES, CHANNELS,
+                           AV_SAMPLE_FMT_FLT);
+
+    return frame;
+}
+
+static void
+run_scenario(const struct scenario *sc, struct result *result) {
+    struct sc_audio_regulator ar;
+
+    AVCodecContext *ctx = create_codec_context();
+    AVFrame *frame = create_frame();
+
+    uint32_t target_buffering = TARGET_BUFFERING * SAMPLE_RATE / SC_TICK_FREQ;
+    bool ok = sc_audio_regulator_init(&ar, SAMPLE_SIZE, ctx, target_buffering);
+    assert(ok);
+    (void) ok;
+
+    uint8_t out[OUT_SAMPLES * SAMPLE_SIZE];
+
+    // Duration of a captured block, in host time
+    double frame_period = (double) FRAME_SAMPLES * SC_TICK_FREQ / SAMPLE_RATE
+                        / (1 + sc->drift_ppm / 1e6);
+    sc_tick out_period = (sc_tick) OUT_SAMPLES * SC_TICK_FREQ / SAMPLE_RATE;
+
+    uint32_t rand_state = 42;
+
+    uint64_t frame_index = 0;
+    sc_tick last_arrival = 0;
+    sc_tick next_push = 0;
+    sc_tick next_pull = 0;
+
+    double window_sum[NB_WINDOWS] = {0};
+    unsigned window_count[NB_WINDOWS] = {0};
+    uint32_t max_buffered = 0;
+
+    while (next_push < DURATION || next_pull < DURATION) {
+        if (next_push <= next_pull) {
+            bool pushed = sc_audio_regulator_push(&ar, frame);
+            assert(pushed);
+            (void) pushed;
+
+            // Compute the arrival date of the next block
+            ++frame_index;
+            sc_tick capture = frame_index * frame_period;
+            sc_tick jitter = sc->max_jitter
+                           ? next_rand(&rand_state) % sc->max_jitter
+                           : 0;
+            sc_tick arrival = capture + jitter;
+            if (sc->stall_interval) {
+                sc_tick pos = capture % sc->stall_interval;
+                sc_tick stall_start = sc->stall_interval - sc->stall_duration;
+                if (pos >= stall_start) {
+                    // Blocked until the end of the stall
+                    arrival = capture - pos + sc->stall_interval;
+                }
+            }
+            // The stream is TCP, packets are received in order
+            if (arrival < last_arrival) {
+                arrival = last_arrival;
+            }
+            last_arrival = arrival;
+            next_push = arrival;
+        } else {
+            bool played = atomic_load_explicit(&ar.played,
+                                               memory_order_relaxed);
+            if (played) {
+                uint32_t buffered = sc_audiobuf_can_read(&ar.buf);
+                unsigned w = next_pull / WINDOW;
+                window_sum[w] += buffered;
+                ++window_count[w];
+                if (buffered > max_buffered) {
+                    max_buffered = buffered;
+                }
+            }
+
+            sc_audio_regulator_pull(&ar, out, OUT_SAMPLES);
+            next_pull += out_period;
+        }
+    }
+
+    sc_tick window_latency[NB_WINDOWS];
+    for (unsigned i = 0; i < NB_WINDOWS; ++i) {
+        double avg = window_count[i] ? window_sum[i] / window_count[i] : 0;
+        window_latency[i] = avg * SC_TICK_FREQ / SAMPLE_RATE;
+    }
+
+    sc_tick steady = 0;
+    for (unsigned i = NB_WINDOWS - STEADY_WINDOWS; i < NB_WINDOWS; ++i) {
+        steady += window_latency[i];
+    }
+    steady /= STEADY_WINDOWS;
+
+    // The convergence time is the end of the last window out of the tolerance
+    sc_tick convergence = 0;
+    for (unsigned i = 0; i < NB_WINDOWS; ++i) {
+        sc_tick diff = window_latency[i] - steady;
+        if (diff < -CONVERGENCE_TOLERANCE || diff > CONVERGENCE_TOLERANCE) {
+            convergence = (i + 1) * WINDOW;
+        }
+    }
+
+    result->latency = steady;
+    result->glitches = sc_audio_regulator_get_underflow_count(&ar);
+    result->convergence = convergence;
+    result->max_latency = (sc_tick) max_buffered * SC_TICK_FREQ / SAMPLE_RATE;
+
+    printf("%-12s latency=%" PRItick "ms max=%" PRItick "ms glitches=%" PRIu32
+           " convergence=%" PRItick "s\n", sc->name,
+           SC_TICK_TO_MS(result->latency), SC_TICK_TO_MS(result->max_latency),
+           result->glitches, SC_TICK_TO_SEC(result->convergence));
+
+    sc_audio_regulator_destroy(&ar);
+    av_frame_free(&frame);
+    avcodec_free_context(&ctx);
+}
+
+static void
+assert_stable(const struct result *result) {
+    // The buffering is measured before each pull, so it is a bit lower than
+    // the target on average
+    assert(result->latency > TARGET_BUFFERING - SC_TICK_FROM_MS(20));
+    assert(result->latency < TARGET_BUFFERING + SC_TICK_FROM_MS(10));
+    assert(!result->glitches);
+    assert(result->convergence <= DURATION / 2);
+}
+
+static void test_regulator_nominal(void) {
+    struct scenario sc = {
+        .name = "nominal",
+    };
+    struct result result;
+    run_scenario(&sc, &result);
+    assert_stable(&result);
+}
+
+static void test_regulator_drift(void) {
+    struct scenario sc = {
+        .name = "drift+500",
+        .drift_ppm = 500,
+    };
+    struct result result;
+    run_scenario(&sc, &result);
+    assert_stable(&result);
+
+    sc.name = "drift-500";
+    sc.drift_ppm = -500;
+    run_scenario(&sc, &result);
+    assert_stable(&result);
+}
+
+static void test_regulator_jitter(void) {
+    struct scenario sc = {
+        .name = "jitter",
+        .drift_ppm = 200,
+        .max_jitter = SC_TICK_FROM_MS(10),
+    };
+    struct result result;
+    run_scenario(&sc, &result);
+    assert_stable(&result);
+}
+
+static void test_regulator_burst_loss(void) {
+    struct scenario sc = {
+        .name = "burst-loss",
+        .drift_ppm = -200,
+        .max_jitter = SC_TICK_FROM_MS(5),
+        .stall_interval = SC_TICK_FROM_SEC(10),
+        .stall_duration = SC_TICK_FROM_MS(150),
+    };
+    struct result result;
+    run_scenario(&sc, &result);
+
+    // Stalls longer than the buffering necessarily cause glitches, but the
+    // latency must remain bounded
+    assert(result.glitches);
+    assert(result.max_latency < TARGET_BUFFERING * 11 / 10
+                              + SC_TICK_FROM_MS(60) + SC_TICK_FROM_MS(20));
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_regulator_nominal();
+    test_regulator_drift();
+    test_regulator_jitter();
+    test_regulator_burst_loss();
+
+    return 0;
+}
@@ -135,6 +135,24 @@ static void test_float_to_i16fp(void) {
     assert(sc_float_to_i16fp(-1.0f) == -0x8000);
 }
 
+static void test_u16fp_to_float(void) {
+    assert(sc_u16fp_to_float(0) == 0.0f);
+    assert(sc_u16fp_to_float(0x800) == 0.03125f);
+    assert(sc_u16fp_to_float(0x4000) == 0.25f);
+    assert(sc_u16fp_to_float(0x8000) == 0.5f);
+    assert(sc_u16fp_to_float(0xc000) == 0.75f);
+    assert(sc_u16fp_to_float(0xffff) == 1.0f);
+}
+
+static void test_i16fp_to_float(void) {
+    assert(sc_i16fp_to_float(0) == 0.0f);
+    assert(sc_i16fp_to_float(0x400) == 0.03125f);
+    assert(sc_i16fp_to_float(0x4000) == 0.5f);
+    assert(sc_i16fp_to_float(0x7fff) == 1.0f);
+    assert(sc_i16fp_to_float(-0x4000) == -0.5f);
+    assert(sc_i16fp_to_float(-0x8000) == -1.0f);
+}
+
 int main(int argc, char *argv[]) {
     (void) argc;
     (void) argv;
@@ -152,5 +170,7 @@ int main(int argc, char *argv[]) {
 
     test_float_to_u16fp();
     test_float_to_i16fp();
+    test_u16fp_to_float();
+    test_i16fp_to_float();
     return 0;
 }
@@ -82,8 +82,10 @@ static void test_options(void) {
     assert(opts->port_range.first == 1234);
     assert(opts->port_range.last == 1236);
     assert(!strcmp(opts->push_target, "/sdcard/Movies"));
-    assert(!strcmp(opts->record_filename, "file"));
+    assert(opts->record_count == 1);
+    assert(!strcmp(opts->records[0].filename, "file"));
     assert(opts->record_format == SC_RECORD_FORMAT_MKV);
+    assert(opts->records[0].format == SC_RECORD_FORMAT_MKV);
     assert(!strcmp(opts->serial, "0123456789abcdef"));
     assert(opts->show_touches);
     assert(opts->turn_screen_off);
@@ -108,6 +110,7 @@ static void test_options2(void) {
         "--no-control",
         "--no-playback",
         "--record", "file.mp4", // cannot enable --no-playback without recording
+        "--audio-output-buffer=auto",
     };
 
     bool ok = scrcpy_parse_args(&args, ARRAY_LEN(argv), argv);
@@ -117,8 +120,154 @@ static void test_options2(void) {
     assert(!opts->control);
     assert(!opts->video_playback);
     assert(!opts->audio_playback);
-    assert(!strcmp(opts->record_filename, "file.mp4"));
-    assert(opts->record_format == SC_RECORD_FORMAT_MP4);
+    assert(opts->record_count == 1);
+    assert(!strcmp(opts->records[0].filename, "file.mp4"));
+    assert(opts->records[0].format == SC_RECORD_FORMAT_MP4);
+    assert(opts->audio_output_buffer == SC_AUDIO_OUTPUT_BUFFER_AUTO);
+}
+
+static void test_options_several_records(void) {
+    struct scrcpy_cli_args args = {
+        .opts = scrcpy_options_default,
+        .help = false,
+        .version = false,
+    };
+
+    char *argv[] = {
+        "scrcpy",
+        "--record", "archive.mkv",
+        "--record=upload.mp4",
+        "-r", "audio.opus",
+    };
+
+    bool ok = scrcpy_parse_args(&args, ARRAY_LEN(argv), argv);
+    assert(ok);
+
+    const struct scrcpy_options *opts = &args.opts;
+    assert(opts->record_count == 3);
+    assert(!strcmp(opts->records[0].filename, "archive.mkv"));
+    assert(opts->records[0].format == SC_RECORD_FORMAT_MKV);
+    assert(!strcmp(opts->records[1].filename, "upload.mp4"));
+    assert(opts->records[1].format == SC_RECORD_FORMAT_MP4);
+    assert(!strcmp(opts->records[2].filename, "audio.opus"));
+    assert(opts->records[2].format == SC_RECORD_FORMAT_OPUS);
+}
+
+static void test_options_record_streams(void) {
+    struct scrcpy_cli_args args = {
+        .opts = scrcpy_options_default,
+        .help = false,
+        .version = false,
+    };
+
+    char *argv[] = {
+        "scrcpy",
+        "--record", "video.mp4",
+        "--record-no-audio",
+        "--record", "audio.mka",
+        "--record-no-video",
+        "--record", "both.mkv",
+    };
+
+    bool ok = scrcpy_parse_args(&args, ARRAY_LEN(argv), argv);
+    assert(ok);
+
+    const struct scrcpy_options *opts = &args.opts;
+    assert(opts->video);
+    assert(opts->audio);
+    assert(opts->record_count == 3);
+    assert(opts->records[0].video);
+    assert(!opts->records[0].audio);
+    assert(!opts->records[1].video);
+    assert(opts->records[1].audio);
+    assert(opts->records[2].video);
+    assert(opts->records[2].audio);
+
+    // Nothing left to record
+    struct scrcpy_cli_args args2 = {
+        .opts = scrcpy_options_default,
+        .help = false,
+        .version = false,
+    };
+
+    char *argv2[] = {
+        "scrcpy",
+        "--no-audio",
+        "--record", "file.mkv",
+        "--record-no-video",
+    };
+
+    ok = scrcpy_parse_args(&args2, ARRAY_LEN(argv2), argv2);
+    assert(!ok);
+}
+
+static void test_options_record_segments(void) {
+    struct scrcpy_cli_args args = {
+        .opts = scrcpy_options_default,
+        .help = false,
+        .version = false,
+    };
+
+    char *argv[] = {
+        "scrcpy",
+        "--record", "file-%03d.mkv",
+        "--record-queue-limit", "64M",
+        "--record-queue-overflow", "drop",
+        "--record-segment-duration", "600",
+    };
+
+    bool ok = scrcpy_parse_args(&args, ARRAY_LEN(argv), argv);
+    assert(ok);
+
+    const struct scrcpy_options *opts = &args.opts;
+    assert(opts->record_count == 1);
+    assert(!strcmp(opts->records[0].filename, "file-%03d.mkv"));
+    assert(opts->records[0].format == SC_RECORD_FORMAT_MKV);
+    assert(opts->record_queue_limit == 64000000);
+    assert(opts->record_queue_overflow == SC_RECORD_OVERFLOW_DROP);
+    assert(opts->record_segment_duration == SC_TICK_FROM_SEC(600));
+}
+
+static void test_options_record_segments_no_pattern(void) {
+    struct scrcpy_cli_args args = {
+        .opts = scrcpy_options_default,
+        .help = false,
+        .version = false,
+    };
+
+    char *argv[] = {
+        "scrcpy",
+        "--record", "file.mkv", // no segment index pattern
+        "--record-segment-duration", "600",
+    };
+
+    bool ok = scrcpy_parse_args(&args, ARRAY_LEN(argv), argv);
+    assert(!ok);
+}
+
+static void test_options_stream_server(void) {
+    struct scrcpy_cli_args args = {
+        .opts = scrcpy_options_default,
+        .help = false,
+        .version = false,
+    };
+
+    char *argv[] = {
+        "scrcpy",
+        "--no-playback", // the stream server is a video consumer
+        "--no-audio",
+        "--video-stream-server=27200",
+        "--video-stream-format=scrcpy",
+    };
+
+    bool ok = scrcpy_parse_args(&args, ARRAY_LEN(argv), argv);
+    assert(ok);
+
+    const struct scrcpy_options *opts = &args.opts;
+    assert(opts->video);
+    assert(!opts->video_playback);
+    assert(opts->video_stream_server_port == 27200);
+    assert(opts->video_stream_format == SC_STREAM_FORMAT_SCRCPY);
 }
 
 static void test_parse_shortcut_mods(void) {
@@ -157,6 +306,11 @@ int main(int argc, char *argv[]) {
     test_flag_help();
     test_options();
     test_options2();
+    test_options_several_records();
+    test_options_record_streams();
+    test_options_record_segments();
+    test_options_record_segments_no_pattern();
+    test_options_stream_server();
     test_parse_shortcut_mods();
     return 0;
 }
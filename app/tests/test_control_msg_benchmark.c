@@ -0,0 +1,281 @@
+#include "common.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "control_msg.h"
+#include "control_recorder.h"
+#include "util/binary.h"
+#include "util/tick.h"
+
+/**
+ * Benchmark of the control message serialization
+ *
+ * For several input traces, compare the full and the compact encodings: the
+ * number of bytes per message, and the serialization time (the parsing time on
+ * the server is measured by ControlMessageReaderBenchmarkTest).
+ *
+ * The synthetic traces simulate a finger swipe, a pinch-to-zoom (two pointers
+ * alternating) and mouse hovering. A real trace, recorded by
+ * --control-record, may also be provided by setting the environment variable
+ * SCRCPY_CONTROL_RECORD to its path.
+ */
+
+#define MAX_MSGS 100000
+// The traces are serialized several times, to measure small durations
+#define MIN_SERIALIZED_MSGS 2000000
+
+#define SCREEN_WIDTH 1080
+#define SCREEN_HEIGHT 2400
+
+struct trace {
+    const char *name;
+    struct sc_control_msg *msgs;
+    size_t count;
+};
+
+static void
+trace_init(struct trace *trace, const char *name) {
+    trace->name = name;
+    trace->msgs = malloc(MAX_MSGS * sizeof(*trace->msgs));
+    assert(trace->msgs);
+    trace->count = 0;
+}
+
+static void
+trace_destroy(struct trace *trace) {
+    for (size_t i = 0; i < trace->count; ++i) {
+        sc_control_msg_destroy(&trace->msgs[i]);
+    }
+    free(trace->msgs);
+}
+
+static void
+trace_push_touch(struct trace *trace, enum android_motionevent_action action,
+                 uint64_t pointer_id, int32_t x, int32_t y, float pressure,
+                 enum android_motionevent_buttons buttons) {
+    assert(trace->count < MAX_MSGS);
+    struct sc_control_msg *msg = &trace->msgs[trace->count++];
+    msg->type = SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT;
+    msg->inject_touch_event.action = action;
+    msg->inject_touch_event.pointer_id = pointer_id;
+    msg->inject_touch_event.position.point.x = x;
+    msg->inject_touch_event.position.point.y = y;
+    msg->inject_touch_event.position.screen_size.width = SCREEN_WIDTH;
+    msg->inject_touch_event.position.screen_size.height = SCREEN_HEIGHT;
+    msg->inject_touch_event.pressure = pressure;
+    msg->inject_touch_event.action_button = 0;
+    msg->inject_touch_event.buttons = buttons;
+    msg->inject_touch_event.event_time = 0;
+}
+
+static void
+trace_init_swipe(struct trace *trace) {
+    trace_init(trace, "swipe");
+
+    uint64_t id = SC_POINTER_ID_GENERIC_FINGER;
+    for (int swipe = 0; swipe < 100; ++swipe) {
+        // Vertical swipes, decelerating
+        int32_t x = 300 + swipe;
+        int32_t y = 2000;
+        trace_push_touch(trace, AMOTION_EVENT_ACTION_DOWN, id, x, y, 1.0f, 0);
+        for (int32_t step = 60; step > 0; step -= 2) {
+            x += step / 10;
+            y -= step;
+            trace_push_touch(trace, AMOTION_EVENT_ACTION_MOVE, id, x, y, 1.0f,
+                             0);
+        }
+        trace_push_touch(trace, AMOTION_EVENT_ACTION_UP, id, x, y, 0.0f, 0);
+    }
+}
+
+static void
+trace_init_pinch(struct trace *trace) {
+    trace_init(trace, "pinch");
+
+    uint64_t id0 = SC_POINTER_ID_GENERIC_FINGER;
+    uint64_t id1 = SC_POINTER_ID_VIRTUAL_FINGER;
+    int32_t cx = SCREEN_WIDTH / 2;
+    int32_t cy = SCREEN_HEIGHT / 2;
+    for (int pinch = 0; pinch < 100; ++pinch) {
+        // The virtual finger is symmetric to the real one
+        int32_t dx = 50;
+        int32_t dy = 80;
+        trace_push_touch(trace, AMOTION_EVENT_ACTION_DOWN, id0, cx + dx,
+                         cy + dy, 1.0f, 0);
+        trace_push_touch(trace, AMOTION_EVENT_ACTION_POINTER_DOWN, id1,
+                         cx - dx, cy - dy, 1.0f, 0);
+        for (int step = 0; step < 30; ++step) {
+            dx += 5;
+            dy += 8;
+            trace_push_touch(trace, AMOTION_EVENT_ACTION_MOVE, id0, cx + dx,
+                             cy + dy, 1.0f, 0);
+            trace_push_touch(trace, AMOTION_EVENT_ACTION_MOVE, id1, cx - dx,
+                             cy - dy, 1.0f, 0);
+        }
+        trace_push_touch(trace, AMOTION_EVENT_ACTION_POINTER_UP, id1, cx - dx,
+                         cy - dy, 0.0f, 0);
+        trace_push_touch(trace, AMOTION_EVENT_ACTION_UP, id0, cx + dx, cy + dy,
+                         0.0f, 0);
+    }
+}
+
+static void
+trace_init_hover(struct trace *trace) {
+    trace_init(trace, "hover");
+
+    uint64_t id = SC_POINTER_ID_MOUSE;
+    int32_t x = 100;
+    int32_t y = 100;
+    for (int i = 0; i < 3000; ++i) {
+        // Mouse motion: mostly small irregular moves
+        x += (i * 7) % 5 - 1;
+        y += (i * 3) % 7 - 2;
+        trace_push_touch(trace, AMOTION_EVENT_ACTION_HOVER_MOVE, id, x, y,
+                         0.0f, 0);
+    }
+}
+
+static bool
+trace_init_record(struct trace *trace, const char *filename) {
+    FILE *file = fopen(filename, "rb");
+    if (!file) {
+        fprintf(stderr, "Could not open %s\n", filename);
+        return false;
+    }
+
+    uint8_t header[SC_CONTROL_RECORD_HEADER_SIZE];
+    if (fread(header, sizeof(header), 1, file) != 1
+            || memcmp(header, SC_CONTROL_RECORD_MAGIC, 4)
+            || sc_read32be(&header[4]) != SC_CONTROL_RECORD_VERSION) {
+        fprintf(stderr, "Invalid control record file: %s\n", filename);
+        fclose(file);
+        return false;
+    }
+
+    trace_init(trace, "record");
+
+    uint8_t *buf = malloc(SC_CONTROL_MSG_MAX_SIZE);
+    assert(buf);
+
+    uint8_t msg_header[SC_CONTROL_RECORD_MSG_HEADER_SIZE];
+    while (trace->count < MAX_MSGS
+            && fread(msg_header, sizeof(msg_header), 1, file) == 1) {
+        uint32_t len = sc_read32be(&msg_header[8]);
+        if (!len || len > SC_CONTROL_MSG_MAX_SIZE
+                || fread(buf, len, 1, file) != 1) {
+            break;
+        }
+
+        if (buf[0] == SC_CONTROL_MSG_TYPE_UHID_CREATE) {
+            // Not supported by sc_control_msg_deserialize()
+            continue;
+        }
+
+        struct sc_control_msg *msg = &trace->msgs[trace->count];
+        if (sc_control_msg_deserialize(buf, len, msg) != (ssize_t) len) {
+            break;
+        }
+        ++trace->count;
+    }
+
+    free(buf);
+    fclose(file);
+    return true;
+}
+
+static double
+serialize_ns_per_msg(const struct trace *trace, bool compact,
+                     size_t *total_bytes) {
+    uint8_t *buf = malloc(SC_CONTROL_MSG_MAX_SIZE);
+    assert(buf);
+
+    size_t rounds = MIN_SERIALIZED_MSGS / trace->count + 1;
+    size_t bytes = 0;
+
+    sc_tick start = sc_tick_now();
+    for (size_t r = 0; r < rounds; ++r) {
+        struct sc_control_msg_encoder encoder;
+        sc_control_msg_encoder_init(&encoder);
+        for (size_t i = 0; i < trace->count; ++i) {
+            const struct sc_control_msg *msg = &trace->msgs[i];
+            size_t len = compact
+                       ? sc_control_msg_serialize_compact(&encoder, msg, buf)
+                       : sc_control_msg_serialize(msg, buf);
+            assert(len);
+            bytes += len;
+        }
+    }
+    sc_tick duration = sc_tick_now() - start;
+
+    free(buf);
+
+    *total_bytes = bytes / rounds;
+    return (double) SC_TICK_TO_US(duration) * 1000 / (rounds * trace->count);
+}
+
+static void
+run_trace(const struct trace *trace) {
+    assert(trace->count);
+
+    size_t full_bytes;
+    double full_ns = serialize_ns_per_msg(trace, false, &full_bytes);
+    size_t compact_bytes;
+    double compact_ns = serialize_ns_per_msg(trace, true, &compact_bytes);
+
+    printf("%-8s %6" SC_PRIsizet " msgs: full %5.1f bytes/msg %5.1f ns/msg, "
+           "compact %5.1f bytes/msg %5.1f ns/msg\n", trace->name, trace->count,
+           (double) full_bytes / trace->count, full_ns,
+           (double) compact_bytes / trace->count, compact_ns);
+
+    // The compact encoding must never be larger on these traces
+    assert(compact_bytes <= full_bytes);
+}
+
+static void
+test_benchmark_synthetic(void) {
+    struct trace trace;
+
+    trace_init_swipe(&trace);
+    run_trace(&trace);
+    trace_destroy(&trace);
+
+    trace_init_pinch(&trace);
+    run_trace(&trace);
+    trace_destroy(&trace);
+
+    trace_init_hover(&trace);
+    run_trace(&trace);
+    trace_destroy(&trace);
+}
+
+static void
+test_benchmark_record(void) {
+    const char *filename = getenv("SCRCPY_CONTROL_RECORD");
+    if (!filename) {
+        return;
+    }
+
+    struct trace trace;
+    bool ok = trace_init_record(&trace, filename);
+    assert(ok);
+    (void) ok;
+
+    if (trace.count) {
+        run_trace(&trace);
+    }
+    trace_destroy(&trace);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_benchmark_synthetic();
+    test_benchmark_record();
+
+    return 0;
+}
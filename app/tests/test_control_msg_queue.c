@@ -0,0 +1,153 @@
+#include "common.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "control_msg_queue.h"
+
+static void push_text(struct sc_control_msg_queue *queue, const char *text) {
+    struct sc_control_msg msg = {
+        .type = SC_CONTROL_MSG_TYPE_INJECT_TEXT,
+        .inject_text = {
+            .text = text,
+        },
+    };
+    bool ok = sc_control_msg_queue_push(queue, &msg);
+    assert(ok);
+    (void) ok;
+}
+
+static void take_and_release(struct sc_control_msg_queue *queue,
+                             const char *expected_text) {
+    const struct sc_control_msg *msg = sc_control_msg_queue_take(queue);
+    assert(msg->type == SC_CONTROL_MSG_TYPE_INJECT_TEXT);
+    assert(!strcmp(msg->inject_text.text, expected_text));
+    (void) msg;
+    (void) expected_text;
+    sc_control_msg_queue_release(queue);
+}
+
+static void test_push_take_release(void) {
+    struct sc_control_msg_queue queue;
+    bool ok = sc_control_msg_queue_init(&queue, 3, 0);
+    assert(ok);
+
+    assert(sc_control_msg_queue_is_empty(&queue));
+
+    struct sc_control_msg msg = {
+        .type = SC_CONTROL_MSG_TYPE_INJECT_KEYCODE,
+    };
+    for (int i = 0; i < 3; ++i) {
+        msg.inject_keycode.repeat = i;
+        ok = sc_control_msg_queue_push(&queue, &msg);
+        assert(ok);
+    }
+    assert(sc_control_msg_queue_is_full(&queue));
+    ok = sc_control_msg_queue_push(&queue, &msg);
+    assert(!ok);
+
+    const struct sc_control_msg *taken = sc_control_msg_queue_take(&queue);
+    assert(taken->inject_keycode.repeat == 0);
+    assert(sc_control_msg_queue_pending(&queue) == 2);
+    // Only the pending messages are accessible
+    assert(sc_control_msg_queue_get(&queue, 0)->inject_keycode.repeat == 1);
+
+    // A taken message still occupies its slot until it is released
+    assert(sc_control_msg_queue_is_full(&queue));
+    sc_control_msg_queue_release(&queue);
+    assert(!sc_control_msg_queue_is_full(&queue));
+
+    msg.inject_keycode.repeat = 3;
+    ok = sc_control_msg_queue_push(&queue, &msg);
+    assert(ok);
+
+    for (uint32_t i = 1; i <= 3; ++i) {
+        taken = sc_control_msg_queue_take(&queue);
+        assert(taken->inject_keycode.repeat == i);
+        sc_control_msg_queue_release(&queue);
+    }
+    assert(sc_control_msg_queue_is_empty(&queue));
+
+    sc_control_msg_queue_destroy(&queue);
+}
+
+static void test_text_payloads(void) {
+    struct sc_control_msg_queue queue;
+    bool ok = sc_control_msg_queue_init(&queue, 8, 96);
+    assert(ok);
+
+    // The payloads are copied
+    char text[] = "abc";
+    push_text(&queue, text);
+    text[0] = 'x';
+
+    char medium[61];
+    memset(medium, 'm', 60);
+    medium[60] = '\0';
+
+    // The arena (96 bytes) fits only one medium text at a time
+    push_text(&queue, medium);
+    push_text(&queue, medium); // allocated out of the arena
+    assert(queue.arena_used == 61);
+
+    take_and_release(&queue, "abc");
+    take_and_release(&queue, medium);
+    assert(!queue.arena_used);
+    take_and_release(&queue, medium);
+
+    // Wrap around the arena: the third text does not fit at the end
+    char small[33]; // too large to be inline
+    memset(small, 's', 32);
+    small[32] = '\0';
+    push_text(&queue, small);
+    push_text(&queue, small);
+    take_and_release(&queue, small);
+    push_text(&queue, small);
+    assert(queue.arena_used == 33 + 30 + 33); // including the skipped end
+
+    // The arena is full
+    push_text(&queue, small);
+    assert(queue.arena_used == 33 + 30 + 33);
+
+    take_and_release(&queue, small);
+    take_and_release(&queue, small);
+    take_and_release(&queue, small);
+    assert(!queue.arena_used);
+
+    sc_control_msg_queue_destroy(&queue);
+}
+
+static void test_text_truncated(void) {
+    struct sc_control_msg_queue queue;
+    bool ok = sc_control_msg_queue_init(&queue, 1, 0);
+    assert(ok);
+
+    size_t len = SC_CONTROL_MSG_INJECT_TEXT_MAX_LENGTH + 10;
+    char *text = malloc(len + 1);
+    assert(text);
+    memset(text, 'a', len);
+    text[len] = '\0';
+
+    push_text(&queue, text);
+    free(text);
+
+    const struct sc_control_msg *msg = sc_control_msg_queue_take(&queue);
+    assert(strlen(msg->inject_text.text)
+                == SC_CONTROL_MSG_INJECT_TEXT_MAX_LENGTH);
+    (void) msg;
+
+    // Not released: destroy must free the payload
+    sc_control_msg_queue_destroy(&queue);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_push_take_release();
+    test_text_payloads();
+    test_text_truncated();
+
+    return 0;
+}
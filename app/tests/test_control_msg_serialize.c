@@ -5,6 +5,7 @@
 #include <string.h>
 
 #include "control_msg.h"
+#include "hid/hid_mouse.h"
 
 static void test_serialize_inject_keycode(void) {
     struct sc_control_msg msg = {
@@ -93,12 +94,13 @@ static void test_serialize_inject_touch_event(void) {
             .pressure = 1.0f,
             .action_button = AMOTION_EVENT_BUTTON_PRIMARY,
             .buttons = AMOTION_EVENT_BUTTON_PRIMARY,
+            .event_time = SC_TICK_FROM_MS(0x01020304),
         },
     };
 
     uint8_t buf[SC_CONTROL_MSG_MAX_SIZE];
     size_t size = sc_control_msg_serialize(&msg, buf);
-    assert(size == 32);
+    assert(size == 36);
 
     const uint8_t expected[] = {
         SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT,
@@ -109,10 +111,158 @@ static void test_serialize_inject_touch_event(void) {
         0xff, 0xff, // pressure
         0x00, 0x00, 0x00, 0x01, // AMOTION_EVENT_BUTTON_PRIMARY (action button)
         0x00, 0x00, 0x00, 0x01, // AMOTION_EVENT_BUTTON_PRIMARY (buttons)
+        0x01, 0x02, 0x03, 0x04, // event time
     };
     assert(!memcmp(buf, expected, sizeof(expected)));
 }
 
+static void test_serialize_inject_touch_event_compact(void) {
+    struct sc_control_msg msg = {
+        .type = SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT,
+        .inject_touch_event = {
+            .action = AMOTION_EVENT_ACTION_DOWN,
+            .pointer_id = UINT64_C(0x1234567887654321),
+            .position = {
+                .point = {
+                    .x = 100,
+                    .y = 200,
+                },
+                .screen_size = {
+                    .width = 1080,
+                    .height = 1920,
+                },
+            },
+            .pressure = 1.0f,
+            .action_button = AMOTION_EVENT_BUTTON_PRIMARY,
+            .buttons = AMOTION_EVENT_BUTTON_PRIMARY,
+        },
+    };
+
+    struct sc_control_msg_encoder encoder;
+    sc_control_msg_encoder_init(&encoder);
+
+    uint8_t buf[SC_CONTROL_MSG_MAX_SIZE];
+    size_t size = sc_control_msg_serialize_compact(&encoder, &msg, buf);
+    assert(size == 33);
+
+    const uint8_t expected[] = {
+        SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT_COMPACT,
+        0x37, // pointer id, screen size, absolute, pressure, buttons
+        0x00, // AKEY_EVENT_ACTION_DOWN
+        0x12, 0x34, 0x56, 0x78, 0x87, 0x65, 0x43, 0x21, // pointer id
+        0x04, 0x38, 0x07, 0x80, // 1080 1920
+        0x00, 0x00, 0x00, 0x64, 0x00, 0x00, 0x00, 0xc8, // 100 200
+        0xff, 0xff, // pressure
+        0x00, 0x00, 0x00, 0x01, // AMOTION_EVENT_BUTTON_PRIMARY (action button)
+        0x00, 0x00, 0x00, 0x01, // AMOTION_EVENT_BUTTON_PRIMARY (buttons)
+    };
+    assert(!memcmp(buf, expected, sizeof(expected)));
+
+    // Small move
+    msg.inject_touch_event.action = AMOTION_EVENT_ACTION_MOVE;
+    msg.inject_touch_event.action_button = 0;
+    msg.inject_touch_event.position.point.x = 97;
+    msg.inject_touch_event.position.point.y = 205;
+    size = sc_control_msg_serialize_compact(&encoder, &msg, buf);
+    assert(size == 13);
+
+    const uint8_t expected2[] = {
+        SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT_COMPACT,
+        0x28, // delta8, buttons
+        0x02, // AMOTION_EVENT_ACTION_MOVE
+        0xfd, 0x05, // -3 +5
+        0x00, 0x00, 0x00, 0x00, // no action button
+        0x00, 0x00, 0x00, 0x01, // AMOTION_EVENT_BUTTON_PRIMARY (buttons)
+    };
+    assert(!memcmp(buf, expected2, sizeof(expected2)));
+
+    // Same move again
+    msg.inject_touch_event.position.point.x = 94;
+    msg.inject_touch_event.position.point.y = 210;
+    size = sc_control_msg_serialize_compact(&encoder, &msg, buf);
+    assert(size == 5);
+
+    const uint8_t expected3[] = {
+        SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT_COMPACT,
+        0x08, // delta8
+        0x02, // AMOTION_EVENT_ACTION_MOVE
+        0xfd, 0x05, // -3 +5
+    };
+    assert(!memcmp(buf, expected3, sizeof(expected3)));
+
+    // Larger move, with a new pressure
+    msg.inject_touch_event.position.point.x = 394;
+    msg.inject_touch_event.position.point.y = 60;
+    msg.inject_touch_event.pressure = 0.5f;
+    size = sc_control_msg_serialize_compact(&encoder, &msg, buf);
+    assert(size == 9);
+
+    const uint8_t expected4[] = {
+        SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT_COMPACT,
+        0x10, // pressure
+        0x02, // AMOTION_EVENT_ACTION_MOVE
+        0x01, 0x2c, 0xff, 0x6a, // +300 -150
+        0x80, 0x00, // pressure
+    };
+    assert(!memcmp(buf, expected4, sizeof(expected4)));
+
+    // Another pointer, far away
+    msg.inject_touch_event.pointer_id = SC_POINTER_ID_MOUSE;
+    msg.inject_touch_event.position.point.x = 100000;
+    size = sc_control_msg_serialize_compact(&encoder, &msg, buf);
+    assert(size == 19);
+
+    const uint8_t expected5[] = {
+        SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT_COMPACT,
+        0x05, // pointer id, absolute
+        0x02, // AMOTION_EVENT_ACTION_MOVE
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, // pointer id
+        0x00, 0x01, 0x86, 0xa0, 0x00, 0x00, 0x00, 0x3c, // 100000 60
+    };
+    assert(!memcmp(buf, expected5, sizeof(expected5)));
+
+    // Back to the first pointer, relative to its own last position
+    msg.inject_touch_event.pointer_id = UINT64_C(0x1234567887654321);
+    msg.inject_touch_event.position.point.x = 395;
+    msg.inject_touch_event.position.point.y = 59;
+    size = sc_control_msg_serialize_compact(&encoder, &msg, buf);
+    assert(size == 5);
+
+    const uint8_t expected6[] = {
+        SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT_COMPACT,
+        0x48, // other pointer, delta8
+        0x02, // AMOTION_EVENT_ACTION_MOVE
+        0x01, 0xff, // +1 -1
+    };
+    assert(!memcmp(buf, expected6, sizeof(expected6)));
+
+    // With the capture time of the event
+    msg.inject_touch_event.position.point.x = 396;
+    msg.inject_touch_event.event_time = SC_TICK_FROM_MS(0x01020304);
+    size = sc_control_msg_serialize_compact(&encoder, &msg, buf);
+    assert(size == 9);
+
+    const uint8_t expected7[] = {
+        SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT_COMPACT,
+        0x88, // event time, delta8
+        0x02, // AMOTION_EVENT_ACTION_MOVE
+        0x01, 0x00, // +1 +0
+        0x01, 0x02, 0x03, 0x04, // event time
+    };
+    assert(!memcmp(buf, expected7, sizeof(expected7)));
+
+    // The other messages are not affected
+    struct sc_control_msg back = {
+        .type = SC_CONTROL_MSG_TYPE_BACK_OR_SCREEN_ON,
+        .back_or_screen_on = {
+            .action = AKEY_EVENT_ACTION_UP,
+        },
+    };
+    size = sc_control_msg_serialize_compact(&encoder, &back, buf);
+    assert(size == 2);
+    assert(buf[0] == SC_CONTROL_MSG_TYPE_BACK_OR_SCREEN_ON);
+}
+
 static void test_serialize_inject_scroll_event(void) {
     struct sc_control_msg msg = {
         .type = SC_CONTROL_MSG_TYPE_INJECT_SCROLL_EVENT,
@@ -135,15 +285,16 @@ static void test_serialize_inject_scroll_event(void) {
 
     uint8_t buf[SC_CONTROL_MSG_MAX_SIZE];
     size_t size = sc_control_msg_serialize(&msg, buf);
-    assert(size == 21);
+    assert(size == 25);
 
     const uint8_t expected[] = {
         SC_CONTROL_MSG_TYPE_INJECT_SCROLL_EVENT,
         0x00, 0x00, 0x01, 0x04, 0x00, 0x00, 0x04, 0x02, // 260 1026
         0x04, 0x38, 0x07, 0x80, // 1080 1920
-        0x7F, 0xFF, // 1 (float encoded as i16)
-        0x80, 0x00, // -1 (float encoded as i16)
+        0x08, 0x00, // 1 (float / 16 encoded as i16)
+        0xF8, 0x00, // -1 (float / 16 encoded as i16)
         0x00, 0x00, 0x00, 0x01, // 1
+        0x00, 0x00, 0x00, 0x00, // unknown event time
     };
     assert(!memcmp(buf, expected, sizeof(expected)));
 }
@@ -426,6 +577,267 @@ static void test_serialize_reset_video(void) {
     assert(!memcmp(buf, expected, sizeof(expected)));
 }
 
+static void test_serialize_chunk(void) {
+    const uint8_t data[] = {1, 2, 3, 4, 5};
+
+    uint8_t buf[SC_CONTROL_MSG_CHUNK_HEADER_SIZE + sizeof(data)];
+    size_t size = sc_control_msg_serialize_chunk(data, sizeof(data), true, buf);
+    assert(size == 9);
+
+    const uint8_t expected[] = {
+        SC_CONTROL_MSG_TYPE_CHUNK,
+        SC_CONTROL_MSG_CHUNK_FLAG_LAST,
+        0, 5, // length
+        1, 2, 3, 4, 5,
+    };
+    assert(!memcmp(buf, expected, sizeof(expected)));
+
+    size = sc_control_msg_serialize_chunk(data, 2, false, buf);
+    assert(size == 6);
+
+    const uint8_t expected2[] = {
+        SC_CONTROL_MSG_TYPE_CHUNK,
+        0, // flags
+        0, 2, // length
+        1, 2,
+    };
+    assert(!memcmp(buf, expected2, sizeof(expected2)));
+}
+
+static void test_merge_touch_move(void) {
+    struct sc_control_msg prev = {
+        .type = SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT,
+        .inject_touch_event = {
+            .action = AMOTION_EVENT_ACTION_MOVE,
+            .pointer_id = 0x1234567887654321L,
+            .position = {
+                .point = {
+                    .x = 100,
+                    .y = 200,
+                },
+                .screen_size = {
+                    .width = 1080,
+                    .height = 1920,
+                },
+            },
+            .pressure = 1.0f,
+            .action_button = 0,
+            .buttons = 0,
+        },
+    };
+
+    struct sc_control_msg msg = prev;
+    msg.inject_touch_event.position.point.x = 110;
+    msg.inject_touch_event.position.point.y = 220;
+    msg.inject_touch_event.pressure = 0.5f;
+
+    bool ok = sc_control_msg_merge(&prev, &msg);
+    assert(ok);
+    assert(prev.inject_touch_event.action == AMOTION_EVENT_ACTION_MOVE);
+    assert(prev.inject_touch_event.position.point.x == 110);
+    assert(prev.inject_touch_event.position.point.y == 220);
+    assert(prev.inject_touch_event.pressure == 0.5f);
+
+    // Another pointer
+    msg.inject_touch_event.pointer_id = 42;
+    ok = sc_control_msg_merge(&prev, &msg);
+    assert(!ok);
+
+    // Never merge an up event
+    msg.inject_touch_event.pointer_id = prev.inject_touch_event.pointer_id;
+    msg.inject_touch_event.action = AMOTION_EVENT_ACTION_UP;
+    ok = sc_control_msg_merge(&prev, &msg);
+    assert(!ok);
+    assert(prev.inject_touch_event.action == AMOTION_EVENT_ACTION_MOVE);
+}
+
+static void test_merge_scroll(void) {
+    struct sc_control_msg prev = {
+        .type = SC_CONTROL_MSG_TYPE_INJECT_SCROLL_EVENT,
+        .inject_scroll_event = {
+            .position = {
+                .point = {
+                    .x = 260,
+                    .y = 1026,
+                },
+                .screen_size = {
+                    .width = 1080,
+                    .height = 1920,
+                },
+            },
+            .hscroll = 0,
+            .vscroll = -1,
+            .buttons = 0,
+            .event_time = SC_TICK_FROM_MS(1000),
+        },
+    };
+
+    struct sc_control_msg msg = prev;
+    msg.inject_scroll_event.hscroll = 0.5f;
+    msg.inject_scroll_event.vscroll = -0.5f;
+    msg.inject_scroll_event.event_time = SC_TICK_FROM_MS(1010);
+
+    bool ok = sc_control_msg_merge(&prev, &msg);
+    assert(ok);
+    assert(prev.inject_scroll_event.hscroll == 0.5f);
+    assert(prev.inject_scroll_event.vscroll == -1.5f);
+    assert(prev.inject_scroll_event.event_time == SC_TICK_FROM_MS(1010));
+
+    // Change of direction
+    msg.inject_scroll_event.vscroll = 1;
+    ok = sc_control_msg_merge(&prev, &msg);
+    assert(!ok);
+    assert(prev.inject_scroll_event.vscroll == -1.5f);
+
+    // Another position
+    msg.inject_scroll_event.vscroll = -1;
+    msg.inject_scroll_event.position.point.y = 1027;
+    ok = sc_control_msg_merge(&prev, &msg);
+    assert(!ok);
+
+    // The sum would exceed the maximum
+    msg.inject_scroll_event.position.point.y = 1026;
+    msg.inject_scroll_event.vscroll = -SC_CONTROL_MSG_SCROLL_MAX;
+    ok = sc_control_msg_merge(&prev, &msg);
+    assert(!ok);
+    assert(prev.inject_scroll_event.vscroll == -1.5f);
+}
+
+static void test_merge_uhid_mouse_input(void) {
+    struct sc_control_msg prev = {
+        .type = SC_CONTROL_MSG_TYPE_UHID_INPUT,
+        .uhid_input = {
+            .id = SC_HID_ID_MOUSE,
+            .size = SC_HID_MOUSE_INPUT_SIZE,
+            .data = {1, 10, (uint8_t) -20, 0},
+        },
+    };
+
+    struct sc_control_msg msg = prev;
+    msg.uhid_input.data[1] = 100;
+    msg.uhid_input.data[2] = (uint8_t) -30;
+    msg.uhid_input.data[3] = 1;
+
+    bool ok = sc_control_msg_merge(&prev, &msg);
+    assert(ok);
+    const uint8_t expected[] = {1, 110, (uint8_t) -50, 1};
+    assert(!memcmp(prev.uhid_input.data, expected, sizeof(expected)));
+
+    // The sum would overflow
+    ok = sc_control_msg_merge(&prev, &msg);
+    assert(!ok);
+    assert(!memcmp(prev.uhid_input.data, expected, sizeof(expected)));
+
+    // Different buttons
+    msg.uhid_input.data[0] = 0;
+    msg.uhid_input.data[1] = 1;
+    ok = sc_control_msg_merge(&prev, &msg);
+    assert(!ok);
+
+    // Not a mouse
+    struct sc_control_msg keyboard = {
+        .type = SC_CONTROL_MSG_TYPE_UHID_INPUT,
+        .uhid_input = {
+            .id = 1,
+            .size = SC_HID_MOUSE_INPUT_SIZE,
+            .data = {1, 1, 0, 0},
+        },
+    };
+    struct sc_control_msg keyboard2 = keyboard;
+    ok = sc_control_msg_merge(&keyboard, &keyboard2);
+    assert(!ok);
+}
+
+static void test_deserialize(void) {
+    struct sc_control_msg msgs[] = {
+        {
+            .type = SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT,
+            .inject_touch_event = {
+                .action = AMOTION_EVENT_ACTION_MOVE,
+                .pointer_id = UINT64_C(0x1234567887654321),
+                .position = {
+                    .point = {.x = 100, .y = 200},
+                    .screen_size = {.width = 1080, .height = 1920},
+                },
+                .pressure = 1.0f,
+                .action_button = 0,
+                .buttons = AMOTION_EVENT_BUTTON_PRIMARY,
+                .event_time = SC_TICK_FROM_MS(123456),
+            },
+        },
+        {
+            .type = SC_CONTROL_MSG_TYPE_INJECT_SCROLL_EVENT,
+            .inject_scroll_event = {
+                .position = {
+                    .point = {.x = 260, .y = 1026},
+                    .screen_size = {.width = 1080, .height = 1920},
+                },
+                .hscroll = -1.0f,
+                .vscroll = 0.5f,
+                .buttons = 0,
+            },
+        },
+        {
+            .type = SC_CONTROL_MSG_TYPE_SET_CLIPBOARD,
+            .set_clipboard = {
+                .sequence = UINT64_C(0x0102030405060708),
+                .text = "hello, world!",
+                .paste = true,
+            },
+        },
+    };
+
+    uint8_t buf[3 * SC_CONTROL_MSG_MAX_SIZE];
+    size_t total = 0;
+    for (size_t i = 0; i < ARRAY_LEN(msgs); ++i) {
+        total += sc_control_msg_serialize(&msgs[i], &buf[total]);
+    }
+
+    // An incomplete message is not an error
+    struct sc_control_msg msg;
+    ssize_t r = sc_control_msg_deserialize(buf, 35, &msg);
+    assert(r == 0);
+
+    size_t offset = 0;
+    r = sc_control_msg_deserialize(&buf[offset], total - offset, &msg);
+    assert(r == 36);
+    offset += r;
+    assert(msg.type == SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT);
+    assert(msg.inject_touch_event.action == AMOTION_EVENT_ACTION_MOVE);
+    assert(msg.inject_touch_event.pointer_id
+                == UINT64_C(0x1234567887654321));
+    assert(msg.inject_touch_event.position.point.x == 100);
+    assert(msg.inject_touch_event.position.point.y == 200);
+    assert(msg.inject_touch_event.position.screen_size.width == 1080);
+    assert(msg.inject_touch_event.position.screen_size.height == 1920);
+    assert(msg.inject_touch_event.pressure == 1.0f);
+    assert(msg.inject_touch_event.buttons == AMOTION_EVENT_BUTTON_PRIMARY);
+    assert(msg.inject_touch_event.event_time == SC_TICK_FROM_MS(123456));
+    sc_control_msg_destroy(&msg);
+
+    r = sc_control_msg_deserialize(&buf[offset], total - offset, &msg);
+    assert(r == 25);
+    offset += r;
+    assert(msg.type == SC_CONTROL_MSG_TYPE_INJECT_SCROLL_EVENT);
+    assert(msg.inject_scroll_event.position.point.x == 260);
+    assert(msg.inject_scroll_event.position.point.y == 1026);
+    assert(msg.inject_scroll_event.hscroll == -1.0f);
+    assert(msg.inject_scroll_event.vscroll == 0.5f);
+    assert(!msg.inject_scroll_event.event_time);
+    sc_control_msg_destroy(&msg);
+
+    r = sc_control_msg_deserialize(&buf[offset], total - offset, &msg);
+    assert(r == 27);
+    offset += r;
+    assert(msg.type == SC_CONTROL_MSG_TYPE_SET_CLIPBOARD);
+    assert(msg.set_clipboard.sequence == UINT64_C(0x0102030405060708));
+    assert(msg.set_clipboard.paste);
+    assert(!strcmp(msg.set_clipboard.text, "hello, world!"));
+    sc_control_msg_destroy(&msg);
+
+    assert(offset == total);
+}
+
 int main(int argc, char *argv[]) {
     (void) argc;
     (void) argv;
@@ -434,6 +846,7 @@ int main(int argc, char *argv[]) {
     test_serialize_inject_text();
     test_serialize_inject_text_long();
     test_serialize_inject_touch_event();
+    test_serialize_inject_touch_event_compact();
     test_serialize_inject_scroll_event();
     test_serialize_back_or_screen_on();
     test_serialize_expand_notification_panel();
@@ -449,5 +862,10 @@ int main(int argc, char *argv[]) {
     test_serialize_uhid_destroy();
     test_serialize_open_hard_keyboard();
     test_serialize_reset_video();
+    test_serialize_chunk();
+    test_merge_touch_move();
+    test_merge_scroll();
+    test_merge_uhid_mouse_input();
+    test_deserialize();
     return 0;
 }
@@ -19,10 +19,10 @@ static void test_deserialize_clipboard(void) {
     assert(r == 8);
 
     assert(msg.type == DEVICE_MSG_TYPE_CLIPBOARD);
-    assert(msg.clipboard.text);
-    assert(!strcmp("ABC", msg.clipboard.text));
-
-    sc_device_msg_destroy(&msg);
+    assert(msg.clipboard.len == 3);
+    assert(!memcmp("ABC", msg.clipboard.text, 3));
+    // The text is not copied
+    assert(msg.clipboard.text == (const char *) &input[5]);
 }
 
 static void test_deserialize_clipboard_big(void) {
@@ -40,11 +40,19 @@ static void test_deserialize_clipboard_big(void) {
     assert(r == DEVICE_MSG_MAX_SIZE);
 
     assert(msg.type == DEVICE_MSG_TYPE_CLIPBOARD);
-    assert(msg.clipboard.text);
-    assert(strlen(msg.clipboard.text) == DEVICE_MSG_TEXT_MAX_LENGTH);
+    assert(msg.clipboard.len == DEVICE_MSG_TEXT_MAX_LENGTH);
     assert(msg.clipboard.text[0] == 'a');
+}
+
+static void test_deserialize_clipboard_too_big(void) {
+    const uint8_t input[] = {
+        DEVICE_MSG_TYPE_CLIPBOARD,
+        0x00, 0x04, 0x00, 0x00, // text length (256k)
+    };
 
-    sc_device_msg_destroy(&msg);
+    // The message could never be received
+    ssize_t r = sc_device_msg_get_size(input, sizeof(input));
+    assert(r == -1);
 }
 
 static void test_deserialize_ack_set_clipboard(void) {
@@ -79,8 +87,40 @@ static void test_deserialize_uhid_output(void) {
 
     uint8_t expected[] = {1, 2, 3, 4, 5};
     assert(!memcmp(msg.uhid_output.data, expected, sizeof(expected)));
+}
+
+static void test_deserialize_uhid_output_partial(void) {
+    const uint8_t input[] = {
+        DEVICE_MSG_TYPE_UHID_OUTPUT,
+        0, 42, // id
+        0, 5, // size
+        0x01, 0x02, 0x03, 0x04, 0x05, // data
+        DEVICE_MSG_TYPE_UHID_OUTPUT,
+        0, 42, // id
+        0, 1, // size
+        0x06, // data
+    };
+
+    // Only the header
+    ssize_t r = sc_device_msg_get_size(input, 4);
+    assert(r == 0);
+    r = sc_device_msg_get_size(input, 5);
+    assert(r == 10);
+
+    struct sc_device_msg msg;
+    // Incomplete data
+    r = sc_device_msg_deserialize(input, 9, &msg);
+    assert(r == 0);
+
+    // Followed by another message
+    r = sc_device_msg_deserialize(input, sizeof(input), &msg);
+    assert(r == 10);
+    assert(msg.uhid_output.size == 5);
 
-    sc_device_msg_destroy(&msg);
+    r = sc_device_msg_deserialize(&input[10], sizeof(input) - 10, &msg);
+    assert(r == 6);
+    assert(msg.uhid_output.size == 1);
+    assert(msg.uhid_output.data[0] == 0x06);
 }
 
 int main(int argc, char *argv[]) {
@@ -89,7 +129,9 @@ int main(int argc, char *argv[]) {
 
     test_deserialize_clipboard();
     test_deserialize_clipboard_big();
+    test_deserialize_clipboard_too_big();
     test_deserialize_ack_set_clipboard();
     test_deserialize_uhid_output();
+    test_deserialize_uhid_output_partial();
     return 0;
 }
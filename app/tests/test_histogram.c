@@ -0,0 +1,74 @@
+#include "common.h"
+
+#include <assert.h>
+
+#include "util/histogram.h"
+
+static void test_histogram_empty(void) {
+    struct sc_histogram h;
+    sc_histogram_reset(&h);
+
+    assert(h.count == 0);
+    assert(sc_histogram_percentile(&h, 50) == 0);
+    assert(sc_histogram_percentile(&h, 99) == 0);
+}
+
+static void test_histogram_small_values(void) {
+    struct sc_histogram h;
+    sc_histogram_reset(&h);
+
+    // Values below 4 are exact
+    sc_histogram_add(&h, 0);
+    sc_histogram_add(&h, 1);
+    sc_histogram_add(&h, 2);
+    sc_histogram_add(&h, 3);
+
+    assert(h.count == 4);
+    assert(sc_histogram_percentile(&h, 0) == 0);
+    assert(sc_histogram_percentile(&h, 25) == 0);
+    assert(sc_histogram_percentile(&h, 50) == 1);
+    assert(sc_histogram_percentile(&h, 75) == 2);
+    assert(sc_histogram_percentile(&h, 100) == 3);
+}
+
+static void test_histogram_percentiles(void) {
+    struct sc_histogram h;
+    sc_histogram_reset(&h);
+
+    for (sc_tick i = 1; i <= 1000; ++i) {
+        sc_histogram_add(&h, i);
+    }
+
+    sc_tick p50 = sc_histogram_percentile(&h, 50);
+    assert(p50 >= 500 && p50 < 500 * 5 / 4);
+
+    sc_tick p99 = sc_histogram_percentile(&h, 99);
+    assert(p99 >= 990 && p99 < 990 * 5 / 4);
+
+    sc_tick p100 = sc_histogram_percentile(&h, 100);
+    assert(p100 >= 1000 && p100 < 1000 * 5 / 4);
+}
+
+static void test_histogram_bounds(void) {
+    struct sc_histogram h;
+    sc_histogram_reset(&h);
+
+    // Out of range values must not overflow the buckets
+    sc_histogram_add(&h, -1);
+    sc_histogram_add(&h, SC_TICK_FROM_SEC(3600));
+
+    assert(h.count == 2);
+    assert(sc_histogram_percentile(&h, 50) == 0);
+    assert(sc_histogram_percentile(&h, 100) >= SC_TICK_FROM_SEC(16));
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_histogram_empty();
+    test_histogram_small_values();
+    test_histogram_percentiles();
+    test_histogram_bounds();
+    return 0;
+}
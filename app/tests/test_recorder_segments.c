@@ -0,0 +1,116 @@
+#include "common.h"
+
+#include <assert.h>
+
+#include "recorder_segments.h"
+
+static void test_no_rotation(void) {
+    struct sc_recorder_segments segs;
+    sc_recorder_segments_init(&segs);
+
+    int64_t pts;
+    bool close_previous;
+    enum sc_recorder_segment segment =
+        sc_recorder_segments_route_audio(&segs, 1000, &pts, &close_previous);
+    assert(segment == SC_RECORDER_SEGMENT_CURRENT);
+    assert(pts == 1000);
+    assert(!close_previous);
+
+    assert(sc_recorder_segments_video_pts(&segs, 2000) == 2000);
+}
+
+static void test_late_audio(void) {
+    struct sc_recorder_segments segs;
+    sc_recorder_segments_init(&segs);
+
+    // The keyframe at 10000 starts a new segment
+    sc_recorder_segments_rotate(&segs, 10000, true);
+    assert(sc_recorder_segments_video_pts(&segs, 10000) == 0);
+    assert(sc_recorder_segments_video_pts(&segs, 10500) == 500);
+
+    // Audio packets older than the keyframe, received after it
+    int64_t pts;
+    bool close_previous;
+    enum sc_recorder_segment segment =
+        sc_recorder_segments_route_audio(&segs, 9800, &pts, &close_previous);
+    assert(segment == SC_RECORDER_SEGMENT_PREVIOUS);
+    assert(pts == 9800);
+    assert(!close_previous);
+
+    segment =
+        sc_recorder_segments_route_audio(&segs, 9900, &pts, &close_previous);
+    assert(segment == SC_RECORDER_SEGMENT_PREVIOUS);
+    assert(pts == 9900);
+    assert(!close_previous);
+
+    // The first audio packet of the new segment closes the previous one
+    segment =
+        sc_recorder_segments_route_audio(&segs, 10000, &pts, &close_previous);
+    assert(segment == SC_RECORDER_SEGMENT_CURRENT);
+    assert(pts == 0);
+    assert(close_previous);
+
+    segment =
+        sc_recorder_segments_route_audio(&segs, 10100, &pts, &close_previous);
+    assert(segment == SC_RECORDER_SEGMENT_CURRENT);
+    assert(pts == 100);
+    assert(!close_previous);
+}
+
+static void test_successive_rotations(void) {
+    struct sc_recorder_segments segs;
+    sc_recorder_segments_init(&segs);
+
+    int64_t pts;
+    bool close_previous;
+
+    sc_recorder_segments_rotate(&segs, 10000, true);
+    enum sc_recorder_segment segment =
+        sc_recorder_segments_route_audio(&segs, 10200, &pts, &close_previous);
+    assert(segment == SC_RECORDER_SEGMENT_CURRENT);
+    assert(pts == 200);
+    assert(close_previous);
+
+    sc_recorder_segments_rotate(&segs, 20000, true);
+
+    // Relative to the start of the previous segment, not of the recording
+    segment =
+        sc_recorder_segments_route_audio(&segs, 19950, &pts, &close_previous);
+    assert(segment == SC_RECORDER_SEGMENT_PREVIOUS);
+    assert(pts == 9950);
+    assert(!close_previous);
+
+    segment =
+        sc_recorder_segments_route_audio(&segs, 20050, &pts, &close_previous);
+    assert(segment == SC_RECORDER_SEGMENT_CURRENT);
+    assert(pts == 50);
+    assert(close_previous);
+}
+
+static void test_previous_not_kept(void) {
+    struct sc_recorder_segments segs;
+    sc_recorder_segments_init(&segs);
+
+    sc_recorder_segments_rotate(&segs, 10000, false);
+
+    // Without a previous segment, a late packet is written at the start of
+    // the current segment
+    int64_t pts;
+    bool close_previous;
+    enum sc_recorder_segment segment =
+        sc_recorder_segments_route_audio(&segs, 9900, &pts, &close_previous);
+    assert(segment == SC_RECORDER_SEGMENT_CURRENT);
+    assert(pts == 0);
+    assert(!close_previous);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_no_rotation();
+    test_late_audio();
+    test_successive_rotations();
+    test_previous_not_kept();
+    return 0;
+}
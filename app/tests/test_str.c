@@ -386,6 +386,41 @@ static void test_remove_trailing_cr(void) {
     assert(!strcmp(s3, "adb\rdef"));
 }
 
+static void test_index_pattern(void) {
+    assert(sc_str_is_index_pattern("file-%d.mkv"));
+    assert(sc_str_is_index_pattern("file-%03d.mkv"));
+    assert(sc_str_is_index_pattern("%3d"));
+    assert(sc_str_is_index_pattern("100%%-%d.mp4"));
+
+    assert(!sc_str_is_index_pattern("file.mkv"));
+    assert(!sc_str_is_index_pattern("file-%d-%d.mkv"));
+    assert(!sc_str_is_index_pattern("file-%s.mkv"));
+    assert(!sc_str_is_index_pattern("file-%%d.mkv"));
+    assert(!sc_str_is_index_pattern("file-%-3d.mkv"));
+    assert(!sc_str_is_index_pattern("file-%99d.mkv"));
+    assert(!sc_str_is_index_pattern("file-%"));
+
+    char *s = sc_str_format_index("file-%d.mkv", 42);
+    assert(s);
+    assert(!strcmp(s, "file-42.mkv"));
+    free(s);
+
+    s = sc_str_format_index("file-%03d.mkv", 7);
+    assert(s);
+    assert(!strcmp(s, "file-007.mkv"));
+    free(s);
+
+    s = sc_str_format_index("%%%2d%%", 5);
+    assert(s);
+    assert(!strcmp(s, "% 5%"));
+    free(s);
+
+    s = sc_str_format_index("file-%02d.mkv", 1234);
+    assert(s);
+    assert(!strcmp(s, "file-1234.mkv"));
+    free(s);
+}
+
 int main(int argc, char *argv[]) {
     (void) argc;
     (void) argv;
@@ -408,5 +443,6 @@ int main(int argc, char *argv[]) {
     test_wrap_lines();
     test_index_of_column();
     test_remove_trailing_cr();
+    test_index_pattern();
     return 0;
 }
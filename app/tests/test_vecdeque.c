@@ -184,6 +184,45 @@ static void test_vecdeque_push_hole(void) {
     sc_vecdeque_destroy(&vdq);
 }
 
+static void test_vecdeque_get(void) {
+    struct SC_VECDEQUE(int) vdq = SC_VECDEQUE_INITIALIZER;
+
+    bool ok = sc_vecdeque_reserve(&vdq, 10);
+    assert(ok);
+
+    for (int i = 0; i < 8; ++i) {
+        ok = sc_vecdeque_push(&vdq, i);
+        assert(ok);
+    }
+
+    for (int i = 0; i < 5; ++i) {
+        int v = sc_vecdeque_pop(&vdq);
+        assert(v == i);
+    }
+
+    // wrap around the end of the buffer
+    for (int i = 8; i < 15; ++i) {
+        ok = sc_vecdeque_push(&vdq, i);
+        assert(ok);
+    }
+
+    assert(vdq.cap == 10);
+    assert(sc_vecdeque_size(&vdq) == 10);
+    assert(sc_vecdeque_peek(&vdq) == 5);
+
+    for (size_t i = 0; i < 10; ++i) {
+        int v = sc_vecdeque_get(&vdq, i);
+        assert(v == (int) i + 5);
+    }
+
+    // get() does not remove items
+    assert(sc_vecdeque_size(&vdq) == 10);
+    assert(sc_vecdeque_pop(&vdq) == 5);
+    assert(sc_vecdeque_peek(&vdq) == 6);
+
+    sc_vecdeque_destroy(&vdq);
+}
+
 int main(int argc, char *argv[]) {
     (void) argc;
     (void) argv;
@@ -192,6 +231,7 @@ int main(int argc, char *argv[]) {
     test_vecdeque_reserve();
     test_vecdeque_grow();
     test_vecdeque_push_hole();
+    test_vecdeque_get();
 
     return 0;
 }
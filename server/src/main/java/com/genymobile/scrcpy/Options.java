@@ -1,6 +1,7 @@
 package com.genymobile.scrcpy;
 
 import com.genymobile.scrcpy.audio.AudioCodec;
+import com.genymobile.scrcpy.audio.AudioConfig;
 import com.genymobile.scrcpy.audio.AudioSource;
 import com.genymobile.scrcpy.device.Device;
 import com.genymobile.scrcpy.device.NewDisplay;
@@ -33,6 +34,8 @@ public class Options {
     private boolean audioDup;
     private int videoBitRate = 8000000;
     private int audioBitRate = 128000;
+    private int audioSampleRate = AudioConfig.DEFAULT_SAMPLE_RATE;
+    private int audioChannels = AudioConfig.DEFAULT_CHANNELS;
     private float maxFps;
     private float angle;
     private boolean tunnelForward;
@@ -126,6 +129,14 @@ public class Options {
         return audioBitRate;
     }
 
+    public int getAudioSampleRate() {
+        return audioSampleRate;
+    }
+
+    public int getAudioChannels() {
+        return audioChannels;
+    }
+
     public float getMaxFps() {
         return maxFps;
     }
@@ -361,6 +372,16 @@ public class Options {
                 case "audio_bit_rate":
                     options.audioBitRate = Integer.parseInt(value);
                     break;
+                case "audio_sample_rate":
+                    options.audioSampleRate = Integer.parseInt(value);
+                    break;
+                case "audio_channels":
+                    int audioChannels = Integer.parseInt(value);
+                    if (audioChannels != 1 && audioChannels != 2) {
+                        throw new IllegalArgumentException("Unsupported audio channel count: " + audioChannels);
+                    }
+                    options.audioChannels = audioChannels;
+                    break;
                 case "max_fps":
                     options.maxFps = parseFloat("max_fps", value);
                     break;
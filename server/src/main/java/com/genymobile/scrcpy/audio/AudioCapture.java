@@ -5,12 +5,14 @@ import android.media.MediaCodec;
 import java.nio.ByteBuffer;
 
 public interface AudioCapture {
+    AudioConfig getConfig();
+
     void checkCompatibility() throws AudioCaptureException;
     void start() throws AudioCaptureException;
     void stop();
 
     /**
-     * Read a chunk of {@link AudioConfig#MAX_READ_SIZE} samples.
+     * Read a chunk of at most {@link AudioConfig#getMaxReadSize()} bytes.
      *
      * @param outDirectBuffer The target buffer
      * @param outBufferInfo The info to provide to MediaCodec
@@ -20,19 +20,17 @@ import java.nio.ByteBuffer;
 
 public class AudioDirectCapture implements AudioCapture {
 
-    private static final int SAMPLE_RATE = AudioConfig.SAMPLE_RATE;
-    private static final int CHANNEL_CONFIG = AudioConfig.CHANNEL_CONFIG;
-    private static final int CHANNELS = AudioConfig.CHANNELS;
-    private static final int CHANNEL_MASK = AudioConfig.CHANNEL_MASK;
     private static final int ENCODING = AudioConfig.ENCODING;
 
     private final int audioSource;
+    private final AudioConfig config;
 
     private AudioRecord recorder;
     private AudioRecordReader reader;
 
-    public AudioDirectCapture(AudioSource audioSource) {
+    public AudioDirectCapture(AudioSource audioSource, AudioConfig config) {
         this.audioSource = getAudioSourceValue(audioSource);
+        this.config = config;
     }
 
     private static int getAudioSourceValue(AudioSource audioSource) {
@@ -48,15 +46,15 @@ public class AudioDirectCapture implements AudioCapture {
 
     @TargetApi(AndroidVersions.API_23_ANDROID_6_0)
     @SuppressLint({"WrongConstant", "MissingPermission"})
-    private static AudioRecord createAudioRecord(int audioSource) {
+    private static AudioRecord createAudioRecord(int audioSource, AudioConfig config) {
         AudioRecord.Builder builder = new AudioRecord.Builder();
         if (Build.VERSION.SDK_INT >= AndroidVersions.API_31_ANDROID_12) {
             // On older APIs, Workarounds.fillAppInfo() must be called beforehand
             builder.setContext(FakeContext.get());
         }
         builder.setAudioSource(audioSource);
-        builder.setAudioFormat(AudioConfig.createAudioFormat());
-        int minBufferSize = AudioRecord.getMinBufferSize(SAMPLE_RATE, CHANNEL_CONFIG, ENCODING);
+        builder.setAudioFormat(config.createAudioFormat());
+        int minBufferSize = AudioRecord.getMinBufferSize(config.getSampleRate(), config.getChannelConfig(), ENCODING);
         if (minBufferSize > 0) {
             // This buffer size does not impact latency
             builder.setBufferSizeInBytes(8 * minBufferSize);
@@ -105,15 +103,21 @@ public class AudioDirectCapture implements AudioCapture {
 
     private void startRecording() throws AudioCaptureException {
         try {
-            recorder = createAudioRecord(audioSource);
+            recorder = createAudioRecord(audioSource, config);
         } catch (NullPointerException e) {
             // Creating an AudioRecord using an AudioRecord.Builder does not work on Vivo phones:
             // - <https://github.com/Genymobile/scrcpy/issues/3805>
             // - <https://github.com/Genymobile/scrcpy/pull/3862>
-            recorder = Workarounds.createAudioRecord(audioSource, SAMPLE_RATE, CHANNEL_CONFIG, CHANNELS, CHANNEL_MASK, ENCODING);
+            recorder = Workarounds.createAudioRecord(audioSource, config.getSampleRate(), config.getChannelConfig(), config.getChannels(),
+                    config.getChannelMask(), ENCODING);
         }
         recorder.startRecording();
-        reader = new AudioRecordReader(recorder);
+        reader = new AudioRecordReader(recorder, config);
+    }
+
+    @Override
+    public AudioConfig getConfig() {
+        return config;
     }
 
     @Override
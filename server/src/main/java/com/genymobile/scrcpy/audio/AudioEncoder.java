@@ -46,9 +46,6 @@ public final class AudioEncoder implements AsyncProcessor {
         }
     }
 
-    private static final int SAMPLE_RATE = AudioConfig.SAMPLE_RATE;
-    private static final int CHANNELS = AudioConfig.CHANNELS;
-
     private final AudioCapture capture;
     private final Streamer streamer;
     private final int bitRate;
@@ -76,12 +73,12 @@ public final class AudioEncoder implements AsyncProcessor {
         this.encoderName = options.getAudioEncoder();
     }
 
-    private static MediaFormat createFormat(String mimeType, int bitRate, List<CodecOption> codecOptions) {
+    private static MediaFormat createFormat(String mimeType, int bitRate, AudioConfig config, List<CodecOption> codecOptions) {
         MediaFormat format = new MediaFormat();
         format.setString(MediaFormat.KEY_MIME, mimeType);
         format.setInteger(MediaFormat.KEY_BIT_RATE, bitRate);
-        format.setInteger(MediaFormat.KEY_CHANNEL_COUNT, CHANNELS);
-        format.setInteger(MediaFormat.KEY_SAMPLE_RATE, SAMPLE_RATE);
+        format.setInteger(MediaFormat.KEY_CHANNEL_COUNT, config.getChannels());
+        format.setInteger(MediaFormat.KEY_SAMPLE_RATE, config.getSampleRate());
 
         if (codecOptions != null) {
             for (CodecOption option : codecOptions) {
@@ -112,7 +109,7 @@ public final class AudioEncoder implements AsyncProcessor {
     }
 
     private void outputThread(MediaCodec mediaCodec) throws IOException, InterruptedException {
-        streamer.writeAudioHeader();
+        streamer.writeAudioHeader(capture.getConfig());
 
         while (!Thread.currentThread().isInterrupted()) {
             OutputTask task = outputTasks.take();
@@ -197,7 +194,7 @@ public final class AudioEncoder implements AsyncProcessor {
             mediaCodecThread = new HandlerThread("media-codec");
             mediaCodecThread.start();
 
-            MediaFormat format = createFormat(codec.getMimeType(), bitRate, codecOptions);
+            MediaFormat format = createFormat(codec.getMimeType(), bitRate, capture.getConfig(), codecOptions);
             mediaCodec.setCallback(new EncoderCallback(), new Handler(mediaCodecThread.getLooper()));
             mediaCodec.configure(format, null, null, MediaCodec.CONFIGURE_FLAG_ENCODE);
 
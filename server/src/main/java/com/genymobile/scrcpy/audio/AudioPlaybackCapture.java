@@ -20,12 +20,14 @@ import java.nio.ByteBuffer;
 public final class AudioPlaybackCapture implements AudioCapture {
 
     private final boolean keepPlayingOnDevice;
+    private final AudioConfig config;
 
     private AudioRecord recorder;
     private AudioRecordReader reader;
 
-    public AudioPlaybackCapture(boolean keepPlayingOnDevice) {
+    public AudioPlaybackCapture(boolean keepPlayingOnDevice, AudioConfig config) {
         this.keepPlayingOnDevice = keepPlayingOnDevice;
+        this.config = config;
     }
 
     @SuppressLint("PrivateApi")
@@ -65,7 +67,7 @@ public final class AudioPlaybackCapture implements AudioCapture {
 
             // audioMixBuilder.setFormat(createAudioFormat());
             Method setFormat = audioMixBuilder.getClass().getMethod("setFormat", AudioFormat.class);
-            setFormat.invoke(audioMixBuilder, AudioConfig.createAudioFormat());
+            setFormat.invoke(audioMixBuilder, config.createAudioFormat());
 
             String routeFlagName = keepPlayingOnDevice ? "ROUTE_FLAG_LOOP_BACK_RENDER" : "ROUTE_FLAG_LOOP_BACK";
             int routeFlags = audioMixClass.getField(routeFlagName).getInt(null);
@@ -107,6 +109,11 @@ public final class AudioPlaybackCapture implements AudioCapture {
         }
     }
 
+    @Override
+    public AudioConfig getConfig() {
+        return config;
+    }
+
     @Override
     public void checkCompatibility() throws AudioCaptureException {
         if (Build.VERSION.SDK_INT < AndroidVersions.API_33_ANDROID_13) {
@@ -119,7 +126,7 @@ public final class AudioPlaybackCapture implements AudioCapture {
     public void start() throws AudioCaptureException {
         recorder = createAudioRecord();
         recorder.startRecording();
-        reader = new AudioRecordReader(recorder);
+        reader = new AudioRecordReader(recorder, config);
     }
 
     @Override
@@ -31,7 +31,7 @@ public final class AudioRawRecorder implements AsyncProcessor {
             return;
         }
 
-        final ByteBuffer buffer = ByteBuffer.allocateDirect(AudioConfig.MAX_READ_SIZE);
+        final ByteBuffer buffer = ByteBuffer.allocateDirect(capture.getConfig().getMaxReadSize());
         final MediaCodec.BufferInfo bufferInfo = new MediaCodec.BufferInfo();
 
         try {
@@ -43,7 +43,7 @@ public final class AudioRawRecorder implements AsyncProcessor {
                 throw t;
             }
 
-            streamer.writeAudioHeader();
+            streamer.writeAudioHeader(capture.getConfig());
             while (!Thread.currentThread().isInterrupted()) {
                 buffer.position(0);
                 int r = capture.read(buffer, bufferInfo);
@@ -12,23 +12,25 @@ import java.nio.ByteBuffer;
 
 public class AudioRecordReader {
 
-    private static final long ONE_SAMPLE_US =
-            (1000000 + AudioConfig.SAMPLE_RATE - 1) / AudioConfig.SAMPLE_RATE; // 1 sample in microseconds (used for fixing PTS)
-
     private final AudioRecord recorder;
+    private final AudioConfig config;
+    private final long oneSampleUs; // 1 sample in microseconds (used for fixing PTS)
 
     private final AudioTimestamp timestamp = new AudioTimestamp();
     private long previousRecorderTimestamp = -1;
     private long previousPts = 0;
     private long nextPts = 0;
 
-    public AudioRecordReader(AudioRecord recorder) {
+    public AudioRecordReader(AudioRecord recorder, AudioConfig config) {
         this.recorder = recorder;
+        this.config = config;
+        int sampleRate = config.getSampleRate();
+        oneSampleUs = (1000000 + sampleRate - 1) / sampleRate;
     }
 
     @TargetApi(AndroidVersions.API_24_ANDROID_7_0)
     public int read(ByteBuffer outDirectBuffer, MediaCodec.BufferInfo outBufferInfo) {
-        int r = recorder.read(outDirectBuffer, AudioConfig.MAX_READ_SIZE);
+        int r = recorder.read(outDirectBuffer, config.getMaxReadSize());
         if (r <= 0) {
             return r;
         }
@@ -48,16 +50,16 @@ public class AudioRecordReader {
             pts = nextPts;
         }
 
-        long durationUs = r * 1000000L / (AudioConfig.CHANNELS * AudioConfig.BYTES_PER_SAMPLE * AudioConfig.SAMPLE_RATE);
+        long durationUs = r * 1000000L / (config.getChannels() * AudioConfig.BYTES_PER_SAMPLE * config.getSampleRate());
         nextPts = pts + durationUs;
 
-        if (previousPts != 0 && pts < previousPts + ONE_SAMPLE_US) {
+        if (previousPts != 0 && pts < previousPts + oneSampleUs) {
             // Audio PTS may come from two sources:
             //  - recorder.getTimestamp() if the call works;
             //  - an estimation from the previous PTS and the packet size as a fallback.
             //
             // Therefore, the property that PTS are monotonically increasing is no guaranteed in corner cases, so enforce it.
-            pts = previousPts + ONE_SAMPLE_US;
+            pts = previousPts + oneSampleUs;
         }
         previousPts = pts;
 
@@ -25,6 +25,10 @@ public final class ControlMessage {
     public static final int TYPE_OPEN_HARD_KEYBOARD_SETTINGS = 15;
     public static final int TYPE_START_APP = 16;
     public static final int TYPE_RESET_VIDEO = 17;
+    // A part of a serialized message, reassembled by ControlMessageReader
+    public static final int TYPE_CHUNK = 18;
+    // A touch event encoded relatively to the previous one, decoded by ControlMessageReader
+    public static final int TYPE_INJECT_TOUCH_EVENT_COMPACT = 19;
 
     public static final long SEQUENCE_INVALID = 0;
 
@@ -41,6 +45,7 @@ public final class ControlMessage {
     private int buttons; // MotionEvent.BUTTON_*
     private long pointerId;
     private float pressure;
+    private long eventTime; // capture time of the input event, in client milliseconds (0 if unknown)
     private Position position;
     private float hScroll;
     private float vScroll;
@@ -75,7 +80,7 @@ public final class ControlMessage {
     }
 
     public static ControlMessage createInjectTouchEvent(int action, long pointerId, Position position, float pressure, int actionButton,
-            int buttons) {
+            int buttons, long eventTime) {
         ControlMessage msg = new ControlMessage();
         msg.type = TYPE_INJECT_TOUCH_EVENT;
         msg.action = action;
@@ -84,16 +89,18 @@ public final class ControlMessage {
         msg.position = position;
         msg.actionButton = actionButton;
         msg.buttons = buttons;
+        msg.eventTime = eventTime;
         return msg;
     }
 
-    public static ControlMessage createInjectScrollEvent(Position position, float hScroll, float vScroll, int buttons) {
+    public static ControlMessage createInjectScrollEvent(Position position, float hScroll, float vScroll, int buttons, long eventTime) {
         ControlMessage msg = new ControlMessage();
         msg.type = TYPE_INJECT_SCROLL_EVENT;
         msg.position = position;
         msg.hScroll = hScroll;
         msg.vScroll = vScroll;
         msg.buttons = buttons;
+        msg.eventTime = eventTime;
         return msg;
     }
 
@@ -202,6 +209,10 @@ public final class ControlMessage {
         return pressure;
     }
 
+    public long getEventTime() {
+        return eventTime;
+    }
+
     public Position getPosition() {
         return position;
     }
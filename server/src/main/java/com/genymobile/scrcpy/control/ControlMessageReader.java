@@ -4,6 +4,8 @@ import com.genymobile.scrcpy.device.Position;
 import com.genymobile.scrcpy.util.Binary;
 
 import java.io.BufferedInputStream;
+import java.io.ByteArrayInputStream;
+import java.io.ByteArrayOutputStream;
 import java.io.DataInputStream;
 import java.io.IOException;
 import java.io.InputStream;
@@ -16,14 +18,61 @@ public class ControlMessageReader {
     public static final int CLIPBOARD_TEXT_MAX_LENGTH = MESSAGE_MAX_SIZE - 14; // type: 1 byte; sequence: 8 bytes; paste flag: 1 byte; length: 4 bytes
     public static final int INJECT_TEXT_MAX_LENGTH = 300;
 
+    private static final int CHUNK_FLAG_LAST = 1;
+
+    private static final int TOUCH_COMPACT_FLAG_POINTER_ID = 0x01;
+    private static final int TOUCH_COMPACT_FLAG_SCREEN_SIZE = 0x02;
+    private static final int TOUCH_COMPACT_FLAG_ABSOLUTE = 0x04;
+    private static final int TOUCH_COMPACT_FLAG_DELTA8 = 0x08;
+    private static final int TOUCH_COMPACT_FLAG_PRESSURE = 0x10;
+    private static final int TOUCH_COMPACT_FLAG_BUTTONS = 0x20;
+    private static final int TOUCH_COMPACT_FLAG_OTHER_POINTER = 0x40;
+    private static final int TOUCH_COMPACT_FLAG_EVENT_TIME = 0x80;
+
+    // The scroll amounts (possibly accumulated from several input events) are scaled down by this factor to be encoded
+    private static final float SCROLL_MAX = 16;
+
     private final DataInputStream dis;
 
+    // Reassembly of a message sent in several chunks
+    private final ByteArrayOutputStream chunks = new ByteArrayOutputStream();
+
+    // The last compact touch event, the omitted fields of the next one are the same
+    private boolean touchValid;
+    private long touchPointerId;
+    private int touchX;
+    private int touchY;
+    // The pointer before the last one, and its last position
+    private boolean otherPointerValid;
+    private long otherPointerId;
+    private int otherX;
+    private int otherY;
+    private int touchScreenWidth;
+    private int touchScreenHeight;
+    private float touchPressure;
+    private int touchActionButton;
+    private int touchButtons;
+
     public ControlMessageReader(InputStream rawInputStream) {
         dis = new DataInputStream(new BufferedInputStream(rawInputStream));
     }
 
     public ControlMessage read() throws IOException {
-        int type = dis.readUnsignedByte();
+        for (;;) {
+            int type = dis.readUnsignedByte();
+            if (type != ControlMessage.TYPE_CHUNK) {
+                return parse(type);
+            }
+
+            ControlMessage msg = parseChunk();
+            if (msg != null) {
+                return msg;
+            }
+            // The message is not complete yet
+        }
+    }
+
+    private ControlMessage parse(int type) throws IOException {
         switch (type) {
             case ControlMessage.TYPE_INJECT_KEYCODE:
                 return parseInjectKeycode();
@@ -31,6 +80,8 @@ public class ControlMessageReader {
                 return parseInjectText();
             case ControlMessage.TYPE_INJECT_TOUCH_EVENT:
                 return parseInjectTouchEvent();
+            case ControlMessage.TYPE_INJECT_TOUCH_EVENT_COMPACT:
+                return parseInjectTouchEventCompact();
             case ControlMessage.TYPE_INJECT_SCROLL_EVENT:
                 return parseInjectScrollEvent();
             case ControlMessage.TYPE_BACK_OR_SCREEN_ON:
@@ -61,6 +112,30 @@ public class ControlMessageReader {
         }
     }
 
+    private ControlMessage parseChunk() throws IOException {
+        int flags = dis.readUnsignedByte();
+        byte[] data = parseByteArray(2);
+        if (chunks.size() + data.length > MESSAGE_MAX_SIZE) {
+            throw new ControlProtocolException("Chunked message too large");
+        }
+        chunks.write(data);
+
+        if ((flags & CHUNK_FLAG_LAST) == 0) {
+            return null;
+        }
+
+        byte[] message = chunks.toByteArray();
+        chunks.reset();
+
+        // The reassembled data contains exactly one (non-chunked) message
+        ControlMessageReader reader = new ControlMessageReader(new ByteArrayInputStream(message));
+        int type = reader.dis.readUnsignedByte();
+        if (type == ControlMessage.TYPE_CHUNK) {
+            throw new ControlProtocolException("Nested chunk");
+        }
+        return reader.parse(type);
+    }
+
     private ControlMessage parseInjectKeycode() throws IOException {
         int action = dis.readUnsignedByte();
         int keycode = dis.readInt();
@@ -107,15 +182,84 @@ public class ControlMessageReader {
         float pressure = Binary.u16FixedPointToFloat(dis.readShort());
         int actionButton = dis.readInt();
         int buttons = dis.readInt();
-        return ControlMessage.createInjectTouchEvent(action, pointerId, position, pressure, actionButton, buttons);
+        long eventTime = parseEventTime();
+        return ControlMessage.createInjectTouchEvent(action, pointerId, position, pressure, actionButton, buttons, eventTime);
+    }
+
+    private ControlMessage parseInjectTouchEventCompact() throws IOException {
+        int flags = dis.readUnsignedByte();
+        int action = dis.readUnsignedByte();
+
+        int required = TOUCH_COMPACT_FLAG_POINTER_ID | TOUCH_COMPACT_FLAG_SCREEN_SIZE | TOUCH_COMPACT_FLAG_ABSOLUTE | TOUCH_COMPACT_FLAG_PRESSURE
+                | TOUCH_COMPACT_FLAG_BUTTONS;
+        if (!touchValid && (flags & required) != required) {
+            throw new ControlProtocolException("Incomplete first compact touch event");
+        }
+
+        if ((flags & TOUCH_COMPACT_FLAG_POINTER_ID) != 0) {
+            // The new pointer position is relative to the last position
+            if (touchValid) {
+                otherPointerId = touchPointerId;
+                otherX = touchX;
+                otherY = touchY;
+                otherPointerValid = true;
+            }
+            touchPointerId = dis.readLong();
+        } else if ((flags & TOUCH_COMPACT_FLAG_OTHER_POINTER) != 0) {
+            if (!otherPointerValid) {
+                throw new ControlProtocolException("No other pointer for compact touch event");
+            }
+            long pointerId = otherPointerId;
+            int x = otherX;
+            int y = otherY;
+            otherPointerId = touchPointerId;
+            otherX = touchX;
+            otherY = touchY;
+            touchPointerId = pointerId;
+            touchX = x;
+            touchY = y;
+        }
+        if ((flags & TOUCH_COMPACT_FLAG_SCREEN_SIZE) != 0) {
+            touchScreenWidth = dis.readUnsignedShort();
+            touchScreenHeight = dis.readUnsignedShort();
+        }
+        if ((flags & TOUCH_COMPACT_FLAG_ABSOLUTE) != 0) {
+            touchX = dis.readInt();
+            touchY = dis.readInt();
+        } else if ((flags & TOUCH_COMPACT_FLAG_DELTA8) != 0) {
+            touchX += dis.readByte();
+            touchY += dis.readByte();
+        } else {
+            touchX += dis.readShort();
+            touchY += dis.readShort();
+        }
+        if ((flags & TOUCH_COMPACT_FLAG_PRESSURE) != 0) {
+            touchPressure = Binary.u16FixedPointToFloat(dis.readShort());
+        }
+        if ((flags & TOUCH_COMPACT_FLAG_BUTTONS) != 0) {
+            touchActionButton = dis.readInt();
+            touchButtons = dis.readInt();
+        }
+        long eventTime = (flags & TOUCH_COMPACT_FLAG_EVENT_TIME) != 0 ? parseEventTime() : 0;
+        touchValid = true;
+
+        Position position = new Position(touchX, touchY, touchScreenWidth, touchScreenHeight);
+        return ControlMessage.createInjectTouchEvent(action, touchPointerId, position, touchPressure, touchActionButton, touchButtons,
+                eventTime);
     }
 
     private ControlMessage parseInjectScrollEvent() throws IOException {
         Position position = parsePosition();
-        float hScroll = Binary.i16FixedPointToFloat(dis.readShort());
-        float vScroll = Binary.i16FixedPointToFloat(dis.readShort());
+        float hScroll = Binary.i16FixedPointToFloat(dis.readShort()) * SCROLL_MAX;
+        float vScroll = Binary.i16FixedPointToFloat(dis.readShort()) * SCROLL_MAX;
         int buttons = dis.readInt();
-        return ControlMessage.createInjectScrollEvent(position, hScroll, vScroll, buttons);
+        long eventTime = parseEventTime();
+        return ControlMessage.createInjectScrollEvent(position, hScroll, vScroll, buttons, eventTime);
+    }
+
+    private long parseEventTime() throws IOException {
+        // Unsigned 32-bit value, in milliseconds (0 if unknown)
+        return dis.readInt() & 0xFFFFFFFFL;
     }
 
     private ControlMessage parseBackOrScreenOnEvent() throws IOException {
@@ -91,6 +91,7 @@ public class Controller implements AsyncProcessor, VirtualDisplayListener {
     private final Object displayDataAvailable = new Object(); // condition variable
 
     private long lastTouchDown;
+    private final EventTimeMapper eventTimeMapper = new EventTimeMapper();
     private final PointersState pointersState = new PointersState();
     private final MotionEvent.PointerProperties[] pointerProperties = new MotionEvent.PointerProperties[PointersState.MAX_POINTERS];
     private final MotionEvent.PointerCoords[] pointerCoords = new MotionEvent.PointerCoords[PointersState.MAX_POINTERS];
@@ -253,12 +254,15 @@ public class Controller implements AsyncProcessor, VirtualDisplayListener {
                 break;
             case ControlMessage.TYPE_INJECT_TOUCH_EVENT:
                 if (supportsInputEvents) {
-                    injectTouch(msg.getAction(), msg.getPointerId(), msg.getPosition(), msg.getPressure(), msg.getActionButton(), msg.getButtons());
+                    long eventTime = eventTimeMapper.map(msg.getEventTime(), SystemClock.uptimeMillis());
+                    injectTouch(msg.getAction(), msg.getPointerId(), msg.getPosition(), msg.getPressure(), msg.getActionButton(), msg.getButtons(),
+                            eventTime);
                 }
                 break;
             case ControlMessage.TYPE_INJECT_SCROLL_EVENT:
                 if (supportsInputEvents) {
-                    injectScroll(msg.getPosition(), msg.getHScroll(), msg.getVScroll(), msg.getButtons());
+                    long eventTime = eventTimeMapper.map(msg.getEventTime(), SystemClock.uptimeMillis());
+                    injectScroll(msg.getPosition(), msg.getHScroll(), msg.getVScroll(), msg.getButtons(), eventTime);
                 }
                 break;
             case ControlMessage.TYPE_BACK_OR_SCREEN_ON:
@@ -381,9 +385,7 @@ public class Controller implements AsyncProcessor, VirtualDisplayListener {
         return Pair.create(point, targetDisplayId);
     }
 
-    private boolean injectTouch(int action, long pointerId, Position position, float pressure, int actionButton, int buttons) {
-        long now = SystemClock.uptimeMillis();
-
+    private boolean injectTouch(int action, long pointerId, Position position, float pressure, int actionButton, int buttons, long eventTime) {
         Pair<Point, Integer> pair = getEventPointAndDisplayId(position);
         if (pair == null) {
             return false;
@@ -420,7 +422,7 @@ public class Controller implements AsyncProcessor, VirtualDisplayListener {
         int pointerCount = pointersState.update(pointerProperties, pointerCoords);
         if (pointerCount == 1) {
             if (action == MotionEvent.ACTION_DOWN) {
-                lastTouchDown = now;
+                lastTouchDown = eventTime;
             }
         } else {
             // secondary pointers must use ACTION_POINTER_* ORed with the pointerIndex
@@ -443,7 +445,7 @@ public class Controller implements AsyncProcessor, VirtualDisplayListener {
             if (action == MotionEvent.ACTION_DOWN) {
                 if (actionButton == buttons) {
                     // First button pressed: ACTION_DOWN
-                    MotionEvent downEvent = MotionEvent.obtain(lastTouchDown, now, MotionEvent.ACTION_DOWN, pointerCount, pointerProperties,
+                    MotionEvent downEvent = MotionEvent.obtain(lastTouchDown, eventTime, MotionEvent.ACTION_DOWN, pointerCount, pointerProperties,
                             pointerCoords, 0, buttons, 1f, 1f, DEFAULT_DEVICE_ID, 0, source, 0);
                     if (!Device.injectEvent(downEvent, targetDisplayId, Device.INJECT_MODE_ASYNC)) {
                         return false;
@@ -451,8 +453,8 @@ public class Controller implements AsyncProcessor, VirtualDisplayListener {
                 }
 
                 // Any button pressed: ACTION_BUTTON_PRESS
-                MotionEvent pressEvent = MotionEvent.obtain(lastTouchDown, now, MotionEvent.ACTION_BUTTON_PRESS, pointerCount, pointerProperties,
-                        pointerCoords, 0, buttons, 1f, 1f, DEFAULT_DEVICE_ID, 0, source, 0);
+                MotionEvent pressEvent = MotionEvent.obtain(lastTouchDown, eventTime, MotionEvent.ACTION_BUTTON_PRESS, pointerCount,
+                        pointerProperties, pointerCoords, 0, buttons, 1f, 1f, DEFAULT_DEVICE_ID, 0, source, 0);
                 if (!InputManager.setActionButton(pressEvent, actionButton)) {
                     return false;
                 }
@@ -465,8 +467,8 @@ public class Controller implements AsyncProcessor, VirtualDisplayListener {
 
             if (action == MotionEvent.ACTION_UP) {
                 // Any button released: ACTION_BUTTON_RELEASE
-                MotionEvent releaseEvent = MotionEvent.obtain(lastTouchDown, now, MotionEvent.ACTION_BUTTON_RELEASE, pointerCount, pointerProperties,
-                        pointerCoords, 0, buttons, 1f, 1f, DEFAULT_DEVICE_ID, 0, source, 0);
+                MotionEvent releaseEvent = MotionEvent.obtain(lastTouchDown, eventTime, MotionEvent.ACTION_BUTTON_RELEASE, pointerCount,
+                        pointerProperties, pointerCoords, 0, buttons, 1f, 1f, DEFAULT_DEVICE_ID, 0, source, 0);
                 if (!InputManager.setActionButton(releaseEvent, actionButton)) {
                     return false;
                 }
@@ -476,7 +478,7 @@ public class Controller implements AsyncProcessor, VirtualDisplayListener {
 
                 if (buttons == 0) {
                     // Last button released: ACTION_UP
-                    MotionEvent upEvent = MotionEvent.obtain(lastTouchDown, now, MotionEvent.ACTION_UP, pointerCount, pointerProperties,
+                    MotionEvent upEvent = MotionEvent.obtain(lastTouchDown, eventTime, MotionEvent.ACTION_UP, pointerCount, pointerProperties,
                             pointerCoords, 0, buttons, 1f, 1f, DEFAULT_DEVICE_ID, 0, source, 0);
                     if (!Device.injectEvent(upEvent, targetDisplayId, Device.INJECT_MODE_ASYNC)) {
                         return false;
@@ -487,14 +489,12 @@ public class Controller implements AsyncProcessor, VirtualDisplayListener {
             }
         }
 
-        MotionEvent event = MotionEvent.obtain(lastTouchDown, now, action, pointerCount, pointerProperties, pointerCoords, 0, buttons, 1f, 1f,
+        MotionEvent event = MotionEvent.obtain(lastTouchDown, eventTime, action, pointerCount, pointerProperties, pointerCoords, 0, buttons, 1f, 1f,
                 DEFAULT_DEVICE_ID, 0, source, 0);
         return Device.injectEvent(event, targetDisplayId, Device.INJECT_MODE_ASYNC);
     }
 
-    private boolean injectScroll(Position position, float hScroll, float vScroll, int buttons) {
-        long now = SystemClock.uptimeMillis();
-
+    private boolean injectScroll(Position position, float hScroll, float vScroll, int buttons, long eventTime) {
         Pair<Point, Integer> pair = getEventPointAndDisplayId(position);
         if (pair == null) {
             return false;
@@ -512,8 +512,8 @@ public class Controller implements AsyncProcessor, VirtualDisplayListener {
         coords.setAxisValue(MotionEvent.AXIS_HSCROLL, hScroll);
         coords.setAxisValue(MotionEvent.AXIS_VSCROLL, vScroll);
 
-        MotionEvent event = MotionEvent.obtain(lastTouchDown, now, MotionEvent.ACTION_SCROLL, 1, pointerProperties, pointerCoords, 0, buttons, 1f, 1f,
-                DEFAULT_DEVICE_ID, 0, InputDevice.SOURCE_MOUSE, 0);
+        MotionEvent event = MotionEvent.obtain(lastTouchDown, eventTime, MotionEvent.ACTION_SCROLL, 1, pointerProperties, pointerCoords, 0,
+                buttons, 1f, 1f, DEFAULT_DEVICE_ID, 0, InputDevice.SOURCE_MOUSE, 0);
         return Device.injectEvent(event, targetDisplayId, Device.INJECT_MODE_ASYNC);
     }
 
@@ -0,0 +1,59 @@
+package com.genymobile.scrcpy.control;
+
+/**
+ * Map the capture time of the input events, sent by the client (in client milliseconds, truncated to 32 bits), to the device uptime clock.
+ * <p>
+ * The offset between the two clocks is estimated as the minimal observed delay between the capture and the reception of an event (the
+ * fastest transit). It may increase slowly, to follow a clock drift, but any faster event immediately lowers it. The injected events
+ * therefore preserve the spacing between their capture times, even if they are received in bursts.
+ */
+public final class EventTimeMapper {
+
+    // Maximum clock drift between the client and the device, in milliseconds per millisecond
+    private static final double MAX_DRIFT = 0.001;
+
+    // Never use an event time older than this (in milliseconds), in case the estimated offset is wrong
+    private static final long MAX_AGE = 1000;
+
+    private boolean initialized;
+    private long lastClientTime; // unwrapped
+    private long lastReceptionTime;
+    private double offset;
+    private long lastEventTime;
+
+    /**
+     * Map a client event time to the device uptime clock.
+     *
+     * @param clientTime the client event time, 0 if unknown
+     * @param now        the current device uptime, in milliseconds
+     * @return the device event time, never after {@code now} and never before the previous one
+     */
+    public long map(long clientTime, long now) {
+        if (clientTime == 0) {
+            lastEventTime = now;
+            return now;
+        }
+
+        long time;
+        if (initialized) {
+            // The value is truncated to 32 bits, so unwrap it from the previous one
+            int delta = (int) (clientTime - lastClientTime);
+            time = lastClientTime + delta;
+            double maxOffset = offset + (now - lastReceptionTime) * MAX_DRIFT;
+            offset = Math.min(now - time, maxOffset);
+        } else {
+            time = clientTime;
+            offset = now - time;
+            initialized = true;
+        }
+        lastClientTime = time;
+        lastReceptionTime = now;
+
+        long eventTime = time + (long) Math.floor(offset);
+        eventTime = Math.min(eventTime, now);
+        eventTime = Math.max(eventTime, now - MAX_AGE);
+        eventTime = Math.max(eventTime, lastEventTime);
+        lastEventTime = eventTime;
+        return eventTime;
+    }
+}
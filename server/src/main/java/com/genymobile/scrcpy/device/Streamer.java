@@ -1,6 +1,7 @@
 package com.genymobile.scrcpy.device;
 
 import com.genymobile.scrcpy.audio.AudioCodec;
+import com.genymobile.scrcpy.audio.AudioConfig;
 import com.genymobile.scrcpy.util.Codec;
 import com.genymobile.scrcpy.util.IO;
 
@@ -35,10 +36,12 @@ public final class Streamer {
         return codec;
     }
 
-    public void writeAudioHeader() throws IOException {
+    public void writeAudioHeader(AudioConfig config) throws IOException {
         if (sendCodecMeta) {
-            ByteBuffer buffer = ByteBuffer.allocate(4);
+            ByteBuffer buffer = ByteBuffer.allocate(9);
             buffer.putInt(codec.getId());
+            buffer.putInt(config.getSampleRate());
+            buffer.put((byte) config.getChannels());
             buffer.flip();
             IO.writeFully(fd, buffer);
         }
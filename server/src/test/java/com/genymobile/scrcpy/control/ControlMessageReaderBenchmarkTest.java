@@ -0,0 +1,142 @@
+package com.genymobile.scrcpy.control;
+
+import android.view.MotionEvent;
+import org.junit.Assert;
+import org.junit.Test;
+
+import java.io.ByteArrayInputStream;
+import java.io.ByteArrayOutputStream;
+import java.io.DataOutputStream;
+import java.io.EOFException;
+import java.io.IOException;
+
+/**
+ * Measure the parsing time of touch events, in the full and the compact encodings.
+ * <p>
+ * The client side (bytes per message and serialization time) is measured by app/tests/test_control_msg_benchmark.c.
+ */
+public class ControlMessageReaderBenchmarkTest {
+
+    private static final int SWIPES = 100;
+    private static final int ROUNDS = 50;
+
+    private static final long POINTER_ID = -2; // generic finger
+
+    // Finger swipes (the same trace as the "swipe" trace of the client benchmark)
+    private interface TouchWriter {
+        void write(DataOutputStream dos, int action, int x, int y, boolean first) throws IOException;
+    }
+
+    private static byte[] createSwipes(TouchWriter writer) throws IOException {
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DataOutputStream dos = new DataOutputStream(bos);
+        boolean first = true;
+        for (int swipe = 0; swipe < SWIPES; ++swipe) {
+            int x = 300 + swipe;
+            int y = 2000;
+            writer.write(dos, MotionEvent.ACTION_DOWN, x, y, first);
+            first = false;
+            for (int step = 60; step > 0; step -= 2) {
+                x += step / 10;
+                y -= step;
+                writer.write(dos, MotionEvent.ACTION_MOVE, x, y, false);
+            }
+            writer.write(dos, MotionEvent.ACTION_UP, x, y, false);
+        }
+        return bos.toByteArray();
+    }
+
+    private static void writeFull(DataOutputStream dos, int action, int x, int y, boolean first) throws IOException {
+        dos.writeByte(ControlMessage.TYPE_INJECT_TOUCH_EVENT);
+        dos.writeByte(action);
+        dos.writeLong(POINTER_ID);
+        dos.writeInt(x);
+        dos.writeInt(y);
+        dos.writeShort(1080);
+        dos.writeShort(2400);
+        dos.writeShort(0xffff); // pressure
+        dos.writeInt(0); // action button
+        dos.writeInt(0); // buttons
+        dos.writeInt(0); // event time
+    }
+
+    private static int lastX;
+    private static int lastY;
+
+    private static void writeCompact(DataOutputStream dos, int action, int x, int y, boolean first) throws IOException {
+        dos.writeByte(ControlMessage.TYPE_INJECT_TOUCH_EVENT_COMPACT);
+        if (first) {
+            dos.writeByte(0x37); // pointer id, screen size, absolute, pressure, buttons
+            dos.writeByte(action);
+            dos.writeLong(POINTER_ID);
+            dos.writeShort(1080);
+            dos.writeShort(2400);
+            dos.writeInt(x);
+            dos.writeInt(y);
+            dos.writeShort(0xffff); // pressure
+            dos.writeInt(0); // action button
+            dos.writeInt(0); // buttons
+        } else {
+            int dx = x - lastX;
+            int dy = y - lastY;
+            boolean delta8 = dx >= Byte.MIN_VALUE && dx <= Byte.MAX_VALUE && dy >= Byte.MIN_VALUE && dy <= Byte.MAX_VALUE;
+            dos.writeByte(delta8 ? 0x08 : 0);
+            dos.writeByte(action);
+            if (delta8) {
+                dos.writeByte(dx);
+                dos.writeByte(dy);
+            } else {
+                dos.writeShort(dx);
+                dos.writeShort(dy);
+            }
+        }
+        lastX = x;
+        lastY = y;
+    }
+
+    private static long parse(byte[] data, int[] lastPosition) throws IOException {
+        long count = 0;
+        ControlMessageReader reader = new ControlMessageReader(new ByteArrayInputStream(data));
+        try {
+            for (;;) {
+                ControlMessage msg = reader.read();
+                lastPosition[0] = msg.getPosition().getPoint().getX();
+                lastPosition[1] = msg.getPosition().getPoint().getY();
+                ++count;
+            }
+        } catch (EOFException e) {
+            // end of the trace
+        }
+        return count;
+    }
+
+    private static void run(String name, byte[] data, int[] lastPosition) throws IOException {
+        // Warm up
+        long count = parse(data, lastPosition);
+
+        long start = System.nanoTime();
+        for (int i = 0; i < ROUNDS; ++i) {
+            parse(data, lastPosition);
+        }
+        long duration = System.nanoTime() - start;
+
+        double bytesPerMsg = (double) data.length / count;
+        double nsPerMsg = (double) duration / (ROUNDS * count);
+        System.out.printf("%-8s %6d msgs: %5.1f bytes/msg %7.1f ns/msg%n", name, count, bytesPerMsg, nsPerMsg);
+    }
+
+    @Test
+    public void benchmarkParseSwipes() throws IOException {
+        byte[] full = createSwipes(ControlMessageReaderBenchmarkTest::writeFull);
+        byte[] compact = createSwipes(ControlMessageReaderBenchmarkTest::writeCompact);
+
+        int[] fullLastPosition = new int[2];
+        int[] compactLastPosition = new int[2];
+        run("full", full, fullLastPosition);
+        run("compact", compact, compactLastPosition);
+
+        // Both encodings must be decoded to the same positions
+        Assert.assertArrayEquals(fullLastPosition, compactLastPosition);
+        Assert.assertTrue(compact.length < full.length);
+    }
+}
@@ -94,6 +94,7 @@ public class ControlMessageReaderTest {
         dos.writeShort(0xffff); // pressure
         dos.writeInt(MotionEvent.BUTTON_PRIMARY); // action button
         dos.writeInt(MotionEvent.BUTTON_PRIMARY); // buttons
+        dos.writeInt(0xfedcba98); // event time
 
         byte[] packet = bos.toByteArray();
 
@@ -111,10 +112,137 @@ public class ControlMessageReaderTest {
         Assert.assertEquals(1f, event.getPressure(), 0f); // must be exact
         Assert.assertEquals(MotionEvent.BUTTON_PRIMARY, event.getActionButton());
         Assert.assertEquals(MotionEvent.BUTTON_PRIMARY, event.getButtons());
+        Assert.assertEquals(0xfedcba98L, event.getEventTime()); // unsigned
 
         Assert.assertEquals(-1, bis.read()); // EOS
     }
 
+    @Test
+    public void testParseTouchEventCompact() throws IOException {
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DataOutputStream dos = new DataOutputStream(bos);
+
+        // All the fields are present in the first compact touch event
+        dos.writeByte(ControlMessage.TYPE_INJECT_TOUCH_EVENT_COMPACT);
+        dos.writeByte(0x37); // pointer id, screen size, absolute, pressure, buttons
+        dos.writeByte(MotionEvent.ACTION_DOWN);
+        dos.writeLong(-42); // pointerId
+        dos.writeShort(1080);
+        dos.writeShort(1920);
+        dos.writeInt(100);
+        dos.writeInt(200);
+        dos.writeShort(0xffff); // pressure
+        dos.writeInt(MotionEvent.BUTTON_PRIMARY); // action button
+        dos.writeInt(MotionEvent.BUTTON_PRIMARY); // buttons
+
+        // Small move
+        dos.writeByte(ControlMessage.TYPE_INJECT_TOUCH_EVENT_COMPACT);
+        dos.writeByte(0x08); // delta8
+        dos.writeByte(MotionEvent.ACTION_MOVE);
+        dos.writeByte(-3);
+        dos.writeByte(5);
+
+        // Larger move, with a new pressure
+        dos.writeByte(ControlMessage.TYPE_INJECT_TOUCH_EVENT_COMPACT);
+        dos.writeByte(0x10); // pressure
+        dos.writeByte(MotionEvent.ACTION_MOVE);
+        dos.writeShort(300);
+        dos.writeShort(-150);
+        dos.writeShort(0x8000); // pressure
+
+        // Another pointer
+        dos.writeByte(ControlMessage.TYPE_INJECT_TOUCH_EVENT_COMPACT);
+        dos.writeByte(0x05); // pointer id, absolute
+        dos.writeByte(MotionEvent.ACTION_MOVE);
+        dos.writeLong(-1); // pointerId
+        dos.writeInt(1000);
+        dos.writeInt(60);
+
+        // Back to the first pointer, relative to its own last position
+        dos.writeByte(ControlMessage.TYPE_INJECT_TOUCH_EVENT_COMPACT);
+        dos.writeByte(0x48); // other pointer, delta8
+        dos.writeByte(MotionEvent.ACTION_MOVE);
+        dos.writeByte(1);
+        dos.writeByte(-1);
+
+        // With the capture time of the event
+        dos.writeByte(ControlMessage.TYPE_INJECT_TOUCH_EVENT_COMPACT);
+        dos.writeByte(0x88); // event time, delta8
+        dos.writeByte(MotionEvent.ACTION_MOVE);
+        dos.writeByte(1);
+        dos.writeByte(0);
+        dos.writeInt(123456); // event time
+
+        byte[] packet = bos.toByteArray();
+
+        ByteArrayInputStream bis = new ByteArrayInputStream(packet);
+        ControlMessageReader reader = new ControlMessageReader(bis);
+
+        ControlMessage event = reader.read();
+        Assert.assertEquals(ControlMessage.TYPE_INJECT_TOUCH_EVENT, event.getType());
+        Assert.assertEquals(MotionEvent.ACTION_DOWN, event.getAction());
+        Assert.assertEquals(-42, event.getPointerId());
+        Assert.assertEquals(100, event.getPosition().getPoint().getX());
+        Assert.assertEquals(200, event.getPosition().getPoint().getY());
+        Assert.assertEquals(1080, event.getPosition().getScreenSize().getWidth());
+        Assert.assertEquals(1920, event.getPosition().getScreenSize().getHeight());
+        Assert.assertEquals(1f, event.getPressure(), 0f); // must be exact
+        Assert.assertEquals(MotionEvent.BUTTON_PRIMARY, event.getActionButton());
+        Assert.assertEquals(MotionEvent.BUTTON_PRIMARY, event.getButtons());
+
+        event = reader.read();
+        Assert.assertEquals(ControlMessage.TYPE_INJECT_TOUCH_EVENT, event.getType());
+        Assert.assertEquals(MotionEvent.ACTION_MOVE, event.getAction());
+        Assert.assertEquals(-42, event.getPointerId());
+        Assert.assertEquals(97, event.getPosition().getPoint().getX());
+        Assert.assertEquals(205, event.getPosition().getPoint().getY());
+        Assert.assertEquals(1080, event.getPosition().getScreenSize().getWidth());
+        Assert.assertEquals(1920, event.getPosition().getScreenSize().getHeight());
+        Assert.assertEquals(1f, event.getPressure(), 0f);
+        Assert.assertEquals(MotionEvent.BUTTON_PRIMARY, event.getButtons());
+
+        event = reader.read();
+        Assert.assertEquals(MotionEvent.ACTION_MOVE, event.getAction());
+        Assert.assertEquals(397, event.getPosition().getPoint().getX());
+        Assert.assertEquals(55, event.getPosition().getPoint().getY());
+        Assert.assertEquals(0.5f, event.getPressure(), 0f);
+
+        event = reader.read();
+        Assert.assertEquals(-1, event.getPointerId());
+        Assert.assertEquals(1000, event.getPosition().getPoint().getX());
+        Assert.assertEquals(60, event.getPosition().getPoint().getY());
+
+        event = reader.read();
+        Assert.assertEquals(-42, event.getPointerId());
+        Assert.assertEquals(398, event.getPosition().getPoint().getX());
+        Assert.assertEquals(54, event.getPosition().getPoint().getY());
+        Assert.assertEquals(0.5f, event.getPressure(), 0f);
+        Assert.assertEquals(0, event.getEventTime()); // unknown
+
+        event = reader.read();
+        Assert.assertEquals(-42, event.getPointerId());
+        Assert.assertEquals(399, event.getPosition().getPoint().getX());
+        Assert.assertEquals(54, event.getPosition().getPoint().getY());
+        Assert.assertEquals(123456, event.getEventTime());
+
+        Assert.assertEquals(-1, bis.read()); // EOS
+    }
+
+    @Test(expected = ControlProtocolException.class)
+    public void testParseTouchEventCompactWithoutPrevious() throws IOException {
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DataOutputStream dos = new DataOutputStream(bos);
+        dos.writeByte(ControlMessage.TYPE_INJECT_TOUCH_EVENT_COMPACT);
+        dos.writeByte(0x08); // delta8
+        dos.writeByte(MotionEvent.ACTION_MOVE);
+        dos.writeByte(1);
+        dos.writeByte(1);
+
+        ByteArrayInputStream bis = new ByteArrayInputStream(bos.toByteArray());
+        ControlMessageReader reader = new ControlMessageReader(bis);
+        reader.read();
+    }
+
     @Test
     public void testParseScrollEvent() throws IOException {
         ByteArrayOutputStream bos = new ByteArrayOutputStream();
@@ -125,8 +253,9 @@ public class ControlMessageReaderTest {
         dos.writeShort(1080);
         dos.writeShort(1920);
         dos.writeShort(0); // 0.0f encoded as i16
-        dos.writeShort(0x8000); // -1.0f encoded as i16
+        dos.writeShort(0xF800); // -1.0f / 16 encoded as i16
         dos.writeInt(1);
+        dos.writeInt(0); // unknown event time
         byte[] packet = bos.toByteArray();
 
         ByteArrayInputStream bis = new ByteArrayInputStream(packet);
@@ -141,6 +270,7 @@ public class ControlMessageReaderTest {
         Assert.assertEquals(0f, event.getHScroll(), 0f);
         Assert.assertEquals(-1f, event.getVScroll(), 0f);
         Assert.assertEquals(1, event.getButtons());
+        Assert.assertEquals(0, event.getEventTime());
 
         Assert.assertEquals(-1, bis.read()); // EOS
     }
@@ -422,6 +552,57 @@ public class ControlMessageReaderTest {
         Assert.assertEquals(-1, bis.read()); // EOS
     }
 
+    @Test
+    public void testParseChunkedSetClipboardEvent() throws IOException {
+        ByteArrayOutputStream msgBos = new ByteArrayOutputStream();
+        DataOutputStream msgDos = new DataOutputStream(msgBos);
+        msgDos.writeByte(ControlMessage.TYPE_SET_CLIPBOARD);
+        msgDos.writeLong(0x0102030405060708L); // sequence
+        msgDos.writeByte(0); // paste
+        byte[] text = "testé".getBytes(StandardCharsets.UTF_8);
+        msgDos.writeInt(text.length);
+        msgDos.write(text);
+        byte[] msg = msgBos.toByteArray();
+
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DataOutputStream dos = new DataOutputStream(bos);
+
+        dos.writeByte(ControlMessage.TYPE_CHUNK);
+        dos.writeByte(0); // flags
+        dos.writeShort(10);
+        dos.write(msg, 0, 10);
+
+        // An input event between two chunks
+        dos.writeByte(ControlMessage.TYPE_INJECT_KEYCODE);
+        dos.writeByte(KeyEvent.ACTION_DOWN);
+        dos.writeInt(KeyEvent.KEYCODE_ENTER);
+        dos.writeInt(0); // repeat
+        dos.writeInt(0); // meta state
+
+        dos.writeByte(ControlMessage.TYPE_CHUNK);
+        dos.writeByte(1); // flags: last
+        dos.writeShort(msg.length - 10);
+        dos.write(msg, 10, msg.length - 10);
+
+        byte[] packet = bos.toByteArray();
+
+        ByteArrayInputStream bis = new ByteArrayInputStream(packet);
+        ControlMessageReader reader = new ControlMessageReader(bis);
+
+        ControlMessage event = reader.read();
+        Assert.assertEquals(ControlMessage.TYPE_INJECT_KEYCODE, event.getType());
+        Assert.assertEquals(KeyEvent.ACTION_DOWN, event.getAction());
+        Assert.assertEquals(KeyEvent.KEYCODE_ENTER, event.getKeycode());
+
+        event = reader.read();
+        Assert.assertEquals(ControlMessage.TYPE_SET_CLIPBOARD, event.getType());
+        Assert.assertEquals(0x0102030405060708L, event.getSequence());
+        Assert.assertEquals("testé", event.getText());
+        Assert.assertFalse(event.getPaste());
+
+        Assert.assertEquals(-1, bis.read()); // EOS
+    }
+
     @Test
     public void testMultiEvents() throws IOException {
         ByteArrayOutputStream bos = new ByteArrayOutputStream();
@@ -0,0 +1,54 @@
+package com.genymobile.scrcpy.control;
+
+import org.junit.Assert;
+import org.junit.Test;
+
+public class EventTimeMapperTest {
+
+    @Test
+    public void testUnknownEventTime() {
+        EventTimeMapper mapper = new EventTimeMapper();
+        Assert.assertEquals(5000, mapper.map(0, 5000));
+    }
+
+    @Test
+    public void testBurstPreservesSpacing() {
+        EventTimeMapper mapper = new EventTimeMapper();
+        // Events captured every 10 ms on the client
+        Assert.assertEquals(5000, mapper.map(100000, 5000));
+        Assert.assertEquals(5010, mapper.map(100010, 5010));
+        // Then delayed and received in a burst
+        Assert.assertEquals(5020, mapper.map(100020, 5080));
+        Assert.assertEquals(5030, mapper.map(100030, 5080));
+        Assert.assertEquals(5040, mapper.map(100040, 5081));
+    }
+
+    @Test
+    public void testFasterTransitLowersOffset() {
+        EventTimeMapper mapper = new EventTimeMapper();
+        // The first event was delayed
+        Assert.assertEquals(5050, mapper.map(100000, 5050));
+        // This one was not: it defines the new offset
+        Assert.assertEquals(5060, mapper.map(100060, 5060));
+        Assert.assertEquals(5070, mapper.map(100070, 5090));
+    }
+
+    @Test
+    public void testNeverBeforePreviousNorTooOld() {
+        EventTimeMapper mapper = new EventTimeMapper();
+        Assert.assertEquals(5000, mapper.map(100000, 5000));
+        // Client time going backwards
+        Assert.assertEquals(5000, mapper.map(99990, 5000));
+        // Received much later than expected
+        Assert.assertEquals(8000, mapper.map(100010, 9000));
+    }
+
+    @Test
+    public void testWrapAround() {
+        EventTimeMapper mapper = new EventTimeMapper();
+        Assert.assertEquals(5000, mapper.map(0xFFFFFFF0L, 5000));
+        // The 32-bit client time wraps around
+        Assert.assertEquals(5020, mapper.map(0x4, 5020));
+        Assert.assertEquals(5030, mapper.map(0xE, 5030));
+    }
+}